@@ -268,6 +268,11 @@ public:
 	virtual	int				GetNumEntities(void ) const=0;
 	virtual	IGISEntity *	GetNthEntity  (int n) const=0;
 
+	// Returns, in ascending order, the index of every entity whose geo bounds overlap the box.  This is a
+	// conservative pre-filter: implementations may return more than that (up to all entities), so callers
+	// still have to cull or hit-test each one.  Large composites answer this from a spatial index.
+	virtual	void			GetEntitiesInBox(const Bbox2& bounds, vector<int>& out_idx) const=0;
+
 };
 
 #endif
@@ -34,6 +34,7 @@
 #include "GISUtils.h"
 #include "FileUtils.h"
 #include "PlatformUtils.h"
+#include "BatchUtils.h"
 #if LIN
 #include <execinfo.h>
 #include <stdarg.h>
@@ -65,346 +66,428 @@ void	CGALFailure(
 
 static int			line_num;
 static const char * fname;
+static FILE *		script_file = NULL;
+
+// Thrown once a DSF build has printed its error - a batch counts the tile as failed and moves on, a single build exits 1.
+struct	make_dsf_failed { };
+
+static void fail_dsf(void)
+{
+	if(script_file)
+		fclose(script_file);
+	script_file = NULL;
+	throw make_dsf_failed();
+}
 
 static void die_parse(const char * msg, ...)
 {
 	va_list	va;
 	va_start(va,msg);
 	vfprintf(stderr,msg,va);
+	va_end(va);
 	fprintf(stderr,"(%s: line %d.)\n",fname,line_num);
-	exit(1);
+	fail_dsf();
 }
 
 static void die_parse2(const char * msg, va_list va)
 {
 	vfprintf(stderr,msg,va);
 	fprintf(stderr,"(%s: line %d.)\n",fname,line_num);
-	exit(1);
+	fail_dsf();
 }
 
 
 
-int	main(int argc, char * argv[])
+// Builds one DSF: loads the DEM, runs the script against it and writes the mesh out.  Errors throw make_dsf_failed.
+static void make_one_dsf(rf_region region, const char * script_path, const char * xes_path, const char * dem_path, const char * dir_base, const char * dsf_path)
 {
-	if(argc == 2 && !strcmp(argv[1],"--version"))
+	DEMGeo	dem_elev;
+
+	if(strstr(dem_path,".bil"))
 	{
-		print_product_version("MeshTool", MESHTOOL_VER, MESHTOOL_EXTRAVER);
-		exit(0);
+		DEMSpec	spec;
+
+		spec.mPost = 1;
+		spec.mBigEndian = true;
+		spec.mBits = 16;
+		spec.mNoData = DEM_NO_DATA; // Use OUR no data flag...this means that no data is re-flagged if the header doesn't have a void flag.  User can fix this later with the n flag.
+		spec.mFloat = false;
+		spec.mHeaderBytes = 0;
+	
+		ReadHDR(dem_path, spec, false);
+	
+		if(!ReadRawWithHeader(dem_elev, dem_path, spec))
+		{
+			fprintf(stderr,"Could not read bil file: %s\n", dem_path);
+			fail_dsf();
+		}
 	}
-
-	if(argc == 2 && !strcmp(argv[1],"--auto_config"))
+	if(strstr(dem_path,".hgt"))
 	{
-		exit(0);
+		if (!ReadRawHGT(dem_elev, dem_path))
+		{
+			fprintf(stderr,"Could not read HGT file: %s\n", dem_path);
+			fail_dsf();
+		}
+	}
+	else if(strstr(dem_path,".tif"))
+	{
+		int align = dem_want_Post;
+		if (!ExtractGeoTiff(dem_elev, dem_path, align,false))
+		{
+			fprintf(stderr,"Could not read GeoTIFF file: %s\n", dem_path);
+			fail_dsf();
+		}
+	}
+	else
+	{
+		fprintf(stderr,"ERROR: unknown file extension for DEM: %s\n", dem_path);
+		fail_dsf();
 	}
-	
-	rf_region region = rf_usa;
 
-	try {
+	char dump_f[24];
+	sprintf(dump_f,DIR_STR "%+03d%+04d",latlon_bucket(round(dem_elev.mSouth)),latlon_bucket(round(dem_elev.mWest)));
+	string dump_dir = string(dir_base) + dump_f;
+	FILE_make_dir_exist(dump_dir.c_str());
 
-		// Set CGAL to throw an exception rather than just
-		// call exit!
-		CGAL::set_error_handler(CGALFailure);
+	FILE * script = fopen(script_path, "r");
+	fname=script_path;
+	script_file = script;
+	if(!script)
+	{
+		fprintf(stderr, "ERROR: could not open %s\n", script_path);
+		fail_dsf();
+	}
 
-		XESInit(region,false);			// no forests
-		MakeDirectRules();
+	int								terrain_type;
+	int								layer_type = NO_VALUE;
+	double							coords[4];
+	char							shp_path[2048];
+	char							cus_ter[256];
+	char							typ[256];
+	char							buf[1024];
+	double							proj_lon[4],proj_lat[4],proj_s[4],proj_t[4];
 
-		if(argc != 6)
-		{
-			fprintf(stderr, "USAGE: MeshTool <script.txt> <file.xes> <file.hgt> <dir_base> <file.dsf>\n");
-			exit(1);
-		}
+	int				proj_pt = -1;
 
-		DEMGeo	dem_elev;
 
-		if(strstr(argv[3],".bil"))
-		{
-			DEMSpec	spec;
+	int				use_wat;
+	int				zlimit=0;
+	int				is_layer = 0;
+	int				param1;
+	float			param2;
+	MT_StartCreate(xes_path, dem_elev, die_parse2);
 
-			spec.mPost = 1;
-			spec.mBigEndian = true;
-			spec.mBits = 16;
-			spec.mNoData = DEM_NO_DATA; // Use OUR no data flag...this means that no data is re-flagged if the header doesn't have a void flag.  User can fix this later with the n flag.
-			spec.mFloat = false;
-			spec.mHeaderBytes = 0;
+	line_num=0;
+	while (fgets(buf, sizeof(buf), script))
+	{
+		++line_num;
 		
-			ReadHDR(argv[3], spec, false);
+		if(sscanf(buf,"GENERATE_DDS %d", &param1)==1)
+		{
+			printf("%s DDS generation.\n", param1 ? "Enabling" : "Disabling");
+			MT_EnableDDSGeneration(param1);
+		}
 		
-			if(!ReadRawWithHeader(dem_elev, argv[3], spec))
-			{
-				fprintf(stderr,"Could not read bil file: %s\n", argv[3]);
-				exit(1);
-			}
+		if(sscanf(buf,"MESH_SPECS %d %f", &param1, &param2) == 2)
+		{
+			printf("Setting mesh specs to: %d height points max, %f minimum error.\n", param1, param2);
+			MT_SetMeshSpecs(param1, param2);
 		}
-		if(strstr(argv[3],".hgt"))
+		
+		if(sscanf(buf,"DEFINE_CUSTOM_TERRAIN %d %s",&use_wat, cus_ter)==2)
 		{
-			if (!ReadRawHGT(dem_elev, argv[3]))
-			{
-				fprintf(stderr,"Could not read HGT file: %s\n", argv[3]);
-				exit(1);
-			}
+			proj_pt = 0;
 		}
-		else if(strstr(argv[3],".tif"))
+		if(sscanf(buf,"PROJECT_POINT %lf %lf %lf %lf",coords,coords+1,coords+2,coords+3)==4)
 		{
-			int align = dem_want_Post;
-			if (!ExtractGeoTiff(dem_elev, argv[3], align,false))
+			if(proj_pt==-1)
+				die_parse("ERROR: PROJECT_POINT not allowed until custom terrain defined, or you have more than 4 projection pooints.\n");
+
+			proj_lon[proj_pt] = coords[0];
+			proj_lat[proj_pt] = coords[1];
+			proj_s  [proj_pt] = coords[2];
+			proj_t  [proj_pt] = coords[3];
+
+			proj_pt++;
+			if(proj_pt==4)
 			{
-				fprintf(stderr,"Could not read GeoTIFF file: %s\n", argv[3]);
-				exit(1);
+				MT_CreateCustomTerrain(cus_ter,proj_lon,proj_lat,proj_s,proj_t,use_wat);
+				proj_pt=-1;
 			}
 		}
-		else
+
+		if(sscanf(buf,"SHAPEFILE_TERRAIN %s %s",cus_ter,shp_path)==2)
 		{
-			fprintf(stderr,"ERROR: unknown file extension for DEM: %s\n", argv[3]);
-			exit(1);
+			MT_LayerShapefile(shp_path,cus_ter);
 		}
 
-		char dump_f[24];
-		sprintf(dump_f,DIR_STR "%+03d%+04d",latlon_bucket(round(dem_elev.mSouth)),latlon_bucket(round(dem_elev.mWest)));
-		string dump_dir = string(argv[4]) + dump_f;
-		FILE_make_dir_exist(dump_dir.c_str());
-
-		FILE * script = fopen(argv[1], "r");
-		fname=argv[1];
-		if(!script)
+		if(sscanf(buf,"BACKGROUND %s",cus_ter)==1)
 		{
-			fprintf(stderr, "ERROR: could not open %s\n", argv[1]);
-			exit(1);
+			MT_LayerBackground(cus_ter);
 		}
 
-		int								terrain_type;
-		int								layer_type = NO_VALUE;
-		double							coords[4];
-		char							shp_path[2048];
-		char							cus_ter[256];
-		char							typ[256];
-		char							buf[1024];
-		double							proj_lon[4],proj_lat[4],proj_s[4],proj_t[4];
-
-		int				proj_pt = -1;
-
-
-		int				use_wat;
-		int				zlimit=0;
-		int				is_layer = 0;
-		int				param1;
-		float			param2;
-		MT_StartCreate(argv[2], dem_elev, die_parse2);
+		if(strncmp(buf,"BEGIN_LAYER",strlen("BEGIN_LAYER"))==0)
+		{
+			is_layer=1;
+			layer_type = NO_VALUE;
+		}
 
-		line_num=0;
-		while (fgets(buf, sizeof(buf), script))
+		if(sscanf(buf,"BEGIN_POLYGON %s",cus_ter)==1)
 		{
-			++line_num;
-			
-			if(sscanf(buf,"GENERATE_DDS %d", &param1)==1)
-			{
-				printf("%s DDS generation.\n", param1 ? "Enabling" : "Disabling");
-				MT_EnableDDSGeneration(param1);
-			}
-			
-			if(sscanf(buf,"MESH_SPECS %d %f", &param1, &param2) == 2)
+			terrain_type = LookupToken(cus_ter);
+			if(terrain_type == -1)
+				die_parse("ERROR: cannot find custom terrain type '%s'\n", cus_ter);
+			if(layer_type == NO_VALUE)
 			{
-				printf("Setting mesh specs to: %d height points max, %f minimum error.\n", param1, param2);
-				MT_SetMeshSpecs(param1, param2);
+				layer_type = terrain_type;
+				MT_LayerStart(layer_type);
+				MT_PolygonStart();
 			}
-			
-			if(sscanf(buf,"DEFINE_CUSTOM_TERRAIN %d %s",&use_wat, cus_ter)==2)
+			else
+				die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
+		}
+
+		if(sscanf(buf,"CUSTOM_POLY %s",cus_ter)==1)
+		{
+			terrain_type = LookupToken(cus_ter);
+			if(terrain_type == -1)
+				die_parse("ERROR: cannot find custom terrain type '%s'\n", cus_ter);
+			if(layer_type == NO_VALUE)
 			{
-				proj_pt = 0;
+				layer_type = terrain_type;
+				MT_LayerStart(layer_type);
+				MT_PolygonStart();
 			}
-			if(sscanf(buf,"PROJECT_POINT %lf %lf %lf %lf",coords,coords+1,coords+2,coords+3)==4)
+			else
+				die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
+		}
+
+		if(strncmp(buf,"LAND_POLY",strlen("LAND_POLY"))==0)
+		{
+			if(layer_type == NO_VALUE)
 			{
-				if(proj_pt==-1)
-					die_parse("ERROR: PROJECT_POINT not allowed until custom terrain defined, or you have more than 4 projection pooints.\n");
-
-				proj_lon[proj_pt] = coords[0];
-				proj_lat[proj_pt] = coords[1];
-				proj_s  [proj_pt] = coords[2];
-				proj_t  [proj_pt] = coords[3];
-
-				proj_pt++;
-				if(proj_pt==4)
-				{
-					MT_CreateCustomTerrain(cus_ter,proj_lon,proj_lat,proj_s,proj_t,use_wat);
-					proj_pt=-1;
-				}
+				layer_type = terrain_Natural;
+				MT_LayerStart(layer_type);
+				MT_PolygonStart();
 			}
-
-			if(sscanf(buf,"SHAPEFILE_TERRAIN %s %s",cus_ter,shp_path)==2)
+			else
+				die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
+		}
+		if(strncmp(buf,"WATER_POLY",strlen("WATER_POLY"))==0)
+		{
+			if(layer_type == NO_VALUE)
 			{
-				MT_LayerShapefile(shp_path,cus_ter);
+				layer_type = terrain_Water;
+				MT_LayerStart(layer_type);
+				MT_PolygonStart();
 			}
-
-			if(sscanf(buf,"BACKGROUND %s",cus_ter)==1)
+			else
+				die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
+		}
+		if(strncmp(buf,"APT_POLY",strlen("APT_POLY"))==0)
+		{
+			if(layer_type == NO_VALUE)
 			{
-				MT_LayerBackground(cus_ter);
+				layer_type = terrain_Airport;
+				MT_LayerStart(layer_type);
+				MT_PolygonStart();
 			}
+			else
+				die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
+		}
+		if(strncmp(buf,"BEGIN_HOLE",strlen("BEGIN_HOLE"))==0)
+		{
+			MT_HoleStart();
+		}
+		if(strncmp(buf,"END_HOLE",strlen("END_HOLE"))==0)
+		{
+			MT_HoleEnd();
+		}
+		if(strncmp(buf,"END_POLY",strlen("END_POLY"))==0)
+		{
+			MT_PolygonEnd();
 
-			if(strncmp(buf,"BEGIN_LAYER",strlen("BEGIN_LAYER"))==0)
+			if(!is_layer)
 			{
-				is_layer=1;
+				MT_LayerEnd();
 				layer_type = NO_VALUE;
 			}
+		}
+		if(strncmp(buf,"END_LAYER",strlen("END_LAYER"))==0)
+		{
+			MT_LayerEnd();
+			is_layer=0;
+			layer_type=NO_VALUE;
+		}
+		if (sscanf(buf, "POLYGON_POINT %lf %lf", &coords[0], &coords[1])==2)
+		{
+			MT_PolygonPoint(coords[0],coords[1]);
+		}
+		if (sscanf(buf, "HOLE_POINT %lf %lf", &coords[0], &coords[1])==2)
+		{
+			MT_HolePoint(coords[0],coords[1]);
+		}
+		if (sscanf(buf, "ZLIMIT %d", &zlimit)==1)
+		{
+			MT_LimitZ(zlimit);
+		}
+		if(sscanf(buf,"BEGIN_NET %s",typ)==1)
+		{
+			MT_NetStart(typ);
+		}
+		if (sscanf(buf, "NET_SEG %lf %lf %lf %lf", &coords[0], &coords[1], &coords[2], &coords[3])==4)
+		{
+			MT_NetSegment(coords[0],coords[1],coords[2],coords[3]);
+		}
+		if(strncmp(buf,"END_NET",strlen("END_NET"))==0)
+		{
+			MT_NetEnd();
+		}
 
-			if(sscanf(buf,"BEGIN_POLYGON %s",cus_ter)==1)
-			{
-				terrain_type = LookupToken(cus_ter);
-				if(terrain_type == -1)
-					die_parse("ERROR: cannot find custom terrain type '%s'\n", cus_ter);
-				if(layer_type == NO_VALUE)
-				{
-					layer_type = terrain_type;
-					MT_LayerStart(layer_type);
-					MT_PolygonStart();
-				}
-				else
-					die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
-			}
+		if(sscanf(buf,"QMID_PATH %s",cus_ter)==1)
+		{
+			MT_QMID_Prefix(cus_ter);
+		}
+		if(sscanf(buf,"QMID %d %s",&use_wat,cus_ter)==2)
+		{
+			MT_QMID(cus_ter, use_wat);
+		}
 
-			if(sscanf(buf,"CUSTOM_POLY %s",cus_ter)==1)
-			{
-				terrain_type = LookupToken(cus_ter);
-				if(terrain_type == -1)
-					die_parse("ERROR: cannot find custom terrain type '%s'\n", cus_ter);
-				if(layer_type == NO_VALUE)
-				{
-					layer_type = terrain_type;
-					MT_LayerStart(layer_type);
-					MT_PolygonStart();
-				}
-				else
-					die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
-			}
+		if(sscanf(buf,"GEOTIFF %d %s",&use_wat,cus_ter)==2)
+		{
+			MT_GeoTiff(cus_ter, use_wat);
+		}
 
-			if(strncmp(buf,"LAND_POLY",strlen("LAND_POLY"))==0)
-			{
-				if(layer_type == NO_VALUE)
-				{
-					layer_type = terrain_Natural;
-					MT_LayerStart(layer_type);
-					MT_PolygonStart();
-				}
-				else
-					die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
-			}
-			if(strncmp(buf,"WATER_POLY",strlen("WATER_POLY"))==0)
-			{
-				if(layer_type == NO_VALUE)
-				{
-					layer_type = terrain_Water;
-					MT_LayerStart(layer_type);
-					MT_PolygonStart();
-				}
-				else
-					die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
-			}
-			if(strncmp(buf,"APT_POLY",strlen("APT_POLY"))==0)
-			{
-				if(layer_type == NO_VALUE)
-				{
-					layer_type = terrain_Airport;
-					MT_LayerStart(layer_type);
-					MT_PolygonStart();
-				}
-				else
-					die_parse("ERROR: you cannot use two different terrains inside a single layer.\n");
-			}
-			if(strncmp(buf,"BEGIN_HOLE",strlen("BEGIN_HOLE"))==0)
-			{
-				MT_HoleStart();
-			}
-			if(strncmp(buf,"END_HOLE",strlen("END_HOLE"))==0)
-			{
-				MT_HoleEnd();
-			}
-			if(strncmp(buf,"END_POLY",strlen("END_POLY"))==0)
-			{
-				MT_PolygonEnd();
+		if(sscanf(buf,"ORTHOPHOTO %d %lf %lf %lf %lf %lf %lf %lf %lf %s",&use_wat,
+				&proj_lon[0],&proj_lat[0],
+				&proj_lon[1],&proj_lat[1],
+				&proj_lon[2],&proj_lat[2],
+				&proj_lon[3],&proj_lat[3],
+				cus_ter) == 10)
+		{
+			proj_s[0] = proj_s[3] = 0.0;
+			proj_s[1] = proj_s[2] = 1.0;
+			proj_t[0] = proj_t[1] = 0.0;
+			proj_t[2] = proj_t[3] = 1.0;
+			MT_OrthoPhoto(cus_ter, proj_lon, proj_lat, proj_s,proj_t,use_wat);
+		}
+		if(sscanf(buf,"SHAPEFILE_MASK %s",shp_path)==1)
+		{
+			MT_Mask(shp_path);
+		}
+		if(sscanf(buf,"SHAPEFILE_CONTOUR %s",shp_path)==1)
+		{
+			MT_Contour(shp_path);
+		}
+		if(strncmp(buf,"CLEAR_MASK",strlen("CLEAR_MASK"))==0)
+		{
+			MT_Mask(NULL);
+		}
 
-				if(!is_layer)
-				{
-					MT_LayerEnd();
-					layer_type = NO_VALUE;
-				}
-			}
-			if(strncmp(buf,"END_LAYER",strlen("END_LAYER"))==0)
-			{
-				MT_LayerEnd();
-				is_layer=0;
-				layer_type=NO_VALUE;
-			}
-			if (sscanf(buf, "POLYGON_POINT %lf %lf", &coords[0], &coords[1])==2)
-			{
-				MT_PolygonPoint(coords[0],coords[1]);
-			}
-			if (sscanf(buf, "HOLE_POINT %lf %lf", &coords[0], &coords[1])==2)
-			{
-				MT_HolePoint(coords[0],coords[1]);
-			}
-			if (sscanf(buf, "ZLIMIT %d", &zlimit)==1)
-			{
-				MT_LimitZ(zlimit);
-			}
-			if(sscanf(buf,"BEGIN_NET %s",typ)==1)
-			{
-				MT_NetStart(typ);
-			}
-			if (sscanf(buf, "NET_SEG %lf %lf %lf %lf", &coords[0], &coords[1], &coords[2], &coords[3])==4)
-			{
-				MT_NetSegment(coords[0],coords[1],coords[2],coords[3]);
-			}
-			if(strncmp(buf,"END_NET",strlen("END_NET"))==0)
-			{
-				MT_NetEnd();
-			}
+	}
+	fclose(script);
+	script_file = NULL;
 
-			if(sscanf(buf,"QMID_PATH %s",cus_ter)==1)
-			{
-				MT_QMID_Prefix(cus_ter);
-			}
-			if(sscanf(buf,"QMID %d %s",&use_wat,cus_ter)==2)
-			{
-				MT_QMID(cus_ter, use_wat);
-			}
+	MT_FinishCreate();
 
-			if(sscanf(buf,"GEOTIFF %d %s",&use_wat,cus_ter)==2)
-			{
-				MT_GeoTiff(cus_ter, use_wat);
-			}
+	MT_MakeDSF(region, dir_base, dsf_path);
+}
 
-			if(sscanf(buf,"ORTHOPHOTO %d %lf %lf %lf %lf %lf %lf %lf %lf %s",&use_wat,
-					&proj_lon[0],&proj_lat[0],
-					&proj_lon[1],&proj_lat[1],
-					&proj_lon[2],&proj_lat[2],
-					&proj_lon[3],&proj_lat[3],
-					cus_ter) == 10)
-			{
-				proj_s[0] = proj_s[3] = 0.0;
-				proj_s[1] = proj_s[2] = 1.0;
-				proj_t[0] = proj_t[1] = 0.0;
-				proj_t[2] = proj_t[3] = 1.0;
-				MT_OrthoPhoto(cus_ter, proj_lon, proj_lat, proj_s,proj_t,use_wat);
-			}
-			if(sscanf(buf,"SHAPEFILE_MASK %s",shp_path)==1)
-			{
-				MT_Mask(shp_path);
-			}
-			if(sscanf(buf,"SHAPEFILE_CONTOUR %s",shp_path)==1)
+struct	batch_args_t {
+	rf_region		region;
+	const char *	args[5];	// script, xes, dem, dir_base, dsf - with $TILE etc. in them
+};
+
+static int batch_one_tile(const string& tile, void * ref)
+{
+	batch_args_t * b = (batch_args_t *) ref;
+	string a[5];
+	for(int i = 0; i < 5; ++i)
+		a[i] = BatchExpandTile(b->args[i], tile);
+	// Without fork (Windows) the tiles run one after another in this process, so each one starts from a clean map and mesh.
+	int result = 0;
+	try {
+		make_one_dsf(b->region, a[0].c_str(), a[1].c_str(), a[2].c_str(), a[3].c_str(), a[4].c_str());
+	} catch (make_dsf_failed&) {
+		result = 1;
+	} catch (std::exception& e) {
+		fprintf(stderr,"ERROR: Caught unknown exception %s.\n", e.what());
+		result = 1;
+	} catch (...) {
+		fprintf(stderr,"ERROR: Caught unknown exception.\n");
+		result = 1;
+	}
+	MT_Cleanup();
+	return result;
+}
+
+int	main(int argc, char * argv[])
+{
+	if(argc == 2 && !strcmp(argv[1],"--version"))
+	{
+		print_product_version("MeshTool", MESHTOOL_VER, MESHTOOL_EXTRAVER);
+		exit(0);
+	}
+
+	if(argc == 2 && !strcmp(argv[1],"--auto_config"))
+	{
+		exit(0);
+	}
+	
+	rf_region region = rf_usa;
+
+	try {
+
+		// Set CGAL to throw an exception rather than just
+		// call exit!
+		CGAL::set_error_handler(CGALFailure);
+
+		XESInit(region,false);			// no forests
+		MakeDirectRules();
+
+		if(argc >= 9 && !strcmp(argv[1],"--batch"))
+		{
+			// --batch <tiles.txt> <log_dir> [max jobs] [GB per job] <script> <xes> <dem> <dir_base> <dsf>
+			BatchSpec_t spec;
+			if(!BatchReadTileList(argv[2], spec.tiles))
 			{
-				MT_Contour(shp_path);
+				fprintf(stderr,"ERROR: could not read tile list %s\n", argv[2]);
+				exit(1);
 			}
-			if(strncmp(buf,"CLEAR_MASK",strlen("CLEAR_MASK"))==0)
+			spec.log_dir = argv[3];
+			int opts = argc - 9;
+			if(opts > 2)
 			{
-				MT_Mask(NULL);
+				fprintf(stderr, "USAGE: MeshTool --batch <tiles.txt> <log_dir> [max jobs] [GB per job] <script.txt> <file.xes> <file.hgt> <dir_base> <file.dsf>\n");
+				exit(1);
 			}
+			if(opts > 0) spec.max_jobs = atoi(argv[4]);
+			if(opts > 1) spec.mem_per_job = atof(argv[5]) * 1024.0 * 1024.0 * 1024.0;
 
+			batch_args_t b;
+			b.region = region;
+			for(int i = 0; i < 5; ++i)
+				b.args[i] = argv[4 + opts + i];
+
+			BatchResetFailed(spec.log_dir);
+			int failed = BatchRunTiles(spec, batch_one_tile, &b);
+			exit(failed ? 1 : 0);
 		}
-		fclose(script);
 
-		MT_FinishCreate();
+		if(argc != 6)
+		{
+			fprintf(stderr, "USAGE: MeshTool <script.txt> <file.xes> <file.hgt> <dir_base> <file.dsf>\n");
+			fprintf(stderr, "       MeshTool --batch <tiles.txt> <log_dir> [max jobs] [GB per job] <script.txt> <file.xes> <file.hgt> <dir_base> <file.dsf>\n");
+			fprintf(stderr, "       (in batch mode $TILE, $WEST, $SOUTH, $EAST and $NORTH in the last five args are replaced per tile.)\n");
+			exit(1);
+		}
 
-		MT_MakeDSF(region, argv[4], argv[5]);
+		make_one_dsf(region, argv[1], argv[2], argv[3], argv[4], argv[5]);
 
 
+	} catch (make_dsf_failed&) {
+		exit(1);
 	} catch (std::exception& e) {
 		fprintf(stdout,"****************************************************************************\n");
 		fprintf(stdout,"ERROR: Caught unknown exception %s.  Exiting.\n", e.what());
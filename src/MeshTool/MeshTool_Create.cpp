@@ -226,6 +226,17 @@ void MT_Cleanup(void)
 	sMesh.clear();
 	sApts.clear();
 	sAptIndex.clear();
+	layer_type = NO_VALUE;
+	ring.clear();
+	the_hole.clear();
+	holes.clear();
+	layer.clear();
+	layer_mask.clear();
+	net.clear();
+	net_type = NO_VALUE;
+	zlimit = 0;
+	zmin = 30000;
+	zmax = -2000;
 }
 
 int MT_CreateCustomTerrain(
@@ -14,10 +14,11 @@
 
 #include "curl/curl.h"
 #include "AssertUtils.h"
-#if !IBM
-#include <pthread.h>
-#endif
 #include <errno.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 int atomic_load(volatile int * a) { return *a; }
 void atomic_store(volatile int * a, int v) { *a = v; }
@@ -27,6 +28,134 @@ void atomic_store(volatile int * a, int v) { *a = v; }
 
 const time_t TIMEOUT_SEC = (30);
 
+const int MAX_TRANSFERS = 16;			// Transfers in flight at once - the rest wait their turn.
+const int MAX_HOST_CONNECTIONS = 6;		// Per host, like a browser.  Tile servers get cranky otherwise.
+const int IDLE_WAIT_MS = 100;			// How long curl_multi_wait may sleep before we look for new work.
+
+/*
+	curl_http_engine - the one background I/O thread
+
+	Requests are queued into 'm_waiting' by the thread that creates them.  The I/O thread moves them into
+	the CURL multi handle as slots free up, pumps the multi handle, and finishes requests as CURL reports
+	them done.  The multi handle and everything in it is ONLY touched by the I/O thread.
+
+	The thread is started on the first request and lives until exit.  The engine is deliberately never
+	destroyed, so requests owned by other globals can still be torn down safely during static destruction.  A request that is deleted while
+	queued is simply pulled from the queue; one that is deleted while transferring sets m_halt (which the
+	progress callback turns into an abort) and the deleting thread waits until the I/O thread signals that
+	it has let go of it.
+*/
+
+class	curl_http_engine {
+public:
+	curl_http_engine() : m_multi(NULL), m_serial(0) { }
+
+	void	queue(curl_http_get_file * req)
+	{
+		lock_guard<mutex> lock(m_lock);
+		if(!m_thread.joinable())
+			m_thread = thread(&curl_http_engine::thread_proc, this);
+		m_waiting.push_back(req);
+		m_work.notify_one();
+	}
+
+	void	cancel(curl_http_get_file * req)
+	{
+		unique_lock<mutex> lock(m_lock);
+		if(req->m_finished)
+			return;
+		deque<curl_http_get_file *>::iterator w = find(m_waiting.begin(), m_waiting.end(), req);
+		if(w != m_waiting.end())
+		{
+			m_waiting.erase(w);
+			return;
+		}
+		atomic_store(&req->m_halt, 1);
+		while(!req->m_finished)
+			m_done.wait(lock);
+	}
+
+	int		serial() { return m_serial; }
+
+private:
+
+	void	thread_proc()
+	{
+		m_multi = curl_multi_init();
+		curl_multi_setopt(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) MAX_HOST_CONNECTIONS);
+		curl_multi_setopt(m_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) MAX_TRANSFERS);
+
+		int running = 0;
+		unique_lock<mutex> lock(m_lock);
+		while(1)
+		{
+			while(running < MAX_TRANSFERS && !m_waiting.empty())
+			{
+				curl_http_get_file * req = m_waiting.front();
+				m_waiting.pop_front();
+				// The stall clock starts now, not when the request was queued - it may have waited a long time for a slot.
+				req->m_last_dl_amount = 0.0;
+				req->m_last_data_time = time(NULL);
+				req->m_sent = false;
+				curl_multi_add_handle(m_multi, (CURL *) req->m_curl);
+				++running;
+			}
+
+			if(running == 0)
+			{
+				m_work.wait(lock);
+				continue;
+			}
+
+			lock.unlock();
+
+			int still_running = 0;
+			curl_multi_perform(m_multi, &still_running);
+
+			vector<curl_http_get_file *> finished;
+			CURLMsg * msg;
+			int msgs_left;
+			while((msg = curl_multi_info_read(m_multi, &msgs_left)) != NULL)
+			if(msg->msg == CURLMSG_DONE)
+			{
+				curl_http_get_file * req = NULL;
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &req);
+				CURLcode res = msg->data.result;
+				curl_multi_remove_handle(m_multi, msg->easy_handle);
+				req->finish(res);
+				finished.push_back(req);
+				--running;
+			}
+
+			if(finished.empty())
+				curl_multi_wait(m_multi, NULL, 0, IDLE_WAIT_MS, NULL);
+
+			lock.lock();
+			if(!finished.empty())
+			{
+				for(vector<curl_http_get_file *>::iterator f = finished.begin(); f != finished.end(); ++f)
+					(*f)->m_finished = true;
+				m_serial += finished.size();
+				m_done.notify_all();
+			}
+		}
+	}
+
+	CURLM *							m_multi;
+	thread							m_thread;
+	mutex							m_lock;
+	condition_variable				m_work;			// signaled when new requests are queued
+	condition_variable				m_done;			// signaled when requests finish
+	deque<curl_http_get_file *>		m_waiting;
+	volatile int					m_serial;
+};
+
+static curl_http_engine&	engine(void)
+{
+	static curl_http_engine * e = new curl_http_engine;
+	return *e;
+}
+
 void	UTL_http_encode_url(string& io_url)
 {
 	string::size_type p;
@@ -47,6 +176,11 @@ curl_http_get_file::curl_http_get_file(
 	m_dest_buffer(NULL),
 	m_errcode(0),
 	m_last_dl_amount(0.0),
+	m_last_data_time(0),
+	m_sent(false),
+	m_curl(NULL),
+	m_headers(NULL),
+	m_finished(false),
 	m_cert(inCert)
 {
 	UTL_http_encode_url(m_url);
@@ -56,11 +190,7 @@ curl_http_get_file::curl_http_get_file(
 		strncmp(inURL.c_str(),"http://",7) == 0 ||
 		strncmp(inURL.c_str(),"https://",8) == 0);
 	
-	#if IBM
-	m_thread = CreateThread(NULL,0,thread_proc,this,0,NULL);
-	#else
-	pthread_create(&m_thread, NULL, thread_proc, this);
-	#endif
+	start();
 
 }
 
@@ -75,6 +205,11 @@ curl_http_get_file::curl_http_get_file(
 	m_dest_buffer(outDestBuffer),
 	m_errcode(0),
 	m_last_dl_amount(0.0),
+	m_last_data_time(0),
+	m_sent(false),
+	m_curl(NULL),
+	m_headers(NULL),
+	m_finished(false),
 	m_cert(inCert)
 {
 	UTL_http_encode_url(m_url);
@@ -84,11 +219,7 @@ curl_http_get_file::curl_http_get_file(
 		strncmp(inURL.c_str(),"http://",7) == 0 ||
 		strncmp(inURL.c_str(),"https://",8) == 0);
 	
-	#if IBM
-	m_thread = CreateThread(NULL,0,thread_proc,this,0,NULL);
-	#else
-	pthread_create(&m_thread, NULL, thread_proc, this);
-	#endif
+	start();
 
 }
 curl_http_get_file::curl_http_get_file(
@@ -104,6 +235,13 @@ curl_http_get_file::curl_http_get_file(
 	m_post(post_data ? *post_data : string()),
 	m_put(put_data ? *put_data : string()),
 	m_dest_buffer(outBuffer),
+	m_errcode(0),
+	m_last_dl_amount(0.0),
+	m_last_data_time(0),
+	m_sent(false),
+	m_curl(NULL),
+	m_headers(NULL),
+	m_finished(false),
 	m_cert(inCert)
 {
 	UTL_http_encode_url(m_url);
@@ -113,25 +251,22 @@ curl_http_get_file::curl_http_get_file(
 		strncmp(inURL.c_str(),"http://",7) == 0 ||
 		strncmp(inURL.c_str(),"https://",8) == 0);
 	 
-	#if IBM
-	m_thread = CreateThread(NULL,0,thread_proc,this,0,NULL);
-	#else
-	pthread_create(&m_thread, NULL, thread_proc, this);
-	#endif
+	start();
 }
 
 				
 curl_http_get_file::~curl_http_get_file()
 {
-	atomic_store(&m_halt,1);
-
-	#if IBM
-	WaitForSingleObject(m_thread,INFINITE);
-	CloseHandle(m_thread);
-	#else
-	void * ret;
-	pthread_join(m_thread, &ret);
-	#endif
+	engine().cancel(this);
+
+	if(m_headers)
+		curl_slist_free_all((curl_slist *) m_headers);
+	curl_easy_cleanup((CURL *) m_curl);
+}
+
+int		curl_http_get_file::get_completion_serial(void)
+{
+	return engine().serial();
 }
 	
 float		curl_http_get_file::get_progress(void)
@@ -212,12 +347,24 @@ int			curl_http_get_file::progress_cb(void* ptr, double TotalToDownload, double
 
 	time_t now = time(NULL);
 
+	// Until the request has gone out we may be waiting on curl for a connection to the host - that is bounded by the connect
+	// timeout, and is not a stall.
+	if(!me->m_sent)
+	{
+		double pretransfer = 0.0;
+		if(curl_easy_getinfo((CURL *) me->m_curl, CURLINFO_PRETRANSFER_TIME, &pretransfer) == CURLE_OK && pretransfer > 0.0)
+		{
+			me->m_sent = true;
+			me->m_last_data_time = now;
+		}
+	}
+
 	if(NowDownloaded > me->m_last_dl_amount)
 	{
 		me->m_last_dl_amount = NowDownloaded;
 		me->m_last_data_time = now;
 	}
-	else if(now - me->m_last_data_time > TIMEOUT_SEC)
+	else if(me->m_sent && now - me->m_last_data_time > TIMEOUT_SEC)
 	{
 		return 1;
 	}
@@ -238,29 +385,22 @@ int			curl_http_get_file::progress_cb(void* ptr, double TotalToDownload, double
 	return 0;
 }
 
-#if IBM
-DWORD WINAPI
-#else
-void *
-#endif
-curl_http_get_file::thread_proc(void * param)
+void	curl_http_get_file::start(void)
 {
-	curl_http_get_file * me = (curl_http_get_file *) param;
-
 	struct  curl_slist * chunk = NULL;	
 
-	me->m_last_data_time = time(NULL);
-	
 	CURL *	curl = curl_easy_init();
+	m_curl = curl;
 
-	curl_easy_setopt(curl, CURLOPT_URL, me->m_url.c_str());
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, this);
+	curl_easy_setopt(curl, CURLOPT_URL, m_url.c_str());
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, true);	// Required because we do a redirect to protect against URL/Server changes breaking URLs
 
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, param);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
 		
 	curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progress_cb);	
-	curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, param);
+	curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, this);
 	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
 	
 	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");  // empty string is expanded into all methods supported by this version of curl.
@@ -274,25 +414,32 @@ curl_http_get_file::thread_proc(void * param)
 //	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0);
 	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 60.0);
 
-	if(!me->m_cert.empty())
-		curl_easy_setopt(curl, CURLOPT_CAINFO, me->m_cert.c_str());
+	if(!m_cert.empty())
+		curl_easy_setopt(curl, CURLOPT_CAINFO, m_cert.c_str());
 
 
-	if(!me->m_post.empty())
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, me->m_post.c_str());
+	if(!m_post.empty())
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, m_post.c_str());
 	
-	if(!me->m_put.empty())
+	if(!m_put.empty())
 	{
 		chunk = curl_slist_append(chunk, "Content-Type: application/json");
 		
 		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);	
 		curl_easy_setopt(curl, CURLOPT_UPLOAD, 1);
 		curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_cb);
-		curl_easy_setopt(curl, CURLOPT_READDATA, param);
-		curl_easy_setopt(curl, CURLOPT_INFILESIZE, me->m_put.size());
+		curl_easy_setopt(curl, CURLOPT_READDATA, this);
+		curl_easy_setopt(curl, CURLOPT_INFILESIZE, m_put.size());
 	}
-	
-	CURLcode res = curl_easy_perform(curl);
+	m_headers = chunk;
+
+	engine().queue(this);
+}
+
+// Called on the I/O thread once CURL is done with us.
+void	curl_http_get_file::finish(int curl_result)
+{
+	CURLcode res = (CURLcode) curl_result;
 	
 	// A note on thread safety: we need to ensure that writes to memory of our error code or data go out BEFORE
 	// we flip the bit to say we are done.  So we use
@@ -304,56 +451,49 @@ curl_http_get_file::thread_proc(void * param)
 
 	if(res != CURLE_OK)
 	{
-		me->m_errcode = res;
-		atomic_store(&me->m_status, done_error);
+		m_errcode = res;
+		atomic_store(&m_status, done_error);
 	}
 	else
 	{
 		long http_code = 0;
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+		curl_easy_getinfo((CURL *) m_curl, CURLINFO_RESPONSE_CODE, &http_code);
 		
 		if(http_code != 200)
 		{
 			DebugAssert(http_code != 0);
 			
-			me->m_errcode = http_code;
-			atomic_store(&me->m_status, done_error);
+			m_errcode = http_code;
+			atomic_store(&m_status, done_error);
 		}
 		else
 		{
-			if(me->m_dest_buffer)
+			if(m_dest_buffer)
 			{
-				me->m_dest_buffer->swap(me->m_dl_buffer);
-				atomic_store(&me->m_status, done_OK);
+				m_dest_buffer->swap(m_dl_buffer);
+				atomic_store(&m_status, done_OK);
 			}
 			else
 			{
-				FILE * fi = fopen(me->m_dest_path.c_str(),"wb");
+				FILE * fi = fopen(m_dest_path.c_str(),"wb");
 				if(fi == NULL)
 				{
-					me->m_errcode = errno;
+					m_errcode = errno;
 				} 
 				else
 				{
-					size_t ws = fwrite(&me->m_dl_buffer[0], 0, me->m_dl_buffer.size(), fi);
-					if(ws != me->m_dl_buffer.size())
+					size_t ws = fwrite(&m_dl_buffer[0], 1, m_dl_buffer.size(), fi);
+					if(ws != m_dl_buffer.size())
 					{
-						me->m_errcode = ferror(fi);
+						m_errcode = ferror(fi);
 					}
 					fclose(fi);
 				}
-				atomic_store(&me->m_status, me->m_errcode == 0 ? done_OK : done_error);
+				atomic_store(&m_status, m_errcode == 0 ? done_OK : done_error);
 			
 			}
 		}
 	}
-
-	/* always cleanup */ 
-	if(chunk)
-		curl_slist_free_all(chunk);
-	curl_easy_cleanup(curl);
-
-	return NULL;
 }
 
 bool	UTL_http_is_error_bad_net(int err)
@@ -8,26 +8,25 @@
 
 #if HAS_GATEWAY
 
-#if !IBM
-#include <pthread.h>
-#endif
-
 /*
  * curl_http_get_file
  *
  * curl_http_get_file runs a single asynchronous HTTP request for one file.  It provides delivery
  * in memory or on disk, and can unzip a delivery to disk.  
  *
- * Operation is truly async - a worker thread is spawned, and the worker thread blocks on network
- * I/O; the worker is destroyed once the connection is completed.
+ * Operation is truly async - all requests are handed to one shared background I/O thread that
+ * drives them through a CURL multi handle.  That keeps connections to the same host alive between
+ * requests and caps how many transfers run at once; anything over the cap waits in a FIFO queue
+ * until a transfer finishes.  Hundreds of queued requests thus cost hundreds of small objects,
+ * not hundreds of threads.
  *
  * Asynchronous progress can be queried from any thread via get_status and get_progress; a request to
  * abort is made by deleting the file.  Note that deleting the file is a -blocking- operation until
  * the request is fully canceled, so halting may take a little time.  In particular, CURL can't short-
  * circuit synchronous host DNS lookup, so when blocked on a true URL, some paranoia is called for!
  *
- * To determine: asynchronuos service is provided by CURL callbacks - mailing lists imply it's about
- * 1 per second.
+ * Instead of polling every request, clients can watch get_completion_serial: it ticks once for every
+ * request that finishes (OK or not), so if it hasn't moved, no is_done() has changed either.
  *
  */
 
@@ -71,28 +70,27 @@ public:
 	void		get_error_data(vector<char>& out_data);	// If an error, any stuff the server sent -- might be text, HTML, who knows!
 	const string&	get_url() const; //The URL we are attempted to GET from
 
+	static	int	get_completion_serial(void);	// Bumped every time any request finishes.
+
 private:
 
+	friend class curl_http_engine;
+
 		volatile	int			m_progress;		// Out of 100
 		volatile	int			m_status;
 		volatile	int			m_halt;
 		volatile	int			m_errcode;
 		
-		#if IBM
-		HANDLE					m_thread;
-		#else
-		pthread_t				m_thread;
-		#endif
+		void *					m_curl;			// CURL easy handle - belongs to the I/O thread once queued
+		void *					m_headers;		// curl_slist of extra headers, if any
+		bool					m_finished;		// I/O thread is done with us - protected by the engine lock
 		
 		static	size_t		write_cb(void *contents, size_t size, size_t nmemb, void *userp);
 		static	size_t		read_cb(void *contents, size_t size, size_t nmemb, void *userp);
 		static	int			progress_cb(void* ptr, double TotalToDownload, double NowDownloaded, double TotalToUpload, double NowUploaded);
 
-		#if IBM
-		static	DWORD WINAPI	thread_proc(void * param);
-		#else
-		static	void *		thread_proc(void * param);
-		#endif
+				void		start(void);
+				void		finish(int curl_result);
 	
 		vector<char>			m_dl_buffer;
 		vector<char>*			m_dest_buffer;
@@ -105,6 +103,7 @@ private:
 		
 		double					m_last_dl_amount;
 		time_t					m_last_data_time;
+		bool					m_sent;			// the request has gone out, so a quiet transfer now counts as stalled - I/O thread only
 
 		curl_http_get_file operator=(const curl_http_get_file & rhs);
 		curl_http_get_file (const curl_http_get_file & copy);
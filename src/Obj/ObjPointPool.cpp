@@ -29,7 +29,11 @@
 using std::min;
 using std::max;
 
-ObjPointPool::ObjPointPool() : mDepth(8)
+#define	MIN_TABLE_SIZE	64		// Power of two
+#define	MAX_LOAD_NUM	7		// Grow the table past 7/10 full
+#define	MAX_LOAD_DEN	10
+
+ObjPointPool::ObjPointPool() : mHashed(0), mDepth(8)
 {
 }
 
@@ -40,36 +44,118 @@ ObjPointPool::~ObjPointPool()
 void	ObjPointPool::clear(int depth)
 {
 	mData.clear();
-	mIndex.clear();
+	mTable.clear();
+	mHashed = 0;
 	mDepth = depth;
 }
 
 void	ObjPointPool::resize(int pts)
 {
 	mData.resize(pts * mDepth);
-	mIndex.clear();
+	mTable.clear();
+	mHashed = 0;
 }
 
 int		ObjPointPool::accumulate(const float pt[])
 {
-	index_type::iterator iter = mIndex.find(key_type(pt, pt + mDepth));
-	if (iter != mIndex.end())
-		return iter->second;
-	return append(pt);
+	hash_pending();
+	int slot = find_slot(pt);
+	if (mTable[slot] != -1)
+		return mTable[slot];
+
+	int ret = append(pt);
+	mTable[slot] = ret;
+	mHashed = ret + 1;
+	return ret;
 }
 
 int		ObjPointPool::append(const float pt[])
 {
 	int ret = mData.size() / mDepth;
 	mData.insert(mData.end(), pt, pt + mDepth);
-	mIndex.insert(index_type::value_type(key_type(pt,pt+mDepth), ret));
 	return ret;
 }
 
 void	ObjPointPool::set(int n, float pt[])
 {
 	memcpy(&mData[n*mDepth], pt, mDepth * sizeof(float));
-	mIndex.insert(index_type::value_type(key_type(pt,pt+mDepth), n));
+	if (n < mHashed)
+	{
+		mTable.clear();
+		mHashed = 0;
+	}
+}
+
+unsigned int	ObjPointPool::hash_pt(const float pt[]) const
+{
+	// FNV-1a over the float bits, then the murmur3 finalizer so that the low bits
+	// we mask with are well mixed.  Zero is hashed as +0.0 since -0.0 == 0.0.
+	unsigned int h = 2166136261u;
+	for (int i = 0; i < mDepth; ++i)
+	{
+		unsigned int bits = 0;
+		if (pt[i] != 0.0f)
+			memcpy(&bits, &pt[i], sizeof(bits));
+		h = (h ^ bits) * 16777619u;
+	}
+	h ^= h >> 16;	h *= 0x85ebca6bu;
+	h ^= h >> 13;	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+bool	ObjPointPool::equal_pt(const float a[], const float b[]) const
+{
+	for (int i = 0; i < mDepth; ++i)
+		if (a[i] != b[i])
+			return false;
+	return true;
+}
+
+int		ObjPointPool::find_slot(const float pt[]) const
+{
+	unsigned int mask = mTable.size() - 1;
+	unsigned int slot = hash_pt(pt) & mask;
+	while (mTable[slot] != -1 && !equal_pt(&mData[mTable[slot] * mDepth], pt))
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+void	ObjPointPool::grow_table(int want)
+{
+	size_t new_size = mTable.empty() ? MIN_TABLE_SIZE : mTable.size() * 2;
+	while ((size_t) want * MAX_LOAD_DEN > new_size * MAX_LOAD_NUM)
+		new_size *= 2;
+
+	vector<int> old_table(new_size, -1);
+	old_table.swap(mTable);
+
+	// Entries are all distinct, so each one just needs an empty slot.
+	unsigned int mask = mTable.size() - 1;
+	for (vector<int>::iterator i = old_table.begin(); i != old_table.end(); ++i)
+	if (*i != -1)
+	{
+		unsigned int slot = hash_pt(&mData[*i * mDepth]) & mask;
+		while (mTable[slot] != -1)
+			slot = (slot + 1) & mask;
+		mTable[slot] = *i;
+	}
+}
+
+void	ObjPointPool::hash_pending(void)
+{
+	// The table never holds more entries than there are points, so sizing it for
+	// every point plus the one accumulate() may add keeps it under the max load.
+	int total = count();
+	if ((size_t) (total + 1) * MAX_LOAD_DEN > mTable.size() * MAX_LOAD_NUM)
+		grow_table(total + 1);
+
+	for (; mHashed < total; ++mHashed)
+	{
+		int slot = find_slot(&mData[mHashed * mDepth]);
+		if (mTable[slot] == -1)		// First (lowest) index wins for duplicates
+			mTable[slot] = mHashed;
+	}
 }
 
 int		ObjPointPool::count(void) const
@@ -77,6 +163,11 @@ int		ObjPointPool::count(void) const
 	return mData.size() / mDepth;
 }
 
+int		ObjPointPool::depth(void) const
+{
+	return mDepth;
+}
+
 float *	ObjPointPool::get(int index)
 {
 	return &mData[index * mDepth];
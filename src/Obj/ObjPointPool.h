@@ -24,21 +24,24 @@
 #define OBJPOINTPOOL_H
 
 #include <vector>
-#include <map>
-#include <functional>
 
-using std::map;
 using std::vector;
-using std::binary_function;
 
-template <class T>
-struct lex_compare_vector : public binary_function<vector<T>, vector<T>, bool> {
+/*
+	ObjPointPool - a flat array of fixed-width float tuples (XYZ, normal, ST...)
 
-	bool operator()(const vector<T>& lhs, const vector<T>& rhs) const {
-		return lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
-	}
-};
+	accumulate() dedupes: it returns the lowest index whose point is exactly equal
+	(float ==, so -0.0 matches 0.0) to the one passed in, appending only if there is
+	none.  The lookup is an open-addressed hash table of point indices (linear
+	probing, power-of-two size, -1 = empty slot) that hashes the point data in
+	place, so lookups never allocate.
 
+	The table is built lazily: append() and set() just write mData, and the next
+	accumulate() hashes whatever points are not in the table yet, in index order.
+	A set() that rewrites an already-hashed point throws the table away.  So a
+	reader that resize()s and set()s a whole pool pays nothing for dedupe it
+	never uses.
+*/
 class ObjPointPool {
 public:
 	ObjPointPool();
@@ -52,6 +55,7 @@ public:
 	void	set(int n, float pt[]);			// Set an existing pt
 
 	int		count(void) const;
+	int		depth(void) const;
 	float *	get(int index);
 	const float *	get(int index) const;
 
@@ -59,11 +63,15 @@ public:
 
 private:
 
-	typedef	vector<float>									key_type;
-	typedef map<key_type, int, lex_compare_vector<float> >	index_type;
+	unsigned int	hash_pt(const float pt[]) const;
+	bool			equal_pt(const float a[], const float b[]) const;
+	int				find_slot(const float pt[]) const;	// Slot holding pt, or the empty slot where it would go
+	void			hash_pending(void);					// Add points [mHashed, count) to the table
+	void			grow_table(int want);				// Rehash into a table with room for want points
 
 	vector<float>	mData;
-	index_type		mIndex;
+	vector<int>		mTable;		// Point indices, -1 = empty; size is zero or a power of two
+	int				mHashed;	// Points [0, mHashed) have been offered to mTable
 	int				mDepth;
 
 };
@@ -27,6 +27,7 @@
 #include "XObjReadWrite.h"
 #include "XObjDefs.h"
 #include "AssertUtils.h"
+#include "FileUtils.h"
 #include <math.h>
 
 #ifndef CRLF
@@ -524,7 +525,27 @@ bool	XObjWrite(const char * inFile, const XObj& inObj)
 /****************************************************************************************
  * OBJ 8 READ
  ****************************************************************************************/
-bool	XObj8Read(const char * inFile, XObj8& outObj)
+static bool	XObj8ReadText(unsigned char * mem_buf, int filesize, XObj8& outObj);
+
+static unsigned char * read_file_mem(const char * inFile, int& outSize)
+{
+	FILE * objFile = fopen(inFile, "rb");
+	if (!objFile) return NULL;
+	fseek(objFile,0L,SEEK_END);
+	int filesize = ftell(objFile);
+	fseek(objFile,0L,SEEK_SET);
+	unsigned char * mem_buf = (unsigned char *) malloc(filesize);
+	if (mem_buf == NULL) { fclose(objFile); return NULL; }
+	if (fread(mem_buf, 1, filesize, objFile) != filesize)
+	{
+		free(mem_buf); fclose(objFile); return NULL;
+	}
+	fclose(objFile);
+	outSize = filesize;
+	return mem_buf;
+}
+
+static bool	XObj8ReadText(unsigned char * mem_buf, int filesize, XObj8& outObj)
 {
 		int 	n;
 
@@ -542,23 +563,6 @@ bool	XObj8Read(const char * inFile, XObj8& outObj)
 	outObj.glass_blending = 0;
 	outObj.fixed_heading = -1.0;
 
-	/*********************************************************************
-	 * READ FILE INTO MEM
-	 *********************************************************************/
-
-	FILE * objFile = fopen(inFile, "rb");
-	if (!objFile) return false;
-	fseek(objFile,0L,SEEK_END);
-	int filesize = ftell(objFile);
-	fseek(objFile,0L,SEEK_SET);
-	unsigned char * mem_buf = (unsigned char *) malloc(filesize);
-	if (mem_buf == NULL) { fclose(objFile); return false; }
-	if (fread(mem_buf, 1, filesize, objFile) != filesize)
-	{
-		free(mem_buf); fclose(objFile); return false;
-	}
-	fclose(objFile);
-
 	/*********************************************************************
 	 * READ HEADER
 	 *********************************************************************/
@@ -580,10 +584,7 @@ bool	XObj8Read(const char * inFile, XObj8& outObj)
 
 	// If we don't have a good version, bail.
 	if (vers != 800)
-	{
-		free(mem_buf);
 		return false;
-	}
 
 	/************************************************************
 	 * READ GEOMETRIC COMMANDS
@@ -1489,13 +1490,21 @@ bool	XObj8Read(const char * inFile, XObj8& outObj)
 			TXT_MAP_str_scan_eoln(cur_ptr, end_ptr, NULL);
 	} // While loop
 
-	free(mem_buf);
-
 	outObj.geo_tri.get_minmax(outObj.xyz_min,outObj.xyz_max);
 	
 	return true;
 }
 
+bool	XObj8Read(const char * inFile, XObj8& outObj)
+{
+	int filesize;
+	unsigned char * mem_buf = read_file_mem(inFile, filesize);
+	if (mem_buf == NULL) return false;
+	bool ok = XObj8ReadText(mem_buf, filesize, outObj);
+	free(mem_buf);
+	return ok;
+}
+
 /****************************************************************************************
  * OBJ 8 WRITE
  ****************************************************************************************/
@@ -1995,3 +2004,351 @@ bool	XObj8Write(const char * inFile, const XObj8& outObj)
 	fclose(fi);
 	return true;
 }
+
+/****************************************************************************************
+ * OBJ 8 BINARY
+ ****************************************************************************************
+ *
+ * The binary form is the parsed XObj8 written out field by field in declaration order,
+ * so reading it back is bounds checks and memcpys - no tokenizing.  Strings are a u32
+ * length plus the bytes, arrays a u32 count plus the elements, and every item is padded
+ * to 4 bytes so the point pools and index table are aligned runs of floats and ints that
+ * can be read straight out of a memory-mapped file.
+ *
+ * Any change to XObj8 or to this layout must bump XOBJ8_BIN_VERSION; old cache files
+ * then fail the header check and get re-parsed from the text.
+ *
+ */
+
+#define XOBJ8_BIN_MAGIC		"XOBJ8BIN"
+#define XOBJ8_BIN_VERSION	1
+#define XOBJ8_BIN_BOM		0x01020304
+
+struct	xobj8_bin_header {
+	char				magic[8];
+	unsigned int		version;
+	unsigned int		byte_order;
+	unsigned long long	source_hash;
+	unsigned int		length;			// Whole blob, header included
+	unsigned int		reserved;
+};
+
+struct	xobj8_bin_writer {
+	vector<char>	buf;
+
+	void	raw(const void * p, size_t len)
+	{
+		buf.insert(buf.end(), (const char *) p, (const char *) p + len);
+		while (buf.size() % 4) buf.push_back(0);
+	}
+	void	u32(unsigned int v)	{ raw(&v, sizeof(v)); }
+	void	i32(int v)			{ raw(&v, sizeof(v)); }
+	void	f32(float v)		{ raw(&v, sizeof(v)); }
+	void	str(const string& s){ u32(s.size()); raw(s.data(), s.size()); }
+
+	template <class T>
+	void	pod_array(const vector<T>& v) { u32(v.size()); if (!v.empty()) raw(&v[0], v.size() * sizeof(T)); }
+
+	void	pool(const ObjPointPool& p)
+	{
+		i32(p.depth());
+		i32(p.count());
+		if (p.count()) raw(p.get(0), p.count() * p.depth() * sizeof(float));
+	}
+};
+
+struct	xobj8_bin_reader {
+	const char *	p;
+	const char *	e;
+	bool			ok;
+
+	void	raw(void * dst, size_t len)
+	{
+		size_t padded = (len + 3) & ~3;
+		if (!ok || (size_t) (e - p) < padded) { ok = false; return; }
+		memcpy(dst, p, len);
+		p += padded;
+	}
+	unsigned int	u32()	{ unsigned int v = 0; raw(&v, sizeof(v)); return v; }
+	int				i32()	{ int v = 0; raw(&v, sizeof(v)); return v; }
+	float			f32()	{ float v = 0; raw(&v, sizeof(v)); return v; }
+
+	// Read a count and check that that many items of at least min_size could fit, so a
+	// corrupt count fails here instead of in a giant resize().
+	unsigned int	count(size_t min_size)
+	{
+		unsigned int n = u32();
+		if (ok && n > (size_t) (e - p) / min_size) ok = false;
+		return ok ? n : 0;
+	}
+	void	str(string& s)
+	{
+		unsigned int n = count(1);
+		s.resize(n);
+		if (n) raw(&s[0], n);
+	}
+
+	template <class T>
+	void	pod_array(vector<T>& v) { v.resize(count(sizeof(T))); if (!v.empty()) raw(&v[0], v.size() * sizeof(T)); }
+
+	void	pool(ObjPointPool& pp, int want_depth)
+	{
+		int depth = i32();
+		int n = i32();
+		if (n < 0 || (n > 0 && depth != want_depth) || (size_t) n > (size_t) (e - p) / (want_depth * sizeof(float))) ok = false;
+		pp.clear(want_depth);
+		if (!ok || n == 0) return;
+		pp.resize(n);
+		raw(pp.get(0), n * want_depth * sizeof(float));
+	}
+};
+
+static unsigned long long	xobj8_hash(const unsigned char * p, size_t len)
+{
+	// FNV-1a, 64 bit
+	unsigned long long h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; ++i)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	return h;
+}
+
+bool	XObj8WriteBinary(const char * inFile, const XObj8& inObj, unsigned long long inSourceHash)
+{
+	xobj8_bin_writer	w;
+	xobj8_bin_header	h;
+	memset(&h, 0, sizeof(h));
+	w.raw(&h, sizeof(h));
+
+	w.str(inObj.texture);
+	w.str(inObj.texture_normal_map);
+	w.str(inObj.texture_lit);
+	w.str(inObj.texture_draped);
+	w.i32(inObj.use_metalness);
+	w.i32(inObj.glass_blending);
+	w.str(inObj.particle_system);
+	w.pod_array(inObj.regions);
+	w.pod_array(inObj.indices);
+	w.pool(inObj.geo_tri);
+	w.pool(inObj.geo_lines);
+	w.pool(inObj.geo_lights);
+
+	w.u32(inObj.animation.size());
+	for (vector<XObjAnim8>::const_iterator a = inObj.animation.begin(); a != inObj.animation.end(); ++a)
+	{
+		w.i32(a->cmd);
+		w.str(a->dataref);
+		w.raw(a->axis, sizeof(a->axis));
+		w.f32(a->loop);
+		w.pod_array(a->keyframes);
+	}
+
+	w.u32(inObj.manips.size());
+	for (vector<XObjManip8>::const_iterator m = inObj.manips.begin(); m != inObj.manips.end(); ++m)
+	{
+		w.str(m->dataref1);
+		w.str(m->dataref2);
+		w.raw(m->centroid, sizeof(m->centroid));
+		w.raw(m->axis, sizeof(m->axis));
+		w.f32(m->angle_min);
+		w.f32(m->angle_max);
+		w.f32(m->lift);
+		w.f32(m->v1_min);
+		w.f32(m->v1_max);
+		w.f32(m->v2_min);
+		w.f32(m->v2_max);
+		w.str(m->cursor);
+		w.str(m->tooltip);
+		w.f32(m->mouse_wheel_delta);
+		w.pod_array(m->rotation_key_frames);
+		w.pod_array(m->detents);
+	}
+
+	w.u32(inObj.emitters.size());
+	for (vector<XObjEmitter8>::const_iterator em = inObj.emitters.begin(); em != inObj.emitters.end(); ++em)
+	{
+		w.str(em->name);
+		w.str(em->dataref);
+		w.f32(em->x);	w.f32(em->y);	w.f32(em->z);
+		w.f32(em->psi);	w.f32(em->the);	w.f32(em->phi);
+		w.f32(em->v_min);
+		w.f32(em->v_max);
+	}
+
+	w.u32(inObj.lods.size());
+	for (vector<XObjLOD8>::const_iterator l = inObj.lods.begin(); l != inObj.lods.end(); ++l)
+	{
+		w.f32(l->lod_near);
+		w.f32(l->lod_far);
+		w.u32(l->cmds.size());
+		for (vector<XObjCmd8>::const_iterator c = l->cmds.begin(); c != l->cmds.end(); ++c)
+		{
+			w.i32(c->cmd);
+			w.raw(c->params, sizeof(c->params));
+			w.str(c->name);
+			w.i32(c->idx_offset);
+			w.i32(c->idx_count);
+		}
+	}
+
+	w.raw(inObj.xyz_min, sizeof(inObj.xyz_min));
+	w.raw(inObj.xyz_max, sizeof(inObj.xyz_max));
+	w.f32(inObj.fixed_heading);
+
+	memcpy(h.magic, XOBJ8_BIN_MAGIC, sizeof(h.magic));
+	h.version = XOBJ8_BIN_VERSION;
+	h.byte_order = XOBJ8_BIN_BOM;
+	h.source_hash = inSourceHash;
+	h.length = w.buf.size();
+	memcpy(&w.buf[0], &h, sizeof(h));
+
+	FILE * fi = fopen(inFile, "wb");
+	if (fi == NULL) return false;
+	bool ok = fwrite(&w.buf[0], 1, w.buf.size(), fi) == w.buf.size();
+	fclose(fi);
+	return ok;
+}
+
+bool	XObj8ReadBinary(const char * inBegin, const char * inEnd, XObj8& outObj, unsigned long long inSourceHash)
+{
+	xobj8_bin_header	h;
+	if (inEnd - inBegin < (ptrdiff_t) sizeof(h)) return false;
+	memcpy(&h, inBegin, sizeof(h));
+	if (memcmp(h.magic, XOBJ8_BIN_MAGIC, sizeof(h.magic)) != 0 ||
+		h.version != XOBJ8_BIN_VERSION ||
+		h.byte_order != XOBJ8_BIN_BOM ||
+		h.length != inEnd - inBegin)
+		return false;
+	if (inSourceHash != 0 && h.source_hash != inSourceHash)
+		return false;
+
+	xobj8_bin_reader	r;
+	r.p = inBegin + sizeof(h);
+	r.e = inEnd;
+	r.ok = true;
+
+	r.str(outObj.texture);
+	r.str(outObj.texture_normal_map);
+	r.str(outObj.texture_lit);
+	r.str(outObj.texture_draped);
+	outObj.use_metalness = r.i32();
+	outObj.glass_blending = r.i32();
+	r.str(outObj.particle_system);
+	r.pod_array(outObj.regions);
+	r.pod_array(outObj.indices);
+	r.pool(outObj.geo_tri, 8);
+	r.pool(outObj.geo_lines, 6);
+	r.pool(outObj.geo_lights, 6);
+
+	outObj.animation.resize(r.count(4));
+	for (vector<XObjAnim8>::iterator a = outObj.animation.begin(); a != outObj.animation.end(); ++a)
+	{
+		a->cmd = r.i32();
+		r.str(a->dataref);
+		r.raw(a->axis, sizeof(a->axis));
+		a->loop = r.f32();
+		r.pod_array(a->keyframes);
+	}
+
+	outObj.manips.resize(r.count(4));
+	for (vector<XObjManip8>::iterator m = outObj.manips.begin(); m != outObj.manips.end(); ++m)
+	{
+		r.str(m->dataref1);
+		r.str(m->dataref2);
+		r.raw(m->centroid, sizeof(m->centroid));
+		r.raw(m->axis, sizeof(m->axis));
+		m->angle_min = r.f32();
+		m->angle_max = r.f32();
+		m->lift = r.f32();
+		m->v1_min = r.f32();
+		m->v1_max = r.f32();
+		m->v2_min = r.f32();
+		m->v2_max = r.f32();
+		r.str(m->cursor);
+		r.str(m->tooltip);
+		m->mouse_wheel_delta = r.f32();
+		r.pod_array(m->rotation_key_frames);
+		r.pod_array(m->detents);
+	}
+
+	outObj.emitters.resize(r.count(4));
+	for (vector<XObjEmitter8>::iterator em = outObj.emitters.begin(); em != outObj.emitters.end(); ++em)
+	{
+		r.str(em->name);
+		r.str(em->dataref);
+		em->x = r.f32();	em->y = r.f32();	em->z = r.f32();
+		em->psi = r.f32();	em->the = r.f32();	em->phi = r.f32();
+		em->v_min = r.f32();
+		em->v_max = r.f32();
+	}
+
+	outObj.lods.resize(r.count(4));
+	for (vector<XObjLOD8>::iterator l = outObj.lods.begin(); l != outObj.lods.end(); ++l)
+	{
+		l->lod_near = r.f32();
+		l->lod_far = r.f32();
+		l->cmds.resize(r.count(4));
+		for (vector<XObjCmd8>::iterator c = l->cmds.begin(); c != l->cmds.end(); ++c)
+		{
+			c->cmd = r.i32();
+			r.raw(c->params, sizeof(c->params));
+			r.str(c->name);
+			c->idx_offset = r.i32();
+			c->idx_count = r.i32();
+		}
+	}
+
+	r.raw(outObj.xyz_min, sizeof(outObj.xyz_min));
+	r.raw(outObj.xyz_max, sizeof(outObj.xyz_max));
+	outObj.fixed_heading = r.f32();
+
+	if (!r.ok || r.p != r.e)
+	{
+		outObj = XObj8();
+		return false;
+	}
+	return true;
+}
+
+bool	XObj8ReadCached(const char * inFile, XObj8& outObj, const char * inCacheDir)
+{
+	int filesize;
+	unsigned char * mem_buf = read_file_mem(inFile, filesize);
+	if (mem_buf == NULL) return false;
+	unsigned long long source_hash = xobj8_hash(mem_buf, filesize);
+
+	// One cache slot per source path; the content hash inside says whether it is current.
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx.obj8", xobj8_hash((const unsigned char *) inFile, strlen(inFile)));
+	string cache_path = string(inCacheDir) + name;
+
+	int cache_size;
+	unsigned char * cache_buf = read_file_mem(cache_path.c_str(), cache_size);
+	if (cache_buf)
+	{
+		bool hit = XObj8ReadBinary((const char *) cache_buf, (const char *) cache_buf + cache_size, outObj, source_hash);
+		free(cache_buf);
+		if (hit)
+		{
+			free(mem_buf);
+			return true;
+		}
+	}
+
+	bool ok = XObj8ReadText(mem_buf, filesize, outObj);
+	free(mem_buf);
+
+	// Write-then-rename so a reader never sees half a file.  If two loaders race on the
+	// same temp file, a torn result fails the length or hash check and is just rebuilt.
+	if (ok)
+	{
+		string temp = cache_path + ".tmp";
+		if (XObj8WriteBinary(temp.c_str(), outObj, source_hash))
+		{
+			FILE_delete_file(cache_path.c_str(), false);
+			if (FILE_rename_file(temp.c_str(), cache_path.c_str()) == 0)
+				return true;
+		}
+		FILE_delete_file(temp.c_str(), false);
+	}
+	return ok;
+}
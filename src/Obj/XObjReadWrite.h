@@ -32,4 +32,14 @@ bool	XObjWrite(const char * inFile, const XObj& inObj);
 bool	XObj8Read(const char * inFile, XObj8& outObj);
 bool	XObj8Write(const char * inFile, const XObj8& outObj);
 
+// Binary OBJ8 - a flat, versioned dump of a parsed XObj8 in native byte order.  It is
+// meant as a local parse cache, not an interchange format.  inSourceHash tags the blob
+// with the text it was parsed from; ReadBinary fails on a mismatch (0 accepts any).
+bool	XObj8WriteBinary(const char * inFile, const XObj8& inObj, unsigned long long inSourceHash);
+bool	XObj8ReadBinary(const char * inBegin, const char * inEnd, XObj8& outObj, unsigned long long inSourceHash);
+
+// Same result as XObj8Read, but keeps a binary copy of each parsed object in inCacheDir
+// (which must end in a directory separator) and uses it while the OBJ text is unchanged.
+bool	XObj8ReadCached(const char * inFile, XObj8& outObj, const char * inCacheDir);
+
 #endif
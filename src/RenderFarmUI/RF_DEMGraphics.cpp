@@ -27,6 +27,8 @@
 #include "TensorUtils.h"
 #include "CompGeomDefs2.h"
 #include "perlin.h"
+#include <thread>
+#include <atomic>
 
 #define		DDA_STEPS 10.0f
 #define		DDA_FACTOR 0.5
@@ -192,36 +194,41 @@ float	kColorBandsTemperatureRange[][4] = {
 0  ,	0  ,	0  ,	DEM_NO_DATA
 };
 
-void	GetColorForTable(float v, ColorBandMap& table, unsigned char col[3])
+static void	GetColorForBand(float v, const DEMColorBand_t& band, unsigned char col[3])
 {
-	ColorBandMap::iterator i = table.lower_bound(v);
-	if (i == table.end())
+	if (v < band.lo_value || v > band.hi_value)
 	{
 		col[0] = col[1] = col[2] = 0;
 		return;
 	}
 
-	if (v < i->second.lo_value || v > i->second.hi_value)
-	{
-		col[0] = col[1] = col[2] = 0;
-		return;
-	}
-
-	float mix2 = (v - i->second.lo_value) / (i->second.hi_value - i->second.lo_value);
+	float mix2 = (v - band.lo_value) / (band.hi_value - band.lo_value);
 	float mix1 = 1.0 - mix2;
 
-	float red = i->second.lo_color.rgb[0] * mix1 + i->second.hi_color.rgb[0] * mix2;
-	float grn = i->second.lo_color.rgb[1] * mix1 + i->second.hi_color.rgb[1] * mix2;
-	float blu = i->second.lo_color.rgb[2] * mix1 + i->second.hi_color.rgb[2] * mix2;
+	float red = band.lo_color.rgb[0] * mix1 + band.hi_color.rgb[0] * mix2;
+	float grn = band.lo_color.rgb[1] * mix1 + band.hi_color.rgb[1] * mix2;
+	float blu = band.lo_color.rgb[2] * mix1 + band.hi_color.rgb[2] * mix2;
 
 	col[0] = red * 255.0;
 	col[1] = grn * 255.0;
 	col[2] = blu * 255.0;
 }
 
-void	GetColorForParam(float	v, float mapping[][4], int num_bands, unsigned char col[3])
+void	GetColorForTable(float v, ColorBandMap& table, unsigned char col[3])
 {
-	for (int n = 0; n < (num_bands-1); ++n)
+	ColorBandMap::iterator i = table.lower_bound(v);
+	if (i == table.end())
+	{
+		col[0] = col[1] = col[2] = 0;
+		return;
+	}
+	GetColorForBand(v, i->second, col);
+}
+
+// Same as GetColorForParam, but skips the bands before first - the caller knows v can't be in them.
+static void	GetColorForParamFrom(float v, float mapping[][4], int num_bands, int first, unsigned char col[3])
+{
+	for (int n = first; n < (num_bands-1); ++n)
 	{
 		if (mapping[n  ][3] <= v &&
 			mapping[n+1][3] >= v)
@@ -241,9 +248,14 @@ void	GetColorForParam(float	v, float mapping[][4], int num_bands, unsigned char
 	col[2] = 	mapping[num_bands-1][2];
 }
 
-void	GetColorForAlt(float alt, unsigned char col[3])
+void	GetColorForParam(float	v, float mapping[][4], int num_bands, unsigned char col[3])
 {
-	int n = 0;
+	GetColorForParamFrom(v, mapping, num_bands, 0, col);
+}
+
+static void	GetColorForAltFrom(float alt, int first, unsigned char col[3])
+{
+	int n = first;
 	while (kColorBands[n][0] != -99.0)
 	{
 		if (kColorBands[n  ][0] <= alt &&
@@ -270,14 +282,84 @@ void	GetColorForAlt(float alt, unsigned char col[3])
 	col[2] = 255;
 }
 
+void	GetColorForAlt(float alt, unsigned char col[3])
+{
+	GetColorForAltFrom(alt, 0, col);
+}
+
 void GetColorForLU(float alt, unsigned char col[3])
 {
-	RGBColor_t&	c = gEnumColors[alt];
+	// find, not [] - this is called from several threads at once and must not modify the table.
+	EnumColorTable::iterator i = gEnumColors.find(alt);
+	if (i == gEnumColors.end())
+	{
+		col[0] = col[1] = col[2] = 0;
+		return;
+	}
+	RGBColor_t&	c = i->second;
 	col[0] = 255.0 * c.rgb[0];
 	col[1] = 255.0 * c.rgb[1];
 	col[2] = 255.0 * c.rgb[2];
 }
 
+/************************************************************************************************************************
+ * BAND INDEX
+ ************************************************************************************************************************
+
+	The banded color modes are piecewise linear in the DEM value, but finding a post's band is a search from the first
+	band.  So once per bitmap we cut the bands' range into even buckets and note, per bucket, the first band whose top is
+	not below the bucket's low end - no band before it can hold a value in the bucket.  A post's search starts there and
+	the color comes from the same code as the full search, so the bitmap is exactly what GetColorForTable,
+	GetColorForParam and GetColorForAlt would give, gaps and band edges included.  Values below the range (including
+	DEM_NO_DATA) and NaNs start from the first band.
+
+ */
+
+#define	DEM_BAND_INDEX_SIZE	1024
+
+struct	dem_band_index {
+	float					lo;
+	float					scale;
+	vector<float>			lows;		// low end of each bucket
+	vector<int>				first;		// first band whose top is >= the bucket's low end
+
+	dem_band_index() : lo(0), scale(0) { }
+
+	// tops[n] is the highest value band n can match, in band search order.
+	void	build(float in_lo, float in_hi, const vector<float>& tops)
+	{
+		lows.clear();
+		first.clear();
+		lo = in_lo;
+		if (!(in_lo < in_hi)) return;
+		scale = (float) DEM_BAND_INDEX_SIZE / (in_hi - in_lo);
+		lows.resize(DEM_BAND_INDEX_SIZE);
+		first.resize(DEM_BAND_INDEX_SIZE);
+		for (int b = 0; b < DEM_BAND_INDEX_SIZE; ++b)
+		{
+			lows[b] = in_lo + (in_hi - in_lo) * (float) b / (float) DEM_BAND_INDEX_SIZE;
+			int n = 0;
+			while (n < tops.size() && tops[n] < lows[b])
+				++n;
+			first[b] = n;
+		}
+	}
+
+	// The first band the search for v needs to look at.
+	inline int	start(float v) const
+	{
+		if (first.empty() || !(v >= lo)) return 0;
+		float f = (v - lo) * scale;
+		int b = f >= (float) DEM_BAND_INDEX_SIZE ? DEM_BAND_INDEX_SIZE - 1 : (int) f;
+		while (b > 0 && lows[b] > v)		// rounding can put v just below its bucket
+			--b;
+		return lows[b] > v ? 0 : first[b];
+	}
+};
+
+/************************************************************************************************************************
+ * DEM TO BITMAP
+ ************************************************************************************************************************/
 
 int	DEMToBitmap(
 				const DEMGeo& 	inDEM,
@@ -291,7 +373,7 @@ int	DEMToBitmap(
 
 	float	dh_max = 0;
 
-	float h, ha, hr, dh, smin, smax, scaled;
+	float h, ha, hr, dh, smin, smax;
 
 	float (*vp)[4];
 	int		cnt;
@@ -326,24 +408,24 @@ int	DEMToBitmap(
 		break;
 	}
 
-	if (gColorBands.count(inMode) != 0)
+	// Set up whatever each mode needs for the whole DEM before the rows are colored.
+	dem_band_index					band_index;
+	vector<float>					band_tops;
+	vector<ColorBandMap::iterator>	table_bands;
+	ColorBandTable::iterator table = gColorBands.find(inMode);
+	if (table != gColorBands.end())
 	{
-		ColorBandMap& table(gColorBands[inMode]);
-		for (y = 0; y < inDEM.mHeight; ++y)
-		for (x = 0; x < inDEM.mWidth; ++x)
+		// A table's bands are keyed by their top, and the search is the map's lower_bound.
+		ColorBandMap& bands(table->second);
+		for (ColorBandMap::iterator b = bands.begin(); b != bands.end(); ++b)
 		{
-			float h = inDEM(x,y);
-			unsigned char col[3];
-			GetColorForTable(h, table, col);
-			outImage.data[(x + y * outImage.width) * outImage.channels  ] = col[2];
-			outImage.data[(x + y * outImage.width) * outImage.channels+1] = col[1];
-			outImage.data[(x + y * outImage.width) * outImage.channels+2] = col[0];
+			table_bands.push_back(b);
+			band_tops.push_back(b->first);
 		}
-		return 0;
+		if (!bands.empty())
+			band_index.build(bands.begin()->second.lo_value, band_tops.back(), band_tops);
 	}
-
-
-	switch(inMode) {
+	else switch(inMode) {
 	case dem_StrataBiomass:
 	case dem_StrataRainfallYearly:
 	case dem_StrataTemperature:
@@ -351,46 +433,10 @@ int	DEMToBitmap(
 	case dem_StrataElevationRange:
 	case dem_StrataRelativeElevation:
 	case dem_StrataDrainage:
-		for (y = 0; y < inDEM.mHeight; ++y)
-		for (x = 0; x < inDEM.mWidth; ++x)
-		{
-			float h = inDEM(x,y);
-			unsigned char col[3];
-			GetColorForParam(h, vp, cnt, col);
-
-			outImage.data[(x + y * outImage.width) * outImage.channels  ] = col[2];
-			outImage.data[(x + y * outImage.width) * outImage.channels+1] = col[1];
-			outImage.data[(x + y * outImage.width) * outImage.channels+2] = col[0];
-		}
-		break;
-	case dem_Zones:
-		for (y = 0; y < inDEM.mHeight; ++y)
-		for (x = 0; x < inDEM.mWidth; ++x)
-		{
-			float h = inDEM(x,y);
-			unsigned int n = round(fabsf(h));
-			unsigned char col[3];
-			col[0] = (n * 59) % 256;
-			col[1] = (n * 239) % 256;
-			col[2] = (n * 383) % 256;
-			
-			outImage.data[(x + y * outImage.width) * outImage.channels  ] = col[2];
-			outImage.data[(x + y * outImage.width) * outImage.channels+1] = col[1];
-			outImage.data[(x + y * outImage.width) * outImage.channels+2] = col[0];
-			
-		}
-		break;
-	case dem_Enum:
-		for (y = 0; y < inDEM.mHeight; ++y)
-		for (x = 0; x < inDEM.mWidth; ++x)
-		{
-			float h = inDEM(x,y);
-			unsigned char col[3];
-			GetColorForLU(h, col);
-			outImage.data[(x + y * outImage.width) * outImage.channels  ] = col[2];
-			outImage.data[(x + y * outImage.width) * outImage.channels+1] = col[1];
-			outImage.data[(x + y * outImage.width) * outImage.channels+2] = col[0];
-		}
+		// Band n runs from row n to row n+1; the last row is the color for values outside the bands, not a band.
+		for (int n = 0; n < cnt-1; ++n)
+			band_tops.push_back(vp[n+1][3]);
+		band_index.build(vp[0][3], vp[cnt-2][3], band_tops);
 		break;
 	case dem_Strata:
 		smin = 9.9e9;
@@ -402,50 +448,10 @@ int	DEMToBitmap(
 			if (h != DEM_NO_DATA && h < smin) smin = h;
 			if (h != DEM_NO_DATA && h > smax) smax = h;
 		}
-		for (y = 0; y < inDEM.mHeight; ++y)
-		for (x = 0; x < inDEM.mWidth; ++x)
-		{
-			float h = inDEM(x,y);
-			if (h != DEM_NO_DATA && smin != smax) h = ((h - smin) * 1000.0 / (smax - smin));
-			unsigned char col[3];
-			GetColorForAlt(h, col);
-
-			outImage.data[(x + y * outImage.width) * outImage.channels  ] = col[0];
-			outImage.data[(x + y * outImage.width) * outImage.channels+1] = col[1];
-			outImage.data[(x + y * outImage.width) * outImage.channels+2] = col[2];
-		}
+		for (int n = 0; kColorBands[n][0] != -99.0; ++n)
+			band_tops.push_back(kColorBands[n+1][0]);
+		band_index.build(0.0, 1000.0, band_tops);
 		break;
-	case dem_Normals:
-		for (y = 0; y < (inDEM.mHeight-1); ++y)
-		for (x = 0; x < (inDEM.mWidth-1); ++x)
-		{
-			h = inDEM(x,y);
-			ha = inDEM(x,y+1);
-			hr = inDEM(x+1,y);
-
-			Point3	p_h(0,0,h);
-			Point3	p_ha(0, inDEM.y_dist_to_m(1), ha);
-			Point3	p_hr(inDEM.x_dist_to_m(1), 0, hr);
-
-			Vector3	to_a(p_h, p_ha);
-			Vector3	to_r(p_h, p_hr);
-
-			Vector3	n(to_r.cross(to_a));
-			n.normalize();
-
-			if (h == DEM_NO_DATA || ha == DEM_NO_DATA || hr == DEM_NO_DATA)
-			{
-				outImage.data[(x + y * outImage.width) * outImage.channels  ] = 0x80;
-				outImage.data[(x + y * outImage.width) * outImage.channels+1] = 0x80;
-				outImage.data[(x + y * outImage.width) * outImage.channels+2] = 0x80;
-			} else {
-				outImage.data[(x + y * outImage.width) * outImage.channels  ] = n.dz * 127.0 + 127.0;
-				outImage.data[(x + y * outImage.width) * outImage.channels+1] = n.dy * 127.0 + 127.0;
-				outImage.data[(x + y * outImage.width) * outImage.channels+2] = n.dx * 127.0 + 127.0;
-			}
-		}
-		break;
-
 	case dem_Shaded:
 		for (y = 0; y < (inDEM.mHeight-1); ++y)
 		for (x = 0; x < (inDEM.mWidth-1); ++x)
@@ -460,43 +466,152 @@ int	DEMToBitmap(
 			if (dh > dh_max)
 				dh_max = dh;
 		}
-		for (y = 0; y < (inDEM.mHeight-1); ++y)
-		for (x = 0; x < (inDEM.mWidth-1); ++x)
+		break;
+	}
+
+	// Each row only reads the DEM and writes its own row (the normals and shading read the next row up), so the
+	// rows are colored on all cores.
+	auto color_row = [&](int y) {
+		unsigned char * row = outImage.data + y * outImage.width * outImage.channels;
+		unsigned char col[3];
+		float h, ha, hr, dh, scaled;
+		int x;
+
+		if (table != gColorBands.end())
 		{
-			h = inDEM(x,y);
-			ha = inDEM(x,y+1);
-			hr = inDEM(x+1,y);
-			if (h == DEM_NO_DATA || ha == DEM_NO_DATA || hr == DEM_NO_DATA)
-				dh = 0.0;
-			else {
-				ha -= h;
-				hr -= h;
-				dh = ha + hr;
+			for (x = 0; x < inDEM.mWidth; ++x)
+			{
+				float h = inDEM(x,y);
+				int n = band_index.start(h);
+				while (n < table_bands.size() && table_bands[n]->first < h)
+					++n;
+				if (n == table_bands.size())
+					col[0] = col[1] = col[2] = 0;
+				else
+					GetColorForBand(h, table_bands[n]->second, col);
+				row[x * outImage.channels  ] = col[2];
+				row[x * outImage.channels+1] = col[1];
+				row[x * outImage.channels+2] = col[0];
 			}
-			scaled = (dh_max > 0.0) ? (dh / dh_max) : 0.0;
-			scaled = (scaled * 0.5 + 0.5) * 255.0;
+			return;
+		}
 
-			if (h == DEM_NO_DATA)
+		switch(inMode) {
+		case dem_StrataBiomass:
+		case dem_StrataRainfallYearly:
+		case dem_StrataTemperature:
+		case dem_StrataTemperatureRange:
+		case dem_StrataElevationRange:
+		case dem_StrataRelativeElevation:
+		case dem_StrataDrainage:
+			for (x = 0; x < inDEM.mWidth; ++x)
 			{
-				outImage.data[(x + y * outImage.width) * outImage.channels  ] = scaled;
-				outImage.data[(x + y * outImage.width) * outImage.channels+1] = 0;
-				outImage.data[(x + y * outImage.width) * outImage.channels+2] = 0;
-			} else {
-				outImage.data[(x + y * outImage.width) * outImage.channels  ] = scaled;
-				outImage.data[(x + y * outImage.width) * outImage.channels+1] = scaled;
-				outImage.data[(x + y * outImage.width) * outImage.channels+2] = scaled;
+				float h = inDEM(x,y);
+				GetColorForParamFrom(h, vp, cnt, band_index.start(h), col);
+
+				row[x * outImage.channels  ] = col[2];
+				row[x * outImage.channels+1] = col[1];
+				row[x * outImage.channels+2] = col[0];
 			}
-		}
-		for (y = 0; y < (inDEM.mHeight-1); ++y)
-		for (ch = 0; ch < 3; ++ch)
-			outImage.data[(outImage.width-1 + y * outImage.width) * outImage.channels + ch] =
-			outImage.data[(outImage.width-2 + y * outImage.width) * outImage.channels + ch];
-		for (x = 0; x < inDEM.mWidth; ++x)
-		{
-			outImage.data[(x + (outImage.height-1) * outImage.width) * outImage.channels + ch] =
-			outImage.data[(x + (outImage.height-2) * outImage.width) * outImage.channels + ch];
-		}
-		break;
+			break;
+		case dem_Zones:
+			for (x = 0; x < inDEM.mWidth; ++x)
+			{
+				float h = inDEM(x,y);
+				unsigned int n = round(fabsf(h));
+				col[0] = (n * 59) % 256;
+				col[1] = (n * 239) % 256;
+				col[2] = (n * 383) % 256;
+
+				row[x * outImage.channels  ] = col[2];
+				row[x * outImage.channels+1] = col[1];
+				row[x * outImage.channels+2] = col[0];
+			}
+			break;
+		case dem_Enum:
+			// Land use comes in runs, so only look up a post's color when it differs from the one before.
+			for (x = 0; x < inDEM.mWidth; ++x)
+			{
+				float h = inDEM(x,y);
+				if (x == 0 || h != inDEM(x-1,y))
+					GetColorForLU(h, col);
+				row[x * outImage.channels  ] = col[2];
+				row[x * outImage.channels+1] = col[1];
+				row[x * outImage.channels+2] = col[0];
+			}
+			break;
+		case dem_Strata:
+			for (x = 0; x < inDEM.mWidth; ++x)
+			{
+				float h = inDEM(x,y);
+				if (h != DEM_NO_DATA && smin != smax) h = ((h - smin) * 1000.0 / (smax - smin));
+				GetColorForAltFrom(h, band_index.start(h), col);
+
+				row[x * outImage.channels  ] = col[0];
+				row[x * outImage.channels+1] = col[1];
+				row[x * outImage.channels+2] = col[2];
+			}
+			break;
+		case dem_Normals:
+			if (y >= (inDEM.mHeight-1)) break;
+			for (x = 0; x < (inDEM.mWidth-1); ++x)
+			{
+				h = inDEM(x,y);
+				ha = inDEM(x,y+1);
+				hr = inDEM(x+1,y);
+
+				Point3	p_h(0,0,h);
+				Point3	p_ha(0, inDEM.y_dist_to_m(1), ha);
+				Point3	p_hr(inDEM.x_dist_to_m(1), 0, hr);
+
+				Vector3	to_a(p_h, p_ha);
+				Vector3	to_r(p_h, p_hr);
+
+				Vector3	n(to_r.cross(to_a));
+				n.normalize();
+
+				if (h == DEM_NO_DATA || ha == DEM_NO_DATA || hr == DEM_NO_DATA)
+				{
+					row[x * outImage.channels  ] = 0x80;
+					row[x * outImage.channels+1] = 0x80;
+					row[x * outImage.channels+2] = 0x80;
+				} else {
+					row[x * outImage.channels  ] = n.dz * 127.0 + 127.0;
+					row[x * outImage.channels+1] = n.dy * 127.0 + 127.0;
+					row[x * outImage.channels+2] = n.dx * 127.0 + 127.0;
+				}
+			}
+			break;
+
+		case dem_Shaded:
+			if (y >= (inDEM.mHeight-1)) break;
+			for (x = 0; x < (inDEM.mWidth-1); ++x)
+			{
+				h = inDEM(x,y);
+				ha = inDEM(x,y+1);
+				hr = inDEM(x+1,y);
+				if (h == DEM_NO_DATA || ha == DEM_NO_DATA || hr == DEM_NO_DATA)
+					dh = 0.0;
+				else {
+					ha -= h;
+					hr -= h;
+					dh = ha + hr;
+				}
+				scaled = (dh_max > 0.0) ? (dh / dh_max) : 0.0;
+				scaled = (scaled * 0.5 + 0.5) * 255.0;
+
+				if (h == DEM_NO_DATA)
+				{
+					row[x * outImage.channels  ] = scaled;
+					row[x * outImage.channels+1] = 0;
+					row[x * outImage.channels+2] = 0;
+				} else {
+					row[x * outImage.channels  ] = scaled;
+					row[x * outImage.channels+1] = scaled;
+					row[x * outImage.channels+2] = scaled;
+				}
+			}
+			break;
 /*
 	case dem_DDA:
 		for (y = 0; y < inDEM.mHeight; ++y)
@@ -523,6 +638,35 @@ int	DEMToBitmap(
 		}
 		break;
 */		
+		}
+	};
+
+	atomic<int>	next(0);
+	auto worker = [&]() {
+		int y;
+		while ((y = next++) < inDEM.mHeight)
+			color_row(y);
+	};
+
+	int num_threads = min(inDEM.mHeight, max(1, (int) thread::hardware_concurrency()));
+	vector<thread> threads;
+	for (int t = 1; t < num_threads; ++t)
+		threads.push_back(thread(worker));
+	worker();
+	for (auto& t : threads)
+		t.join();
+
+	if (inMode == dem_Shaded && table == gColorBands.end())
+	{
+		for (y = 0; y < (inDEM.mHeight-1); ++y)
+		for (ch = 0; ch < 3; ++ch)
+			outImage.data[(outImage.width-1 + y * outImage.width) * outImage.channels + ch] =
+			outImage.data[(outImage.width-2 + y * outImage.width) * outImage.channels + ch];
+		for (x = 0; x < inDEM.mWidth; ++x)
+		{
+			outImage.data[(x + (outImage.height-1) * outImage.width) * outImage.channels + ch] =
+			outImage.data[(x + (outImage.height-2) * outImage.width) * outImage.channels + ch];
+		}
 	}
 	return 0;
 }
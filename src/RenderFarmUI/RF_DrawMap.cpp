@@ -53,6 +53,100 @@ int g_color_face_with_supr = 0;
 int g_color_face_with_appr = 0;
 int g_color_face_use_supr_tint = 0;
 
+// Buckets per side of the grid the retained drawing arrays are split into.
+#define DRAW_BUCKET_GRID 32
+
+// Copies an element's color into "count" rgba entries of a drawing color array - halfedges have no alpha.
+static void	fill_draw_colors(unsigned char * dst, const unsigned char * src, int channels, int count)
+{
+	while(count--)
+	{
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = channels == 4 ? src[3] : 255;
+		dst += 4;
+	}
+}
+
+static void	BuildDrawBuckets(Pmwx& pmwx, PmwxIndex_t& index)
+{
+	index.draw_buckets.clear();
+	index.draw_face_slots.clear();
+
+	Bbox2	all;
+	for(Pmwx::Vertex_iterator v = pmwx.vertices_begin(); v != pmwx.vertices_end(); ++v)
+		all += Point2(v->data().mGL[0], v->data().mGL[1]);
+	if(all.is_null())
+		return;
+
+	index.draw_buckets.resize(DRAW_BUCKET_GRID * DRAW_BUCKET_GRID);
+
+	auto bucket_for = [&](const Bbox2& b) {
+		int x = all.xspan() > 0.0 ? (int) ((b.centroid().x() - all.xmin()) / all.xspan() * DRAW_BUCKET_GRID) : 0;
+		int y = all.yspan() > 0.0 ? (int) ((b.centroid().y() - all.ymin()) / all.yspan() * DRAW_BUCKET_GRID) : 0;
+		x = intlim(x, 0, DRAW_BUCKET_GRID-1);
+		y = intlim(y, 0, DRAW_BUCKET_GRID-1);
+		return x + y * DRAW_BUCKET_GRID;
+	};
+
+	for(Pmwx::Face_iterator f = pmwx.faces_begin(); f != pmwx.faces_end(); ++f)
+	if(!f->is_unbounded() && !f->data().mGLTris.empty())
+	{
+		const vector<const float *>& tris(f->data().mGLTris);
+		Bbox2	bounds;
+		for(vector<const float *>::const_iterator v = tris.begin(); v != tris.end(); ++v)
+			bounds += Point2((*v)[0], (*v)[1]);
+
+		int bn = bucket_for(bounds);
+		PmwxIndex_t::DrawBucket_t& b(index.draw_buckets[bn]);
+		b.bounds += bounds;
+		index.draw_face_slots[f] = pair<int,int>(bn, b.tri_faces.size());
+		b.tri_faces.push_back(f);
+		b.tri_starts.push_back(b.tri_pts.size() / 2);
+		for(vector<const float *>::const_iterator v = tris.begin(); v != tris.end(); ++v)
+		{
+			b.tri_pts.push_back((*v)[0]);
+			b.tri_pts.push_back((*v)[1]);
+		}
+		b.tri_colors.resize(b.tri_pts.size() * 2);
+		fill_draw_colors(&b.tri_colors[b.tri_starts.back() * 4], f->data().mGLColor, 4, tris.size());
+	}
+
+	for(Pmwx::Edge_iterator e = pmwx.edges_begin(); e != pmwx.edges_end(); ++e)
+	{
+		Bbox2	bounds(Point2(e->source()->data().mGL[0], e->source()->data().mGL[1]),
+					   Point2(e->target()->data().mGL[0], e->target()->data().mGL[1]));
+		PmwxIndex_t::DrawBucket_t& b(index.draw_buckets[bucket_for(bounds)]);
+		b.bounds += bounds;
+		for(int n = 0; n < 2; ++n)
+		{
+			Pmwx::Halfedge_handle h = n ? e->twin() : Pmwx::Halfedge_handle(e);
+			b.line_halfedges.push_back(h);
+			b.line_pts.push_back(h->source()->data().mGL[0]);
+			b.line_pts.push_back(h->source()->data().mGL[1]);
+			b.line_pts.push_back(h->target()->data().mGL[0]);
+			b.line_pts.push_back(h->target()->data().mGL[1]);
+			b.line_colors.resize(b.line_pts.size() * 2);
+			fill_draw_colors(&b.line_colors[b.line_colors.size() - 8], h->data().mGLColor, 3, 2);
+		}
+	}
+
+	for(vector<PmwxIndex_t::DrawBucket_t>::iterator b = index.draw_buckets.begin(); b != index.draw_buckets.end(); ++b)
+		b->tri_starts.push_back(b->tri_pts.size() / 2);
+}
+
+void	RecolorPmwxIndex(PmwxIndex_t& index)
+{
+	for(vector<PmwxIndex_t::DrawBucket_t>::iterator b = index.draw_buckets.begin(); b != index.draw_buckets.end(); ++b)
+	{
+		for(int f = 0; f < b->tri_faces.size(); ++f)
+			fill_draw_colors(&b->tri_colors[b->tri_starts[f] * 4], b->tri_faces[f]->data().mGLColor, 4, b->tri_starts[f+1] - b->tri_starts[f]);
+		for(int h = 0; h < b->line_halfedges.size(); ++h)
+			fill_draw_colors(&b->line_colors[h * 8], b->line_halfedges[h]->data().mGLColor, 3, 2);
+	}
+}
+
 void	IndexPmwx(Pmwx& pmwx, PmwxIndex_t& index)
 {
 	index.faces.clear();
@@ -99,7 +193,8 @@ void	IndexPmwx(Pmwx& pmwx, PmwxIndex_t& index)
 	index.vertices.insert(vertices.begin(),vertices.end());	
 	vertices.clear();
 	trim(vertices);
-	
+
+	BuildDrawBuckets(pmwx, index);
 }
 
 
@@ -658,7 +753,6 @@ void	DrawMapBucketed(
 //	double	screenHeight = screenTop - screenBottom;
 
 	vector<PmwxIndex_t::FaceTree::item_type>		faces;
-	vector<PmwxIndex_t::HalfedgeTree::item_type>	halfedges;
 	vector<PmwxIndex_t::VertexTree::item_type>		vertices;
 //	FindFaceTouchesRectFast(inMap,Point2(mapWest, mapSouth), Point2(mapEast, mapNorth), faces);
 //	FindHalfedgeTouchesRectFast(inMap,Point2(mapWest, mapSouth), Point2(mapEast, mapNorth), halfedges);
@@ -668,8 +762,6 @@ void	DrawMapBucketed(
 
 	faces.reserve(inMap.number_of_faces());
 	inIndex.faces.query<back_insert_iterator<vector<PmwxIndex_t::FaceTree::item_type> > > (box,back_inserter(faces));
-	halfedges.reserve(inMap.number_of_edges());
-	inIndex.halfedges.query(box, back_inserter(halfedges));
 	vertices.reserve(inMap.number_of_vertices());
 	inIndex.vertices.query(box, back_inserter(vertices));
 	
@@ -687,31 +779,46 @@ void	DrawMapBucketed(
 	 * DRAW FACES - SELECTED AND CONTAINING ZONING INFO
 	 ******************************************************************************************/
 
+#if DRAW_FACES || DRAW_EDGES
+	vector<PmwxIndex_t::DrawBucket_t *>	visible;
+	for(vector<PmwxIndex_t::DrawBucket_t>::iterator b = inIndex.draw_buckets.begin(); b != inIndex.draw_buckets.end(); ++b)
+	if(b->bounds.overlap(box))
+		visible.push_back(&*b);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+#endif
+
 #if DRAW_FACES
 	glDisable(GL_CULL_FACE);
-	glBegin(GL_TRIANGLES);
 
-	for (vector<PmwxIndex_t::FaceTree::item_type>::iterator fi = faces.begin(); fi != faces.end(); ++fi)
+	// Selected faces are tinted by patching their colors in place for this draw, then putting them back.
+	for(set<Pmwx::Face_handle>::const_iterator f = faceSel.begin(); f != faceSel.end(); ++f)
 	{
-		Pmwx::Face_handle f = fi->second;
-		if (!f->is_unbounded())
-		{
-			bool	sel = faceSel.count(f) > 0;
-			bool	draw = sel || f->data().mGLColor[3] != 0.0;
+		map<Face_handle, pair<int,int> >::iterator slot = inIndex.draw_face_slots.find(*f);
+		if(slot == inIndex.draw_face_slots.end()) continue;
+		PmwxIndex_t::DrawBucket_t& b(inIndex.draw_buckets[slot->second.first]);
+		int n = slot->second.second;
+		GLubyte	tint[4] = { (GLubyte) ((*f)->data().mGLColor[0] / 2 + 127), (GLubyte) ((*f)->data().mGLColor[1]/2), (GLubyte) ((*f)->data().mGLColor[2]/2), 200 };
+		fill_draw_colors(&b.tri_colors[b.tri_starts[n] * 4], tint, 4, b.tri_starts[n+1] - b.tri_starts[n]);
+	}
 
-			if (draw)
-			{
-				if (sel)
-					glColor4ub(f->data().mGLColor[0] / 2 + 127, f->data().mGLColor[1]/2, f->data().mGLColor[2]/2,200);
-				else
-					glColor4ubv(f->data().mGLColor);
+	for(vector<PmwxIndex_t::DrawBucket_t *>::iterator b = visible.begin(); b != visible.end(); ++b)
+	if(!(*b)->tri_pts.empty())
+	{
+		glVertexPointer(2, GL_FLOAT, 0, &(*b)->tri_pts[0]);
+		glColorPointer(4, GL_UNSIGNED_BYTE, 0, &(*b)->tri_colors[0]);
+		glDrawArrays(GL_TRIANGLES, 0, (*b)->tri_pts.size() / 2);
+	}
 
-				for(vector<const float *>::const_iterator v = f->data().mGLTris.begin(); v != f->data().mGLTris.end(); ++v)
-					glVertex2fv(*v);
-			}
-		}
+	for(set<Pmwx::Face_handle>::const_iterator f = faceSel.begin(); f != faceSel.end(); ++f)
+	{
+		map<Face_handle, pair<int,int> >::iterator slot = inIndex.draw_face_slots.find(*f);
+		if(slot == inIndex.draw_face_slots.end()) continue;
+		PmwxIndex_t::DrawBucket_t& b(inIndex.draw_buckets[slot->second.first]);
+		int n = slot->second.second;
+		fill_draw_colors(&b.tri_colors[b.tri_starts[n] * 4], (*f)->data().mGLColor, 4, b.tri_starts[n+1] - b.tri_starts[n]);
 	}
-	glEnd();
 #endif
 
 	/******************************************************************************************
@@ -719,31 +826,37 @@ void	DrawMapBucketed(
 	 ******************************************************************************************/
 
 #if DRAW_EDGES
-	glBegin(GL_LINES);
-	int	width = 1;
-	for (vector<PmwxIndex_t::HalfedgeTree::item_type>::iterator he = halfedges.begin(); he != halfedges.end(); ++he)
-	for(int n = 0; n < 2; ++n)
+	for(vector<PmwxIndex_t::DrawBucket_t *>::iterator b = visible.begin(); b != visible.end(); ++b)
+	if(!(*b)->line_pts.empty())
 	{
-		Pmwx::Halfedge_handle e = n ? he->second->twin() : he->second;
+		glVertexPointer(2, GL_FLOAT, 0, &(*b)->line_pts[0]);
+		glColorPointer(4, GL_UNSIGNED_BYTE, 0, &(*b)->line_colors[0]);
+		glDrawArrays(GL_LINES, 0, (*b)->line_pts.size() / 2);
+	}
+#endif
+
+#if DRAW_FACES || DRAW_EDGES
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+#endif
+
+#if DRAW_EDGES
+	// Selected edges go over the top, wider - both sides of the edge, as either side may be the one selected.
+	if(!edgeSel.empty())
+	{
+		glLineWidth(2);
+		glBegin(GL_LINES);
+		for(set<Pmwx::Halfedge_handle>::const_iterator he = edgeSel.begin(); he != edgeSel.end(); ++he)
+		for(int n = 0; n < 2; ++n)
 		{
+			Pmwx::Halfedge_handle e = n ? (*he)->twin() : *he;
 			glColor3ubv(e->data().mGLColor);
-			int wantWidth = (edgeSel.find(e) != edgeSel.end() || edgeSel.find(e->twin()) != edgeSel.end()) ? 2 : 1;
-			if (width != wantWidth)
-			{
-				glEnd();
-				glLineWidth(wantWidth);
-				width = wantWidth;
-				glBegin(GL_LINES);
-			}
-
 			glVertex2fv(e->source()->data().mGL);
 			glVertex2fv(e->target()->data().mGL);
-
-//			draw_he(e);
 		}
+		glEnd();
+		glLineWidth(1);
 	}
-	glEnd();
-	glLineWidth(1);
 #endif
 
 	/******************************************************************************************
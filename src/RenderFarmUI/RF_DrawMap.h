@@ -49,6 +49,23 @@ struct PmwxIndex_t {
 	HalfedgeTree 	halfedges;
 	VertexTree		vertices;
 
+	// Retained drawing data: the faces' triangles and the edges' lines packed into client-side vertex and color arrays,
+	// one bucket per cell of a coarse grid over the map.  The map draw culls whole buckets against the view and draws
+	// each with one call per array.  Each face and edge lives in the bucket holding the center of its bounds; a
+	// bucket's bounds are the union of what it holds.
+	struct DrawBucket_t {
+		Bbox2					bounds;
+		vector<float>			tri_pts;			// x,y per triangle vertex
+		vector<unsigned char>	tri_colors;			// rgba per triangle vertex
+		vector<Face_handle>		tri_faces;			// one per face...
+		vector<int>				tri_starts;			// ...with its first vertex in tri_pts, plus the total at the end
+		vector<float>			line_pts;			// x,y per line vertex - each halfedge is a line from source to target
+		vector<unsigned char>	line_colors;		// rgba per line vertex
+		vector<Halfedge_handle>	line_halfedges;		// one per line
+	};
+	vector<DrawBucket_t>						draw_buckets;
+	map<Face_handle, pair<int,int> >			draw_face_slots;		// face -> bucket, index in tri_faces
+
 	void	IndexPmwx(Pmwx& pmwx, PmwxIndex_t& index);
 
 private:
@@ -56,7 +73,8 @@ private:
 	PmwxIndex_t& operator=(const PmwxIndex_t&);
 };
 
-void	IndexPmwx(Pmwx& pmwx, PmwxIndex_t& index);
+void	IndexPmwx(Pmwx& pmwx, PmwxIndex_t& index);			// Call after PrecalcOGL - copies its geometry and colors.
+void	RecolorPmwxIndex(PmwxIndex_t& index);				// Call after RecalcOGLColors - refreshes only the color arrays.
 
 	
 
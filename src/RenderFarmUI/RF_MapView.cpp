@@ -59,6 +59,8 @@
 
 #include "BitmapUtils.h"
 #include "TexUtils.h"
+#include <thread>
+#include <atomic>
 
 #if IBM
 #include "XWinGL.h"
@@ -253,6 +255,288 @@ float		sShadingDecl = 45;
 
 static int			sShowDEMData[DEMChoiceCount-1] = { 1, 0, 1, 0, 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 1, 1, 0, 0 };
 
+/***************************************************************************************************************************************
+ * RASTER LAYER CACHE
+ ***************************************************************************************************************************************
+
+	Showing a raster layer means resampling it to texture size, coloring every post and uploading the result with mip-maps.  For a big
+	DEM that is slow enough that flipping between layers stalls the UI.  So we keep the textures of the last few layers shown.  While a
+	layer is on screen, the layers on either side of it (in next/prev raster order) are colored on a background thread and uploaded when
+	they are done, so stepping through the layers usually just swaps textures.
+
+	A background job colors a private copy of its DEM, so the processing commands can go on editing gDem while it runs.  Any raster change
+	throws the whole cache away, and a job started before the change is thrown away when it finishes.
+
+	The view draws a layer as one texture, so the cache holds whole layers at texture size rather than tiles.  GL calls only happen
+	from the draw code - flushing the cache just queues the textures for deletion.
+
+ */
+
+#define	DEM_LAYER_CACHE_SIZE	6			// Layers whose textures we keep; each is up to 4096x4096.
+#define	DEM_RELIEF_KEY			-1			// Cache key for the shading made from dem_Elevation - other keys are kDEMs indices.
+
+struct	DEMLayerBits_t {
+	ImageInfo		color;					// data is NULL if there is no color bitmap
+	ImageInfo		relief;					// data is NULL if there is no shading bitmap
+	double			bounds[4];
+};
+
+struct	DEMLayerTex_t {
+	GLuint			color;					// 0 if none
+	float			color_s;
+	float			color_t;
+	GLuint			relief;					// 0 if none
+	float			relief_s;
+	float			relief_t;
+	double			bounds[4];
+	int				last_used;
+};
+
+struct	DEMLayerJob_t {
+	int				key;
+	int				generation;
+	DEMGeo			dem;					// Our own copy - gDem may change while we run.
+	DEMLayerBits_t	bits;
+	atomic<bool>	done;
+	thread			worker;
+};
+
+static map<int, DEMLayerTex_t>		sDEMLayers;
+static vector<GLuint>				sDEMDeadTex;
+static DEMLayerJob_t *				sDEMJob = NULL;
+static int							sDEMGeneration = 0;
+static int							sDEMUseCount = 0;
+
+static bool	dem_key_valid(int key)
+{
+	return key == DEM_RELIEF_KEY || (key > 0 && key < DEMChoiceCount);
+}
+
+static int	dem_key_param(int key)
+{
+	return key == DEM_RELIEF_KEY ? dem_Elevation : kDEMs[key].dem;
+}
+
+static int	dem_max_tex_dim(void)
+{
+	GLint maxDim;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE,&maxDim);
+	if(maxDim > 4096) maxDim = 4096;
+	return maxDim;
+}
+
+// Resamples and colors one layer - safe to call from any thread.
+static void	color_dem_layer(const DEMGeo& inMaster, int key, int maxDim, DEMLayerBits_t& outBits)
+{
+	outBits.color.data = NULL;
+	outBits.relief.data = NULL;
+
+	const DEMGeo *	master = &inMaster;
+	DEMGeo	resized;
+	int want_x = min(maxDim, master->mWidth);
+	int want_y = min(maxDim, master->mHeight);
+	if(want_x != master->mWidth || want_y != master->mHeight)
+	{
+		resized.resize(want_x,want_y);
+		resized.copy_geo_from(*master);
+		resized.mPost = master->mPost;
+		ResampleDEM(*master, resized);
+		master = &resized;
+	}
+
+	outBits.bounds[0] = master->x_to_lon_double(-0.5);
+	outBits.bounds[1] = master->y_to_lat_double(-0.5);
+	outBits.bounds[2] = master->x_to_lon_double((double) master->mWidth - 0.5);
+	outBits.bounds[3] = master->y_to_lat_double((double) master->mHeight - 0.5);
+
+	if (key != DEM_RELIEF_KEY)
+	if (DEMToBitmap(*master, outBits.color, kDEMs[key].view_mode) != 0)
+		outBits.color.data = NULL;
+
+	if (key == DEM_RELIEF_KEY || kDEMs[key].view_mode == dem_Elevation)
+	if (DEMToBitmap(*master, outBits.relief, dem_Normals) != 0)
+		outBits.relief.data = NULL;
+}
+
+// Uploads a colored layer into new textures and frees its bitmaps.
+static void	load_dem_layer(int key, DEMLayerBits_t& ioBits, DEMLayerTex_t& outTex)
+{
+	bool nearest = key != DEM_RELIEF_KEY && !kDEMs[key].interpolate;
+	outTex.color = outTex.relief = 0;
+	outTex.color_s = outTex.color_t = outTex.relief_s = outTex.relief_t = 1.0;
+	memcpy(outTex.bounds, ioBits.bounds, sizeof(outTex.bounds));
+	if (ioBits.color.data)
+	{
+		glGenTextures(1, &outTex.color);
+		if (!LoadTextureFromImage(ioBits.color, outTex.color, tex_Mipmap + (nearest ? 0 : tex_Linear), NULL, NULL, &outTex.color_s, &outTex.color_t))
+		{
+			glDeleteTextures(1, &outTex.color);
+			outTex.color = 0;
+		}
+		DestroyBitmap(&ioBits.color);
+	}
+	if (ioBits.relief.data)
+	{
+		glGenTextures(1, &outTex.relief);
+		if (!LoadTextureFromImage(ioBits.relief, outTex.relief, tex_Mipmap + (tex_Linear), NULL, NULL, &outTex.relief_s, &outTex.relief_t))
+		{
+			glDeleteTextures(1, &outTex.relief);
+			outTex.relief = 0;
+		}
+		DestroyBitmap(&ioBits.relief);
+	}
+}
+
+static void	kill_dem_layer(DEMLayerTex_t& tex)
+{
+	if (tex.color)	sDEMDeadTex.push_back(tex.color);
+	if (tex.relief)	sDEMDeadTex.push_back(tex.relief);
+}
+
+// Adds a layer to the cache, dropping the least recently used layers whose textures aren't in use (keep_1, keep_2) to make room.
+static DEMLayerTex_t *	store_dem_layer(int key, const DEMLayerTex_t& tex, GLuint keep_1, GLuint keep_2)
+{
+	DEMLayerTex_t& stored(sDEMLayers[key]);
+	stored = tex;
+	stored.last_used = ++sDEMUseCount;
+
+	while (sDEMLayers.size() > DEM_LAYER_CACHE_SIZE)
+	{
+		map<int, DEMLayerTex_t>::iterator victim = sDEMLayers.end();
+		for (map<int, DEMLayerTex_t>::iterator l = sDEMLayers.begin(); l != sDEMLayers.end(); ++l)
+		if (l->first != key)
+		if (keep_1 == 0 || (l->second.color != keep_1 && l->second.relief != keep_1))
+		if (keep_2 == 0 || (l->second.color != keep_2 && l->second.relief != keep_2))
+		if (victim == sDEMLayers.end() || l->second.last_used < victim->second.last_used)
+			victim = l;
+		if (victim == sDEMLayers.end())
+			break;
+		kill_dem_layer(victim->second);
+		sDEMLayers.erase(victim);
+	}
+	return &stored;
+}
+
+// Waits for the background job, if any, and files its layer.
+static void	finish_dem_job(GLuint keep_1, GLuint keep_2)
+{
+	if (sDEMJob == NULL) return;
+	sDEMJob->worker.join();
+	if (sDEMJob->generation == sDEMGeneration && sDEMLayers.count(sDEMJob->key) == 0)
+	{
+		DEMLayerTex_t	tex;
+		load_dem_layer(sDEMJob->key, sDEMJob->bits, tex);
+		store_dem_layer(sDEMJob->key, tex, keep_1, keep_2);
+	}
+	else
+	{
+		if (sDEMJob->bits.color.data)	DestroyBitmap(&sDEMJob->bits.color);
+		if (sDEMJob->bits.relief.data)	DestroyBitmap(&sDEMJob->bits.relief);
+	}
+	delete sDEMJob;
+	sDEMJob = NULL;
+}
+
+static void	start_dem_job(int key)
+{
+	DEMGeoMap::iterator dem = gDem.find(dem_key_param(key));
+	if (dem == gDem.end()) return;
+
+	DEMLayerJob_t * job = new DEMLayerJob_t;
+	job->key = key;
+	job->generation = sDEMGeneration;
+	job->dem = dem->second;
+	job->bits.color.data = NULL;
+	job->bits.relief.data = NULL;
+	job->done = false;
+	int maxDim = dem_max_tex_dim();
+	job->worker = thread([job, maxDim]() {
+		try {
+			color_dem_layer(job->dem, job->key, maxDim, job->bits);
+		} catch (...) {
+			if (job->bits.color.data)	DestroyBitmap(&job->bits.color);
+			if (job->bits.relief.data)	DestroyBitmap(&job->bits.relief);
+			job->bits.color.data = NULL;
+			job->bits.relief.data = NULL;
+		}
+		job->dem.resize(0,0);
+		job->done = true;
+	});
+	sDEMJob = job;
+}
+
+// Throws away every cached layer - call when any raster changes.
+static void	flush_dem_layers(void)
+{
+	++sDEMGeneration;
+	for (map<int, DEMLayerTex_t>::iterator l = sDEMLayers.begin(); l != sDEMLayers.end(); ++l)
+		kill_dem_layer(l->second);
+	sDEMLayers.clear();
+}
+
+// Returns a layer from the cache, coloring it now if it is neither cached nor being colored in the background.
+// Returns NULL if the layer's DEM isn't loaded.
+static DEMLayerTex_t *	fetch_dem_layer(int key, GLuint keep_1, GLuint keep_2)
+{
+	if (sDEMJob && sDEMJob->key == key)
+		finish_dem_job(keep_1, keep_2);
+
+	map<int, DEMLayerTex_t>::iterator l = sDEMLayers.find(key);
+	if (l != sDEMLayers.end())
+	{
+		l->second.last_used = ++sDEMUseCount;
+		return &l->second;
+	}
+
+	DEMGeoMap::iterator dem = gDem.find(dem_key_param(key));
+	if (dem == gDem.end())
+		return NULL;
+
+	DEMLayerBits_t	bits;
+	DEMLayerTex_t	tex;
+	color_dem_layer(dem->second, key, dem_max_tex_dim(), bits);
+	load_dem_layer(key, bits, tex);
+	return store_dem_layer(key, tex, keep_1, keep_2);
+}
+
+// Called every frame: deletes dead textures, files a finished background job and starts coloring the next layer the user is likely
+// to look at.
+static void	poll_dem_layers(int current, GLuint keep_1, GLuint keep_2)
+{
+	if (!sDEMDeadTex.empty())
+	{
+		glDeleteTextures(sDEMDeadTex.size(), &sDEMDeadTex[0]);
+		sDEMDeadTex.clear();
+	}
+
+	if (sDEMJob)
+	{
+		if (!sDEMJob->done)
+			return;
+		finish_dem_job(keep_1, keep_2);
+	}
+
+	if (!dem_key_valid(current) || current == DEM_RELIEF_KEY)
+		return;
+
+	// Same walk as the next/prev raster commands.
+	for (int dir = 1; dir >= -1; dir -= 2)
+	{
+		int n = current;
+		for (int i = 0; i < DEMChoiceCount; ++i)
+		{
+			n = (n + dir + DEMChoiceCount) % DEMChoiceCount;
+			if (gDem.count(kDEMs[n].dem))
+				break;
+		}
+		if (n != current && dem_key_valid(n) && gDem.count(kDEMs[n].dem) && sDEMLayers.count(n) == 0)
+		{
+			start_dem_job(n);
+			return;
+		}
+	}
+}
+
 
 void	RF_MapView_HandleMenuCommand(void *, void *);
 void	RF_MapView_HandleDEMMenuCommand(void *, void *);
@@ -348,6 +632,7 @@ int		RF_MapView::HandleCommand(int command)
 		mNeedRecalcDEM = true;
 		return 1;
 	case viewCmd_RecalcDEM:
+		flush_dem_layers();
 		mNeedRecalcDEM = true;
 		mNeedRecalcRelief = true;
 		return 1;
@@ -500,8 +785,8 @@ RF_MapView::RF_MapView(GUI_Commander * cmdr) : GUI_Commander(cmdr),
 	mDLMeshLine = 0;
 	mDLMeshFill = 0;
 
-	glGenTextures(1, &mTexID);
-	glGenTextures(1, &mReliefID);
+	mTexID = 0;						// The raster layer textures belong to the layer cache.
+	mReliefID = 0;
 	glGenTextures(1, &mFlowID);
 	mHasTex = false;
 	mHasRelief = false;
@@ -526,6 +811,9 @@ RF_MapView::~RF_MapView()
 	if (mDLMeshLine != 0)	glDeleteLists(mDLMeshLine, MESH_BUCKET_SIZE * MESH_BUCKET_SIZE + 1);
 	if (mDLMeshFill != 0)	glDeleteLists(mDLMeshFill, MESH_BUCKET_SIZE * MESH_BUCKET_SIZE + 1);
 
+	flush_dem_layers();
+	finish_dem_job(0, 0);
+
 	delete mZoomer;
 	for(int n = 0; n < mTools.size(); ++n)
 		delete mTools[n];
@@ -667,6 +955,7 @@ void	RF_MapView::Draw(GUI_GraphState * state)
 		{
 //			RF_ProgressFunc(0, 1, "Updating graphics for vector map...", 0.0);
 			RecalcOGLColors(gMap,RF_ProgressFunc);
+			RecolorPmwxIndex(gMapIndex);
 //			RF_ProgressFunc(0, 1, "Updating graphics for vector map...", 1.0);
 		}
 
@@ -877,6 +1166,7 @@ void	RF_MapView::Draw(GUI_GraphState * state)
 			mNeedRecalcRelief = false;
 		mNeedRecalcDEM = false;
 	}
+	poll_dem_layers(sDEMType, mHasTex ? mTexID : 0, mHasRelief ? mReliefID : 0);
 
 	if (mHasTex)
 	{
@@ -1513,6 +1803,7 @@ void	RF_MapView::HandleNotification(int catagory, int message, void * param)
 		switch(message) {
 		case rf_Msg_FileLoaded:
 			{
+				flush_dem_layers();
 				mNeedRecalcMapFull = true;
 				mNeedRecalcMapMeta = true;
 				mNeedRecalcDEM = true;
@@ -1556,6 +1847,7 @@ void	RF_MapView::HandleNotification(int catagory, int message, void * param)
 			}
 			break;
 		case rf_Msg_RasterChange:
+			flush_dem_layers();
 			mNeedRecalcDEM = true;
 			mNeedRecalcRelief = true;
 			break;
@@ -1593,93 +1885,46 @@ bool	RF_MapView::RecalcDEM(bool do_relief)
 		return false;
 	}
 
-	ImageInfo	image;
-	double	south, north, east, west;
-
-	mZoomer->GetMapVisibleBounds(west, south, east, north);
-
-	DEMGeo	sub;
-	int param = kDEMs[sDEMType].dem;
 	int mode = 	kDEMs[sDEMType].view_mode;
-	bool nearest = !kDEMs[sDEMType].interpolate;
 
-	if (gDem.find(param) == gDem.end())
+	DEMLayerTex_t * layer = fetch_dem_layer(sDEMType, mTexID, mReliefID);
+	if (layer == NULL)
 	{
 		mHasTex = false;
 		return false;
 	}
 
-	const DEMGeo *	master = &gDem[param];
-	DEMGeo	resized;
-	
-	GLint maxDim;
-	glGetIntegerv(GL_MAX_TEXTURE_SIZE,&maxDim);
-	if(maxDim > 4096) maxDim = 4096;
-
-	int want_x = min(maxDim, master->mWidth);
-	int want_y = min(maxDim, master->mHeight);
-	if(want_x != master->mWidth || want_y != master->mHeight)
+	if (layer->color)
 	{
-		resized.resize(want_x,want_y);
-		resized.copy_geo_from(*master);
-		resized.mPost = master->mPost;
-		ResampleDEM(*master, resized);
-		master = &resized;
-	}
+		memcpy(mDEMBounds, layer->bounds, sizeof(mDEMBounds));
+		mTexID = layer->color;
+		mTexS = layer->color_s;
+		mTexT = layer->color_t;
+		mHasTex = true;
 
-	if (DEMToBitmap(*master, image, mode) == 0)
-	{
-		mDEMBounds[0] = master->x_to_lon_double(-0.5);
-		mDEMBounds[1] = master->y_to_lat_double(-0.5);
-		mDEMBounds[2] = master->x_to_lon_double((double) master->mWidth - 0.5);
-		mDEMBounds[3] = master->y_to_lat_double((double) master->mHeight - 0.5);
-
-		if (LoadTextureFromImage(image, mTexID, tex_Mipmap + (nearest ? 0 : tex_Linear), NULL, NULL, &mTexS, &mTexT))
+		if(mode == dem_Elevation && layer->relief)
 		{
-			mHasTex = true;
-		}
-		DestroyBitmap(&image);
-		
-		if(mode == dem_Elevation)
-		{
-			if (DEMToBitmap(*master, image, dem_Normals) == 0)
-			{
-				if (LoadTextureFromImage(image, mReliefID, tex_Mipmap + (tex_Linear), NULL, NULL, &mReliefS, &mReliefT))
-				{
-					mHasRelief = true;
-				}
-				DestroyBitmap(&image);			
-				do_relief = false;
-			}
+			mReliefID = layer->relief;
+			mReliefS = layer->relief_s;
+			mReliefT = layer->relief_t;
+			mHasRelief = true;
+			do_relief = false;
 		}
 	}
+	else
+		mHasTex = false;
 
 	if (do_relief)
 	{
-		if (gDem.count(dem_Elevation) == 0)
+		DEMLayerTex_t * relief = fetch_dem_layer(DEM_RELIEF_KEY, mTexID, mReliefID);
+		if (relief == NULL)
 			mHasRelief = false;
-		else {
-			const DEMGeo *	master = &gDem[dem_Elevation];
-			DEMGeo resized;
-			int want_x = min(maxDim, master->mWidth);
-			int want_y = min(maxDim, master->mHeight);
-			if(want_x != master->mWidth || want_y != master->mHeight)
-			{
-				resized.resize(want_x,want_y);
-				resized.copy_geo_from(*master);
-				resized.mPost = master->mPost;
-				ResampleDEM(*master, resized);
-				master = &resized;
-			}
-
-			if (DEMToBitmap(*master, image, dem_Normals) == 0)
-			{
-				if (LoadTextureFromImage(image, mReliefID, tex_Mipmap + (tex_Linear), NULL, NULL, &mReliefS, &mReliefT))
-				{
-					mHasRelief = true;
-				}
-				DestroyBitmap(&image);
-			}
+		else if (relief->relief)
+		{
+			mReliefID = relief->relief;
+			mReliefS = relief->relief_s;
+			mReliefT = relief->relief_t;
+			mHasRelief = true;
 		}
 	}
 	return true;
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2026, Laminar Research.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "BatchUtils.h"
+#include "FileUtils.h"
+#include "PlatformUtils.h"
+#include <time.h>
+
+#if !IBM
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+#define BATCH_DONE_FILE		"batch_done.txt"
+#define BATCH_FAILED_FILE	"batch_failed.txt"
+#define BATCH_POLL_SECS		1				// how often we look at memory while tiles are running
+
+bool	BatchParseTile(const string& tile, int& west, int& south)
+{
+	int n = 0;
+	if(sscanf(tile.c_str(), "%d%d%n", &south, &west, &n) != 2 || n != tile.size())
+		return false;
+	return south >= -90 && south < 90 && west >= -180 && west < 180;
+}
+
+string	BatchExpandTile(const string& str, const string& tile)
+{
+	int west = 0, south = 0;
+	BatchParseTile(tile, west, south);
+
+	static const char * keys[5] = { "$TILE", "$WEST", "$SOUTH", "$EAST", "$NORTH" };
+	string vals[5] = { tile, to_string(west), to_string(south), to_string(west+1), to_string(south+1) };
+
+	string r(str);
+	for(int k = 0; k < 5; ++k)
+	{
+		string::size_type p;
+		while((p = r.find(keys[k])) != r.npos)
+			r.replace(p, strlen(keys[k]), vals[k]);
+	}
+	return r;
+}
+
+bool	BatchReadTileList(const char * path, vector<string>& tiles)
+{
+	FILE * fi = fopen(path, "r");
+	if(!fi)
+		return false;
+	char buf[1024];
+	while(fgets(buf, sizeof(buf), fi))
+	{
+		char * c = strchr(buf, '#');
+		if(c) *c = 0;
+		char tile[256];
+		if(sscanf(buf, "%255s", tile) == 1)
+			tiles.push_back(tile);
+	}
+	fclose(fi);
+	return true;
+}
+
+static void	read_list(const string& path, set<string>& tiles)
+{
+	vector<string> v;
+	if(BatchReadTileList(path.c_str(), v))
+		tiles.insert(v.begin(), v.end());
+}
+
+static void	append_list(const string& path, const string& tile)
+{
+	FILE * fi = fopen(path.c_str(), "a");
+	if(fi)
+	{
+		fprintf(fi, "%s\n", tile.c_str());
+		fclose(fi);
+	}
+}
+
+void	BatchResetFailed(const string& log_dir)
+{
+	string failed_path = log_dir + DIR_STR BATCH_FAILED_FILE;
+	FILE_delete_file(failed_path.c_str(), false);
+}
+
+#if !IBM
+
+// Bytes the machine can still hand out, or -1 if we can't tell.
+static double	mem_available(void)
+{
+#if LIN
+	FILE * fi = fopen("/proc/meminfo", "r");
+	if(fi)
+	{
+		char buf[256];
+		double kb = -1;
+		while(fgets(buf, sizeof(buf), fi))
+		if(sscanf(buf, "MemAvailable: %lf", &kb) == 1)
+			break;
+		fclose(fi);
+		if(kb >= 0)
+			return kb * 1024.0;
+	}
+#endif
+	return -1;
+}
+
+// Resident bytes of a child, or 0 if we can't tell.
+static double	mem_resident(pid_t pid)
+{
+#if LIN
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/statm", (int) pid);
+	FILE * fi = fopen(path, "r");
+	if(fi)
+	{
+		long total = 0, resident = 0;
+		int got = fscanf(fi, "%ld %ld", &total, &resident);
+		fclose(fi);
+		if(got == 2)
+			return (double) resident * (double) sysconf(_SC_PAGESIZE);
+	}
+#endif
+	return 0;
+}
+
+struct	batch_job {
+	string	tile;
+	time_t	start;
+};
+
+int		BatchRunTiles(const BatchSpec_t& spec, BatchTile_f func, void * ref)
+{
+	FILE_make_dir_exist(spec.log_dir.c_str());
+	string done_path = spec.log_dir + DIR_STR BATCH_DONE_FILE;
+	string failed_path = spec.log_dir + DIR_STR BATCH_FAILED_FILE;
+
+	set<string> done;
+	read_list(done_path, done);
+
+	vector<string> todo;
+	for(vector<string>::const_iterator t = spec.tiles.begin(); t != spec.tiles.end(); ++t)
+	if(done.count(*t) == 0)
+		todo.push_back(*t);
+	printf("Batch: %d tiles, %d already done, %d to go.\n", (int) spec.tiles.size(), (int) (spec.tiles.size() - todo.size()), (int) todo.size());
+
+	int max_jobs = spec.max_jobs;
+	if(max_jobs <= 0)
+		max_jobs = max(1, (int) sysconf(_SC_NPROCESSORS_ONLN));
+
+	map<pid_t, batch_job>	running;
+	int						next = 0, finished = 0, failed = 0;
+
+	while(next < todo.size() || !running.empty())
+	{
+		// Start tiles while we have slots and memory.
+		while(next < todo.size() && running.size() < max_jobs)
+		{
+			if(spec.mem_per_job > 0.0 && !running.empty())
+			{
+				double avail = mem_available();
+				if(avail >= 0.0)
+				{
+					for(map<pid_t, batch_job>::iterator r = running.begin(); r != running.end(); ++r)
+						avail -= max(0.0, spec.mem_per_job - mem_resident(r->first));
+					if(avail < spec.mem_per_job)
+						break;
+				}
+			}
+
+			const string& tile(todo[next++]);
+			string log_path = spec.log_dir + DIR_STR + tile + ".log";
+
+			fflush(stdout);
+			fflush(stderr);
+			pid_t pid = fork();
+			if(pid == 0)
+			{
+				int log = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				if(log >= 0)
+				{
+					dup2(log, STDOUT_FILENO);
+					dup2(log, STDERR_FILENO);
+					close(log);
+				}
+				int result = func(tile, ref);
+				fflush(stdout);
+				fflush(stderr);
+				_exit(result);
+			}
+			if(pid < 0)
+			{
+				perror("Batch: could not fork");
+				--next;
+				if(running.empty())
+					return todo.size() - finished + failed;
+				break;
+			}
+			batch_job job;
+			job.tile = tile;
+			job.start = time(NULL);
+			running[pid] = job;
+		}
+
+		// Collect whatever finished; if nothing did, wait a bit - memory may have freed up or a tile may finish.
+		int status;
+		pid_t pid = waitpid(-1, &status, running.size() < max_jobs && next < todo.size() ? WNOHANG : 0);
+		if(pid <= 0)
+		{
+			if(pid < 0 && running.empty())
+				break;
+			sleep(BATCH_POLL_SECS);
+			continue;
+		}
+		map<pid_t, batch_job>::iterator j = running.find(pid);
+		if(j == running.end())
+			continue;
+
+		bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		++finished;
+		if(ok)
+			append_list(done_path, j->second.tile);
+		else
+		{
+			++failed;
+			append_list(failed_path, j->second.tile);
+		}
+
+		if(WIFSIGNALED(status))
+			printf("Batch: [%d/%d] %s killed by signal %d after %ds.\n", finished, (int) todo.size(), j->second.tile.c_str(),
+							WTERMSIG(status), (int) (time(NULL) - j->second.start));
+		else
+			printf("Batch: [%d/%d] %s %s (exit %d) after %ds.\n", finished, (int) todo.size(), j->second.tile.c_str(),
+							ok ? "done" : "FAILED", WEXITSTATUS(status), (int) (time(NULL) - j->second.start));
+		running.erase(j);
+	}
+
+	printf("Batch: %d tiles run, %d failed.\n", finished, failed);
+	return failed;
+}
+
+#else
+
+int		BatchRunTiles(const BatchSpec_t& spec, BatchTile_f func, void * ref)
+{
+	FILE_make_dir_exist(spec.log_dir.c_str());
+	string done_path = spec.log_dir + DIR_STR BATCH_DONE_FILE;
+	string failed_path = spec.log_dir + DIR_STR BATCH_FAILED_FILE;
+
+	set<string> done;
+	read_list(done_path, done);
+
+	int failed = 0;
+	for(vector<string>::const_iterator t = spec.tiles.begin(); t != spec.tiles.end(); ++t)
+	if(done.count(*t) == 0)
+	{
+		printf("Batch: %s\n", t->c_str());
+		if(func(*t, ref) == 0)
+			append_list(done_path, *t);
+		else
+		{
+			++failed;
+			append_list(failed_path, *t);
+		}
+	}
+	printf("Batch: %d failed.\n", failed);
+	return failed;
+}
+
+#endif
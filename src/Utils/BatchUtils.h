@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2026, Laminar Research.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#ifndef BATCHUTILS_H
+#define BATCHUTILS_H
+
+/*
+	BatchUtils - THEORY OF OPERATION
+
+	Runs a list of tiles through some per-tile work, several tiles at a time, each in its own process forked from the
+	caller.  Because the children are forked, they start with everything the parent already set up - the config tables
+	in particular - so that init is paid once per batch, yet every tile still gets a clean address space: a tile that
+	crashes or leaks can't hurt the others.
+
+	Each tile's stdout and stderr go to <log_dir>/<tile>.log.  Tiles that succeed are appended to
+	<log_dir>/batch_done.txt as they finish, and are skipped when the same batch is run again - so an interrupted batch
+	just picks up where it stopped.  Failed tiles are listed in batch_failed.txt and are retried on the next run.
+	BatchRunTiles only appends to batch_failed.txt, so a caller that runs several batches into one log dir (one per
+	region, say) gets all of their failures; call BatchResetFailed once before the first of them.
+
+	Concurrency is capped by the job count and by memory: a tile is only started if the machine has mem_per_job bytes
+	available beyond what the tiles already running are expected to still grow into.  At least one tile always runs.
+
+	Windows has no fork, so there the tiles simply run one after another in this process.
+*/
+
+// Called in the child process for one tile - returns the exit status, 0 for success.
+typedef int (* BatchTile_f)(const string& tile, void * ref);
+
+struct	BatchSpec_t {
+	vector<string>		tiles;
+	string				log_dir;
+	int					max_jobs;		// 0 = one per CPU
+	double				mem_per_job;	// bytes a tile is expected to need at its peak, 0 = don't check memory
+
+	BatchSpec_t() : max_jobs(0), mem_per_job(0.0) { }
+};
+
+// Runs the batch; returns the number of tiles that failed.
+int		BatchRunTiles(const BatchSpec_t& spec, BatchTile_f func, void * ref);
+
+// Empties <log_dir>/batch_failed.txt before a run.
+void	BatchResetFailed(const string& log_dir);
+
+// Reads a tile list: one tile per line, like +42-072 (lat, lon of the SW corner); blank lines and # comments are skipped.
+bool	BatchReadTileList(const char * path, vector<string>& tiles);
+
+// Parses a tile name, returns false if it isn't one.
+bool	BatchParseTile(const string& tile, int& west, int& south);
+
+// Replaces $TILE, $WEST, $SOUTH, $EAST and $NORTH in str with the tile's name and bounds.
+string	BatchExpandTile(const string& str, const string& tile);
+
+#endif /* BATCHUTILS_H */
@@ -31,6 +31,9 @@
 
 #include <errno.h>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 #if IBM
 #include "GUI_Unicode.h"
@@ -1130,16 +1133,20 @@ int		CreateBitmapFromJPEGData(void * inBytes, int inLength, struct ImageInfo * o
 void my_error  (png_structp,png_const_charp err){}
 void my_warning(png_structp,png_const_charp err){}
 
-const char *			png_start_pos 	= NULL;
-const char *			png_end_pos 	= NULL;
-const char *			png_current_pos	= NULL;
+// Read position for one CreateBitmapFromPNGData call, passed as the png io pointer so that several
+// threads can decode PNGs at once.
+struct png_mem_reader {
+	const char *	current_pos;
+	const char *	end_pos;
+};
 
 void png_buffered_read_func(png_structp png_ptr, png_bytep data, png_size_t length)
 {
-   if((png_current_pos+length)>png_end_pos)
+   png_mem_reader * r = (png_mem_reader *) png_get_io_ptr(png_ptr);
+   if((r->current_pos+length)>r->end_pos)
 		png_error(png_ptr,"PNG Read Error, overran end of buffer!");
-   memcpy(data,png_current_pos,length);
-   png_current_pos+=length;
+   memcpy(data,r->current_pos,length);
+   r->current_pos+=length;
 }
 
 // PNG is 0,0 = upper left so we vertically flip.  Lib gives us image in any component order we want.
@@ -1180,6 +1187,7 @@ int		CreateBitmapFromPNGData(const void * inStart, int inLength, struct ImageInf
 	png_infop		infoPtr = NULL;
 	outImageInfo->data = NULL;
 	char** 			rows = NULL;
+	png_mem_reader	reader;
 
 	pngPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING,(png_voidp)NULL,my_error,my_warning);
 	if(!pngPtr) goto bail;
@@ -1187,11 +1195,10 @@ int		CreateBitmapFromPNGData(const void * inStart, int inLength, struct ImageInf
 	infoPtr=png_create_info_struct(pngPtr);
 	if(!infoPtr) goto bail;
 
-	png_start_pos = (const char *) inStart;
-	png_current_pos = (const char *) inStart;
-	png_end_pos = (const char *) inStart + inLength;
+	reader.current_pos = (const char *) inStart;
+	reader.end_pos = (const char *) inStart + inLength;
 
-	if (png_sig_cmp((unsigned char *) png_current_pos,0,8)) goto bail;
+	if (png_sig_cmp((unsigned char *) reader.current_pos,0,8)) goto bail;
 
 	png_set_interlace_handling(pngPtr);
 
@@ -1201,8 +1208,8 @@ int		CreateBitmapFromPNGData(const void * inStart, int inLength, struct ImageInf
 	}
 
 	png_init_io      (pngPtr,NULL						);
-	png_set_read_fn  (pngPtr,NULL,png_buffered_read_func);
-	png_set_sig_bytes(pngPtr,8							);	png_current_pos+=8;
+	png_set_read_fn  (pngPtr,&reader,png_buffered_read_func);
+	png_set_sig_bytes(pngPtr,8							);	reader.current_pos+=8;
 	png_read_info	 (pngPtr,infoPtr					);
 
 	png_get_IHDR(pngPtr,infoPtr,&width,&height,
@@ -1707,26 +1714,163 @@ static void swap_bgra_y(struct ImageInfo& i)
 	}
 }
 
+/*	DDS ENCODE POOL
+
+	squish compresses every 4x4 block on its own, so a mip level can be cut into bands of whole block
+	rows and each band compressed by a different thread straight into its place in the output.  The
+	result is byte for byte what one CompressImage call over the whole level gives.
+
+	The pool is a plain job queue.  Each file being written has a dds_encode that counts its queued
+	bands.  The writer queues a level as soon as it is ready, goes on filtering the next one, and at
+	the end runs queued bands itself until all of its own are done rather than just sleep.  Encodes
+	sharing a pool share its threads, so many files at once still means one worker per core.
+*/
+
+#define DDS_BAND_PIXELS		(128*128)		// Aim for bands about this big - small enough to spread a 256x256 level around
+
+struct DDS_encode_job {
+	const unsigned char *	src;
+	int						width;
+	int						height;
+	void *					dst;
+	int						flags;
+	int *					pending;		// Owner's count of unfinished bands
+};
+
+struct DDS_encode_pool {
+	mutex					lock;
+	condition_variable		work_cv;		// New jobs or quit
+	condition_variable		done_cv;		// Some owner's pending count hit zero
+	deque<DDS_encode_job>	jobs;
+	vector<thread>			workers;
+	bool					quit;
+
+	// Pop the next job and run it.  Called with lock held, returns with it held.
+	void	run_one(unique_lock<mutex>& l)
+	{
+		DDS_encode_job j = jobs.front();
+		jobs.pop_front();
+		l.unlock();
+		squish::CompressImage(j.src, j.width, j.height, j.dst, j.flags);
+		l.lock();
+		if(--*j.pending == 0)
+			done_cv.notify_all();
+	}
+
+	void	worker()
+	{
+		unique_lock<mutex> l(lock);
+		while(1)
+		{
+			while(!quit && jobs.empty())
+				work_cv.wait(l);
+			if(jobs.empty())
+				return;
+			run_one(l);
+		}
+	}
+};
+
+DDS_encode_pool *	DDS_encode_pool_create(int threads)
+{
+	if(threads <= 0)
+		threads = max(1, (int) thread::hardware_concurrency());
+	DDS_encode_pool * pool = new DDS_encode_pool;
+	pool->quit = false;
+	for(int i = 0; i < threads; ++i)
+		pool->workers.push_back(thread(&DDS_encode_pool::worker, pool));
+	return pool;
+}
+
+void	DDS_encode_pool_destroy(DDS_encode_pool * pool)
+{
+	{
+		lock_guard<mutex> l(pool->lock);
+		pool->quit = true;
+	}
+	pool->work_cv.notify_all();
+	for(vector<thread>::iterator t = pool->workers.begin(); t != pool->workers.end(); ++t)
+		t->join();
+	delete pool;
+}
+
+// Shared by every WriteBitmapToDDS_MT caller that does not bring its own pool.  Never torn down.
+static DDS_encode_pool * dds_default_pool()
+{
+	static DDS_encode_pool * pool = DDS_encode_pool_create(0);
+	return pool;
+}
+
+struct dds_encode {
+	DDS_encode_pool *	pool;
+	int					pending;
+
+	dds_encode(DDS_encode_pool * p) : pool(p), pending(0) { }
+	~dds_encode() { wait(); }
+
+	// Queue one RGBA level (no row padding) to be compressed into dst.
+	void	compress(const ImageInfo& level, void * dst, int flags)
+	{
+		int band = max(4, (int) (DDS_BAND_PIXELS / level.width) & ~3);
+		{
+			lock_guard<mutex> l(pool->lock);
+			for(int y = 0; y < level.height; y += band)
+			{
+				DDS_encode_job j;
+				j.src = level.data + y * level.width * 4;
+				j.width = level.width;
+				j.height = min(band, (int) level.height - y);
+				j.dst = (unsigned char *) dst + squish::GetStorageRequirements(level.width, y, flags);	// y is a multiple of 4
+				j.flags = flags;
+				j.pending = &pending;
+				pool->jobs.push_back(j);
+				++pending;
+			}
+		}
+		pool->work_cv.notify_all();
+	}
+
+	void	wait()
+	{
+		if(!pool) return;
+		unique_lock<mutex> l(pool->lock);
+		while(pending > 0)
+		{
+			if(!pool->jobs.empty())
+				pool->run_one(l);
+			else
+				pool->done_cv.wait(l);
+		}
+	}
+};
+
+// Compressed size of every level of a full mip chain, back to back.
+static int dds_mip_chain_size(int width, int height, int flags, int * out_mips)
+{
+	int total = 0, mips = 1;
+	while(1)
+	{
+		total += squish::GetStorageRequirements(width, height, flags);
+		if(width == 1 && height == 1) break;
+		if(width > 1) width >>= 1;
+		if(height > 1) height >>= 1;
+		++mips;
+	}
+	if(out_mips) *out_mips = mips;
+	return total;
+}
+
 // Compressed DDS.
-int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma)
+int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma, DDS_encode_pool * pool)
 {
 	Assert(ioImage.channels == 4);//Your number of channels better equal 4 or else
 	FILE * fi = fopen(file_name,"wb");
 	if (fi == NULL) return -1;
-	vector<unsigned char>	src_v, dst_v;
-	int flags = (dxt == 1 ? squish::kDxt1 : (dxt == 3 ? squish::kDxt3 : squish::kDxt5));
-	dst_v.resize(squish::GetStorageRequirements(ioImage.width,ioImage.height,flags));
-	unsigned char * dst_mem = &*dst_v.begin();
+	int flags = (dxt == 1 ? squish::kDxt1 : (dxt == 3 ? squish::kDxt3 : squish::kDxt5)) | squish::kColourIterativeClusterFit;
 
-	int x = ioImage.width;
-	int y = ioImage.height;
-	int mips=1;
-	while(x > 1 || y > 1)
-	{
-		x >>= 1;
-		y >>= 1;
-		++mips;
-	}
+	int mips;
+	vector<unsigned char>	dst_v(dds_mip_chain_size(ioImage.width, ioImage.height, flags, &mips));
+	unsigned char * dst_mem = &*dst_v.begin();
 
 	struct ImageInfo img(ioImage);
 
@@ -1734,20 +1878,32 @@ int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name,
 	if(!use_win_gamma) header.ddsCaps.dwCaps=SWAP32(DDSCAPS_TEXTURE|DDSCAPS_MIPMAP|DDSCAPS_COMPLEX);
 	fwrite(&header,sizeof(header),1,fi);
 
-	do {
+	{
+		dds_encode enc(pool);
+		do {
 
-		// Get the image into RGBA upper left origin, that's what Squish/DXT/DDS wants.
-		swap_bgra_y(img);
+			// Get the image into RGBA upper left origin, that's what Squish/DXT/DDS wants.
+			swap_bgra_y(img);
+
+			if(pool)
+				enc.compress(img, dst_mem, flags);
+			else
+				squish::CompressImage(img.data, img.width, img.height, dst_mem, flags);
+			dst_mem += squish::GetStorageRequirements(img.width,img.height,flags);
+
+		} while (AdvanceMipmapStack(&img));
+		if(pool)
+			enc.wait();
+	}
+	fwrite(&*dst_v.begin(),dst_v.size(),1,fi);
 
-		squish::CompressImage(img.data, img.width, img.height, dst_mem, flags|squish::kColourIterativeClusterFit);
-		int len = squish::GetStorageRequirements(img.width,img.height,flags);
-		fwrite(dst_mem,len,1,fi);
 #if !WED
-		// Put it back before we advance...really necessary??!
+	// Put it back - only once every band is compressed.
+	img = ioImage;
+	do {
 		swap_bgra_y(img);
-#endif
-
 	} while (AdvanceMipmapStack(&img));
+#endif
 
 	fclose(fi);
 	return 0;
@@ -1823,14 +1979,7 @@ static void in_place_sharpen(int x, int y, const unsigned char * b4sharp, unsign
 	*((int *) sharp) =  *((int *) b4sharp);       // bottom right corner - just copy
 }
 
-struct CompressImageData
-{
-	ImageInfo img;
-	void * dst_mem;
-	int dst_size;
-};
-
-int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int dxt, const char * file_name)
+int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int dxt, const char * file_name, DDS_encode_pool * pool)
 {
 	Assert(ioImage.channels == 4);    // this only accepts BGRA bitmaps
 	swap_bgra_y(ioImage);             // do this early - so we won't have to do it for all the mipmaps again
@@ -1838,42 +1987,40 @@ int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int dxt, const char * file_na
 	FILE * fi = fopen(file_name,"wb");
 	if (fi == NULL) return -1;
 
-/* The very simply parallel processing of the full resolution texture scales to ~(3+1) threads, only. As the
-   remaining mipmap levels all together use ~1/3 as many pixels as the full resolution texture. Otherwise the
-   full texture gets done haead of the mipmaps == no faster overall. */
-
-	#define MAX_WORKER_THREADS 3
-	thread threads[MAX_WORKER_THREADS];
-	CompressImageData args[MAX_WORKER_THREADS];
-
-	/* don't waste thread startup time parallelizing so much for small textures, libsquish runs at 1+ Mpixels/sec */
-	int num_threads = (ioImage.height * ioImage.width >= 256 * 256) ? MAX_WORKER_THREADS : 1;
+/* Every level goes to the pool as soon as it exists - the full size one right away, each smaller one
+   while we filter the next - so the mipmaps no longer trail behind the top level on a single thread. */
 
 	int flags = (dxt == 1 ? squish::kDxt1 : (dxt == 3 ? squish::kDxt3 : squish::kDxt5)) | squish::kColourIterativeClusterFit;
-	int start_line = 0;
-	for (int i = 0; i < num_threads; i++)
-	{
-		args[i].img = ioImage;
-		args[i].img.height =  i < num_threads-1 ? ((ioImage.height / num_threads) >> 2) << 2 : ioImage.height - start_line;
-		args[i].img.data += start_line * ioImage.width * ioImage.channels;
-		args[i].dst_size = squish::GetStorageRequirements(args[i].img.width, args[i].img.height, flags);
-		args[i].dst_mem = malloc(args[i].dst_size);
-		
-		threads[i] = thread(squish::CompressImage, args[i].img.data, args[i].img.width, args[i].img.height, args[i].dst_mem, flags);
-//		squish::CompressImage(args[i].img.data, args[i].img.width, args[i].img.height, args[i].dst_mem, flags);
-		start_line += args[i].img.height;
-	}
+	int mips;
+	int dst_size = dds_mip_chain_size(ioImage.width, ioImage.height, flags, &mips);
+	unsigned char * dst_mem = (unsigned char *) malloc(dst_size);
+	unsigned char * dst_ptr = dst_mem;
+
+	dds_encode enc(pool ? pool : dds_default_pool());
+	enc.compress(ioImage, dst_ptr, flags);
+	dst_ptr += squish::GetStorageRequirements(ioImage.width, ioImage.height, flags);
 	
 	// scale down the mipmaps using sRGB gamma and sharpen the result a bit. Create the next map starting from the sharpened map.
+	// Each level stays where it is once written (only the scratch space past it gets reused), so the pool can read it meanwhile.
 	
-	ImageInfo ioMips(ioImage);
-	ioMips.data = (unsigned char *) malloc(ioImage.width * ioImage.height  * 2);
-	ioMips.width /= 2;
-	ioMips.height /= 2;
-
+	// Each level is built in scratch space just past where it ends up.  Once one side is down to 1 pixel
+	// that scratch overlaps the level itself, so size the buffer for the furthest any scratch reaches.
+	int mip_size = 0;
+	{
+		int w = ioImage.width, h = ioImage.height, at = 0;
+		while(w > 1 || h > 1)
+		{
+			int src_pixels = w * h;
+			if(w > 1) w >>= 1;
+			if(h > 1) h >>= 1;
+			mip_size = max(mip_size, at + src_pixels + w * h * 4);
+			at += w * h * 4;
+		}
+	}
+	unsigned char * mip_data = (unsigned char *) malloc(max(mip_size, 1));
 	ImageInfo src(ioImage);
-	unsigned char * mip_ptr = ioMips.data;
-	int mips = 1;
+	unsigned char * mip_ptr = mip_data;
+	int level = 1;
 	
 	while(src.width > 1 || src.height > 1)
 	{
@@ -1886,7 +2033,7 @@ int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int dxt, const char * file_na
 #if SCALE_SSE
 		copy_mip_SSE(src.width, src.height ,src.data, dst.data);
 #else
-		copy_mip_with_filter(src, dst, mips, average_with_gamma);
+		copy_mip_with_filter(src, dst, level, average_with_gamma);
 #endif
 		src = dst;
 
@@ -1895,36 +2042,22 @@ int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int dxt, const char * file_na
 			in_place_sharpen(src.width, src.height, src.data, mip_ptr);
 		else
 #endif
-			memcpy(mip_ptr, src.data, src.width * src.height * 4);        // nothing gets sharpened, still need to move the data to the location its expected to be
+			memmove(mip_ptr, src.data, src.width * src.height * 4);       // nothing gets sharpened, still need to move the data to the location its expected to be
 				
 		src.data = mip_ptr;
+		enc.compress(src, dst_ptr, flags);
+		dst_ptr += squish::GetStorageRequirements(src.width, src.height, flags);
 		mip_ptr += src.width * src.height * 4;
-		++mips;
+		++level;
 	}
-	
-	void * dst_mem = malloc(2 * squish::GetStorageRequirements(ioMips.width,ioMips.height,flags)); // its a bit more than needed ...
-	mip_ptr = (unsigned char *) dst_mem;
-	unsigned char * src_ptr = ioMips.data;
-
-	do
-	{
-		squish::CompressImage(ioMips.data, ioMips.width, ioMips.height, mip_ptr, flags);
-		mip_ptr += squish::GetStorageRequirements(ioMips.width, ioMips.height, flags);
-	} 
-	while (AdvanceMipmapStack(&ioMips));
-	
-	free(src_ptr);
 
 	TEX_dds_desc header(ioImage.width, ioImage.height, mips, dxt);
 	fwrite(&header,sizeof(header), 1, fi);
-	
-	for (int i = 0; i < num_threads; i++)
-	{
-		threads[i].join();
-		fwrite(args[i].dst_mem, args[i].dst_size, 1, fi);
-		free(args[i].dst_mem);
-	}
-	fwrite(dst_mem, mip_ptr - (unsigned char *) dst_mem, 1, fi);
+
+	enc.wait();
+	free(mip_data);
+
+	fwrite(dst_mem, dst_size, 1, fi);
 	free(dst_mem);
 
 	fclose(fi);
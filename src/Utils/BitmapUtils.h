@@ -107,14 +107,23 @@ int		WriteBitmapToFile(const struct ImageInfo * inImage, const char * inFilePath
 /* Given an imageInfo structure, this routine writes it to disk as a .png file.  Image is tagged with gamma, or 0.0f to leave untagged. */
 int		WriteBitmapToPNG(const struct ImageInfo * inImage, const char * inFilePath, char * inPalette, int inPaletteLen, float gamma);
 
+/* A pool of threads that DXT-compresses mip levels in bands for the DDS writers below.  Writers that
+ * share a pool share its threads, so converting many files at once still uses one thread per core.
+ * Pass 0 threads for one per core. */
+struct DDS_encode_pool;
+DDS_encode_pool *	DDS_encode_pool_create(int threads);
+void				DDS_encode_pool_destroy(DDS_encode_pool * pool);
+
 /* This routine writes a 4 channel bitmap as a mip-mapped DXT1, DXT3 or DXT5 image.
  * NOTE: if you compile with PHONE then DDS are written upside down (lower left origin
  * instead of upper-left).  This is an optimization for the iphone, which can then
- * pass the data DIRECTLY to OpenGL. */
-int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma);
+ * pass the data DIRECTLY to OpenGL.
+ * With a pool, all levels of the (already built) mip stack are compressed on it. */
+int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma, DDS_encode_pool * pool = NULL);
 
-// same, but multi-threaded compression and gamma corrected mipmap generation is done within
-int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int dxt, const char * file_name);
+// same, but multi-threaded compression and gamma corrected mipmap generation is done within.
+// Without a pool, a process-wide one is used.
+int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int dxt, const char * file_name, DDS_encode_pool * pool = NULL);
 
 /* This routine writes a 3 or 4 channel bitmap as a mip-mapped DXT1 or DXT3 image. */
 int	WriteUncompressedToDDS(struct ImageInfo& ioImage, const char * file_name, int use_win_gamma);
@@ -185,6 +185,97 @@ int FILE_case_correct(char * buf)
 	return 1;
 #endif
 }
+FILE_case_correct_cache::~FILE_case_correct_cache()
+{
+	for(map<string, dir_listing_t *>::iterator d = mDirs.begin(); d != mDirs.end(); ++d)
+		delete d->second;
+}
+
+const FILE_case_correct_cache::dir_listing_t * FILE_case_correct_cache::get_listing(const char * dir)
+{
+#if LIN
+	map<string, dir_listing_t *>::iterator d = mDirs.find(dir);
+	if(d != mDirs.end())
+		return d->second;
+
+	dir_listing_t * listing = NULL;
+	DIR * dh = opendir(dir);
+	if(dh)
+	{
+		listing = new dir_listing_t;
+		struct dirent * de;
+		while((de = readdir(dh)) != NULL)
+		{
+			string lc(de->d_name);
+			for(string::iterator c = lc.begin(); c != lc.end(); ++c)
+				*c = tolower(*c);
+			listing->insert(dir_listing_t::value_type(lc, de->d_name));		// first match wins, like desens_partial
+		}
+		closedir(dh);
+	}
+	mDirs[dir] = listing;
+	return listing;
+#else
+	return NULL;
+#endif
+}
+
+int FILE_case_correct_cache::correct(char * buf)
+{
+	#if LIN
+	struct stat sta;
+	if (stat(buf, &sta) == 0) 
+		return 1;
+
+	char * p = buf;
+	while (*p != 0)
+	{
+		const dir_listing_t * listing;
+		if (*p == '/')
+		{
+			listing = get_listing("/");
+			++p;
+		}
+		else if (p == buf)
+			listing = get_listing(".");
+		else
+		{
+			*(p-1) = 0;
+			listing = get_listing(buf);
+			*(p-1) = '/';
+		}
+		if (listing == NULL)
+			return 0;
+
+		char * q = p;
+		while (*q != 0 && *q != '/') ++q;
+
+		int last_time = *q == 0;
+		*q = 0;
+
+		string lc(p);
+		for(string::iterator c = lc.begin(); c != lc.end(); ++c)
+			*c = tolower(*c);
+		dir_listing_t::const_iterator hit = listing->find(lc);
+		if(hit != listing->end())
+			strcpy(p, hit->second.c_str());
+
+		if (!last_time)
+		{
+			*q = '/';
+			p = q+1;
+			if (hit == listing->end())
+				return 0;
+		}
+		else
+			return hit != listing->end();
+	}
+	return 0;
+	#else
+	return 1;
+	#endif
+}
+
 #ifdef _MSC_VER
 FILE_case_correct_path::FILE_case_correct_path(const char * in_path) : path(_strdup(in_path)) { FILE_case_correct(path); }
 #else
@@ -50,6 +50,22 @@ private:
 
 int FILE_case_correct(char * buf);
 
+/* Same as FILE_case_correct, but remembers every directory listing it had to read.  Correcting lots of paths that live
+   in the same few directories (like all the EXPORTs of a library.txt) thus reads each of those directories only once.
+   The cache never notices changes to the disk, so keep it only for one batch of work.  Not thread safe - use one per thread.
+*/
+
+class	FILE_case_correct_cache {
+public:
+	~FILE_case_correct_cache();
+
+	int		correct(char * buf);			// Same return values as FILE_case_correct
+private:
+	typedef map<string, string>		dir_listing_t;		// lower case name -> real name
+	const dir_listing_t *	get_listing(const char * dir);
+	map<string, dir_listing_t *>	mDirs;				// NULL if the directory can't be read
+};
+
 /* FILE API Overview
 	Method Name                 |                    Purpose                    | Trailing Seperator? | Returns (Sucess, fail)
 	exists                      | Does file exist?                              | N/A                 | True/false
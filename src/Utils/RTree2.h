@@ -47,6 +47,11 @@ template <typename T>	bool _get_lsb(T * v)	{	return reinterpret_cast<T*>(reinter
 //
 // Since the value type stored may not contain a cache of its AABB and the AABB may be expensive, this class 
 // caches AABB/value pairs ("items").  Insert chews a pile of storage since it needs a working buffer to sort.
+//
+// If the items move but the set of items does not change, refit can be used instead of a re-insert: it asks a
+// functor for the new AABB of every value and re-grows the node bounds bottom-up.  This is O(N) and needs no
+// sorting, but the split structure is the one from the last insert, so queries get slower as things wander off.
+// Re-insert from time to time if the items move a lot.
 
 template <typename T, int N>
 class RTree2 {
@@ -63,6 +68,10 @@ public:
 	void	insert(I begin, I end);
 
 	void	clear() { if(root) delete root; root = NULL; }
+	bool	empty() const { return root == NULL; }
+
+	template <typename F>
+	void	refit(F key_of);										// key_of(value) must return the new Bbox2 of the value.
 	
 	template <typename O>
 	void	query(const Bbox2& where, O out);						// This results item_type ptrs.
@@ -78,6 +87,11 @@ private:
 	template <typename O>
 	void	query_value_recursive(node * node, const Bbox2& where, O out);
 	
+	template <typename F>
+	void	refit_recursive(node * node, F& key_of);
+	template <typename F>
+	void	refit_leaf(leaf * l, F& key_of);
+
 	node *	insert_range(int level, typename vector<item_type>::iterator begin, typename  vector<item_type>::iterator end);
 
 	struct	item_compare_x {
@@ -238,10 +252,48 @@ void	RTree2<T,N>::insert(I begin, I end)
 		root = NULL;
 	else {
 		vector<item_type>	container(begin,end);
-		root = insert_range(0, begin, end);
+		root = insert_range(0, container.begin(), container.end());
 	}
 }
 
+template<typename T, int N>
+template <typename F>
+void	RTree2<T,N>::refit(F key_of)
+{
+	if(root)
+		refit_recursive(root, key_of);
+}
+
+template<typename T, int N>
+template <typename F>
+void	RTree2<T,N>::refit_leaf(leaf * l, F& key_of)
+{
+	l->bounds = Bbox2();
+	for(int n = 0; n < l->count; ++n)
+	{
+		l->items[n].first = key_of(l->items[n].second);
+		l->bounds += l->items[n].first;
+	}
+}
+
+template<typename T, int N>
+template <typename F>
+void	RTree2<T,N>::refit_recursive(node * node, F& key_of)
+{
+	if(node->left_is_leaf())
+		refit_leaf(node->left_as_leaf(), key_of);
+	else
+		refit_recursive(node->left_as_node(), key_of);
+
+	if(node->right_is_leaf())
+		refit_leaf(node->right_as_leaf(), key_of);
+	else
+		refit_recursive(node->right_as_node(), key_of);
+
+	node->bounds = node->left_as_leaf()->bounds;
+	node->bounds += node->right_as_leaf()->bounds;
+}
+
 template<typename T, int N>
 typename RTree2<T,N>::node *	RTree2<T,N>::insert_range(int level, typename vector<item_type>::iterator begin, typename vector<item_type>::iterator end)
 {	
@@ -31,6 +31,10 @@
 #include "WED_Errors.h"
 #include "WED_XMLWriter.h"
 #include "WED_Messages.h"
+#include <thread>
+#include <atomic>
+
+#define SAVE_CHUNK_OBJS	1024		// objects per chunk of text in a parallel save
 
 WED_Archive::WED_Archive(IResolver * r) : mResolver(r), mDying(false), mUndo(NULL), mUndoMgr(NULL),
  #if WITHNWLINK
@@ -65,7 +69,7 @@ WED_Persistent *	WED_Archive::Fetch(int id) const
 	return iter->second;
 }
 
-void		WED_Archive::ChangedObject(WED_Persistent * inObject, int change_kind)
+void		WED_Archive::ChangedObject(WED_Persistent * inObject, int change_kind, int section)
 {
 	if (mDying) return;
 	++mCacheKey;
@@ -73,7 +77,7 @@ void		WED_Archive::ChangedObject(WED_Persistent * inObject, int change_kind)
 	if (mNWAdapter) mNWAdapter->ObjectChanged(inObject, change_kind);
 #endif
 	if (mUndo == UNDO_DISCARD) return;
-	if (mUndo)	mUndo->ObjectChanged(inObject, change_kind);
+	if (mUndo)	mUndo->ObjectChanged(inObject, change_kind, section);
 	else		DebugAssert(!"Error: object changed outside of a command.");
 }
 
@@ -134,6 +138,47 @@ void			WED_Archive::SaveToXML(WED_XMLElement * parent)
 
 	mOpCount = 0;
 }
+int				WED_Archive::SaveToXML(int indent, const function<void(int n, string& text)>& put)
+{
+	vector<WED_Persistent *> objs;
+	objs.reserve(mObjects.size());
+	for (ObjectMap::iterator ob = mObjects.begin(); ob != mObjects.end(); ++ob)
+	if(ob->second != NULL)
+		objs.push_back(ob->second);
+
+	int num_chunks = (objs.size() + SAVE_CHUNK_OBJS - 1) / SAVE_CHUNK_OBJS;
+	atomic<int> next(0);
+
+	auto worker = [&]() {
+		int c;
+		while((c = next++) < num_chunks)
+		{
+			string text;
+			{
+				WED_XMLElement frag(NULL, indent - 2, &text);
+				int stop = min((int) objs.size(), (c + 1) * SAVE_CHUNK_OBJS);
+				for(int i = c * SAVE_CHUNK_OBJS; i < stop; ++i)
+				{
+					objs[i]->ToXML(&frag);
+					frag.flush();
+				}
+			}
+			put(c, text);
+		}
+	};
+
+	int num_threads = min(num_chunks, max(1, (int) thread::hardware_concurrency()));
+	vector<thread> threads;
+	for(int t = 1; t < num_threads; ++t)
+		threads.push_back(thread(worker));
+	worker();
+	for(auto& t : threads)
+		t.join();
+
+	mOpCount = 0;
+	return num_chunks;
+}
+
 #if WITHNWLINK
 void			WED_Archive::SetNWLinkAdapter(WED_NWLinkAdapter * inAdapter)
 {
@@ -195,48 +240,34 @@ void	WED_Archive::Validate(void)
 }
 
 
-void		WED_Archive::StartElement(
-								WED_XMLReader * reader,
-								const XML_Char *	name,
-								const XML_Char **	atts)
+// Makes the object an <object> element describes, without adding it to the archive.
+static WED_Persistent * build_from_xml(WED_Archive * archive, WED_XMLReader * reader, const XML_Char ** atts)
 {
-	const XML_Char ** a = atts;
-	const char * class_name = NULL;
-	const char * id_str = NULL;
-	while(*a)
-	{
-		if(strcmp(*a,"class")==0)
-		{
-			++a;
-			class_name = *a;
-			++a;
-		}
-		if(strcmp(*a,"id")==0)
-		{
-			++a;
-			id_str = *a;
-			++a;
-		}
-		else
-		{
-			++a;
-			++a;
-		}
-	}
+	const char * class_name = get_att("class", atts);
+	const char * id_str = get_att("id", atts);
 	if(id_str == NULL || class_name == NULL)
 	{
 		reader->FailWithError("Object missing ID/Class.");
-		return;
+		return NULL;
 	}
 
-	WED_Persistent * new_obj = WED_Persistent::CreateByClass(class_name, this, atoi(id_str));
+	WED_Persistent * new_obj = WED_Persistent::BuildByClass(class_name, archive, atoi(id_str));
 	if(new_obj==NULL)
-	{
 		reader->FailWithError("Create obj failed.");
-		return;
-	}
-	new_obj->FromXML(reader, atts);
+	return new_obj;
+}
 
+void		WED_Archive::StartElement(
+								WED_XMLReader * reader,
+								const XML_Char *	name,
+								const XML_Char **	atts)
+{
+	WED_Persistent * new_obj = build_from_xml(this, reader, atts);
+	if(new_obj)
+	{
+		new_obj->AddToArchive();
+		new_obj->FromXML(reader, atts);
+	}
 }
 
 void		WED_Archive::EndElement(void)
@@ -248,3 +279,49 @@ void		WED_Archive::PopHandler(void)
 	mOpCount = 0;
 	++mCacheKey;
 }
+
+// The handler for one batch of a parallel load - it collects the objects instead of adding them to the archive.
+class	bulk_batch_handler : public WED_XMLHandler {
+public:
+	bulk_batch_handler(WED_Archive * a) : archive(a) { }
+
+	virtual void		StartElement(
+								WED_XMLReader * reader,
+								const XML_Char *	name,
+								const XML_Char **	atts)
+	{
+		WED_Persistent * new_obj = build_from_xml(archive, reader, atts);
+		if(new_obj)
+		{
+			objs->push_back(new_obj);
+			new_obj->FromXML(reader, atts);
+		}
+	}
+	virtual	void		EndElement(void) { }
+	virtual	void		PopHandler(void) { }
+
+	WED_Archive *				archive;
+	vector<WED_Persistent *> *	objs;
+};
+
+void *		WED_Archive::ParseBulk(const char * xml, int len, string& err)
+{
+	vector<WED_Persistent *> * objs = new vector<WED_Persistent *>;
+	bulk_batch_handler handler(this);
+	handler.objs = objs;
+
+	WED_XMLReader reader;
+	reader.PushHandler(&handler);
+	err = reader.ReadFragment(xml, len);
+	return objs;
+}
+
+void		WED_Archive::FinishBulk(void * batch)
+{
+	// This is the link step - until now no object could find its parent, children or sources by ID.  Objects from a
+	// failed batch are added too; the load is aborted, and undoing the load's command deletes them.
+	vector<WED_Persistent *> * objs = reinterpret_cast<vector<WED_Persistent *> *>(batch);
+	for(vector<WED_Persistent *>::iterator o = objs->begin(); o != objs->end(); ++o)
+		(*o)->AddToArchive();
+	delete objs;
+}
@@ -45,6 +45,7 @@
 */
 
 #include "WED_XMLReader.h"
+#include <functional>
 
 class	WED_Persistent;
 class	WED_UndoLayer;
@@ -62,7 +63,7 @@ enum {
 	wed_Change_CreateDestroy =  1
 };
 
-class	WED_Archive : public GUI_Broadcaster, public WED_XMLHandler {
+class	WED_Archive : public GUI_Broadcaster, public WED_XMLHandler, public WED_XMLBulkHandler {
 public:
 
 					WED_Archive(IResolver * resolver);
@@ -77,6 +78,10 @@ public:
 
 	void			ClearAll(void);
 	void			SaveToXML(WED_XMLElement * parent);
+	// Parallel save: writes every object's XML (at the given indent) into numbered chunks of text on all cores, calling
+	// put for each chunk as it is done - from any thread, in any order.  The chunks, in order, are the <objects> list.
+	// Returns the number of chunks.  The archive is only read, but nothing may edit it until this returns.
+	int				SaveToXML(int indent, const function<void(int n, string& text)>& put);
 #if WITHNWLINK
 	void			SetNWLinkAdapter(WED_NWLinkAdapter * inAdapter);
 #endif
@@ -102,10 +107,15 @@ public:
 	virtual	void		EndElement(void);
 	virtual	void		PopHandler(void);
 
+	// Parallel load: WED_XMLBulkHandler for the <objects> list.  Batches of objects are built on worker threads and
+	// only added to the archive when the batch is finished, on the reading thread, in file order.
+	virtual	void *		ParseBulk(const char * xml, int len, string& err);
+	virtual	void		FinishBulk(void * batch);
+
 
 private:
 
-	void			ChangedObject	(WED_Persistent * inObject, int change_kind);
+	void			ChangedObject	(WED_Persistent * inObject, int change_kind, int section = -1);	// -1 = all non-lazy undo sections
 	void			AddObject		(WED_Persistent * inObject);
 	void			RemoveObject	(WED_Persistent * inObject);
 
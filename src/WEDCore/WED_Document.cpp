@@ -52,6 +52,11 @@
 #include "GUI_Resources.h"
 #include "GUI_Prefs.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
 #if IBM
 #include "GUI_Unicode.h"
 #endif
@@ -71,6 +76,113 @@ string gCustomSlippyMap;
 
 static set<WED_Document *> sDocuments;
 static map<string,string>	sGlobalPrefs;
+enum {none,nobackup,both};	// what Save renamed to make the backups
+
+/************************************************************************************************************************
+ * SAVE JOB
+ ************************************************************************************************************************/
+
+// A file being written on a background thread.  Chunks of text are put in any order from any thread and written in
+// order 0, 1, 2... as soon as they are in; once closed with the chunk count, the thread closes the file and is done.
+
+class	WED_Document::SaveJob {
+public:
+			 SaveJob(FILE * fi);
+			~SaveJob();
+
+	void	put(int n, string& text);		// takes the text
+	void	close(int count);
+	bool	done(void) const { return mDone; }
+	bool	wait(void);						// returns true if everything was written and the file closed without error
+
+	// What Save must undo if the write fails
+	int		stage;
+	string	xml;
+	string	bakXML;
+	string	tempBakBak;
+
+private:
+
+	void	writer(void);
+
+	FILE *					mFile;
+	mutex					mMutex;
+	condition_variable		mReady;
+	map<int, string>		mChunks;
+	int						mNext;
+	int						mCount;			// -1 until closed
+	bool					mOK;
+	atomic<bool>			mDone;
+	thread					mThread;
+};
+
+WED_Document::SaveJob::SaveJob(FILE * fi) : stage(none), mFile(fi), mNext(0), mCount(-1), mOK(ferror(fi) == 0), mDone(false)
+{
+	mThread = thread(&SaveJob::writer, this);
+}
+
+WED_Document::SaveJob::~SaveJob()
+{
+	wait();
+}
+
+void WED_Document::SaveJob::put(int n, string& text)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mChunks[n].swap(text);
+	}
+	mReady.notify_one();
+}
+
+void WED_Document::SaveJob::close(int count)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+		mCount = count;
+	}
+	mReady.notify_one();
+}
+
+bool WED_Document::SaveJob::wait(void)
+{
+	if(mThread.joinable())
+		mThread.join();
+	return mOK;
+}
+
+void WED_Document::SaveJob::writer(void)
+{
+	unique_lock<mutex> lock(mMutex);
+	while(mCount < 0 || mNext < mCount)
+	{
+		map<int, string>::iterator c = mChunks.find(mNext);
+		if(c == mChunks.end())
+		{
+			mReady.wait(lock);
+			continue;
+		}
+		string text;
+		text.swap(c->second);
+		mChunks.erase(c);
+		++mNext;
+		lock.unlock();
+
+		if(mOK && fwrite(text.data(), 1, text.size(), mFile) != text.size())
+			mOK = false;
+
+		lock.lock();
+	}
+	lock.unlock();
+
+	if(ferror(mFile) != 0)	mOK = false;
+	if(fclose(mFile) != 0)	mOK = false;
+	mDone = true;
+}
+
+/************************************************************************************************************************
+ * DOCUMENT
+ ************************************************************************************************************************/
 
 WED_Document::WED_Document(
 								const string& 		package,
@@ -85,6 +197,7 @@ WED_Document::WED_Document(
 	mNWLink(NULL),
 	mOnDisk(false),
 #endif
+	mSaveJob(NULL),
 	mUndo(&mArchive, this),
 	mArchive(this)
 {
@@ -120,6 +233,7 @@ WED_Document::WED_Document(
 
 WED_Document::~WED_Document()
 {
+	FinishSave();
 	delete mTexMgr;
 	delete mResourceMgr;
 	delete mLibraryMgr;
@@ -168,9 +282,10 @@ WED_NWLinkAdapter *	WED_Document::GetNWLink(void)
 #endif
 void	WED_Document::Save(void)
 {
+	FinishSave();			// one at a time - the backup renames below need the last save to be on disk.
+
 	BroadcastMessage(msg_DocWillSave, reinterpret_cast<uintptr_t>(static_cast<IDocPrefs *>(this)));
 
-	enum {none,nobackup,both};
 	int stage = none;
 
 	//Create the strings path.
@@ -237,57 +352,86 @@ void	WED_Document::Save(void)
 		return;
 	}
 
-	int ferrorErr = ferror(xml_file);
-		//If everything else has worked
-	if(ferrorErr == 0)
+	mSaveJob = new SaveJob(xml_file);
+	mSaveJob->stage = stage;
+	mSaveJob->xml = xml;
+	mSaveJob->bakXML = bakXML;
+	mSaveJob->tempBakBak = tempBakBak;
+	{
+#if DEV
+		StElapsedTime	etime("Save time (snapshot)");
+#endif
+		WriteXML(mSaveJob);
+	}
+
+	// The writer thread finishes on its own - we just check on it to report the result.
+	Start(0.1);
+}
+
+void	WED_Document::FinishSave(void)
+{
+	if(mSaveJob == NULL)
+		return;
+	Stop();
+
+	SaveJob * job = mSaveJob;
+	mSaveJob = NULL;
+
+	bool ok;
 	{
 #if DEV
-		StElapsedTime	etime("Save time");
+		StElapsedTime	etime("Save time (waiting for disk)");
 #endif
-		WriteXML(xml_file);
+		ok = job->wait();
 	}
-	int fcloseErr = fclose(xml_file);
-	if(ferrorErr != 0 || fcloseErr != 0)
+	if(!ok)
 	{
 		//This is the error handling switch
-		switch(stage)
+		switch(job->stage)
 		{
 			case none:
-				FILE_delete_file(xml.c_str(), false);
+				FILE_delete_file(job->xml.c_str(), false);
 				DoUserAlert("Please check file path for errors or missing parts");
 				break;
 			case nobackup:
 				//Delete's the bad save
-				FILE_delete_file(xml.c_str(), false);
+				FILE_delete_file(job->xml.c_str(), false);
 				//un-renames the old one
-				FILE_rename_file(bakXML.c_str(),xml.c_str());
+				FILE_rename_file(job->bakXML.c_str(),job->xml.c_str());
 				DoUserAlert("Please check file path for errors or missing parts");
 				break;
 			case both:
 				//delete incomplete file
-				FILE_delete_file(xml.c_str(), false);
+				FILE_delete_file(job->xml.c_str(), false);
 
 				//un-rename earth.wed.bak.xml to earth.wed.xml
-				FILE_rename_file(bakXML.c_str(), xml.c_str());
+				FILE_rename_file(job->bakXML.c_str(), job->xml.c_str());
 
 				//un-rename earth.wed.bak.bak.xml to earth.wed.bak.xml
-				FILE_rename_file(tempBakBak.c_str(), bakXML.c_str());
+				FILE_rename_file(job->tempBakBak.c_str(), job->bakXML.c_str());
 				DoUserAlert("Please check file path for errors or missing parts");
 				break;
 		}
-	}	
+	}
 	else
 	{
 		// This is the save-was-okay case.
 		mOnDisk=true;
 	}
-	
+
 	//if the second backup still exists after the error handling
-	if(FILE_exists(tempBakBak.c_str()) == true)
+	if(FILE_exists(job->tempBakBak.c_str()) == true)
 	{
 		//Delete it
-		FILE_delete_file(tempBakBak.c_str(), false);
+		FILE_delete_file(job->tempBakBak.c_str(), false);
 	}
+	delete job;
+}
+
+void	WED_Document::TimerFired(void)
+{
+	if(mSaveJob && mSaveJob->done())
+		FinishSave();
 }
 
 void	WED_Document::Revert(void)
@@ -299,6 +443,7 @@ void	WED_Document::Revert(void)
 			return;
 	}
 
+	FinishSave();
 	mDocPrefs.clear();
 	mUndo.__StartCommand("Revert from Saved.",__FILE__,__LINE__);
 
@@ -314,7 +459,7 @@ void	WED_Document::Revert(void)
 
 		// First: try to IO the XML file.
 		bool xml_exists;
-		string result = reader.ReadFile(fname.c_str(),&xml_exists);
+		string result = reader.ReadFile(fname.c_str(),&xml_exists, "objects", 1, &mArchive);
 
 		if(xml_exists && !result.empty())
 			WED_ThrowPrintf("Unable to open XML file: %s",result.c_str());
@@ -364,6 +509,9 @@ void	WED_Document::Revert(void)
 		mUndo.PurgeUndo();
 	}
 
+	// Get the loader going on all the objects we use - so they are there (or close) by the time the map asks for them.
+	mResourceMgr->Preload(GetRoot(), false);
+
 	BroadcastMessage(msg_DocLoaded, reinterpret_cast<uintptr_t>(static_cast<IDocPrefs *>(this)));
 }
 
@@ -389,6 +537,7 @@ bool	WED_Document::TryClose(void)
 		case close_Cancel:	return false;
 		}
 	}
+	FinishSave();
 #if WITHNWLINK
 	if(mServer)
 	{
@@ -686,24 +835,31 @@ void WED_Document::Panic(void)
 	FILE * xml_file = fopen(xml.c_str(),"w");
 	if(xml_file)
 	{
-		WriteXML(xml_file);
-		fclose(xml_file);
+		SaveJob job(xml_file);
+		WriteXML(&job);
+		job.wait();
 	}
 }
 
-void		WED_Document::WriteXML(FILE * xml_file)
+void		WED_Document::WriteXML(SaveJob * job)
 {
-	//print to file the xml file passed in with the following encoding
-	fprintf(xml_file,"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-	fprintf(xml_file,"<!-- written by WED " WED_VERSION_STRING " -->\n");
+	// The archive's chunks are numbered 1 to n - the header and the prefs go around them.  This writes the same text
+	// as one big WED_XMLElement tree would.
+	string head("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				"<!-- written by WED " WED_VERSION_STRING " -->\n"
+				"<doc>\n"
+				"  <objects>\n");
+	job->put(0, head);
+
+	int n = mArchive.SaveToXML(4, [job](int c, string& text) { job->put(c + 1, text); });
+
+	string tail("  </objects>\n");
 	{
-		WED_XMLElement	top_level("doc",0,xml_file);
-		mArchive.SaveToXML(&top_level);
 		WED_XMLElement * pref;
-		WED_XMLElement * prefs = top_level.add_sub_element("prefs");
+		WED_XMLElement prefs("prefs", 2, &tail);
 		for(map<string,set<int> >::iterator pi = mDocPrefsItems.begin(); pi != mDocPrefsItems.end(); ++pi)
 		{
-			pref = prefs->add_sub_element("pref");
+			pref = prefs.add_sub_element("pref");
 			pref->add_attr_stl_str("name",pi->first);
 			for(set<int>::iterator i = pi->second.begin(); i != pi->second.end(); ++i)
 			{
@@ -713,11 +869,14 @@ void		WED_Document::WriteXML(FILE * xml_file)
 		}
 		for(map<string,string>::iterator p = mDocPrefs.begin(); p != mDocPrefs.end(); ++p)
 		{
-			pref = prefs->add_sub_element("pref");
+			pref = prefs.add_sub_element("pref");
 			pref->add_attr_stl_str("name",p->first);
 			pref->add_attr_stl_str("value",p->second);
 		}
 	}
+	tail += "</doc>\n";
+	job->put(n + 1, tail);
+	job->close(n + 2);
 }
 
 
@@ -26,6 +26,7 @@
 
 #include "WED_XMLReader.h"
 #include "GUI_Destroyable.h"
+#include "GUI_Timer.h"
 //#include "MeshDefs.h"
 #include "AptDefs.h"
 #include "ILibrarian.h"
@@ -62,10 +63,19 @@ class	WED_NWLinkAdapter;
 
 	Object with ID 1 is by definition "the document root" - that is, it is used as a starting point for all resolutions.
 
+	SAVE AND LOAD
+
+	Save snapshots the archive as XML text on all cores - the UI waits for that, since the archive can't change under
+	it - while a background thread streams the text to disk.  Save returns once the snapshot is taken; the write is
+	finished (errors reported, backups rolled back) from a timer, or whenever anything else needs the file: the next
+	save, a revert, closing.
+
+	Revert parses the <objects> list in batches on worker threads, then adds the objects to the archive in file order.
+
 */
 
 
-class	WED_Document : public GUI_Broadcaster, public GUI_Destroyable, public virtual IResolver, public virtual ILibrarian, public IDocPrefs, public WED_XMLHandler, public WED_UndoFatalErrorHandler {
+class	WED_Document : public GUI_Broadcaster, public GUI_Destroyable, public virtual IResolver, public virtual ILibrarian, public IDocPrefs, public WED_XMLHandler, public WED_UndoFatalErrorHandler, public GUI_Timer {
 public:
 
 						WED_Document(
@@ -113,6 +123,8 @@ public:
 
 	virtual	void		Panic(void);
 
+	virtual	void		TimerFired(void);
+
 	bool				TryClose(void);
 
 	//Saves the file, returns true if successful, false if not.
@@ -132,7 +144,10 @@ public:
 	static	bool	TryCloseAll(void);
 
 private:
-	void				WriteXML(FILE * fi);
+	class				SaveJob;
+
+	void				WriteXML(SaveJob * job);
+	void				FinishSave(void);
 
 	//Member Variables
 
@@ -141,6 +156,7 @@ private:
 	string				mFilePath;
 	string				mPackage;
 	bool				mOnDisk;
+	SaveJob *			mSaveJob;			// save still being written, or NULL
 
 	//sql_db				mDB;
 	WED_Archive			mArchive;
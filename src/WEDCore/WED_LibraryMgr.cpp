@@ -30,6 +30,11 @@
 #include "PlatformUtils.h"
 #include "MemFileUtils.h"
 #include <time.h>
+#include <thread>
+#include <atomic>
+
+#define LIBRARY_INDEX_FILE "wed_library_index.txt"
+#define LIBRARY_INDEX_VERSION 1
 
 static void clean_vpath(string& s)
 {
@@ -95,7 +100,7 @@ static int is_direct_parent(const string& parent, const string& child)
 }
 
 //Library manager constructor
-WED_LibraryMgr::WED_LibraryMgr(const string& ilocal_package) : local_package(ilocal_package)
+WED_LibraryMgr::WED_LibraryMgr(const string& ilocal_package) : local_package(ilocal_package), lib_index_loaded(false)
 {
 	DebugAssert(gPackageMgr != NULL);
 	gPackageMgr->AddListener(this);
@@ -271,106 +276,265 @@ struct local_scan_t {
 	WED_LibraryMgr * who;
 };
 
+// Parse one library.txt into a list of EXPORTs - no access to the package mgr or res_table, so this is safe to run on
+// a worker thread.
+void		WED_LibraryMgr::ParseLibrary(const string& lib_path, const string& pack_base, lib_pack_t& out_pack)
+{
+	out_pack.exports.clear();
+
+	//Connects the physical Library.txt to the virual Memory File system? (95% sure) -Ted
+	MFMemFile * lib = MemFile_Open(lib_path.c_str());
+
+	if(lib)
+	{
+		FILE_case_correct_cache	case_cache;
+		MFScanner	s;
+		MFS_init(&s, lib);
+
+		int cur_status = status_Public;
+		int cur_new_until = 0;
+		int lib_version[] = { 800, 0 };
+
+		if(MFS_xplane_header(&s,lib_version,"LIBRARY",NULL))
+		while(!MFS_done(&s))
+		{
+			string vpath, rpath;
+			bool is_export_backup = false;
+			bool is_export = false;
+			
+			if( MFS_string_match(&s,"EXPORT",false) ||
+			    MFS_string_match(&s,"EXPORT_EXTEND",false) ||
+			    MFS_string_match(&s,"EXPORT_EXCLUDE",false) ||
+				(is_export_backup  = MFS_string_match(&s,"EXPORT_BACKUP",false)))
+			{
+				is_export = true;
+			}
+			else if(MFS_string_match(&s,"EXPORT_RATIO",false))
+			{
+			    MFS_double(&s);
+				is_export = true;
+			}
+			
+			if(is_export)
+			{
+				MFS_string(&s,&vpath);
+				MFS_string_eol(&s,&rpath);
+				clean_vpath(vpath);
+				clean_rpath(rpath);
+
+				if (is_no_true_subdir_path(rpath)) break; // ignore paths that lead outside current scenery directory
+				rpath=pack_base+DIR_STR+rpath;
+				case_cache.correct( (char *) rpath.c_str());  /* yeah - I know I'm overriding the 'const' protection of the c_str() here.
+				   But I know this operation is never going to change the strings length, so thats OK to do.
+				   And I have to case-correct the path right here, as this path later is not only used by the case insensitive MF_open()
+				   but also to derive the paths to the textures referenced in those assets. And those textures are loaded with case-sensitive fopen.
+				   */
+				lib_export_t e;
+				e.vpath = vpath;
+				e.rpath = rpath;
+				e.status = cur_status;
+				e.new_until = cur_new_until;
+				e.is_backup = is_export_backup;
+				out_pack.exports.push_back(e);
+			}
+			else
+			{
+				if(MFS_string_match(&s,"PUBLIC",true))
+				{
+					cur_status = status_Public;
+					cur_new_until = MFS_int(&s);
+				}
+				else if(MFS_string_match(&s,"PRIVATE",true))
+					cur_status = status_Private;
+				else if(MFS_string_match(&s,"DEPRECATED",true))
+					cur_status = status_Deprecated;
+				else if(MFS_string_match(&s,"SEMI_DEPRECATED",true))
+					cur_status = status_Yellow;
+
+				MFS_string_eol(&s,NULL);
+			}
+		}
+		MemFile_Close(lib);
+	}
+}
+
+// Parse a pile of library.txt files (pairs of library.txt path and package base) on all cores.
+void		WED_LibraryMgr::ParseLibraries(const vector<pair<string, string> >& todo, const vector<lib_pack_t *>& out_packs)
+{
+	DebugAssert(todo.size() == out_packs.size());
+	atomic<int>	next(0);
+	int num_threads = min((int) todo.size(), max(1, (int) thread::hardware_concurrency()));
+
+	auto worker = [&]() {
+		int n;
+		while((n = next++) < (int) todo.size())
+			ParseLibrary(todo[n].first, todo[n].second, *out_packs[n]);
+	};
+
+	vector<thread> threads;
+	for(int t = 1; t < num_threads; ++t)
+		threads.push_back(thread(worker));
+	worker();
+	for(vector<thread>::iterator t = threads.begin(); t != threads.end(); ++t)
+		t->join();
+}
+
+void		WED_LibraryMgr::LoadLibraryIndex()
+{
+	lib_index_loaded = true;
+	lib_index.clear();
+
+	string content;
+	if(FILE_read_file_to_string(GetCacheFolder() + DIR_STR LIBRARY_INDEX_FILE, content) != 0)
+		return;
+
+	lib_pack_t * cur = NULL;
+	string::size_type p = 0;
+	bool first = true;
+	while(p < content.size())
+	{
+		string::size_type eol = content.find('\n', p);
+		if(eol == content.npos) eol = content.size();
+		string line(content, p, eol - p);
+		p = eol + 1;
+
+		if(first)
+		{
+			int vers = 0;
+			if(sscanf(line.c_str(), "WED_LIBRARY_INDEX %d", &vers) != 1 || vers != LIBRARY_INDEX_VERSION)
+				return;
+			first = false;
+			continue;
+		}
+
+		string::size_type t1 = line.find('\t');
+		if(t1 == line.npos) continue;
+
+		if(line[0] == 'P')
+		{
+			long long mtime, size;
+			if(sscanf(line.c_str(), "P %lld %lld", &mtime, &size) != 2) { lib_index.clear(); return; }
+			cur = &lib_index[line.substr(t1+1)];
+			cur->mtime = mtime;
+			cur->size = size;
+		}
+		else if(line[0] == 'E' && cur)
+		{
+			string::size_type t2 = line.find('\t', t1+1);
+			int backup, status, new_until;
+			if(t2 == line.npos || sscanf(line.c_str(), "E %d %d %d", &backup, &status, &new_until) != 3) { lib_index.clear(); return; }
+			lib_export_t e;
+			e.vpath = line.substr(t1+1, t2-t1-1);
+			e.rpath = line.substr(t2+1);
+			e.status = status;
+			e.new_until = new_until;
+			e.is_backup = backup != 0;
+			cur->exports.push_back(e);
+		}
+	}
+}
+
+void		WED_LibraryMgr::SaveLibraryIndex()
+{
+	string path = GetCacheFolder() + DIR_STR LIBRARY_INDEX_FILE;
+	string temp = path + ".tmp";
+	FILE * fi = fopen(temp.c_str(), "w");
+	if(!fi) return;
+
+	fprintf(fi, "WED_LIBRARY_INDEX %d\n", LIBRARY_INDEX_VERSION);
+	for(lib_index_t::iterator l = lib_index.begin(); l != lib_index.end(); ++l)
+	{
+		fprintf(fi, "P %lld %lld\t%s\n", (long long) l->second.mtime, l->second.size, l->first.c_str());
+		for(vector<lib_export_t>::iterator e = l->second.exports.begin(); e != l->second.exports.end(); ++e)
+			fprintf(fi, "E %d %d %d\t%s\t%s\n", e->is_backup ? 1 : 0, e->status, e->new_until, e->vpath.c_str(), e->rpath.c_str());
+	}
+	bool ok = ferror(fi) == 0;
+	fclose(fi);
+
+	// Write-then-rename, so a crash mid-way leaves the old index and not half of a new one.
+	FILE_delete_file(path.c_str(), false);
+	if(!ok || FILE_rename_file(temp.c_str(), path.c_str()) != 0)
+		FILE_delete_file(temp.c_str(), false);
+}
+
 void		WED_LibraryMgr::Rescan()
 {
 	res_table.clear();
 	int np = gPackageMgr->CountPackages();
 
+	if(!lib_index_loaded)
+		LoadLibraryIndex();
+
+	// Work out which library.txt files changed since we last parsed them.
+	lib_index_t						new_index;
+	vector<string>					pack_libs(np);
+	vector<pair<string, string> >	parse_todo;
+	vector<lib_pack_t *>			parse_out;
+
 	for(int p = 0; p < np; ++p)
 	{
-		if(gPackageMgr->IsDisabled(p)) continue;
 		//the physical directory of the scenery pack
 		string pack_base;
 		//Get the pack's physical location
 		gPackageMgr->GetNthPackagePath(p,pack_base);
+		string lib_path = pack_base + DIR_STR "library.txt";
 
-		pack_base += DIR_STR "library.txt";
-
-		bool is_default_pack = gPackageMgr->IsPackageDefault(p);
+		lib_index_t::iterator old = lib_index.find(lib_path);
+		if(gPackageMgr->IsDisabled(p))
+		{
+			if(old != lib_index.end())								// keep it for when the pack is enabled again
+				swap(new_index[lib_path], old->second);
+			continue;
+		}
 
-		//Connects the physical Library.txt to the virual Memory File system? (95% sure) -Ted
-		MFMemFile * lib = MemFile_Open(pack_base.c_str());
+		struct stat ss;
+		if(FILE_get_file_meta_data(lib_path, ss) != 0)
+			continue;
 
-		if(lib)
+		pack_libs[p] = lib_path;
+		lib_pack_t& pack = new_index[lib_path];
+		if(old != lib_index.end() && old->second.mtime == ss.st_mtime && old->second.size == ss.st_size)
 		{
-			gPackageMgr->GetNthPackagePath(p,pack_base);
-			MFScanner	s;
-			MFS_init(&s, lib);
+			pack.exports.swap(old->second.exports);
+		}
+		else
+		{
+			parse_todo.push_back(pair<string, string>(lib_path, pack_base));
+			parse_out.push_back(&pack);
+		}
+		pack.mtime = ss.st_mtime;
+		pack.size = ss.st_size;
+	}
 
-			int cur_status = status_Public;
-			int lib_version[] = { 800, 0 };
+	bool index_changed = !parse_todo.empty() || new_index.size() != lib_index.size();
+	if(!parse_todo.empty())
+		ParseLibraries(parse_todo, parse_out);
+	lib_index.swap(new_index);
 
-			if(MFS_xplane_header(&s,lib_version,"LIBRARY",NULL))
-			while(!MFS_done(&s))
-			{
-				string vpath, rpath;
-				bool is_export_backup = false;
-				
-				if( MFS_string_match(&s,"EXPORT",false) ||
-				    MFS_string_match(&s,"EXPORT_EXTEND",false) ||
-				    MFS_string_match(&s,"EXPORT_EXCLUDE",false) ||
-					(is_export_backup  = MFS_string_match(&s,"EXPORT_BACKUP",false)))
-				{
-					MFS_string(&s,&vpath);
-					MFS_string_eol(&s,&rpath);
-					clean_vpath(vpath);
-					clean_rpath(rpath);
-
-					if (is_no_true_subdir_path(rpath)) break; // ignore paths that lead outside current scenery directory
-					rpath=pack_base+DIR_STR+rpath;
-					FILE_case_correct( (char *) rpath.c_str());  /* yeah - I know I'm overriding the 'const' protection of the c_str() here.
-					   But I know this operation is never going to change the strings length, so thats OK to do.
-					   And I have to case-correct the path right here, as this path later is not only used by the case insensitive MF_open()
-					   but also to derive the paths to the textures referenced in those assets. And those textures are loaded with case-sensitive fopen.
-					   */
-					AccumResource(vpath, p, rpath, is_export_backup, is_default_pack, cur_status);
-				}
-				else if(MFS_string_match(&s,"EXPORT_RATIO",false))
-				{
-				    double x = MFS_double(&s);
-					MFS_string(&s,&vpath);
-					MFS_string_eol(&s,&rpath);
-					clean_vpath(vpath);
-					clean_rpath(rpath);
-					if (is_no_true_subdir_path(rpath)) break; // ignore paths that lead outside current scenery directory
-					rpath=pack_base+DIR_STR+rpath;
-					FILE_case_correct( (char *) rpath.c_str());  // yeah - I know I'm overriding the 'const' protection of the c_str() here.
-					AccumResource(vpath, p, rpath,false,is_default_pack, cur_status);
-				}
-				else
-				{
-					if(MFS_string_match(&s,"PUBLIC",true))
-					{
-						cur_status = status_Public;
+	time_t rawtime;
+	struct tm * timeinfo;
+	time (&rawtime);
+	timeinfo = localtime (&rawtime);
+	int now = 10000 * (timeinfo->tm_year+1900) +100*timeinfo->tm_mon + timeinfo->tm_mday;
 
-						int new_until = 0;
-						new_until = MFS_int(&s);
-						if (new_until > 20170101)
-						{
-							time_t rawtime;
-							struct tm * timeinfo;
-							time (&rawtime);
-							timeinfo = localtime (&rawtime);
-							int now = 10000 * (timeinfo->tm_year+1900) +100*timeinfo->tm_mon + timeinfo->tm_mday;
-							if (new_until >= now)
-							{
-								cur_status = status_New;
-							}
-						}
-					}
-					else if(MFS_string_match(&s,"PRIVATE",true))
-						cur_status = status_Private;
-					else if(MFS_string_match(&s,"DEPRECATED",true))
-						cur_status = status_Deprecated;
-					else if(MFS_string_match(&s,"SEMI_DEPRECATED",true))
-						cur_status = status_Yellow;
-
-					MFS_string_eol(&s,NULL);
-				}
-			}
-			MemFile_Close(lib);
+	// Now build the resource table - serially and in package order, since later packages override earlier ones.
+	for(int p = 0; p < np; ++p)
+	if(!pack_libs[p].empty())
+	{
+		bool is_default_pack = gPackageMgr->IsPackageDefault(p);
+		const lib_pack_t& pack = lib_index[pack_libs[p]];
+		for(vector<lib_export_t>::const_iterator e = pack.exports.begin(); e != pack.exports.end(); ++e)
+		{
+			int status = e->status;
+			if(status == status_Public && e->new_until > 20170101 && e->new_until >= now)
+				status = status_New;
+			AccumResource(e->vpath, p, e->rpath, e->is_backup, is_default_pack, status);
 		}
 	}
+
+	if(index_changed)
+		SaveLibraryIndex();
+
 	RescanLines();
 
 	string package_base;
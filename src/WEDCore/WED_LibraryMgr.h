@@ -62,6 +62,18 @@ enum {
 	status_New			= 4
 };
 
+/*
+	WED_LibraryMgr - LIBRARY INDEX
+
+	Parsing every library.txt (and case-correcting every EXPORT path) takes a while with a big Custom Scenery folder,
+	and we do it at startup and on every scenery folder change.  So the parsed EXPORTs of each library.txt are kept
+	in an index keyed by the library.txt's path, mtime and size, and the index is saved to the cache folder.
+
+	A rescan only re-parses the library.txt files that changed - on worker threads, since they are independent -
+	and then builds res_table from the index in package order on the main thread, so the result is exactly what a
+	full serial parse would give.  A warm start does no parsing at all.
+*/
+
 class WED_LibraryMgr : public GUI_Broadcaster, public GUI_Listener, public virtual IBase {
 public:
 
@@ -100,6 +112,27 @@ public:
 
 private:
 
+	struct	lib_export_t {
+		string		vpath;
+		string		rpath;			// full path, already case-corrected
+		int			status;			// as declared in the library.txt - status_New is decided at Rescan time
+		int			new_until;		// date from "PUBLIC <date>", or 0
+		bool		is_backup;
+	};
+
+	struct	lib_pack_t {
+		time_t		mtime;
+		long long	size;
+		vector<lib_export_t>	exports;
+	};
+
+	typedef	map<string, lib_pack_t>	lib_index_t;			// key is the path of the library.txt
+
+	static	void	ParseLibrary(const string& lib_path, const string& pack_base, lib_pack_t& out_pack);
+	static	void	ParseLibraries(const vector<pair<string, string> >& todo, const vector<lib_pack_t *>& out_packs);
+			void	LoadLibraryIndex();
+			void	SaveLibraryIndex();
+
 	void			Rescan();
 	void			RescanLines();
 	void			AccumResource(const string& path, int package, const string& real_path, bool is_backup, bool is_default, int status);
@@ -156,6 +189,9 @@ private:
 
 	string				local_package;
 	map<int, string>	default_lines;  // list of art assets for sim default lines
+
+	lib_index_t			lib_index;
+	bool				lib_index_loaded;
 };
 
 #endif /* WED_LibraryMgr_H */
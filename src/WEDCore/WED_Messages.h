@@ -45,7 +45,8 @@ enum {
 	msg_SystemFolderChanged,
 	msg_SystemFolderUpdated,
 
-	msg_LibraryChanged
+	msg_LibraryChanged,
+	msg_ArtAssetsLoaded						// Sent by the resource mgr when the background loader delivered art assets
 
 #if WITHNWLINK
 	,msg_NetworkStatusInfo
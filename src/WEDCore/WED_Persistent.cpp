@@ -69,6 +69,12 @@ void 			WED_Persistent::StateChanged(int change_kind)
 	mDirty = true;
 }
 
+void			WED_Persistent::SectionChanged(int section, int change_kind)
+{
+	mArchive->ChangedObject(this, change_kind, section);
+	mDirty = true;
+}
+
 WED_Persistent::~WED_Persistent()
 {
 }
@@ -102,12 +108,20 @@ void WED_Persistent::Register(
 
 WED_Persistent * WED_Persistent::CreateByClass(const char * class_id, WED_Archive * parent, int id)
 {
-	if(sStaticCtors.count(class_id) == 0) return NULL;
-	WED_Persistent * ret = sStaticCtors[class_id](parent, id);
-	ret->PostCtor();
+	WED_Persistent * ret = BuildByClass(class_id, parent, id);
+	if(ret)
+		ret->PostCtor();
 	return ret;
 }
 
+WED_Persistent * WED_Persistent::BuildByClass(const char * class_id, WED_Archive * parent, int id)
+{
+	// find, not [] - this is called from the parallel loader and must not modify the table.
+	hash_map<string, WED_Persistent::CTOR_f>::const_iterator i = sStaticCtors.find(class_id);
+	if(i == sStaticCtors.end()) return NULL;
+	return i->second(parent, id);
+}
+
 void			WED_Persistent::SetDirty(int dirty)
 {
 	mDirty = dirty;
@@ -172,6 +172,12 @@ public:
 	static	void			Register(const char * id, CTOR_f ctor);
 	static	WED_Persistent *CreateByClass(const char * id, WED_Archive * parent, int in_ID);
 
+	// For loaders that build objects on several threads: BuildByClass makes the object without telling the archive
+	// (it touches nothing shared, so it is thread safe); AddToArchive must then be called on the main thread before
+	// anyone else sees the object.
+	static	WED_Persistent *BuildByClass(const char * id, WED_Archive * parent, int in_ID);
+			void			AddToArchive(void) { PostCtor(); }
+
 							WED_Persistent(WED_Archive * parent);
 							WED_Persistent(WED_Archive * parent, int inID);
 
@@ -194,6 +200,10 @@ public:
 	//IMPORTANT! Despite "Changed" being past tense, StateChanged MUST BE CALLED BEFORE changes to the object!
 			void 			StateChanged(int change_kind = wed_Change_Any);
 
+	// Like StateChanged, but promises that only undo section "section" (see below) is about to change.  This is the only
+	// way to announce a change to a lazy section.
+			void			SectionChanged(int section, int change_kind = wed_Change_Any);
+
 	// Methods provided by the base: all persistent objs must have an archive and
 	// GUID - this is non-negotiable!
 
@@ -209,6 +219,19 @@ public:
 	virtual	void			ToXML(WED_XMLElement * parent)=0;
 	virtual	void			FromXML(WED_XMLReader * reader, const XML_Char ** atts)=0;
 
+	// Undo sections.  The undo system snapshots, compares and restores an object one section at a time, so that the
+	// memory an undo step holds and the time to undo/redo it follow what the command actually changed, not the size of
+	// the objects it touched.  StateChanged snapshots every section that is not lazy; a lazy section (a big ID list, say)
+	// is only snapshotted by SectionChanged, so it must never be modified without calling SectionChanged first.
+	//
+	// Sections must be independent of each other, and reading every section into a freshly made object must give the
+	// same object as ReadFrom.  ReadUndoSection gets the byte length of the section's stream and returns true if it needs
+	// a post-change notification, like ReadFrom.  The default is one section that is the whole object.
+	virtual	int				CountUndoSections(void) const { return 1; }
+	virtual	bool			IsLazyUndoSection(int n) const { return false; }
+	virtual	void			WriteUndoSection(int n, IOWriter * writer) { WriteTo(writer); }
+	virtual	bool			ReadUndoSection(int n, IOReader * reader, int bytes) { return ReadFrom(reader); }
+
 	// If you return true from read, this is called on you AFTER the entire archive is
 	// processed. Computing that requires all peers/parents/children to be fully
 	// re-instantiated goes here.
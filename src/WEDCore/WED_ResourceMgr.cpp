@@ -33,10 +33,17 @@
 #include "XObjReadWrite.h"
 #include "ObjConvert.h"
 #include "FileUtils.h"
+#include "PlatformUtils.h"
 #include "WED_PackageMgr.h"
+#include "WED_Thing.h"
+#include "IHasResource.h"
 #include "CompGeomDefs2.h"
 #include "MathUtils.h"
 
+#define MAX_LOADER_THREADS 8
+#define LOADER_POLL_SECONDS 0.1
+#define OBJ_CACHE_FOLDER "wed_obj_cache"
+
 /* Resouce Manager Theory of operation:
 	It provides access to all properties/details of any art asset referenced in WED.	Normally these art assets are 
 	identified by a virtual path (vpath). This is how all non-local assets are indexed in the RegMgr's databases.
@@ -79,12 +86,24 @@ static void process_texture_path(const string& path_of_obj, string& path_of_tex)
 	path_of_tex = parent + ".bmp";
 }
 
-WED_ResourceMgr::WED_ResourceMgr(WED_LibraryMgr * in_library) : mLibrary(in_library)
+WED_ResourceMgr::WED_ResourceMgr(WED_LibraryMgr * in_library) : mLibrary(in_library),
+	mTimerRunning(false), mLoadGeneration(0), mLoadQuit(false)
 {
 }
 
 WED_ResourceMgr::~WED_ResourceMgr()
 {
+	{
+		lock_guard<mutex> lock(mLoadMutex);
+		mLoadQuit = true;
+	}
+	mLoadWork.notify_all();
+	for(auto& t : mLoaders)
+		t.join();
+	for(auto& j : mLoadTodo)
+		delete j.result;
+	for(auto& j : mLoadResults)
+		delete j.result;
 	Purge();
 }
 
@@ -102,6 +121,17 @@ void	WED_ResourceMgr::Purge(void)
 	mFor.clear();
 	mFac.clear();
 	mStr.clear();
+
+	// Anything still in the loader queue was resolved against the old library - drop it when it shows up.
+	{
+		lock_guard<mutex> lock(mLoadMutex);
+		++mLoadGeneration;
+		for(auto& j : mLoadTodo)
+			delete j.result;
+		mLoadTodo.clear();
+	}
+	mObjLoading.clear();
+	mObjFailed.clear();
 }
 
 int		WED_ResourceMgr::GetNumVariants(const string& path)
@@ -109,13 +139,27 @@ int		WED_ResourceMgr::GetNumVariants(const string& path)
 	return mLibrary->GetNumVariants(path);
 }
 
+static string make_obj_cache_dir()
+{
+	string dir = GetCacheFolder();
+	if(dir.empty()) return dir;
+	dir += DIR_STR OBJ_CACHE_FOLDER;
+	if(FILE_make_dir_exist(dir.c_str()) != 0) return string();
+	return dir + DIR_STR;
+}
+
 XObj8 * WED_ResourceMgr::LoadObj(const string& abspath)
 {
 
 //printf("LoadObj '%s' - ",abspath.c_str());
 
+	// Binary copies of parsed OBJs - no cache folder means we parse the text every time.
+	static const string obj_cache_dir = make_obj_cache_dir();
+
 	XObj8 * new_obj = new XObj8;
-	if(!XObj8Read(abspath.c_str(),*new_obj))
+	bool ok = obj_cache_dir.empty() ? XObj8Read(abspath.c_str(),*new_obj)
+	                                : XObj8ReadCached(abspath.c_str(),*new_obj,obj_cache_dir.c_str());
+	if(!ok)
 	{
 		XObj obj7;
 		if(XObjRead(abspath.c_str(),obj7))
@@ -220,6 +264,210 @@ bool	WED_ResourceMgr::GetObj(const string& vpath, XObj8 const *& obj, int varian
 	return true;
 }
 
+void	WED_ResourceMgr::QueueObj(const string& key, const string& abspath, int variant)
+{
+	pair<string,int> id(key, variant);
+	if(mObjLoading.count(id) || mObjFailed.count(id)) return;
+	mObjLoading.insert(id);
+
+	{
+		lock_guard<mutex> lock(mLoadMutex);
+		obj_job_t j = { key, abspath, variant, mLoadGeneration, nullptr };
+		mLoadTodo.push_back(j);
+
+		if(mLoaders.empty())
+		{
+			int n = intlim((int) thread::hardware_concurrency() - 1, 1, MAX_LOADER_THREADS);
+			for(int t = 0; t < n; ++t)
+				mLoaders.push_back(thread(&WED_ResourceMgr::LoaderThread, this));
+		}
+	}
+	mLoadWork.notify_one();
+
+	if(!mTimerRunning)
+	{
+		Start(LOADER_POLL_SECONDS);
+		mTimerRunning = true;
+	}
+}
+
+// Take one job off the queue and load it. Called with the lock held, which is dropped while loading.
+bool	WED_ResourceMgr::RunOneJob(unique_lock<mutex>& lock)
+{
+	if(mLoadTodo.empty()) return false;
+	obj_job_t j = mLoadTodo.front();
+	mLoadTodo.pop_front();
+
+	lock.unlock();
+	j.result = LoadObj(j.abspath);
+	lock.lock();
+
+	mLoadResults.push_back(j);
+	mLoadDone.notify_all();
+	return true;
+}
+
+void	WED_ResourceMgr::LoaderThread(void)
+{
+	unique_lock<mutex> lock(mLoadMutex);
+	while(!mLoadQuit)
+	{
+		if(!RunOneJob(lock))
+			mLoadWork.wait(lock);
+	}
+}
+
+// Move whatever the loaders finished into the cache. Main thread only. Returns true if we got anything new.
+bool	WED_ResourceMgr::IntegrateLoaded(void)
+{
+	list<obj_job_t> results;
+	int generation;
+	{
+		lock_guard<mutex> lock(mLoadMutex);
+		results.swap(mLoadResults);
+		generation = mLoadGeneration;
+	}
+
+	bool got_any = false;
+	for(auto& j : results)
+	{
+		if(j.generation != generation)
+		{
+			delete j.result;
+			continue;
+		}
+		mObjLoading.erase(pair<string,int>(j.key, j.variant));
+
+		if(!j.result)
+		{
+			mObjFailed.insert(pair<string,int>(j.key, j.variant));
+			continue;
+		}
+		vector<const XObj8 *>& variants = mObj[j.key];
+		if(variants.size() == j.variant)						// a blocking GetObj might have beaten us to it
+		{
+			variants.push_back(j.result);
+			got_any = true;
+		}
+		else
+			delete j.result;
+	}
+	return got_any;
+}
+
+void	WED_ResourceMgr::TimerFired(void)
+{
+	if(IntegrateLoaded())
+		BroadcastMessage(msg_ArtAssetsLoaded, 0);
+
+	if(mObjLoading.empty())
+	{
+		Stop();
+		mTimerRunning = false;
+	}
+}
+
+bool	WED_ResourceMgr::RequestObj(const string& vpath, XObj8 const *& obj, int variant)
+{
+	if(toupper(vpath[vpath.size()-3]) != 'O') return false;
+
+	auto i = mObj.find(vpath);
+	int first_needed = 0;
+	if(i != mObj.end())
+	{
+		if(variant < i->second.size())
+		{
+			obj = i->second[variant];
+			return true;
+		}
+		first_needed = i->second.size();
+	}
+
+	// Variants are stored in order, so always ask for the first one we are missing. The rest comes on later requests.
+	string p = mLibrary->GetResourcePath(vpath, first_needed);
+	if(!p.empty())
+		QueueObj(vpath, p, first_needed);
+	return false;
+}
+
+bool	WED_ResourceMgr::RequestObjRelative(const string& obj_path, const string& parent_path, XObj8 const *& obj)
+{
+	// same resolution rules as GetObjRelative
+	if(mLibrary->GetResourcePath(obj_path).size())
+	{
+		if(RequestObj(obj_path, obj))
+			return true;
+		if(IsLoading(obj_path))
+			return false;
+	}
+
+	string apath = FILE_get_dir_name(mLibrary->GetResourcePath(parent_path)) + obj_path;
+	auto i = mObj.find(apath);
+	if(i != mObj.end())
+	{
+		obj = i->second.front();
+		return true;
+	}
+	QueueObj(apath, apath, 0);
+	return false;
+}
+
+bool	WED_ResourceMgr::IsLoading(const string& vpath, int variant) const
+{
+	return mObjLoading.count(pair<string,int>(vpath, variant)) > 0;
+}
+
+static void collect_resources(WED_Thing * t, set<string>& out)
+{
+	IHasResource * r = dynamic_cast<IHasResource *>(t);
+	if(r)
+	{
+		string res;
+		r->GetResource(res);
+		if(res.size() > 3)
+			out.insert(res);
+	}
+	int nc = t->CountChildren();
+	for(int n = 0; n < nc; ++n)
+		collect_resources(t->GetNthChild(n), out);
+}
+
+void	WED_ResourceMgr::Preload(WED_Thing * root, bool wait)
+{
+	set<string> res;
+	collect_resources(root, res);
+
+	const XObj8 * o;
+	for(auto& r : res)
+	{
+		if(RequestObj(r, o)) continue;
+		if(IsLoading(r)) continue;
+
+		// AGPs are small - read them right here and have their objects loaded, too.
+		agp_t agp;
+		if(toupper(r[r.size()-3]) == 'A' && GetAGP(r, agp))
+			for(auto& ao : agp.objs)
+				RequestObjRelative(ao.name, r, o);
+	}
+
+	if(!wait) return;
+
+	// Lend the loaders a hand while we are waiting anyway.
+	unique_lock<mutex> lock(mLoadMutex);
+	while(true)
+	{
+		lock.unlock();
+		IntegrateLoaded();
+		lock.lock();
+		if(mObjLoading.empty()) break;
+		if(!RunOneJob(lock) && mLoadResults.empty())
+			mLoadDone.wait(lock);
+	}
+	lock.unlock();
+
+	BroadcastMessage(msg_ArtAssetsLoaded, 0);
+}
+
 bool 	WED_ResourceMgr::SetPolUV(const string& path, Bbox2 box)
 {
 	auto i = mPol.find(path);
@@ -42,16 +42,39 @@
 	it's also definitely not very dangerous at this point in the code's development - that is, WED is not so big that this
 	represents a scalability issue.
 
+	BACKGROUND LOADING
+
+	Parsing OBJs is by far the most expensive thing we do here, and doing it on first use meant the UI stalled whenever a
+	document was opened or the map scrolled over a lot of new objects.  So OBJs can also be loaded by a pool of loader
+	threads:
+
+	- RequestObj/RequestObjRelative never block: they return the object if we have it, and otherwise queue it for the
+	  loaders and return false.  The caller draws a placeholder (IsLoading tells it apart from a missing object).
+	- Loaded objects are only ever moved into mObj on the main thread (from a timer), which then broadcasts
+	  msg_ArtAssetsLoaded so the map can redraw.  The loaders never touch the library or the caches - the real path of
+	  every job is resolved when it is queued.
+	- Preload queues all OBJs used by a part of the document - on open this feeds the loaders in the background, and
+	  validation/export can wait for the whole lot to be loaded in parallel instead of one at a time.
+
+	The blocking Get calls are unchanged; if they ask for something that is still queued they just load it right away
+	and the loader's copy is dropped when it arrives.  Purge bumps a generation count so that results of jobs queued
+	before the purge are dropped as well.
+
 */
 
 #include "GUI_Listener.h"
 #include "GUI_Broadcaster.h"
+#include "GUI_Timer.h"
 #include "IBase.h"
 #include "XObjDefs.h"
 #include "CompGeomDefs2.h"
 #include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 class	WED_LibraryMgr;
+class	WED_Thing;
 
 struct	pol_info_t {
 	string		base_tex; //Relative path
@@ -136,7 +159,7 @@ struct agp_t {
 };
 
 
-class WED_ResourceMgr : public GUI_Broadcaster, public GUI_Listener, public virtual IBase {
+class WED_ResourceMgr : public GUI_Broadcaster, public GUI_Listener, public GUI_Timer, public virtual IBase {
 public:
 
 					 WED_ResourceMgr(WED_LibraryMgr * in_library);
@@ -159,14 +182,37 @@ public:
 			bool	GetAGP(const string& path, agp_t& out_info);
 			bool	GetRoad(const string& path, road_info_t& out_info);
 
+			// Non-blocking versions of GetObj/GetObjRelative - if the OBJ isn't loaded yet it is queued for the loader threads.
+			bool	RequestObj(const string& path, XObj8 const *& obj, int variant = 0);
+			bool	RequestObjRelative(const string& obj_path, const string& parent_path, XObj8 const *& obj);
+			bool	IsLoading(const string& path, int variant = 0) const;
+
+			// Queue every OBJ used by anything in or below root - and if wait is set, don't return until they are all loaded.
+			void	Preload(WED_Thing * root, bool wait);
+
 	virtual	void	ReceiveMessage(
 							GUI_Broadcaster *		inSrc,
 							intptr_t				inMsg,
 							intptr_t				inParam);
 
+	virtual	void	TimerFired(void);
+
 private:
 
-			XObj8 * LoadObj(const string& abspath);
+	static	XObj8 * LoadObj(const string& abspath);
+
+	struct obj_job_t {
+		string		key;				// vpath - or the absolute path for objects referenced by a relative path
+		string		abspath;
+		int			variant;
+		int			generation;
+		XObj8 *		result;
+	};
+
+			void	QueueObj(const string& key, const string& abspath, int variant);
+			bool	RunOneJob(unique_lock<mutex>& lock);
+			void	LoaderThread(void);
+			bool	IntegrateLoaded(void);
 	
 	unordered_map<string,vector<fac_info_t *> > mFac;
 	unordered_map<string,pol_info_t>		mPol;
@@ -179,6 +225,20 @@ private:
 	unordered_map<string,road_info_t>		mRoad;
 #endif	
 	WED_LibraryMgr *				mLibrary;
+
+	// Background OBJ loading - mObjLoading, mObjFailed and mTimerRunning are main thread only, the rest is guarded by mLoadMutex.
+	set<pair<string,int> >			mObjLoading;
+	set<pair<string,int> >			mObjFailed;
+	bool							mTimerRunning;
+
+	mutex							mLoadMutex;
+	condition_variable				mLoadWork;			// signalled when a job is queued or we quit
+	condition_variable				mLoadDone;			// signalled when a job is done
+	list<obj_job_t>					mLoadTodo;
+	list<obj_job_t>					mLoadResults;
+	vector<thread>					mLoaders;
+	int								mLoadGeneration;
+	bool							mLoadQuit;
 };	
 
 #endif /* WED_ResourceMgr_H */
@@ -23,31 +23,58 @@
 
 #include "WED_UndoLayer.h"
 #include "WED_Persistent.h"
-#include "WED_Buffer.h"
 #include "WED_Archive.h"
 #include "AssertUtils.h"
-#include "WED_FastBuffer.h"
-// NOTE: we could store no turd for created objs
+#include "IODefs.h"
+
+// Native byte streams for section snapshots.  An int is sizeof(int) bytes - ID list sections size themselves off of that.
+
+class	undo_writer : public IOWriter {
+public:
+					undo_writer(vector<char>& dst) : mDst(dst) { }
+
+	virtual	void	WriteShort(short v)		{ put(&v, sizeof(v)); }
+	virtual	void	WriteInt(int v)			{ put(&v, sizeof(v)); }
+	virtual	void	WriteFloat(float v)		{ put(&v, sizeof(v)); }
+	virtual	void	WriteDouble(double v)	{ put(&v, sizeof(v)); }
+	virtual	void	WriteBulk(const char * inBuf, int inLength, bool inZip) { put(inBuf, inLength); }
+
+private:
+			void	put(const void * p, size_t l) { const char * c = (const char *) p; mDst.insert(mDst.end(), c, c + l); }
+
+	vector<char>&	mDst;
+};
+
+class	undo_reader : public IOReader {
+public:
+					undo_reader(const char * p, const char * e) : mP(p), mEnd(e) { }
+
+	virtual	void	ReadShort(short& v)		{ get(&v, sizeof(v)); }
+	virtual	void	ReadInt(int& v)			{ get(&v, sizeof(v)); }
+	virtual	void	ReadFloat(float& v)		{ get(&v, sizeof(v)); }
+	virtual	void	ReadDouble(double& v)	{ get(&v, sizeof(v)); }
+	virtual	void	ReadBulk(char * inBuf, int inLength, bool inZip) { get(inBuf, inLength); }
+
+private:
+			void	get(void * p, size_t l) { DebugAssert(mP + l <= mEnd); memcpy(p, mP, l); mP += l; }
+
+	const char *	mP;
+	const char *	mEnd;
+};
 
 WED_UndoLayer::WED_UndoLayer(WED_Archive * inArchive, const string& inName, const char * inFile, int inLine) :
-	mArchive(inArchive), mName(inName), mChangeMask(0), mFile(inFile), mLine(inLine)
+	mArchive(inArchive), mName(inName), mChangeMask(0), mFile(inFile), mLine(inLine), mCompacted(false)
 {
-	mStorage = new WED_FastBufferGroup;
 }
 
 WED_UndoLayer::~WED_UndoLayer(void)
 {
-//	for(ObjInfoMap::iterator i = mObjects.begin(); i != mObjects.end(); ++i)
-//	{
-//		if (i->second.buffer)
-//			delete i->second.buffer;
-//	}
-	delete mStorage;
 }
 
 void 	WED_UndoLayer::ObjectCreated(WED_Persistent * inObject)
 {
 		mChangeMask |= wed_Change_CreateDestroy;
+	DebugAssert(!mCompacted);
 
 	ObjInfoMap::iterator iter = mObjects.find(inObject->GetID());
 	if (iter != mObjects.end())
@@ -55,51 +82,62 @@ void 	WED_UndoLayer::ObjectCreated(WED_Persistent * inObject)
 		// There is only one possible "rewrite" - if we are creating and knew
 		// about the obj - it better have been destroyed!  In this case
 		// destroy + recreate = change.  But keep the original data, the earliest
-		// not this recent data.
+		// not this recent data - the destroy saved every section.
 		Assert(iter->second.op == op_Destroyed);
 		iter->second.op = op_Changed;
 
 	} else {
-		// Brand new object
+		// Brand new object - undo just deletes it, so there is nothing to save.
 		ObjInfo	info;
-		info.the_class = inObject->GetClass();
 		info.op = op_Created;
-		info.id = inObject->GetID();
-		info.buffer = NULL;
+		info.dirty = 0;
+		info.the_class = inObject->GetClass();
+		info.sections = -1;
+		info.eager_done = true;
 		mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info));
 	}
 }
 
 
-void	WED_UndoLayer::ObjectChanged(WED_Persistent * inObject, int change_kind)
+void	WED_UndoLayer::ObjectChanged(WED_Persistent * inObject, int change_kind, int section)
 {
 	mChangeMask |= change_kind;
+	DebugAssert(!mCompacted);
 	ObjInfoMap::iterator iter = mObjects.find(inObject->GetID());
 	if (iter != mObjects.end())
 	{
 		// Object is changed - it must not have been destroyed before!
 		Assert(iter->second.op != op_Destroyed);
 		// Create + change = create, change + change = change, so
-		// no change in the op.  Not even a change is needed, because we
-		// want to store the original data, not this latest change.
-
+		// no change in the op.  Sections we already saved hold the original
+		// data, so only sections we have not seen yet get saved below.
 	} else {
 		// First time changed
 		ObjInfo	info;
-		info.the_class = inObject->GetClass();
 		info.op = op_Changed;
-		info.id = inObject->GetID();
-		info.buffer = mStorage->MakeNewBuffer();
-//		info.buffer = new WED_Buffer;
-		inObject->WriteTo(info.buffer);
-		info.buffer->WriteInt(inObject->GetDirty());
-		mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info));
+		info.dirty = inObject->GetDirty();
+		info.the_class = inObject->GetClass();
+		info.sections = -1;
+		info.eager_done = false;
+		iter = mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info)).first;
 	}
+
+	ObjInfo& info(iter->second);
+	if (info.op == op_Created)
+		return;
+	if (section == -1)
+	{
+		if (!info.eager_done)
+			SaveSections(inObject, info, false);
+	}
+	else if (!HasSection(info, section))
+		SaveSection(inObject, info, section);
 }
 
 void	WED_UndoLayer::ObjectDestroyed(WED_Persistent * inObject)
 {
 		mChangeMask |= wed_Change_CreateDestroy;
+	DebugAssert(!mCompacted);
 	ObjInfoMap::iterator iter = mObjects.find(inObject->GetID());
 	if (iter != mObjects.end())
 	{
@@ -110,70 +148,191 @@ void	WED_UndoLayer::ObjectDestroyed(WED_Persistent * inObject)
 		if (iter->second.op == op_Created)
 		{
 			// Special case - a created and nuked object basically is temporary
-			// and is unneeded in the bigger scheme of things.
-			// Ben says: yes this sadly leaks space in the undo buffer, but
-			// generally creating and then nuking a huge number of objects
-			// is a rare use pattern....the compression and speed the consolidated
-			// buffer gives us is a lot more important.
+			// and is unneeded in the bigger scheme of things.  Created objects
+			// never save anything, so this does not leak snapshot space.
 			mObjects.erase(iter);
 		} else {
-			// Note that we don't need to save the data - the original
-			// change op already saved it!
+			// Sections the change saved are the originals; the rest have not
+			// been touched yet, so save them now to be able to rebuild the object.
+			SaveSections(inObject, iter->second, true);
 			iter->second.op = op_Destroyed;
 		}
 	} else {
 		// First time changed
 		ObjInfo	info;
-		info.the_class = inObject->GetClass();
 		info.op = op_Destroyed;
-		info.id = inObject->GetID();
-		info.buffer = mStorage->MakeNewBuffer();
-//		info.buffer = new WED_Buffer;
-		inObject->WriteTo(info.buffer);
-		info.buffer->WriteInt(inObject->GetDirty());
-		mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info));
+		info.dirty = inObject->GetDirty();
+		info.the_class = inObject->GetClass();
+		info.sections = -1;
+		info.eager_done = false;
+		iter = mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info)).first;
+		SaveSections(inObject, iter->second, true);
 	}
 
 }
 
+bool	WED_UndoLayer::HasSection(const ObjInfo& info, int section) const
+{
+	for (int s = info.sections; s != -1; s = mSections[s].next)
+		if (mSections[s].section == section)
+			return true;
+	return false;
+}
+
+void	WED_UndoLayer::SaveSection(WED_Persistent * inObject, ObjInfo& info, int section)
+{
+	SectionInfo si;
+	si.section = section;
+	si.prefix = 0;
+	si.suffix = 0;
+	si.offset = mData.size();
+	undo_writer w(mData);
+	inObject->WriteUndoSection(section, &w);
+	si.length = mData.size() - si.offset;
+	si.next = info.sections;
+	info.sections = mSections.size();
+	mSections.push_back(si);
+}
+
+void	WED_UndoLayer::SaveSections(WED_Persistent * inObject, ObjInfo& info, bool lazy_too)
+{
+	int sc = inObject->CountUndoSections();
+	for (int s = 0; s < sc; ++s)
+	if ((lazy_too || !inObject->IsLazyUndoSection(s)) && !HasSection(info, s))
+		SaveSection(inObject, info, s);
+	info.eager_done = true;
+}
+
+void	WED_UndoLayer::Compact(void)
+{
+	if (mCompacted) return;
+	mCompacted = true;
+
+	vector<char>		data, cur;
+	vector<SectionInfo>	sections;
+
+	for (ObjInfoMap::iterator i = mObjects.begin(); i != mObjects.end(); )
+	{
+		ObjInfo& info(i->second);
+
+		// Destroyed objects have nothing to compare against - they keep everything.
+		WED_Persistent * obj = NULL;
+		if (info.op == op_Changed)
+		{
+			obj = mArchive->Fetch(i->first);
+			Assert(obj != NULL);
+		}
+
+		int head = -1;
+		for (int s = info.sections; s != -1; s = mSections[s].next)
+		{
+			SectionInfo si = mSections[s];
+			const char * old_p = mData.data() + si.offset;
+			if (obj)
+			{
+				cur.clear();
+				undo_writer w(cur);
+				obj->WriteUndoSection(si.section, &w);
+
+				int cur_len = cur.size();
+				int common = min(si.length, cur_len);
+				int p = 0, q = 0;
+				while (p < common && old_p[p] == cur[p])
+					++p;
+				if (p == si.length && p == cur_len)
+					continue;
+				while (q < common - p && old_p[si.length - 1 - q] == cur[cur_len - 1 - q])
+					++q;
+
+				si.prefix = p;
+				si.suffix = q;
+				old_p += p;
+				si.length -= p + q;
+			}
+			si.offset = data.size();
+			data.insert(data.end(), old_p, old_p + si.length);
+			si.next = head;
+			head = sections.size();
+			sections.push_back(si);
+		}
+		info.sections = head;
+
+		// A change that put everything back the way it was needs no undo at all.
+		if (obj && head == -1)
+			mObjects.erase(i++);
+		else
+			++i;
+	}
+
+	mData.swap(data);
+	mSections.swap(sections);
+	mData.shrink_to_fit();
+	mSections.shrink_to_fit();
+}
+
+size_t	WED_UndoLayer::GetMemoryUsage(void) const
+{
+	// Hash map nodes are estimated as the pair plus a next ptr and a bucket slot.
+	return sizeof(*this) + mName.capacity() + mData.capacity() +
+		mSections.capacity() * sizeof(SectionInfo) +
+		mObjects.size() * (sizeof(ObjInfoMap::value_type) + 2 * sizeof(void *));
+}
+
 void	WED_UndoLayer::Execute(void)
 {
 	vector<WED_Persistent *>	needs_post_call;
-	int d;
+	vector<char>				cur, buf;
 	for (ObjInfoMap::iterator i = mObjects.begin(); i != mObjects.end(); ++i)
 	{
+		ObjInfo& info(i->second);
 		WED_Persistent * obj;
-		switch(i->second.op) {
+		switch(info.op) {
 		case op_Created:
 			obj = mArchive->Fetch(i->first);
-			DebugAssert(i->second.buffer == NULL);
+			DebugAssert(info.sections == -1);
 			Assert(obj != NULL);
 			obj->Delete();
-			break;
+			continue;
 		case op_Changed:
 			obj = mArchive->Fetch(i->first);
 			Assert(obj != NULL);
-			DebugAssert(i->second.buffer != NULL);
-			i->second.buffer->ResetRead();
-			obj->StateChanged();
-			if(obj->ReadFrom(i->second.buffer))
-				needs_post_call.push_back(obj);
-			i->second.buffer->ReadInt(d);
-			obj->SetDirty(d);
 			break;
 		case op_Destroyed:
-			obj = WED_Persistent::CreateByClass(i->second.the_class, mArchive, i->first);
+			obj = WED_Persistent::CreateByClass(info.the_class, mArchive, i->first);
 			DebugAssert(obj != NULL);
-			DebugAssert(i->second.buffer != NULL);
-			i->second.buffer->ResetRead();
-			if(obj->ReadFrom(i->second.buffer))
-				needs_post_call.push_back(obj);
-			i->second.buffer->ReadInt(d);
-			obj->SetDirty(d);
 			break;
 		}
+
+		bool post = false;
+		for (int s = info.sections; s != -1; s = mSections[s].next)
+		{
+			const SectionInfo& si(mSections[s]);
+			const char * p = mData.data() + si.offset;
+			int len = si.length;
+			if (si.prefix || si.suffix)
+			{
+				// Splice the saved middle back between the parts of the current stream that never changed.
+				DebugAssert(info.op == op_Changed);
+				cur.clear();
+				undo_writer w(cur);
+				obj->WriteUndoSection(si.section, &w);
+				DebugAssert(si.prefix + si.suffix <= cur.size());
+				buf.assign(cur.begin(), cur.begin() + si.prefix);
+				buf.insert(buf.end(), p, p + len);
+				buf.insert(buf.end(), cur.end() - si.suffix, cur.end());
+				p = buf.data();
+				len = buf.size();
+			}
+			if (info.op == op_Changed)
+				obj->SectionChanged(si.section);
+			undo_reader r(p, p + len);
+			if (obj->ReadUndoSection(si.section, &r, len))
+				post = true;
+		}
+		obj->SetDirty(info.dirty);
+		if (post)
+			needs_post_call.push_back(obj);
 	}
 	for(vector<WED_Persistent *>::iterator o = needs_post_call.begin(); o != needs_post_call.end(); ++o)
 		(*o)->PostChangeNotify();
 }
-
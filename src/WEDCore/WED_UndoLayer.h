@@ -24,10 +24,25 @@
 #ifndef WED_UNDOLAYER_H
 #define WED_UNDOLAYER_H
 
+/*
+	WED_UndoLayer - THEORY OF OPERATION
+
+	An undo layer records the ORIGINAL state of everything one command touched, so that Execute can put it back.
+
+	Objects are recorded one undo section at a time (see WED_Persistent) - a section is snapshotted the first time the
+	command announces it is about to change it, and never again.  So touching a polygon's property copies its properties,
+	not its child list, and adding a child to a group copies the group's child list only.
+
+	When the command is over, Compact compares every snapshot with the object's current state.  Sections that did not
+	really change are dropped and the rest are trimmed down to the bytes between the common front and back of the old and
+	new streams.  Execute rebuilds the original stream from the current one plus that middle run.  This is only valid
+	while the archive is in the exact state the layer was compacted against, which the undo/redo stacks guarantee.
+
+	All snapshot bytes live in one vector per layer, so GetMemoryUsage is cheap and honest enough for the undo manager to
+	cap its history by memory.
+*/
+
 class	WED_Archive;
-class	WED_Buffer;
-class	WED_FastBuffer;
-class	WED_FastBufferGroup;
 class	WED_Persistent;
 
 #define 	UNDO_DISCARD	((WED_UndoLayer *) -1)
@@ -40,11 +55,15 @@ public:
 				~WED_UndoLayer(void);
 
 		void 	ObjectCreated(WED_Persistent * inObject);
-		void	ObjectChanged(WED_Persistent * inObject, int change_kind);
+		void	ObjectChanged(WED_Persistent * inObject, int change_kind, int section);		// section -1 = all non-lazy sections
 		void	ObjectDestroyed(WED_Persistent * inObject);
 
 		void	Execute(void);
 
+		// Drop what did not change - call once the command is done, with the archive still in its post-command state.
+		void	Compact(void);
+		size_t	GetMemoryUsage(void) const;
+
 		string	GetName(void) const { return mName; }
 		const char * GetFile(void) const { return mFile; }
 		int		GetLine(void) const { return mLine; }
@@ -60,22 +79,38 @@ private:
 			op_Destroyed
 	};
 
+	struct SectionInfo {
+		int					section;
+		int					prefix;			// Bytes shared with the current stream at its front...
+		int					suffix;			// ...and at its back.  The original middle run is stored.
+		int					offset;			// Where that run starts in mData, and its length.
+		int					length;
+		int					next;			// Next section of the same object in mSections, -1 ends the chain.
+	};
+
 	struct ObjInfo {
 		LayerOp				op;
-		int					id;
+		int					dirty;
 		const char *		the_class;
-		WED_FastBuffer *	buffer;
+		int					sections;		// Head of our section chain, -1 if none.
+		bool				eager_done;		// All non-lazy sections are snapshotted.
 	};
 
 	typedef hash_map<int, ObjInfo>		ObjInfoMap;
 
+	bool	HasSection(const ObjInfo& info, int section) const;
+	void	SaveSection(WED_Persistent * inObject, ObjInfo& info, int section);
+	void	SaveSections(WED_Persistent * inObject, ObjInfo& info, bool lazy_too);
+
 	ObjInfoMap				mObjects;
+	vector<SectionInfo>		mSections;
+	vector<char>			mData;
 	WED_Archive *			mArchive;
 	string					mName;
 	const char *			mFile;
 	int						mLine;
 	int						mChangeMask;
-	WED_FastBufferGroup *	mStorage;
+	bool					mCompacted;
 
 	// Things we do not allow
 	WED_UndoLayer();
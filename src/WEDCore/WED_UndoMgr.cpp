@@ -33,8 +33,13 @@
 // So...the last op DONE is in undo.back()
 // The first op UNDONE is redo.front()
 
+// The history is capped by the memory the layers hold, not just by count - undo layers only keep what their
+// command changed, so a cheap command costs next to nothing while one huge import can be most of the budget.
+// The most recent command is always kept, however big.
+
 #define WARN_IF_LESS_LEVEL	10
-#define MAX_UNDO_LEVELS 20
+#define MAX_UNDO_LEVELS 100
+#define MAX_UNDO_MEMORY (256*1024*1024)
 
 WED_UndoMgr::WED_UndoMgr(WED_Archive * inArchive, WED_UndoFatalErrorHandler * panic_handler) : mCommand(NULL), mArchive(inArchive), mPanicHandler(panic_handler)
 {
@@ -63,11 +68,7 @@ static const char * trim_file(const char * p)
 
 void	WED_UndoMgr::__StartCommand(const string& inName, const char * file, int line)
 {
-	while(mUndo.size() > MAX_UNDO_LEVELS)
-	{
-		delete mUndo.front();
-		mUndo.pop_front();
-	}
+	TrimUndo();
 	
 	// This is the asset case that often burns us: a command is started WHILE another command is going on.  This happens due to
 	// either bad UI code or unknown weird shit from the window mgr.
@@ -100,9 +101,11 @@ void	WED_UndoMgr::CommitCommand(void)
 		return;
 	}
 	PurgeRedo();
+	mCommand->Compact();
 	mUndo.push_back(mCommand);
 	int change_mask = mCommand->GetChangeMask();
 	mCommand = NULL;
+	TrimUndo();
 	mArchive->BroadcastMessage(msg_ArchiveChanged,change_mask);
 }
 
@@ -148,6 +151,7 @@ void	WED_UndoMgr::Undo(void)
 	int change_mask = undo->GetChangeMask();
 	undo->Execute();
 	mArchive->SetUndo(NULL);
+	redo->Compact();
 	mRedo.push_front(redo);
 	delete undo;
 	mUndo.pop_back();
@@ -165,6 +169,7 @@ void	WED_UndoMgr::Redo(void)
 	int change_mask = redo->GetChangeMask();
 	redo->Execute();
 	mArchive->SetUndo(NULL);
+	undo->Compact();
 	mUndo.push_back(undo);
 	delete redo;
 	mRedo.pop_front();
@@ -187,6 +192,33 @@ void	WED_UndoMgr::PurgeRedo(void)
 	mRedo.clear();
 }
 
+size_t	WED_UndoMgr::GetMemoryUsage(void) const
+{
+	size_t total = 0;
+	for (LayerList::const_iterator l = mUndo.begin(); l != mUndo.end(); ++l)
+		total += (*l)->GetMemoryUsage();
+	for (LayerList::const_iterator l = mRedo.begin(); l != mRedo.end(); ++l)
+		total += (*l)->GetMemoryUsage();
+	return total;
+}
+
+void	WED_UndoMgr::TrimUndo(void)
+{
+	while(mUndo.size() > MAX_UNDO_LEVELS)
+	{
+		delete mUndo.front();
+		mUndo.pop_front();
+	}
+
+	size_t total = GetMemoryUsage();
+	while(total > MAX_UNDO_MEMORY && mUndo.size() > 1)
+	{
+		total -= mUndo.front()->GetMemoryUsage();
+		delete mUndo.front();
+		mUndo.pop_front();
+	}
+}
+
 bool	WED_UndoMgr::ReleaseMemory(void)
 {
 	if (mUndo.empty() && mRedo.empty()) return false;
@@ -67,6 +67,9 @@ public:
 	void	PurgeUndo(void);
 	void	PurgeRedo(void);
 
+	// Bytes held by the undo and redo history.
+	size_t	GetMemoryUsage(void) const;
+
 	// From GUI_MemoryHog
 	virtual	bool	ReleaseMemory(void);
 
@@ -74,6 +77,8 @@ private:
 
 	typedef list<WED_UndoLayer *>	LayerList;
 
+	void	TrimUndo(void);		// Enforce the level and memory caps, oldest first.
+
 	LayerList 		mUndo;
 	LayerList		mRedo;
 
@@ -23,8 +23,220 @@
 
 #include "WED_XMLReader.h"
 #include "AssertUtils.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
-WED_XMLReader::WED_XMLReader()
+#define READ_BLOCK	(1024*1024)		// bytes read from the file at a time
+#define BULK_BATCH	(1024*1024)		// bytes of XML handed to a bulk worker at a time
+
+/************************************************************************************************************************
+ * BULK BATCH POOL
+ ************************************************************************************************************************/
+
+// Runs ParseBulk on a pool of threads and calls FinishBulk on the reading thread in the order batches were queued.
+// At most a few batches per thread are in memory at once, so we stream no matter how long the list is.
+
+class	bulk_pool {
+public:
+			 bulk_pool(WED_XMLBulkHandler * handler);
+			~bulk_pool();
+
+	void	queue(string& xml);		// takes the text, leaves xml empty
+	void	finish_all(void);
+
+	string	err;					// first error from any batch
+
+private:
+
+	struct batch_t {
+		string	xml;
+		void *	result;
+		string	err;
+		bool	done;
+	};
+
+	void	finish_oldest(void);
+	void	worker(void);
+
+	WED_XMLBulkHandler *	mHandler;
+	mutex					mMutex;
+	condition_variable		mWork;
+	condition_variable		mDone;
+	deque<batch_t *>		mTodo;			// not yet started
+	deque<batch_t *>		mInFlight;		// queued, in file order - reading thread only
+	int						mMaxInFlight;
+	bool					mQuit;
+	vector<thread>			mThreads;
+};
+
+bulk_pool::bulk_pool(WED_XMLBulkHandler * handler) : mHandler(handler), mQuit(false)
+{
+	int n = max(1, (int) thread::hardware_concurrency());
+	mMaxInFlight = 2 * n + 1;
+	for(int i = 0; i < n; ++i)
+		mThreads.push_back(thread(&bulk_pool::worker, this));
+}
+
+bulk_pool::~bulk_pool()
+{
+	finish_all();
+	{
+		lock_guard<mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWork.notify_all();
+	for(auto& t : mThreads)
+		t.join();
+}
+
+void bulk_pool::queue(string& xml)
+{
+	while(mInFlight.size() >= mMaxInFlight)
+		finish_oldest();
+
+	batch_t * b = new batch_t;
+	b->xml.swap(xml);
+	b->result = NULL;
+	b->done = false;
+	mInFlight.push_back(b);
+	{
+		lock_guard<mutex> lock(mMutex);
+		mTodo.push_back(b);
+	}
+	mWork.notify_one();
+}
+
+void bulk_pool::finish_all(void)
+{
+	while(!mInFlight.empty())
+		finish_oldest();
+}
+
+void bulk_pool::finish_oldest(void)
+{
+	batch_t * b = mInFlight.front();
+	mInFlight.pop_front();
+	{
+		unique_lock<mutex> lock(mMutex);
+		while(!b->done)
+			mDone.wait(lock);
+	}
+	mHandler->FinishBulk(b->result);
+	if(err.empty())
+		err = b->err;
+	delete b;
+}
+
+void bulk_pool::worker(void)
+{
+	unique_lock<mutex> lock(mMutex);
+	while(true)
+	{
+		if(mTodo.empty())
+		{
+			if(mQuit) break;
+			mWork.wait(lock);
+			continue;
+		}
+		batch_t * b = mTodo.front();
+		mTodo.pop_front();
+		lock.unlock();
+
+		b->result = mHandler->ParseBulk(b->xml.data(), b->xml.size(), b->err);
+		string().swap(b->xml);
+
+		lock.lock();
+		b->done = true;
+		mDone.notify_all();
+	}
+}
+
+/************************************************************************************************************************
+ * MARKUP SCANNING
+ ************************************************************************************************************************/
+
+// Just enough of XML to find where elements start and end: tags, end tags, comments, processing instructions, CDATA
+// and DOCTYPE declarations, minding quoted attribute values.  The text is not checked - expat does that later.
+
+enum { mk_start, mk_empty, mk_end, mk_other };
+
+static int	find_str(const char * p, int n, int from, const char * pat)
+{
+	int l = strlen(pat);
+	for(int i = from; i + l <= n; ++i)
+	if(p[i] == pat[0] && memcmp(p + i, pat, l) == 0)
+		return i + l;
+	return -1;
+}
+
+// p[0] is '<'.  Returns the length of the markup there, or -1 if it runs past n.  For tags, [name, name+name_len)
+// is the element name.
+static int	scan_markup(const char * p, int n, int& kind, const char *& name, int& name_len)
+{
+	kind = mk_other;
+	name = NULL;
+	name_len = 0;
+	if(n < 2) return -1;
+
+	if(p[1] == '?')
+		return find_str(p, n, 2, "?>");
+
+	if(p[1] == '!')
+	{
+		if(n < 4) return -1;
+		if(p[2] == '-' && p[3] == '-')
+			return find_str(p, n, 4, "-->");
+		if(n < 9) return -1;
+		if(memcmp(p, "<![CDATA[", 9) == 0)
+			return find_str(p, n, 9, "]]>");
+		int brackets = 0;
+		char quote = 0;
+		for(int i = 2; i < n; ++i)
+		{
+			if(quote)							{ if(p[i] == quote) quote = 0; }
+			else if(p[i] == '"' || p[i] == '\'') quote = p[i];
+			else if(p[i] == '[')				++brackets;
+			else if(p[i] == ']')				--brackets;
+			else if(p[i] == '>' && brackets <= 0) return i + 1;
+		}
+		return -1;
+	}
+
+	int i = 1;
+	if(p[1] == '/')
+	{
+		kind = mk_end;
+		i = 2;
+	}
+	else
+		kind = mk_start;
+	name = p + i;
+	while(i < n && !isspace((unsigned char) p[i]) && p[i] != '/' && p[i] != '>')
+		++i;
+	name_len = p + i - name;
+
+	char quote = 0;
+	for(; i < n; ++i)
+	{
+		if(quote)							{ if(p[i] == quote) quote = 0; }
+		else if(p[i] == '"' || p[i] == '\'') quote = p[i];
+		else if(p[i] == '>')
+		{
+			if(kind == mk_start && p[i-1] == '/')
+				kind = mk_empty;
+			return i + 1;
+		}
+	}
+	return -1;
+}
+
+/************************************************************************************************************************
+ * READER
+ ************************************************************************************************************************/
+
+WED_XMLReader::WED_XMLReader() : skip_root(false)
 {
 	parser = XML_ParserCreate(NULL);
 	XML_SetElementHandler(parser, StartElementHandler, EndElementHandler);
@@ -49,11 +261,26 @@ void	WED_XMLReader::FailWithError(const string& e)
 	XML_StopParser(parser, false);		// we're dead!
 }
 
-string	WED_XMLReader::ReadFile(const char * filename, bool * exists)
+bool	WED_XMLReader::Parse(const char * xml, int len)
+{
+	if(len > 0)
+	if(XML_Parse(parser, xml, len, 0) == XML_STATUS_ERROR)
+	{
+		XML_Error e = XML_GetErrorCode(parser);
+		if(err.empty())
+			err = XML_ErrorString(e);
+		printf("%s At: %zd,%zd\n", err.c_str(), XML_GetCurrentLineNumber(parser), XML_GetCurrentColumnNumber(parser));
+		return false;
+	}
+	return true;
+}
+
+string	WED_XMLReader::ReadFile(const char * filename, bool * exists, const char * bulk_element, int bulk_depth, WED_XMLBulkHandler * bulk)
 {
 	XML_ParserReset(parser, NULL);
 	XML_SetElementHandler(parser, StartElementHandler, EndElementHandler);
 	XML_SetUserData(parser, reinterpret_cast<void*>(this));
+	skip_root = false;
 
 	FILE * fi = fopen(filename,"rb");
 
@@ -68,26 +295,122 @@ string	WED_XMLReader::ReadFile(const char * filename, bool * exists)
 	{
 		return string("Unable to open file:") + string(filename);
 	}
-	char buf[1024];
 
-	//While there is something left to read
-	while(!feof(fi))
+	bulk_pool * pool = bulk ? new bulk_pool(bulk) : NULL;
+	int			bulk_len = bulk ? strlen(bulk_element) : 0;
+	string		buf;				// bytes not yet routed: the tail of the last block (a partial tag) + the new block
+	string		batch;				// children of the bulk element not yet queued
+	bool		in_bulk = false;
+	int			depth = 0;			// elements open at the start of buf
+
+	while(err.empty())
 	{
-		//len is the amount of read in this loop
-		int len = fread(buf,1,sizeof(buf),fi);
-		if(len > 0)
-		if(XML_Parse(parser, buf, len, 0) == XML_STATUS_ERROR)
-		{
-			XML_Error e = XML_GetErrorCode(parser);
-			if(err.empty())
-				err = XML_ErrorString(e);
-			printf("%s At: %zd,%zd\n", err.c_str(), XML_GetCurrentLineNumber(parser), XML_GetCurrentColumnNumber(parser));
+		int old = buf.size();
+		buf.resize(old + READ_BLOCK);
+		int len = fread(&buf[old], 1, READ_BLOCK, fi);
+		buf.resize(old + max(len, 0));
+		if(len <= 0)
 			break;
+
+		if(!pool)
+		{
+			if(!Parse(buf.data(), buf.size()))
+				break;
+			buf.clear();
+			continue;
+		}
+
+		// Walk the markup in the block.  run is the start of the bytes not yet sent to the parser or the batch.
+		const char * p = buf.data();
+		int n = buf.size();
+		int run = 0, i = 0;
+		while(i < n)
+		{
+			const char * lt = (const char *) memchr(p + i, '<', n - i);
+			if(lt == NULL)
+			{
+				i = n;
+				break;
+			}
+			int s = lt - p;
+			int kind, name_len;
+			const char * name;
+			int e = scan_markup(lt, n - s, kind, name, name_len);
+			if(e < 0)
+			{
+				i = s;					// partial markup - wait for the next block
+				break;
+			}
+			e += s;
+
+			if(!in_bulk)
+			{
+				if(kind == mk_start && depth == bulk_depth && name_len == bulk_len && strncmp(name, bulk_element, bulk_len) == 0)
+				{
+					if(!Parse(p + run, e - run))
+						break;
+					run = e;
+					in_bulk = true;
+				}
+			}
+			else if(kind == mk_end && depth == bulk_depth + 1)
+			{
+				// End of the list.  Every object must be in before the handlers see the end tag.
+				batch.append(p + run, s - run);
+				pool->queue(batch);
+				pool->finish_all();
+				run = s;
+				in_bulk = false;
+				if(!pool->err.empty())
+				{
+					err = pool->err;
+					break;
+				}
+			}
+
+			if(kind == mk_start)	++depth;
+			if(kind == mk_end)		--depth;
+
+			if(in_bulk && depth == bulk_depth + 1 && (kind == mk_end || kind == mk_empty))
+			{
+				batch.append(p + run, e - run);
+				run = e;
+				if(batch.size() >= BULK_BATCH)
+				{
+					pool->queue(batch);
+					if(!pool->err.empty())
+					{
+						err = pool->err;
+						break;
+					}
+				}
+			}
+			i = e;
 		}
-		//if total read == 0
+		if(!err.empty())
+			break;
+
+		if(in_bulk)
+			batch.append(p + run, i - run);
+		else if(!Parse(p + run, i - run))
+			break;
+		buf.erase(0, i);
 	}
+
+	// Whatever is left is a tag cut off by the end of the file - let expat complain about it.
+	if(err.empty() && !in_bulk)
+		Parse(buf.data(), buf.size());
+
+	if(pool)
+	{
+		pool->finish_all();
+		if(err.empty())
+			err = pool->err;
+		delete pool;
+	}
+
 	//It reads it again so it can finish off any last pieces remaining
-	XML_Parse(parser, buf, 0, 1);
+	XML_Parse(parser, NULL, 0, 1);
 	XML_Error result = XML_GetErrorCode(parser);
 	 
 	//If the err string is empty and there is some kind of error
@@ -100,12 +423,38 @@ string	WED_XMLReader::ReadFile(const char * filename, bool * exists)
 	return err;
 }
 
+string	WED_XMLReader::ReadFragment(const char * xml, int len)
+{
+	XML_ParserReset(parser, NULL);
+	XML_SetElementHandler(parser, StartElementHandler, EndElementHandler);
+	XML_SetUserData(parser, reinterpret_cast<void*>(this));
+	skip_root = true;
+
+	static const char open_tag[] = "<fragment>";
+	static const char close_tag[] = "</fragment>";
+
+	if(Parse(open_tag, sizeof(open_tag) - 1) && Parse(xml, len) && Parse(close_tag, sizeof(close_tag) - 1))
+	{
+		XML_Parse(parser, NULL, 0, 1);
+		XML_Error result = XML_GetErrorCode(parser);
+		if(err.empty() && result != XML_ERROR_NONE)
+			err = XML_ErrorString(result);
+	}
+	return err;
+}
+
 void	WED_XMLReader::StartElementHandler(void *userData,
 						const XML_Char *name,
 						const XML_Char **atts)
 {
 	WED_XMLReader * me = reinterpret_cast<WED_XMLReader*>(userData);
 	me->new_handler_for_element.push_back(false);
+	if(me->skip_root)
+	{
+		// The made-up parent of a fragment - our handlers never hear about it, except for its EndElement.
+		me->skip_root = false;
+		return;
+	}
 	DebugAssert(!me->handlers.empty());
 	me->handlers.back()->StartElement(me,name,atts);
 }
@@ -58,6 +58,27 @@ public:
 	virtual	void		PopHandler(void)=0;
 };
 
+/*
+	BULK PARSING
+
+	A document that is mostly one long list of independent elements (the <objects> of a WED file) can have that list
+	parsed on several threads.  The reader finds the list by name and depth, cuts its children (uninterpreted XML text)
+	into batches at element boundaries as it streams the file, and hands the batches to a bulk handler on a pool of
+	worker threads.  Everything outside the list - including the list's own start and end tags - still goes through the
+	handler stack on the reading thread.  All batches are finished before the list's end tag is delivered.
+
+*/
+
+class WED_XMLBulkHandler {
+public:
+
+	// Called on a worker thread, batches in any order, with a run of complete child elements of the bulk element.
+	// Returns the batch's results to pass to FinishBulk; sets err on failure.
+	virtual	void *		ParseBulk(const char * xml, int len, string& err)=0;
+	// Called on the reading thread, once for every batch - even failed ones - in file order.
+	virtual	void		FinishBulk(void * batch)=0;
+};
+
 class WED_XMLReader {
 public:
 			 WED_XMLReader();
@@ -66,15 +87,24 @@ public:
 	void	PushHandler(WED_XMLHandler * handler);
 	void	FailWithError(const string& err);
 	
-	// Returns err msg or "" for none.
-	string	ReadFile(const char * filename, bool * exists);
+	// Returns err msg or "" for none.  If bulk is not NULL, the children of the element bulk_element found inside
+	// bulk_depth other elements go to it instead of the handler stack.
+	string	ReadFile(const char * filename, bool * exists,
+						const char * bulk_element = NULL, int bulk_depth = 0, WED_XMLBulkHandler * bulk = NULL);
+
+	// Parses a run of sibling elements held in memory, as if they had one common parent.  The handler stack sees only
+	// the elements themselves.  Returns err msg or "" for none.
+	string	ReadFragment(const char * xml, int len);
 
 private:
 
+	bool	Parse(const char * xml, int len);
+
 	list<WED_XMLHandler *>	handlers;
 	list<bool>				new_handler_for_element;
 	XML_Parser				parser;
 	string					err;
+	bool					skip_root;
 	
 	static void	StartElementHandler(void *userData,
 						const XML_Char *name,
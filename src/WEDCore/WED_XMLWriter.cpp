@@ -53,8 +53,6 @@
 
 #define FIX_EMPTY 0
 
-inline void fi_indent(int n, FILE * fi) { while(n--) fputc(' ', fi); }
-
 inline string str_escape(const string& str)
 {
 	string result;
@@ -131,37 +129,49 @@ WED_XMLElement::WED_XMLElement(
 									const char *		n,
 									int					i,
 									FILE *				f) : 
-	file(f), indent(i), name(n), flushed(false), parent(NULL)
+	file(f), str(NULL), indent(i), name(n), flushed(false), parent(NULL)
+{
+}
+
+WED_XMLElement::WED_XMLElement(
+									const char *		n,
+									int					i,
+									string *			s) : 
+	file(NULL), str(s), indent(i), name(n), flushed(false), parent(NULL)
 {
 }
 
 WED_XMLElement::~WED_XMLElement()
 {
-	if(!flushed)
+	if(!flushed && name)
 	{
-		fi_indent(indent, file);
-		fputc('<',file); fputs(name,file);
-
-		for(auto a : attrs)
-		{
-			fputc(' ',file); fputs(a.first,file); fputs("=\"",file);
-			fputs(a.second.c_str(), file);
-			fputc('"',file);
-		}
-
+		write_open_tag();
 		if(children.empty())
-			fputs("/>\n",file);
+			put("/>\n");
 		else
-			fputs(">\n",file);
+			put(">\n");
 	}
 
 	for(vector<WED_XMLElement *>::iterator c = children.begin(); c != children.end(); ++c)
 		delete *c;
 
-	if(!children.empty() || flushed)
+	if(name && (!children.empty() || flushed))
+	{
+		put_indent(indent);
+		put("</"); put(name); put(">\n");
+	}
+}
+
+void WED_XMLElement::write_open_tag(void)
+{
+	put_indent(indent);
+	put('<'); put(name);
+
+	for(const auto& a : attrs)
 	{
-		fi_indent(indent,file);
-		fputs("</",file); fputs(name,file); fputs(">\n",file);
+		put(' '); put(a.first); put("=\"");
+		put(a.second.c_str());
+		put('"');
 	}
 }
 
@@ -178,18 +188,10 @@ void WED_XMLElement::flush_from(WED_XMLElement * who)
 		parent->flush_from(this);
 	parent = NULL;
 
-	if(!flushed)
+	if(!flushed && name)
 	{
-		fi_indent(indent, file);
-		fputc('<',file); fputs(name,file);
-
-		for(auto a : attrs)
-		{
-			fputc(' ',file); fputs(a.first,file); fputs("=\"",file);
-			fputs(a.second.c_str(), file);
-			fputc('"',file);
-		}
-		fputs(">\n",file);
+		write_open_tag();
+		put(">\n");
 	}
 
 	DebugAssert(who == children.back() || who == NULL);
@@ -288,7 +290,7 @@ WED_XMLElement *		WED_XMLElement::add_sub_element(const char * name)
 	DebugAssert(name && *name);	
 #endif
 
-	WED_XMLElement * child = new WED_XMLElement(name, indent + 2, file);
+	WED_XMLElement * child = file ? new WED_XMLElement(name, indent + 2, file) : new WED_XMLElement(name, indent + 2, str);
 	children.push_back(child);
 	child->parent = this;
 	return child;
@@ -308,7 +310,7 @@ WED_XMLElement *		WED_XMLElement::add_or_find_sub_element(const char * name)
 	if(children[i]->name == n)
 		return children[i];
 		
-	WED_XMLElement * child = new WED_XMLElement(name, indent + 2, file);
+	WED_XMLElement * child = file ? new WED_XMLElement(name, indent + 2, file) : new WED_XMLElement(name, indent + 2, str);
 	children.push_back(child);
 	child->parent = this;
 	return child;
@@ -30,6 +30,10 @@
 	
 	C strings passed to add_attr_c_str are copied - you don't need to retire them.
 
+	An element can write to a string instead of a FILE, so that several threads can each build a piece of one
+	document.  An element with a NULL name is a "fragment": it writes no tags of its own, only its children, so
+	a run of sibling elements can be written on their own and pasted into the document later.
+
  */
 
 class	WED_XMLElement {
@@ -39,6 +43,10 @@ public:
 									const char *		name,
 									int					indent,
 									FILE *				destination);
+				 WED_XMLElement(
+									const char *		name,		// NULL for a fragment
+									int					indent,
+									string *			destination);
 				~WED_XMLElement();
 		
 	void					add_attr_int(const char * name, int value);
@@ -60,9 +68,14 @@ public:
 private:
 
 	void					flush_from(WED_XMLElement * child);
+	void					put(char c)				{ if(file) fputc(c, file); else str->push_back(c); }
+	void					put(const char * s)		{ if(file) fputs(s, file); else str->append(s); }
+	void					put_indent(int n)		{ if(file) while(n--) fputc(' ', file); else str->append(n, ' '); }
+	void					write_open_tag(void);
 
 		bool									flushed;
 		FILE *									file;
+		string *								str;
 		int										indent;
 		const char *							name;
 		vector<pair<const char *,string> >	attrs;
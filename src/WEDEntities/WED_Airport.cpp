@@ -102,6 +102,8 @@ void		WED_Airport::SetSceneryID(int x) { scenery_id = x; }
 //Adds a Meta Data Key
 void		WED_Airport::AddMetaDataKey(const string& key, const string& value)
 {
+	StateChanged(wed_Change_Properties);
+
 	//Insert in alphabetical order
 	vector<meta_data_entry>::iterator itr;
 	
@@ -153,6 +155,7 @@ void	WED_Airport::EditMetaDataKey(const string& key, const string& value)
 	{
 		if(itr->first == key)
 		{
+			StateChanged(wed_Change_Properties);
 			itr->second = value;
 			return;
 		}
@@ -452,7 +455,41 @@ void WED_Airport::CopyFrom(const WED_Airport* rhs)
 bool 			WED_Airport::ReadFrom(IOReader * reader)
 {
 	bool r = WED_GISComposite::ReadFrom(reader);
-	
+	ReadMetaData(reader);
+	return r;
+}
+
+void 			WED_Airport::WriteTo(IOWriter * writer)
+{
+	WED_Thing::WriteTo(writer);
+	WriteMetaData(writer);
+}
+
+// The meta data is one more undo section after everything our bases have.
+
+int				WED_Airport::CountUndoSections(void) const
+{
+	return WED_GISComposite::CountUndoSections() + 1;
+}
+
+void			WED_Airport::WriteUndoSection(int n, IOWriter * writer)
+{
+	if (n < WED_GISComposite::CountUndoSections())
+		WED_GISComposite::WriteUndoSection(n, writer);
+	else
+		WriteMetaData(writer);
+}
+
+bool			WED_Airport::ReadUndoSection(int n, IOReader * reader, int bytes)
+{
+	if (n < WED_GISComposite::CountUndoSections())
+		return WED_GISComposite::ReadUndoSection(n, reader, bytes);
+	ReadMetaData(reader);
+	return true;
+}
+
+void			WED_Airport::ReadMetaData(IOReader * reader)
+{
 	meta_data_vec_map.clear();
 
 	//Loop counter to fill the hashmap back up
@@ -477,13 +514,10 @@ bool 			WED_Airport::ReadFrom(IOReader * reader)
 		
 		meta_data_vec_map.push_back(meta_data_entry(key,val));
 	}
-	return r;
 }
 
-void 			WED_Airport::WriteTo(IOWriter * writer)
+void			WED_Airport::WriteMetaData(IOWriter * writer)
 {
-	WED_Thing::WriteTo(writer);
-	
 	//Write the hashmap size
 	writer->WriteInt(meta_data_vec_map.size());
 	for (vector<meta_data_entry>::iterator it = meta_data_vec_map.begin(); it != meta_data_vec_map.end(); ++it)
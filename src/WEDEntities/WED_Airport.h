@@ -87,6 +87,9 @@ public:
 	//WED_Persistant, for Undo/Redo
 	virtual	bool 			ReadFrom(IOReader * reader);
 	virtual	void 			WriteTo(IOWriter * writer);
+	virtual	int				CountUndoSections(void) const;
+	virtual	void			WriteUndoSection(int n, IOWriter * writer);
+	virtual	bool			ReadUndoSection(int n, IOReader * reader, int bytes);
 
 	//WED_Thing
 	virtual void			AddExtraXML(WED_XMLElement * obj);
@@ -103,6 +106,9 @@ public:
 
 private:
 
+			void			ReadMetaData(IOReader * reader);
+			void			WriteMetaData(IOWriter * writer);
+
 	WED_PropIntEnum				airport_type;
 	WED_PropDoubleTextMeters	elevation;
 	WED_PropBoolText			has_atc;
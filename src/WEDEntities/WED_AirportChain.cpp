@@ -110,6 +110,29 @@ void 			WED_AirportChain::WriteTo(IOWriter * writer)
 	writer->WriteInt(closed);
 }
 
+// Closure is one more undo section after everything the chain has.
+
+int				WED_AirportChain::CountUndoSections(void) const
+{
+	return WED_GISChain::CountUndoSections() + 1;
+}
+
+void			WED_AirportChain::WriteUndoSection(int n, IOWriter * writer)
+{
+	if (n < WED_GISChain::CountUndoSections())
+		WED_GISChain::WriteUndoSection(n, writer);
+	else
+		writer->WriteInt(closed);
+}
+
+bool			WED_AirportChain::ReadUndoSection(int n, IOReader * reader, int bytes)
+{
+	if (n < WED_GISChain::CountUndoSections())
+		return WED_GISChain::ReadUndoSection(n, reader, bytes);
+	reader->ReadInt(closed);
+	return true;
+}
+
 void	WED_AirportChain::AddExtraXML(WED_XMLElement * obj)
 {
 	WED_XMLElement * xml = obj->add_sub_element("airport_chain");
@@ -43,6 +43,9 @@ public:
 	// WED_Persistent
 	virtual	bool 			ReadFrom(IOReader * reader);
 	virtual	void 			WriteTo(IOWriter * writer);
+	virtual	int				CountUndoSections(void) const;
+	virtual	void			WriteUndoSection(int n, IOWriter * writer);
+	virtual	bool			ReadUndoSection(int n, IOReader * reader, int bytes);
 	// WED_Thing
 	virtual	void			AddExtraXML(WED_XMLElement * obj);
 
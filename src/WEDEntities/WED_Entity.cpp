@@ -69,6 +69,12 @@ bool 	WED_Entity::ReadFrom(IOReader * reader)
 	return true;
 }
 
+bool	WED_Entity::ReadUndoSection(int n, IOReader * reader, int bytes)
+{
+	WED_Thing::ReadUndoSection(n, reader, bytes);
+	return true;
+}
+
 void	WED_Entity::PostChangeNotify(void)
 {
 	CacheInval(cache_All);
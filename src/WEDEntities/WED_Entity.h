@@ -114,6 +114,7 @@ public:
 			int		GetHidden(void) const;
 
 	virtual	bool 	ReadFrom(IOReader * reader);
+	virtual	bool	ReadUndoSection(int n, IOReader * reader, int bytes);
 	
 	virtual	void	PostChangeNotify(void);
 	
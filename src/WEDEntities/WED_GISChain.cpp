@@ -512,3 +512,11 @@ IGISEntity *	WED_GISChain::GetNthEntity  (int n) const
 	RebuildCache(CacheBuild(cache_Topological));
 	return mCachePts[n];
 }
+
+void			WED_GISChain::GetEntitiesInBox(const Bbox2& bounds, vector<int>& out_idx) const
+{
+	int n = GetNumEntities();
+	out_idx.resize(n);
+	for (int i = 0; i < n; ++i)
+		out_idx[i] = i;
+}
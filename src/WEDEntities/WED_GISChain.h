@@ -61,6 +61,7 @@ public:
 	// IGISComposite
 	virtual	int				GetNumEntities(void ) const;
 	virtual	IGISEntity *	GetNthEntity  (int n) const;
+	virtual	void			GetEntitiesInBox(const Bbox2& bounds, vector<int>& out_idx) const;
 
 protected:
 
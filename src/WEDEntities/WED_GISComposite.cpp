@@ -23,9 +23,12 @@
 
 #include "WED_GISComposite.h"
 
+// Below this many children a linear walk is as fast as the tree and saves the memory.
+#define MIN_INDEXED_ENTITIES 64
+
 TRIVIAL_COPY(WED_GISComposite, WED_Entity)
 
-WED_GISComposite::WED_GISComposite(WED_Archive * a, int i) : WED_Entity(a,i)
+WED_GISComposite::WED_GISComposite(WED_Archive * a, int i) : WED_Entity(a,i), mIndexStale(true)
 {
 }
 
@@ -72,6 +75,17 @@ bool			WED_GISComposite::IntersectsBox	(GISLayer_t l, const Bbox2&  bounds) cons
 	GetBounds(l,me);
 	if (!bounds.overlap(me)) return false;
 
+	if (l == gis_Geo)
+	{
+		vector<int> hits;
+		GetEntitiesInBox(bounds, hits);
+		for (vector<int>::iterator i = hits.begin(); i != hits.end(); ++i)
+			if (mEntities[*i]->IntersectsBox(l,bounds))
+			if(!IsWEDLocked(mEntities[*i]))
+				return true;
+		return false;
+	}
+
 	int n = GetNumEntities();
 	for (int i = 0; i < n; ++i)
 		if (GetNthEntity(i)->IntersectsBox(l,bounds)) 
@@ -98,6 +112,17 @@ bool			WED_GISComposite::PtWithin		(GISLayer_t l, const Point2& p	 ) const
 	GetBounds(l, me);
 	if (!me.contains(p)) return false;
 
+	if (l == gis_Geo)
+	{
+		vector<int> hits;
+		GetEntitiesInBox(Bbox2(p), hits);
+		for (vector<int>::iterator i = hits.begin(); i != hits.end(); ++i)
+			if (mEntities[*i]->PtWithin(l, p))
+			if(!IsWEDLocked(mEntities[*i]))
+				return true;
+		return false;
+	}
+
 	int n = GetNumEntities();
 	for (int i = 0; i < n; ++i)
 		if (GetNthEntity(i)->PtWithin(l, p)) 
@@ -130,10 +155,15 @@ bool WED_GISComposite::Cull(const Bbox2& b) const
 
 	if(!b.overlap(me))
 		return false;
-	
-	int n = GetNumEntities();
-	for (int i = 0; i < n; ++i)
-		if(GetNthEntity(i)->Cull(b))
+
+	// Children cull with their own (fudged) extent, so widen the search by the same fudge we use for ourselves.
+	Bbox2 search(b);
+	search.expand(GLOBAL_WED_ART_ASSET_FUDGE_FACTOR);
+
+	vector<int> hits;
+	GetEntitiesInBox(search, hits);
+	for (vector<int>::iterator i = hits.begin(); i != hits.end(); ++i)
+		if(mEntities[*i]->Cull(b))
 			return true;
 	return false;	
 }
@@ -177,12 +207,49 @@ IGISEntity *	WED_GISComposite::GetNthEntity  (int n) const
 	return mEntities[n];
 }
 
+struct entity_bounds_of {
+	const vector<IGISEntity *> * ents;
+	Bbox2 operator()(int n) const { Bbox2 b; (*ents)[n]->GetBounds(gis_Geo, b); return b; }
+};
+
+void			WED_GISComposite::GetEntitiesInBox(const Bbox2& bounds, vector<int>& out_idx) const
+{
+	RebuildCache(CacheBuild(cache_Spatial|cache_Topological));
+	out_idx.clear();
+	int n = mEntities.size();
+	if (n < MIN_INDEXED_ENTITIES)
+	{
+		out_idx.reserve(n);
+		for (int i = 0; i < n; ++i)
+			out_idx.push_back(i);
+		return;
+	}
+
+	// A topo rebuild without a spatial one (e.g. someone only asked for the entity list) leaves the tree stale.
+	if (mIndexStale)
+	{
+		vector<EntityIndex::item_type> items(n);
+		for (int i = 0; i < n; ++i)
+		{
+			mEntities[i]->GetBounds(gis_Geo, items[i].first);
+			items[i].second = i;
+		}
+		mIndex.insert(items.begin(), items.end());
+		mIndexStale = false;
+	}
+
+	mIndex.query_value(bounds, back_inserter(out_idx));
+	sort(out_idx.begin(), out_idx.end());
+}
+
 
 void	WED_GISComposite::RebuildCache(int flags) const
 {
 	if(flags & cache_Topological)
 	{
 		mEntities.clear();
+		mIndex.clear();
+		mIndexStale = true;
 		int n = CountChildren();
 		mHasUV = (n > 0);
 		mEntities.reserve(n);
@@ -219,5 +286,13 @@ void	WED_GISComposite::RebuildCache(int flags) const
 					mHasUV = false;
 			}
 		}
+
+		// Same children, new places - refit the tree in place instead of re-sorting everyone.
+		if (!mIndexStale && !mIndex.empty())
+		{
+			entity_bounds_of	key_of;
+			key_of.ents = &mEntities;
+			mIndex.refit(key_of);
+		}
 	}		
 }
@@ -26,6 +26,19 @@
 
 #include "WED_Entity.h"
 #include "IGIS.h"
+#include "RTree2.h"
+
+/*
+	WED_GISComposite - SPATIAL INDEX
+
+	Flat overlays (e.g. tens of thousands of objects or forest points imported from a DSF) all live under a single
+	composite, so a linear walk over the children on every frame and every click does not scale.  Once a composite
+	has more than a few dozen children it keeps an RTree2 of its children's geo bounds, keyed by child index.
+
+	The index piggy-backs on the entity cache: a topological rebuild (children added, removed or re-ordered) throws
+	the tree away and it is rebuilt from scratch; a spatial-only rebuild (children moved) just refits the existing
+	tree, which costs one pass over the children - the same pass we already do to accumulate our own bounds.
+*/
 
 class	WED_GISComposite : public WED_Entity, public virtual IGISComposite {
 
@@ -48,15 +61,20 @@ public:
 	// IGISComposite
 	virtual	int				GetNumEntities(void ) const;
 	virtual	IGISEntity *	GetNthEntity  (int n) const;
+	virtual	void			GetEntitiesInBox(const Bbox2& bounds, vector<int>& out_idx) const;
 
 private:
 
 			void			RebuildCache(int flags) const;
 
+	typedef RTree2<int, 16>	EntityIndex;
+
 	mutable	Bbox2					mCacheBounds;
 	mutable	Bbox2					mCacheBoundsUV;
 	mutable	bool					mHasUV;
 	mutable	vector<IGISEntity *>	mEntities;
+	mutable	EntityIndex				mIndex;
+	mutable	bool					mIndexStale;		// Children changed - the tree must be rebuilt, not just refit.
 
 };
 
@@ -331,6 +331,15 @@ IGISEntity *	WED_GISPolygon::GetNthEntity  (int n) const
 	return dynamic_cast<IGISEntity *>(GetNthChild(n));
 }
 
+void			WED_GISPolygon::GetEntitiesInBox(const Bbox2& bounds, vector<int>& out_idx) const
+{
+	// A polygon only has a handful of rings - just hand them all out.
+	int n = GetNumEntities();
+	out_idx.resize(n);
+	for (int i = 0; i < n; ++i)
+		out_idx[i] = i;
+}
+
 // this code all skips bezier segment expansion. Assuming that overlaps created by sur curved segment will be small and
 // false positives rare - as things near to runway perimeter are most likely all straight non-bezier segments
 
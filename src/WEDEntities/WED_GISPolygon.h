@@ -70,6 +70,7 @@ public:
 	// IGISComposite
 	virtual	int				GetNumEntities(void ) const;
 	virtual	IGISEntity *	GetNthEntity  (int n) const;
+	virtual	void			GetEntitiesInBox(const Bbox2& bounds, vector<int>& out_idx) const;
 	
 						bool	Overlaps(GISLayer_t l, const Polygon2& inPolyNoHoles) const;        // a regular polygon, NOT having any holes. E.g. runway outlines
 protected:
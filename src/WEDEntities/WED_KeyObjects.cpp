@@ -72,6 +72,39 @@ void WED_KeyObjects::Directory_Edit(const char * name, IBase * who)
 bool 			WED_KeyObjects::ReadFrom(IOReader * reader)
 {
 	bool r = WED_Thing::ReadFrom(reader);
+	ReadChoices(reader);
+	return r;
+}
+
+void 			WED_KeyObjects::WriteTo(IOWriter * writer)
+{
+	WED_Thing::WriteTo(writer);
+	WriteChoices(writer);
+}
+
+int				WED_KeyObjects::CountUndoSections(void) const
+{
+	return WED_Thing::CountUndoSections() + 1;
+}
+
+void			WED_KeyObjects::WriteUndoSection(int n, IOWriter * writer)
+{
+	if (n < WED_Thing::CountUndoSections())
+		WED_Thing::WriteUndoSection(n, writer);
+	else
+		WriteChoices(writer);
+}
+
+bool			WED_KeyObjects::ReadUndoSection(int n, IOReader * reader, int bytes)
+{
+	if (n < WED_Thing::CountUndoSections())
+		return WED_Thing::ReadUndoSection(n, reader, bytes);
+	ReadChoices(reader);
+	return false;
+}
+
+void			WED_KeyObjects::ReadChoices(IOReader * reader)
+{
 	choices.clear();
 	int n;
 	reader->ReadInt(n);
@@ -86,12 +119,10 @@ bool 			WED_KeyObjects::ReadFrom(IOReader * reader)
 		reader->ReadInt(id);
 		choices[key] = id;
 	}
-	return r;
 }
 
-void 			WED_KeyObjects::WriteTo(IOWriter * writer)
+void			WED_KeyObjects::WriteChoices(IOWriter * writer)
 {
-	WED_Thing::WriteTo(writer);
 	writer->WriteInt(choices.size());
 	for (map<string,int>::iterator it = choices.begin(); it != choices.end(); ++it)
 	{
@@ -46,6 +46,9 @@ public:
 
 	virtual	bool 			ReadFrom(IOReader * reader);
 	virtual	void 			WriteTo(IOWriter * writer);
+	virtual	int				CountUndoSections(void) const;
+	virtual	void			WriteUndoSection(int n, IOWriter * writer);
+	virtual	bool			ReadUndoSection(int n, IOReader * reader, int bytes);
 	virtual	void			AddExtraXML(WED_XMLElement * obj);
 	virtual void		StartElement(
 								WED_XMLReader * reader,
@@ -58,6 +61,9 @@ public:
 	
 private:
 
+		void				ReadChoices(IOReader * reader);
+		void				WriteChoices(IOWriter * writer);
+
 		map<string,int>		choices;
 
 };
@@ -111,9 +111,18 @@ bool		WED_ObjPlacement::Cull(const Bbox2& b) const
 
 	if(visibleWithinDeg < 0.0)                            // so we only do this once for each object, ever
 	{
+		WED_ResourceMgr * rmgr = WED_GetResourceMgr(GetArchive()->GetResolver());
+		const XObj8 * o;
+		if(rmgr && !rmgr->RequestObj(resource.value,o) && rmgr->IsLoading(resource.value))
+		{
+			// Don't stall the map to load the object - go by the rule of thumb until the loader delivered it.
+			Point2	my_loc;
+			GetLocation(gis_Geo,my_loc);
+			Vector2 fudge(GLOBAL_WED_ART_ASSET_FUDGE_FACTOR, GLOBAL_WED_ART_ASSET_FUDGE_FACTOR);
+			return b.overlap(Bbox2(my_loc - fudge, my_loc + fudge));
+		}
 		float * f = (float *) &visibleWithinDeg;          // tricking the compiler, breaking all rules. But Cull() must be const ...
 		*f = GLOBAL_WED_ART_ASSET_FUDGE_FACTOR;           // the old, brain-dead visibility rule of thumb
-		WED_ResourceMgr * rmgr = WED_GetResourceMgr(GetArchive()->GetResolver());
 		if(rmgr)
 		{
 			const XObj8 * o;
@@ -43,6 +43,7 @@ void WED_Select::CopyFrom(const WED_Select * rhs)
 	DebugAssert(!"We should not be copying selection objects.");
 	WED_Thing::CopyFrom(rhs);
 	StateChanged();
+	SectionChanged(SelectionSection());
 	mSelected = rhs->mSelected;
 }
 
@@ -69,6 +70,43 @@ void 			WED_Select::WriteTo(IOWriter * writer)
 
 }
 
+// The selection is a lazy undo section after WED_Thing's - every edit below announces it with SectionChanged, so
+// selection changes never snapshot anything else.  Like WED_Thing's ID lists it has no count, so selecting or
+// deselecting a few things in a big selection only keeps the bytes around them.
+
+int				WED_Select::CountUndoSections(void) const
+{
+	return WED_Thing::CountUndoSections() + 1;
+}
+
+bool			WED_Select::IsLazyUndoSection(int n) const
+{
+	return n == SelectionSection() || WED_Thing::IsLazyUndoSection(n);
+}
+
+void			WED_Select::WriteUndoSection(int n, IOWriter * writer)
+{
+	if (n != SelectionSection())
+		WED_Thing::WriteUndoSection(n, writer);
+	else
+		for (set<int>::iterator i = mSelected.begin(); i != mSelected.end(); ++i)
+			writer->WriteInt(*i);
+}
+
+bool			WED_Select::ReadUndoSection(int n, IOReader * reader, int bytes)
+{
+	if (n != SelectionSection())
+		return WED_Thing::ReadUndoSection(n, reader, bytes);
+	mSelected.clear();
+	for (int ct = bytes / sizeof(int); ct > 0; --ct)
+	{
+		int id;
+		reader->ReadInt(id);
+		mSelected.insert(mSelected.end(), id);
+	}
+	return false;
+}
+
 void		WED_Select::AddExtraXML(WED_XMLElement * obj)
 {
 	WED_XMLElement * selection = obj->add_sub_element("selection");
@@ -117,7 +155,7 @@ void		WED_Select::Select(ISelectable * iwho)
 
 	if (mSelected.size() != 1 || mSelected.count(id) == 0)
 	{
-		StateChanged(wed_Change_Selection);
+		SectionChanged(SelectionSection(), wed_Change_Selection);
 		mSelected.clear();
 		mSelected.insert(id);
 	}
@@ -127,7 +165,7 @@ void		WED_Select::Clear(void)
 {
 	if (!mSelected.empty())
 	{
-		StateChanged(wed_Change_Selection);
+		SectionChanged(SelectionSection(), wed_Change_Selection);
 		mSelected.clear();
 	}
 }
@@ -136,7 +174,7 @@ void		WED_Select::Toggle(ISelectable * iwho)
 {
 	int id = iwho->GetSelectionID();
 
-	StateChanged(wed_Change_Selection);
+	SectionChanged(SelectionSection(), wed_Change_Selection);
 	if (mSelected.count(id) > 0)
 		mSelected.erase(id);
 	else
@@ -149,7 +187,7 @@ void		WED_Select::Insert(ISelectable * iwho)
 
 	if (mSelected.count(id) == 0)
 	{
-		StateChanged(wed_Change_Selection);
+		SectionChanged(SelectionSection(), wed_Change_Selection);
 		mSelected.insert(id);
 	}
 }
@@ -186,7 +224,7 @@ void		WED_Select::Erase(ISelectable * iwho)
 
 	if (mSelected.count(id) > 0)
 	{
-		StateChanged(wed_Change_Selection);
+		SectionChanged(SelectionSection(), wed_Change_Selection);
 		mSelected.erase(id);
 	}
 }
@@ -69,6 +69,10 @@ public:
 	// WED_Persistent
 	virtual		bool 			ReadFrom(IOReader * reader);
 	virtual		void 			WriteTo(IOWriter * writer);
+	virtual		int				CountUndoSections(void) const;
+	virtual		bool			IsLazyUndoSection(int n) const;
+	virtual		void			WriteUndoSection(int n, IOWriter * writer);
+	virtual		bool			ReadUndoSection(int n, IOReader * reader, int bytes);
 	virtual		void			AddExtraXML(WED_XMLElement * obj);
 	virtual void		StartElement(
 								WED_XMLReader * reader,
@@ -81,6 +85,8 @@ public:
 
 private:
 
+			int				SelectionSection(void) const { return WED_Thing::CountUndoSections(); }
+
 	set<int>		mSelected;
 
 };
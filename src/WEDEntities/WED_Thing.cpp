@@ -27,6 +27,14 @@
 #include "WED_XMLWriter.h"
 #include <algorithm>
 
+enum {
+	undo_Children,		// Lazy sections: every edit of these lists goes through SectionChanged.
+	undo_Sources,
+	undo_Viewers,
+	undo_Parent,
+	undo_Props			// One section per property item from here on.
+};
+
 WED_Thing::WED_Thing(WED_Archive * parent, int id) :
 	WED_Persistent(parent, id),
 	type(this),
@@ -51,8 +59,10 @@ void WED_Thing::CopyFrom(const WED_Thing * rhs)
 		new_child->SetParent(this, n);
 	}
 	
+	SectionChanged(undo_Viewers);
 	viewer_id.clear();		// I am a clone.  No one is REALLY watching me.
 	
+	SectionChanged(undo_Sources);
 	source_id = rhs->source_id;
 	nn = CountSources();						// But I am YET ANOTHER observer of my sources...
 	for(int n = 0; n < nn; ++n)						// go register with my parent now!
@@ -128,6 +138,74 @@ void 			WED_Thing::WriteTo(IOWriter * writer)
 	WritePropsTo(writer);
 }
 
+int				WED_Thing::CountUndoSections(void) const
+{
+	return undo_Props + mItems.size();
+}
+
+bool			WED_Thing::IsLazyUndoSection(int n) const
+{
+	return n < undo_Parent;
+}
+
+// ID lists go out without a count, so that adding or removing an ID only changes the bytes around it - the undo
+// layer then keeps just those.  The reader gets the count back from the section length.
+
+void			WED_Thing::WriteUndoSection(int n, IOWriter * writer)
+{
+	switch(n) {
+	case undo_Children:
+		for (vector<int>::iterator c = child_id.begin(); c != child_id.end(); ++c)
+			writer->WriteInt(*c);
+		break;
+	case undo_Sources:
+		for (vector<int>::iterator s = source_id.begin(); s != source_id.end(); ++s)
+			writer->WriteInt(*s);
+		break;
+	case undo_Viewers:
+		for (set<int>::iterator v = viewer_id.begin(); v != viewer_id.end(); ++v)
+			writer->WriteInt(*v);
+		break;
+	case undo_Parent:
+		writer->WriteInt(parent_id);
+		break;
+	default:
+		mItems[n - undo_Props]->WriteTo(writer);
+	}
+}
+
+bool			WED_Thing::ReadUndoSection(int n, IOReader * reader, int bytes)
+{
+	int ct = bytes / sizeof(int);
+	switch(n) {
+	case undo_Children:
+		child_id.resize(ct);
+		for (int i = 0; i < ct; ++i)
+			reader->ReadInt(child_id[i]);
+		break;
+	case undo_Sources:
+		source_id.resize(ct);
+		for (int i = 0; i < ct; ++i)
+			reader->ReadInt(source_id[i]);
+		break;
+	case undo_Viewers:
+		viewer_id.clear();
+		for (int i = 0; i < ct; ++i)
+		{
+			int vid;
+			reader->ReadInt(vid);
+			viewer_id.insert(viewer_id.end(), vid);
+		}
+		break;
+	case undo_Parent:
+		reader->ReadInt(parent_id);
+		break;
+	default:
+		mItems[n - undo_Props]->ReadFrom(reader);
+	}
+	return false;
+}
+
 void			WED_Thing::ToXML(WED_XMLElement * parent)
 {
 	WED_XMLElement * obj = parent->add_sub_element("object");
@@ -295,7 +373,7 @@ WED_Thing *		WED_Thing::GetParent(void) const
 
 void				WED_Thing::SetParent(WED_Thing * parent, int nth)
 {
-	StateChanged(wed_Change_Topology);
+	SectionChanged(undo_Parent, wed_Change_Topology);
 	WED_Thing * old_parent = STATIC_CAST(WED_Thing, FetchPeer(parent_id));
 	if (old_parent) old_parent->RemoveChild(GetID());
 	parent_id = parent ? parent->GetID() : 0;
@@ -306,7 +384,7 @@ void				WED_Thing::AddSource(WED_Thing * src, int nth)
 {
 	DebugAssert(nth >= 0);
 	DebugAssert(nth <= source_id.size());
-	StateChanged(wed_Change_Topology);
+	SectionChanged(undo_Sources, wed_Change_Topology);
 	source_id.insert(source_id.begin()+nth,src->GetID());
 	if(src->viewer_id.count(GetID())==0)
 		src->AddViewer(GetID());
@@ -317,7 +395,7 @@ void				WED_Thing::RemoveSource(WED_Thing * src)
 	vector<int>::iterator k = find(source_id.begin(), source_id.end(), src->GetID());
 	DebugAssert(k != source_id.end());
 	DebugAssert(src->viewer_id.count(GetID()) > 0);
-	StateChanged(wed_Change_Topology);
+	SectionChanged(undo_Sources, wed_Change_Topology);
 
 	while(k != source_id.end())
 	{
@@ -335,7 +413,7 @@ void	WED_Thing::ReplaceSource(WED_Thing * old, WED_Thing * rep)
 	DebugAssert(old->viewer_id.count(GetID()) > 0);
 	old->RemoveViewer(GetID());
 	
-	StateChanged();
+	SectionChanged(undo_Sources);
 	int subs =0;
 	for(vector<int>::iterator s = source_id.begin(); s != source_id.end(); ++s)
 	if(*s == old_id)
@@ -359,7 +437,7 @@ int			WED_Thing::GetMyPosition(void) const
 
 void				WED_Thing::AddChild(int id, int n)
 {
-	StateChanged(wed_Change_Topology);
+	SectionChanged(undo_Children, wed_Change_Topology);
 	DebugAssert(n >= 0);
 	DebugAssert(n <= child_id.size());
 	vector<int>::iterator i = find(child_id.begin(),child_id.end(),id);
@@ -369,7 +447,7 @@ void				WED_Thing::AddChild(int id, int n)
 
 void				WED_Thing::RemoveChild(int id)
 {
-	StateChanged(wed_Change_Topology);
+	SectionChanged(undo_Children, wed_Change_Topology);
 	vector<int>::iterator i = find(child_id.begin(),child_id.end(),id);
 	DebugAssert(i != child_id.end());
 	child_id.erase(i);
@@ -377,14 +455,14 @@ void				WED_Thing::RemoveChild(int id)
 
 void		WED_Thing::AddViewer(int id)
 {
-	StateChanged(wed_Change_Topology);
+	SectionChanged(undo_Viewers, wed_Change_Topology);
 	DebugAssert(viewer_id.count(id) == 0);
 	viewer_id.insert(id);
 }
 	
 void		WED_Thing::RemoveViewer(int id)
 {
-	StateChanged(wed_Change_Topology);
+	SectionChanged(undo_Viewers, wed_Change_Topology);
 	DebugAssert(viewer_id.count(id) != 0);
 	viewer_id.erase(id);
 }
@@ -107,6 +107,13 @@ public:
 	virtual	void			PostChangeNotify(void);
 	virtual	void			Validate(void);
 
+	// Undo sections: the child, source and viewer lists (lazy - only our own list editing touches them), the parent,
+	// then one section per property item.  Sub-classes with more state add their sections after ours.
+	virtual	int				CountUndoSections(void) const;
+	virtual	bool			IsLazyUndoSection(int n) const;
+	virtual	void			WriteUndoSection(int n, IOWriter * writer);
+	virtual	bool			ReadUndoSection(int n, IOReader * reader, int bytes);
+
 	// This is a template method - sub-classes of things that have to add MORE XML than they would get via the property system and the thing
 	// itself override this method.  This way their extra XML is _inside_ the toplevel obj.
 	virtual	void			AddExtraXML(WED_XMLElement * obj) { }
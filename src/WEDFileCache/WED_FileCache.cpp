@@ -159,7 +159,7 @@ void WED_FileCache::init(void)
 
 		for (auto p : paired_files)
 		{
-			CACHE_file_cache.push_back(new CACHE_CacheObject());
+			CACHE_CacheObject * co = new CACHE_CacheObject();
 
 			bool info_read_success = false;
 
@@ -175,21 +175,25 @@ void WED_FileCache::init(void)
 
 				if(json_parse_result == true)
 				{
-					CACHE_file_cache.back()->m_last_time_modified = root["last_time_modified"].asInt();
-					CACHE_file_cache.back()->m_domain = static_cast<CACHE_domain>(root["domain"].asInt());
-					CACHE_file_cache.back()->set_disk_location(files[p.first]);
+					co->m_last_time_modified = root["last_time_modified"].asInt();
+					co->m_domain = static_cast<CACHE_domain>(root["domain"].asInt());
+					co->set_disk_location(files[p.first]);
 
-					time_t age = difftime(now,CACHE_file_cache.back()->m_last_time_modified);
+					time_t age = difftime(now,co->m_last_time_modified);
 
-					if(age < (GetDomainPolicy(CACHE_file_cache.back()->m_domain)).cache_domain_pol_max_seconds_on_disk /* + margin ? */)
+					if(age < (GetDomainPolicy(co->m_domain)).cache_domain_pol_max_seconds_on_disk /* + margin ? */)
 						info_read_success = true;
 				}
 			}
 
-			if(info_read_success == false)
+			if(info_read_success)
 			{
-				delete CACHE_file_cache.back();
-				CACHE_file_cache.pop_back();
+				CACHE_file_cache.insert(co);
+				CACHE_by_path[co->get_disk_location()] = co;
+			}
+			else
+			{
+				delete co;
 #if KEEP_EXPIRED_CACHE_FILES
 				files_to_delete.push_back(p.first);
 				files_to_delete.push_back(p.second);
@@ -296,10 +300,12 @@ static void interpret_error(curl_http_get_file& mCurl, string& out_error_human,
 
 WED_file_cache_response WED_FileCache::start_new_cache_object(WED_file_cache_request req)
 {
-	CACHE_file_cache.push_back(new CACHE_CacheObject());
-	CACHE_CacheObject& co = *CACHE_file_cache.back();
+	CACHE_CacheObject * new_co = new CACHE_CacheObject();
+	CACHE_file_cache.insert(new_co);
+	CACHE_CacheObject& co = *new_co;
 	
 	co.create_RAII_curl_hndl(req.in_url, req.in_cert);
+	CACHE_by_url[co.get_last_url()] = new_co;
 	
 	return WED_file_cache_response(co.get_RAII_curl_hndl()->get_curl_handle().get_progress(),
 								   "",
@@ -308,10 +314,28 @@ WED_file_cache_response WED_FileCache::start_new_cache_object(WED_file_cache_req
 								   cache_status_downloading);
 }
 
-void WED_FileCache::remove_cache_object(vector<CACHE_CacheObject* >::iterator itr)
+void WED_FileCache::remove_cache_object(CACHE_CacheObject * co)
+{
+	unordered_map<string, CACHE_CacheObject *>::iterator i = CACHE_by_url.find(co->get_last_url());
+	if(i != CACHE_by_url.end() && i->second == co)
+		CACHE_by_url.erase(i);
+	i = CACHE_by_path.find(co->get_disk_location());
+	if(i != CACHE_by_path.end() && i->second == co)
+		CACHE_by_path.erase(i);
+
+	CACHE_file_cache.erase(co);
+	delete co;
+}
+
+CACHE_CacheObject * WED_FileCache::find_cache_object(const WED_file_cache_request& req)
 {
-	delete *itr;
-	CACHE_file_cache.erase(itr);
+	unordered_map<string, CACHE_CacheObject *>::iterator i = CACHE_by_path.find(url_to_cache_path(req));
+	if(i != CACHE_by_path.end())
+		return i->second;
+	i = CACHE_by_url.find(req.in_url);
+	if(i != CACHE_by_url.end())
+		return i->second;
+	return NULL;
 }
 
 WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request& req)
@@ -345,29 +369,18 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 	---------------------------------------------------------------------------
 	*/
 	
-	vector<CACHE_CacheObject* >::iterator itr = CACHE_file_cache.begin();
-	for ( ; itr != CACHE_file_cache.end(); ++itr)
-	{
-		if((**itr).get_disk_location() == url_to_cache_path(req))
-		{
-			break;
-		}
-		else if ((**itr).get_last_url() == req.in_url)
-		{
-			break;
-		}
-	}
+	CACHE_CacheObject * found = find_cache_object(req);
 
-	if(itr == CACHE_file_cache.end()) //1. Not in CACHE_file_cache?
+	if(found == NULL) //1. Not in CACHE_file_cache?
 	{
 		//If it is not on disk, not cooling down, and not in the download_queue, we finally get to download it
 		return start_new_cache_object(req);
 	}
 	
-	CACHE_CacheObject & co = **itr;
+	CACHE_CacheObject & co = *found;
 
 	//2. In CACHE_file_cache with active cURL_handle?
-	if((**itr).get_RAII_curl_hndl() != NULL)
+	if(co.get_RAII_curl_hndl() != NULL)
 	{
 		curl_http_get_file & hndl = co.get_RAII_curl_hndl()->get_curl_handle();
 		
@@ -448,6 +461,8 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 #endif
 				res.out_error_type = co.get_last_error_type();
 				co.set_disk_location(res.out_path);
+				if(!res.out_path.empty())
+					CACHE_by_path[res.out_path] = &co;
 				co.close_RAII_curl_hndl();
 
 				return res;
@@ -482,22 +497,22 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 		{
 			return WED_file_cache_response(-1, "Cache cooling after failed network attempt, please wait: " + to_string(seconds_left) + " seconds...", cache_error_type_none, "", cache_status_cooling);
 		}
-		else if(FILE_exists((*itr)->get_disk_location().c_str()) == true) //Check if file was deleted between requests
+		else if(FILE_exists(co.get_disk_location().c_str()) == true) //Check if file was deleted between requests
 		{
 			if(co.needs_refresh(pol) == false)
 			{
-				DebugAssert((*itr)->get_disk_location() != "");
-				return WED_file_cache_response(-1, "", cache_error_type_none, (*itr)->get_disk_location(), cache_status_available);
+				DebugAssert(co.get_disk_location() != "");
+				return WED_file_cache_response(-1, "", cache_error_type_none, co.get_disk_location(), cache_status_available);
 			}
 			else
 			{
-				remove_cache_object(itr);
+				remove_cache_object(&co);
 				return start_new_cache_object(req);
 			}
 		}
 		else
 		{
-			remove_cache_object(itr);
+			remove_cache_object(&co);
 			return start_new_cache_object(req);
 		}
 	}
@@ -508,6 +523,11 @@ string WED_FileCache::file_in_cache(const WED_file_cache_request & req)
 	return request_file(req).out_path;
 }
 
+int WED_FileCache::get_completion_serial(void)
+{
+	return curl_http_get_file::get_completion_serial();
+}
+
 string WED_FileCache::url_to_cache_path(const WED_file_cache_request & req)
 {
 	return CACHE_folder + DIR_STR + req.in_folder_prefix + DIR_STR + FILE_get_file_name(req.in_url);
@@ -521,12 +541,14 @@ vector<string> WED_FileCache::get_files_available(CACHE_domain domain, string fo
 
 WED_FileCache::~WED_FileCache()
 {
-	for(vector<CACHE_CacheObject* >::iterator co = CACHE_file_cache.begin();
+	for(unordered_set<CACHE_CacheObject* >::iterator co = CACHE_file_cache.begin();
 		co != CACHE_file_cache.end();
 		++co)
 	{
 		delete *co;
 	}
 	CACHE_file_cache.clear();
+	CACHE_by_url.clear();
+	CACHE_by_path.clear();
 }
 //---------------------------------------------------------------------------//
@@ -25,6 +25,8 @@
 #define WED_FILECACHE_H
 
 #include "CACHE_DomainPolicy.h"
+#include <unordered_map>
+#include <unordered_set>
 
 class CACHE_CacheObject;
 
@@ -39,6 +41,10 @@ class CACHE_CacheObject;
 		* Clients can use the error information to decide whether or not to try again
 	- Cached files that are too old are re-downloaded
 	- A cache domain policy determines maximum age and minimum cool down periods
+
+	All downloads share one background I/O thread (see curl_http.h) and cache objects are found through hash indexes
+	by disk path and by URL, so polling hundreds of outstanding requests stays cheap.  Clients juggling many requests
+	can check get_completion_serial and skip re-polling requests that were downloading while it hasn't changed.
 */
 
 enum CACHE_status
@@ -96,17 +102,21 @@ class WED_FileCache
 		WED_file_cache_response	request_file(const WED_file_cache_request& req);
 		string			file_in_cache(const WED_file_cache_request& req);
 		string			url_to_cache_path(const WED_file_cache_request& req);
+		int				get_completion_serial(void);	// changes whenever any download finishes
 
 	private:
 
 		vector<string>	get_files_available(CACHE_domain domain, string folder_prefix);
 		WED_file_cache_response Request_file(const WED_file_cache_request& req);
 		WED_file_cache_response start_new_cache_object(WED_file_cache_request req);
-		void 				remove_cache_object(vector<CACHE_CacheObject* >::iterator itr);
+		void 				remove_cache_object(CACHE_CacheObject * co);
+		CACHE_CacheObject *	find_cache_object(const WED_file_cache_request& req);
 
 		const string 	CACHE_INFO_FILE_EXT = ".cache_object_info";
 		string 			CACHE_folder;	                  // The fully qualified path to the file cache folder
-		vector<CACHE_CacheObject* > CACHE_file_cache;   // Our vector of CacheObjects
+		unordered_set<CACHE_CacheObject* > CACHE_file_cache;   // Our CacheObjects - we own them
+		unordered_map<string, CACHE_CacheObject* > CACHE_by_path;	// Index by disk location, for files we have
+		unordered_map<string, CACHE_CacheObject* > CACHE_by_url;	// Index by URL, for files we are fetching (or failed to)
 };
 
 extern WED_FileCache gFileCache;
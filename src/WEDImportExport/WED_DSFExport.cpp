@@ -58,6 +58,12 @@
 #include <time.h>
 #include "STLUtils.h"
 #include "WED_RoadEdge.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
 
 #if 1 // DEV
 #include "PerfUtils.h"
@@ -71,17 +77,112 @@
 // something on the ragged edge.
 #define DSF_EXTRA_1021 0.25
 
+/*
+	PARALLEL EXPORT
+
+	Walking the hierarchy for a tile has to happen on the main thread - it reads (and for orthophotos even edits) the
+	document, and it may have to talk to the user.  But that part is quick.  The slow parts are encoding the DSF
+	(DSFWriteToFile pools, sorts and packs everything we fed the writer) and compressing orthophotos to DDS - and those
+	only need data that was already pulled out of the document.
+
+	So the main thread walks the tiles in the same order as always and hands each finished DSF writer and each DDS to
+	a DSF_export_pool.  The pool is bounded, so a huge package can't pile up all of its tiles in memory while the workers
+	catch up.  Every job writes its own file from its own inputs, so the bytes on disk don't depend on the number of
+	threads or the order in which the jobs finish.
+*/
+
+class DSF_export_pool {
+public:
+	DSF_export_pool();
+	~DSF_export_pool();				// waits for all jobs
+
+	void	queue(const function<void()>& job);		// blocks while the queue is full
+	void	wait_idle(void);
+
+private:
+	void	worker(void);
+
+	mutex						mMutex;
+	condition_variable			mWork;
+	condition_variable			mDone;
+	deque<function<void()> >	mTodo;
+	int							mBusy;
+	int							mMaxQueued;
+	bool						mQuit;
+	vector<thread>				mThreads;
+};
+
+DSF_export_pool::DSF_export_pool() : mBusy(0), mQuit(false)
+{
+	int n = max(1, (int) thread::hardware_concurrency());
+	mMaxQueued = 2 * n;
+	for(int i = 0; i < n; ++i)
+		mThreads.push_back(thread(&DSF_export_pool::worker, this));
+}
+
+DSF_export_pool::~DSF_export_pool()
+{
+	wait_idle();
+	{
+		lock_guard<mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWork.notify_all();
+	for(auto& t : mThreads)
+		t.join();
+}
+
+void DSF_export_pool::queue(const function<void()>& job)
+{
+	unique_lock<mutex> lock(mMutex);
+	while(mTodo.size() >= mMaxQueued)
+		mDone.wait(lock);
+	mTodo.push_back(job);
+	mWork.notify_one();
+}
+
+void DSF_export_pool::wait_idle(void)
+{
+	unique_lock<mutex> lock(mMutex);
+	while(!mTodo.empty() || mBusy)
+		mDone.wait(lock);
+}
+
+void DSF_export_pool::worker(void)
+{
+	unique_lock<mutex> lock(mMutex);
+	while(true)
+	{
+		if(mTodo.empty())
+		{
+			if(mQuit) break;
+			mWork.wait(lock);
+			continue;
+		}
+		function<void()> job(mTodo.front());
+		mTodo.pop_front();
+		++mBusy;
+		lock.unlock();
+		job();
+		lock.lock();
+		--mBusy;
+		mDone.notify_all();
+	}
+}
+
 // various pieces of information about the currently running export
 
 struct DSF_export_info_t
 {
-	ImageInfo	orthoImg;      // in case an orthoimage is to be converted/exported, store its info, so it does not need to be loaded it repeatedly
-	string		orthoFile;     // path to last orthoImage - so we know if there is a 2nd one to deal with - in which case we drop the first
+	shared_ptr<ImageInfo>	orthoImg;      // in case an orthoimage is to be converted/exported, store its info, so it does not need to be loaded it repeatedly.
+	string					orthoFile;     // path to last orthoImage - so we know if there is a 2nd one to deal with - in which case we drop the first.
+	                                       // DDS jobs still working on an older image hold their own reference to it.
+	set<string>				ddsQueued;     // DDS files made in this export - they are newer than their image, even if the pool hasn't written them yet.
+	DSF_export_pool *		pool;          // NULL means do everything right away, on this thread
 
-	DSF_export_info_t() { orthoImg.data = NULL; }
+	DSF_export_info_t() : pool(NULL) { }
 };
 
-
 //---------------------------------------------------------------------------------------------------------------------------------------
 
 int zip_printf(void * fi, const char * fmt, ...)
@@ -219,6 +320,57 @@ static bool usesAlpha(ImageInfo * info)
 	return usesAlpha;
 }
 
+static void free_ortho_image(ImageInfo * img)
+{
+	if(img->data) DestroyBitmap(img);
+	delete img;
+}
+
+// Cut the part of an orthophoto a polygon uses out of the source image and compress it. Runs on a pool thread.
+static void DSF_WriteOrthoDDS(shared_ptr<ImageInfo> src, Bbox2 UVbounds, string absPathDDS)
+{
+#if DEV
+	StElapsedTime	etime("DDS export time");
+#endif
+	ImageInfo imgInfo(*src);
+	ImageInfo DDSInfo;
+
+	int UVMleft   = intround(imgInfo.width * UVbounds.xmin());
+	int UVMright  = intround(imgInfo.width * UVbounds.xmax());
+	int UVMtop    = intround(imgInfo.height * UVbounds.ymax());
+	int UVMbottom = intround(imgInfo.height * UVbounds.ymin());
+	int UVMwidth  = UVMright - UVMleft;
+	int UVMheight = UVMtop - UVMbottom;
+
+	int DDSwidth = 1;
+	int DDSheight = 1;
+
+	while(DDSwidth < UVMwidth && DDSwidth < 2048) DDSwidth <<= 1;      // round up dimensions under 2k to a power of 2 AND limit to 2k
+	while(DDSheight < UVMheight && DDSheight < 2048) DDSheight <<= 1;
+
+	if (CreateNewBitmap(DDSwidth, DDSheight, imgInfo.channels, &DDSInfo) == 0)       // create array to hold upsized image
+	{
+		if(UVMwidth == DDSwidth && UVMheight == DDSheight)
+			CopyBitmapSectionDirect(imgInfo,DDSInfo, UVMleft, UVMbottom, 0, 0, DDSwidth, DDSheight);
+		else
+		{
+			CopyBitmapSection(&imgInfo,&DDSInfo, UVMleft, UVMbottom, UVMright, UVMtop,
+																0,       0,    DDSwidth, DDSheight);
+		}
+		if(DDSInfo.channels == 3)
+			ConvertBitmapToAlpha(&DDSInfo,false);
+		int DXTMethod = usesAlpha(&DDSInfo) ? 5 : 1;
+		WriteBitmapToDDS_MT(DDSInfo, DXTMethod, absPathDDS.c_str());
+		DestroyBitmap(&DDSInfo);
+	}
+}
+
+static void DSF_WriteTile(string path, void * writer)
+{
+	DSFWriteToFile(path.c_str(), writer);
+	DSFDestroyWriter(writer);
+}
+
 /************************************************************************************************************************************************
  * ROAD PROCESSOR
  ************************************************************************************************************************************************/
@@ -1796,6 +1948,8 @@ static int	DSF_ExportTileRecursive(
 				WED_ResourceMgr * rmgr = WED_GetResourceMgr(resolver);
 				
 				date_cmpr_result_t date_cmpr_res = FILE_date_cmpr(absPathIMG.c_str(),absPathDDS.c_str());
+				if(export_info.ddsQueued.count(absPathDDS))
+					date_cmpr_res = dcr_secondIsNew;		// we made it earlier in this export - it just may not be on disk yet
 				//-----------------
 				/* How to export a orthophoto
 				* If it is a orthophoto and the image is newer than the DDS (avoid unnecissary DDS creation),
@@ -1808,58 +1962,29 @@ static int	DSF_ExportTileRecursive(
 				
 				if(date_cmpr_res == dcr_firstIsNew || date_cmpr_res == dcr_same)
 				{
-	#if DEV
-					StElapsedTime	etime("DDS export time");
-	#endif
 					if(export_info.orthoFile != absPathIMG)
 					{
-						if(!export_info.orthoFile.empty())
-						{
-							Assert(export_info.orthoImg.data);
-							free(export_info.orthoImg.data);
-							export_info.orthoImg.data = NULL;
-							export_info.orthoFile = "";
-						}
-						if(MakeSupportedType(absPathIMG.c_str(),&export_info.orthoImg))
+						export_info.orthoImg.reset();
+						export_info.orthoFile = "";
+
+						shared_ptr<ImageInfo> img(new ImageInfo, free_ortho_image);
+						img->data = NULL;
+						if(MakeSupportedType(absPathIMG.c_str(),img.get()))
 						{
 							DoUserAlert((msg + "Unable to convert the image file '" + absPathIMG + "'to a DDS file, aborting DSF Export.").c_str());
 							return -1;
 						}
 						else
 						{
+							export_info.orthoImg = img;
 							export_info.orthoFile = absPathIMG;
 						}
 					}
-					ImageInfo imgInfo(export_info.orthoImg);
-					ImageInfo DDSInfo;
-
-					int UVMleft   = intround(imgInfo.width * UVbounds.xmin());
-					int UVMright  = intround(imgInfo.width * UVbounds.xmax());
-					int UVMtop    = intround(imgInfo.height * UVbounds.ymax());
-					int UVMbottom = intround(imgInfo.height * UVbounds.ymin());
-					int UVMwidth  = UVMright - UVMleft;
-					int UVMheight = UVMtop - UVMbottom;
-					
-					int DDSwidth = 1;
-					int DDSheight = 1;
-
-					while(DDSwidth < UVMwidth && DDSwidth < 2048) DDSwidth <<= 1;      // round up dimensions under 2k to a power of 2 AND limit to 2k
-					while(DDSheight < UVMheight && DDSheight < 2048) DDSheight <<= 1;
-
-					if (CreateNewBitmap(DDSwidth, DDSheight, imgInfo.channels, &DDSInfo) == 0)       // create array to hold upsized image
-					{
-						if(UVMwidth == DDSwidth && UVMheight == DDSheight)
-							CopyBitmapSectionDirect(imgInfo,DDSInfo, UVMleft, UVMbottom, 0, 0, DDSwidth, DDSheight);
-						else
-						{
-							CopyBitmapSection(&imgInfo,&DDSInfo, UVMleft, UVMbottom, UVMright, UVMtop,
-																				0,       0,    DDSwidth, DDSheight);
-						}
-						if(DDSInfo.channels == 3)
-							ConvertBitmapToAlpha(&DDSInfo,false);
-						int DXTMethod = usesAlpha(&DDSInfo) ? 5 : 1;
-						WriteBitmapToDDS_MT(DDSInfo, DXTMethod, absPathDDS.c_str());
-					}
+					export_info.ddsQueued.insert(absPathDDS);
+					if(export_info.pool)
+						export_info.pool->queue(bind(DSF_WriteOrthoDDS, export_info.orthoImg, UVbounds, absPathDDS));
+					else
+						DSF_WriteOrthoDDS(export_info.orthoImg, UVbounds, absPathDDS);
 				}
 				else if(date_cmpr_res == dcr_error)
 				{
@@ -1870,6 +1995,7 @@ static int	DSF_ExportTileRecursive(
 				
 				if(!FILE_exists(absPathPOL.c_str()))
 				{
+					if(export_info.pool) export_info.pool->wait_idle();		// we need the DDS on disk to get its size
 					ImageInfo DDSInfo;
 					if(CreateBitmapFromDDS(absPathDDS.c_str(), &DDSInfo) == 0)
 					{
@@ -2065,6 +2191,11 @@ static int DSF_ExportTile(WED_Thing * base, IResolver * resolver, const string&
 		FILE_make_dir_exist(buffer);
 		
 		snprintf(buffer, 255, "%sEarth nav data" DIR_STR "%+03d%+04d" DIR_STR "%+03d%+04d.dsf", pkg.c_str(), latlon_bucket(y), latlon_bucket(x), y, x);
+		if(export_info.pool)
+		{
+			export_info.pool->queue(bind(DSF_WriteTile, string(buffer), writer));		// the pool owns the writer now
+			return entities;
+		}
 		DSFWriteToFile(buffer, writer);
 	}
 
@@ -2105,7 +2236,9 @@ int DSF_Export(WED_Thing * base, IResolver * resolver, const string& package, se
 
 	int DSF_export_tile_res = 0;
 
-	DSF_export_info_t DSF_export_info;   // We kept the last loaded orthoimage open, so it does not have to be loaded repeatedly. This gates parallel DSF exports.
+	DSF_export_pool		pool;
+	DSF_export_info_t	DSF_export_info;   // We kept the last loaded orthoimage open, so it does not have to be loaded repeatedly.
+	DSF_export_info.pool = &pool;
 
 	for (int y = tile_south; y < tile_north; ++y)
 	{
@@ -2116,10 +2249,8 @@ int DSF_Export(WED_Thing * base, IResolver * resolver, const string& package, se
 		}
 		if (DSF_export_tile_res == -1) break;
 	}
-	if (DSF_export_info.orthoImg.data)
-	{
-		free(DSF_export_info.orthoImg.data);
-	}
+	pool.wait_idle();			// all DSFs and DDSs are on disk once we return - even if we bailed out half-way
+
 	if (g_dropped_pts)
 	{
 		DoUserAlert("Warning: you have bezier curves that cross a DSF tile boundary.  X-Plane 9 cannot handle this case.  To fix this, only use non-curved polygons to cross a tile boundary.");
@@ -2171,7 +2302,7 @@ int DSF_ExportAirportOverlay(IResolver * resolver, WED_Airport  * apt, const str
 		for(int show_level = 6; show_level >= 1; --show_level)
 			entities += DSF_ExportTileRecursive(apt, resolver, package, cull_bounds, safe_bounds, rsrc, &cbs, writer, problem_children, show_level, DSF_export_info);
 			
-		Assert(DSF_export_info.orthoImg.data == NULL); //  In this type of export - orthoimages are not allowed. So this should never happen.
+		Assert(!DSF_export_info.orthoImg); //  In this type of export - orthoimages are not allowed. So this should never happen.
 
 		rsrc.write_tables(cbs,writer);
 
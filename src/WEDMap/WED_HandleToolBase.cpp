@@ -587,6 +587,11 @@ void WED_HandleToolBase::ProcessSelectionRecursive(
 	Point2	psel; if(pt_sel) psel = bounds.centroid();
 	double	frame_dist  = icon_dist_v/2;
 
+	// Children get pruned below if their bounds, grown by the icon size, miss the selection.  Growing the
+	// selection instead gives the same answer and lets composites pre-filter through their spatial index.
+	Bbox2	search = pt_sel ? Bbox2(psel) : bounds;
+	search.expand(icon_dist_h,icon_dist_v);
+
 	{   //  speedup: do not traverse into entities which have their own bounding box already out of reach
 		Bbox2	ent_bounds;
 		entity->GetBounds(gis_Geo,ent_bounds);
@@ -627,9 +632,10 @@ void WED_HandleToolBase::ProcessSelectionRecursive(
 
 		if (com)
 		{
-			int count = com->GetNumEntities();
-			for (int n = 0; n < count; ++n)
-				ProcessSelectionRecursive(com->GetNthEntity(n),bounds,pt_sel, icon_dist_h, icon_dist_v, result);
+			vector<int> hits;
+			com->GetEntitiesInBox(search, hits);
+			for (vector<int>::iterator n = hits.begin(); n != hits.end(); ++n)
+				ProcessSelectionRecursive(com->GetNthEntity(*n),bounds,pt_sel, icon_dist_h, icon_dist_v, result);
 		}
 		else if (seq)
 		{
@@ -650,9 +656,10 @@ void WED_HandleToolBase::ProcessSelectionRecursive(
 			result.insert(entity); 
 		else if (com)
 		{
-			int count = com->GetNumEntities();
-			for (int n = 0; n < count; ++n)
-				ProcessSelectionRecursive(com->GetNthEntity(n),bounds,pt_sel, icon_dist_h, icon_dist_v, result);
+			vector<int> hits;
+			com->GetEntitiesInBox(search, hits);
+			for (vector<int>::iterator n = hits.begin(); n != hits.end(); ++n)
+				ProcessSelectionRecursive(com->GetNthEntity(*n),bounds,pt_sel, icon_dist_h, icon_dist_v, result);
 		}
 		else if (seq)
 		{
@@ -314,6 +314,15 @@ void		WED_Map::Draw(GUI_GraphState * state)
 
 }
 
+// Entities cull themselves with a fudged extent (art assets stick out of their points), so the pre-filter
+// for a composite's children has to look that much further than the screen.
+static Bbox2 cull_bounds(const Bbox2& screen)
+{
+	Bbox2 b(screen);
+	b.expand(GLOBAL_WED_ART_ASSET_FUDGE_FACTOR);
+	return b;
+}
+
 void		WED_Map::DrawVisFor(WED_MapLayer * layer, int current, const Bbox2& bounds, IGISEntity * what, GUI_GraphState * g, ISelection * sel, int depth)
 {
 	if(!what->Cull(bounds))	return;
@@ -332,9 +341,10 @@ void		WED_Map::DrawVisFor(WED_MapLayer * layer, int current, const Bbox2& bounds
 		Vector2 span(p1,p2);
 		if(max(span.dx, span.dy) > TOO_SMALL_TO_GO_IN || (p1 == p2) || depth == 0)		// Why p1 == p2?  If the composite contains ONLY ONE POINT it is zero-size.  We'd LOD out.  But if
 		{																				// it contains one thing then we might as well ALWAYS draw it - it's relatively cheap!
-			int t = c->GetNumEntities();												// Depth == 0 means we draw ALL top level objects -- good for airports.
-			for (int n = t-1; n >= 0; --n)
-				DrawVisFor(layer, current, bounds, c->GetNthEntity(n), g, sel, depth+1);
+			vector<int> vis;															// Depth == 0 means we draw ALL top level objects -- good for airports.
+			c->GetEntitiesInBox(cull_bounds(bounds), vis);
+			for (vector<int>::reverse_iterator n = vis.rbegin(); n != vis.rend(); ++n)
+				DrawVisFor(layer, current, bounds, c->GetNthEntity(*n), g, sel, depth+1);
 		}
 	}
 }
@@ -358,9 +368,10 @@ void		WED_Map::DrawStrFor(WED_MapLayer * layer, int current, const Bbox2& bounds
 		Vector2 span(p1,p2);
 		if(max(span.dx, span.dy) > TOO_SMALL_TO_GO_IN || (p1 == p2) || depth == 0)
 		{
-			int t = c->GetNumEntities();
-			for (int n = t-1; n >= 0; --n)
-				DrawStrFor(layer, current, bounds, c->GetNthEntity(n), g, sel, depth+1);
+			vector<int> vis;
+			c->GetEntitiesInBox(cull_bounds(bounds), vis);
+			for (vector<int>::reverse_iterator n = vis.rbegin(); n != vis.rend(); ++n)
+				DrawStrFor(layer, current, bounds, c->GetNthEntity(*n), g, sel, depth+1);
 		}
 	}
 }
@@ -463,7 +474,7 @@ void		WED_Map::ReceiveMessage(
 							intptr_t				inMsg,
 							intptr_t				inParam)
 {
-	if(inMsg == msg_ArchiveChanged)	Refresh();
+	if(inMsg == msg_ArchiveChanged || inMsg == msg_ArtAssetsLoaded)	Refresh();
 }
 
 IGISEntity *	WED_Map::GetGISBase()
@@ -32,6 +32,7 @@
 #include "WED_Map.h"
 #include "WED_MapBkgnd.h"
 #include "WED_ToolUtils.h"
+#include "WED_ResourceMgr.h"
 #include "WED_MarqueeTool.h"
 #include "WED_CreateBoxTool.h"
 #include "WED_CreateEdgeTool.h"
@@ -298,6 +299,9 @@ WED_MapPane::WED_MapPane(GUI_Commander * cmdr, double map_bounds[4], IResolver *
 
 	archive->AddListener(mMap);
 
+	// Same for art assets - objects are drawn as placeholders while the resource manager loads them in the background.
+	WED_GetResourceMgr(resolver)->AddListener(mMap);
+
 	// This is a band-aid.  We don't restore the current tab in the tab hierarchy (as of WED 1.5) so we don't get a tab changed message.  Instead we just
 	// are always in the selection tab.  So mostly that means the defaults for things like filters are fine, but for the ATC layer it needs to be off!
 	mATCLayer->ToggleVisible();
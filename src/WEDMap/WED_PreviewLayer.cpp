@@ -722,7 +722,7 @@ struct	preview_string : WED_PreviewItem {
 		if(ps && sinfo->objs.size())
 		{
 			const XObj8 * o;
-			if(rmgr->GetObjRelative(sinfo->objs.front(),vpath,o))
+			if(rmgr->RequestObjRelative(sinfo->objs.front(),vpath,o))
 			{
 				float real_radius=pythag(
 						o->xyz_max[0]- o->xyz_min[0],
@@ -904,7 +904,7 @@ struct	preview_airportlights : WED_PreviewItem {
 					}
 				}
 				const XObj8 * obj;
-				if(rmgr->GetObjRelative(sinfo->objs.front(), vpath, obj))
+				if(rmgr->RequestObjRelative(sinfo->objs.front(), vpath, obj))
 					draw_string_preview(pts, d0, ds, *sinfo, zoomer, g, tman, obj);
 			}
 			else
@@ -1114,7 +1114,7 @@ struct	preview_object : public WED_PreviewItem {
 		obj->GetResource(vpath);
 		const XObj8 * o;
 		agp_t agp;
-		if(rmgr->GetObj(vpath,o))
+		if(rmgr->RequestObj(vpath,o))
 		{
 			g->SetState(false,1,false,false,true,false,false);
 			glColor3f(1,1,1);
@@ -1122,7 +1122,7 @@ struct	preview_object : public WED_PreviewItem {
 			obj->GetLocation(gis_Geo,loc);
 			draw_obj_at_ll(tman, o, loc, obj->GetHeading(), g, zoomer);
 		}
-		else if (rmgr->GetAGP(vpath,agp))
+		else if (!rmgr->IsLoading(vpath) && rmgr->GetAGP(vpath,agp))
 		{
 			Point2 loc;
 			obj->GetLocation(gis_Geo,loc);
@@ -1158,7 +1158,7 @@ struct	preview_object : public WED_PreviewItem {
 			{
 				const XObj8 * oo;
 				if((o->show_lo+o->show_hi)/2 <= preview_level)
-				if(rmgr->GetObjRelative(o->name,vpath,oo))
+				if(rmgr->RequestObjRelative(o->name,vpath,oo))
 				{
 					draw_obj_at_xyz(tman, oo, o->x,0,-o->y,o->r, g);
 				}
@@ -1170,7 +1170,10 @@ struct	preview_object : public WED_PreviewItem {
 			Point2 l;
 			obj->GetLocation(gis_Geo,l);
 			l = zoomer->LLToPixel(l);
-			glColor3f(1,0,0);
+			if(rmgr->IsLoading(vpath))
+				glColor3f(0.5,0.5,0.5);			// not missing, just not loaded yet - we get redrawn when it arrives
+			else
+				glColor3f(1,0,0);
 			GUI_PlotIcon(g,"map_missing_obj.png", l.x(),l.y(),0,1.0);
 		}
 	}
@@ -1205,7 +1208,7 @@ struct	preview_truck : public WED_PreviewItem {
 
 		const XObj8 * o1 = NULL, * o2 = NULL;
 		agp_t agp;
-		if(!vpath1.empty() && rmgr->GetObj(vpath1,o1))
+		if(!vpath1.empty() && rmgr->RequestObj(vpath1,o1))
 		{
 			g->SetState(false,1,false,false,true,false,false);
 			glColor3f(1,1,1);
@@ -1216,7 +1219,7 @@ struct	preview_truck : public WED_PreviewItem {
 
 			if(trk->GetTruckType() == atc_ServiceTruck_Baggage_Train)
 			{
-				rmgr->GetObj(vpath2,o2);
+				rmgr->RequestObj(vpath2,o2);
 				if(o2)
 				{
 					double gap = 3.899;
@@ -1234,7 +1237,7 @@ struct	preview_truck : public WED_PreviewItem {
 			}
 			if(trk->GetTruckType() == atc_ServiceTruck_Ground_Power_Unit)
 			{
-				rmgr->GetObj(vpath2,o2);
+				rmgr->RequestObj(vpath2,o2);
 				if(o2)
 				{
 					double gap = 4.247;
@@ -1252,7 +1255,10 @@ struct	preview_truck : public WED_PreviewItem {
 			Point2 l;
 			trk->GetLocation(gis_Geo,l);
 			l = zoomer->LLToPixel(l);
-			glColor3f(1,0,0);
+			if(rmgr->IsLoading(vpath1))
+				glColor3f(0.5,0.5,0.5);
+			else
+				glColor3f(1,0,0);
 			GUI_PlotIcon(g,"map_missing_obj.png", l.x(),l.y(),0,1.0);
 		}
 	}
@@ -1283,7 +1289,7 @@ struct	preview_light : public WED_PreviewItem {
 		}
 
 		const XObj8 * o = NULL;
-		if(!vpath.empty() && rmgr->GetObj(vpath,o))
+		if(!vpath.empty() && rmgr->RequestObj(vpath,o))
 		{
 			g->SetState(false,1,false,false,true,false,false);
 			glColor3f(1,1,1);
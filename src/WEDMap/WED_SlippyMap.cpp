@@ -60,6 +60,10 @@
 							// Since zoom goes by 1.2x steps - it matters little w.r.t "sharpness"
 							// but saves on average 34% of all tile loads
 
+#define MAX_TILE_REQUESTS 8            // download slots. The file cache runs each one on its own connection.
+#define TEX_CACHE_BUDGET (128 << 20)  // bytes of tile textures to keep around once they scroll off screen
+#define TILE_RETRY_SECS 60            // how long a tile that failed to load stays failed before we ask for it again
+
 #define PREDEFINED_MAPS 2
 
 static const char * attributions[PREDEFINED_MAPS] = {
@@ -134,23 +138,76 @@ static void get_tile_range_for_box(const double bounds[4], int z, int tiles[4])
 }
 
 
+// A tile we'd like to have - ordered so that the current zoom level comes first, then closest to the center of the screen.
+struct tile_wish {
+	int						z;
+	double					dist;
+	WED_file_cache_request	req;
+	bool operator<(const tile_wish& rhs) const { return z == rhs.z ? dist < rhs.dist : z > rhs.z; }
+};
+
 WED_SlippyMap::WED_SlippyMap(GUI_Pane * h, WED_MapZoomerNew * zoomer, IResolver * resolver)
 	: WED_MapLayer(h, zoomer, resolver),
-	m_cache_request(NULL),
+	m_request_serial(0),
+	m_cache_bytes(0),
+	m_frame(0),
+	m_decode_quit(false),
 	mMapMode(0)
 {
+	m_decoder = thread(&WED_SlippyMap::decoder_thread, this);
 }
 
 WED_SlippyMap::~WED_SlippyMap()
 {
-	delete m_cache_request;
-	m_cache_request = NULL;
+	{
+		lock_guard<mutex> lock(m_decode_lock);
+		m_decode_quit = true;
+	}
+	m_decode_cond.notify_all();
+	m_decoder.join();
+
+	for(list<decode_job>::iterator j = m_decode_done.begin(); j != m_decode_done.end(); ++j)
+		if(j->result == 0)
+			DestroyBitmap(&j->info);
+}
+
+void	WED_SlippyMap::decoder_thread()
+{
+	unique_lock<mutex> lock(m_decode_lock);
+	while(1)
+	{
+		while(!m_decode_quit && m_decode_todo.empty())
+			m_decode_cond.wait(lock);
+		if(m_decode_quit)
+			break;
+
+		list<decode_job> job;
+		job.splice(job.begin(), m_decode_todo, m_decode_todo.begin());
+		lock.unlock();
+
+		decode_job& j(job.front());
+		j.result = CreateBitmapFromPNG(j.path.c_str(), &j.info, false, 0);
+		if(j.result != 0)
+			j.result = CreateBitmapFromJPEG(j.path.c_str(), &j.info);
+		if(j.result == 0 && j.info.channels == 3)                                              // apply to color changes
+			for (int x = 0; x < j.info.height * (j.info.width+j.info.pad) * j.info.channels; x += j.info.channels)
+			{
+				int val = 0.3 * j.info.data[x] + 0.6 * j.info.data[x+1] + 0.1 * j.info.data[x+2];  // deliberately not HSV weighing - want red's brighter
+				for (int c = 0; c < j.info.channels; ++c)
+					j.info.data[x+c] = intlim((1.0-j.saturation) * val + j.saturation * j.info.data[x+c] + j.brightness, 0, 255);
+			}
+
+		lock.lock();
+		m_decode_done.splice(m_decode_done.end(), job);
+	}
 }
 
 void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 {
 	if (mMapMode ==0) return;
-	finish_loading_tile();
+	++m_frame;
+	upload_decoded_tiles();
+	finish_loading_tiles();
 
 	double map_bounds[4];
 
@@ -166,7 +223,11 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 	int min_zoom = flt_abs(map_bounds[1]) > 60.0 ? MIN_ZOOM-1 : MIN_ZOOM; // get those ant/artic designers a bit more visibility
 	if(z_max < min_zoom) return;
 
+	Point2 view_center((map_bounds[0] + map_bounds[2]) * 0.5, (map_bounds[1] + map_bounds[3]) * 0.5);
+	vector<tile_wish> wishes;
+
 	int want = 0, got = 0, bad = 0;
+	time_t now = time(NULL);
 	for(int z = max(min_zoom,z_max-1); z <= z_max; ++z)      // Display only the next lower zoom level
 	{                                                        // avoids having to load up to 4x14 extra tiles at ZL16
 		int tiles[4];
@@ -228,11 +289,18 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 			//The potential place the tile could appear on disk, were it to be downloaded or have been downloaded
 			string potential_path = gFileCache.url_to_cache_path(WED_file_cache_request("", cache_domain_osm_tile, folder_prefix , url));
 
-			if (m_cache.count(potential_path))
+			map<string,tile_texture>::iterator t = m_cache.find(potential_path);
+			if (t != m_cache.end() && t->second.retry_at != 0 && t->second.retry_at <= now)
+			{
+				drop_tile(t);
+				t = m_cache.end();
+			}
+			if (t != m_cache.end())
 			{
 				++got;
+				touch_tile(t);
 
-				int id = m_cache[potential_path];
+				int id = t->second.tex_id;
 				if(id != 0)
 				{
 					g->SetState(0, 1, 0, 0, 0, 0, 0);
@@ -262,17 +330,43 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 					++bad;
 				}
 			}
-			else if(m_cache_request == NULL)
+			else if(m_decoding.count(potential_path) == 0)
 			{
-				m_cache_request = new WED_file_cache_request("", cache_domain_osm_tile, folder_prefix, url);
+				tile_wish w;
+				w.z = z;
+				w.dist = Vector2(view_center, Point2((tbounds[0] + tbounds[2]) * 0.5, (tbounds[1] + tbounds[3]) * 0.5)).squared_length();
+				w.req = WED_file_cache_request("", cache_domain_osm_tile, folder_prefix, url);
+				wishes.push_back(w);
 			}
 		}
 	}
 
-	if (m_cache_request)
+	// Hand out free download slots, most wanted tiles first.
+	sort(wishes.begin(), wishes.end());
+	for(vector<tile_wish>::iterator w = wishes.begin(); w != wishes.end() && m_requests.size() < MAX_TILE_REQUESTS; ++w)
+	{
+		list<tile_request>::iterator r = m_requests.begin();
+		while(r != m_requests.end() && r->req.in_url != w->req.in_url)
+			++r;
+		if(r == m_requests.end())
+		{
+			tile_request t;
+			t.req = w->req;
+			t.downloading = false;
+			m_requests.push_back(t);
+		}
+	}
+
+	purge_texture_cache();
+
+	if (!m_requests.empty() || !m_decoding.empty())
 	{
 		this->Start(0.05);
 	}
+	else if (bad)
+	{
+		this->Start(TILE_RETRY_SECS);                // come back for the failed tiles even if nobody pans the map
+	}
 	else
 	{
 		this->Stop();
@@ -282,7 +376,7 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 	zoom_msg << "ZL" << z_max << ": "
 			 << got << " of " << want
 			 << " (" << (float)got * 100.0f / (float)want << "% done, " << bad << " errors). "
-			 << (int)m_cache.size() << " tiles cached (" << (int)m_cache.size() / 4 << " MB)";
+			 << (int)m_cache.size() << " tiles cached (" << m_cache_bytes / (1 << 20) << " MB)";
 
 	int bnds[4];
 	GetHost()->GetBounds(bnds);
@@ -310,63 +404,145 @@ void	WED_SlippyMap::GetCaps(bool& draw_ent_v, bool& draw_ent_s, bool& cares_abou
 	draw_ent_v = draw_ent_s = cares_about_sel = wants_clicks = 0;
 }
 
-void	WED_SlippyMap::finish_loading_tile()
+void	WED_SlippyMap::finish_loading_tiles()
 {
-	if (m_cache_request != NULL)
+	int serial = gFileCache.get_completion_serial();
+	bool any_finished = serial != m_request_serial;
+	m_request_serial = serial;
+
+	list<tile_request>::iterator r = m_requests.begin();
+	while(r != m_requests.end())
 	{
-		WED_file_cache_response res = gFileCache.request_file(*m_cache_request);
+		if(r->downloading && !any_finished)
+		{
+			++r;
+			continue;
+		}
+		WED_file_cache_response res = gFileCache.request_file(r->req);
 		if (res.out_status == cache_status_available)
 		{
-			struct ImageInfo info;
-			int r = CreateBitmapFromPNG(res.out_path.c_str(), &info, false, 0);
-			if(r != 0)
-				r = CreateBitmapFromJPEG(res.out_path.c_str(), &info);
-			if(r == 0)
+			decode_job j;
+			j.path = res.out_path;
+			j.brightness = mMapMode == 1 ? -140.0 : -20.0;
+			j.saturation = mMapMode == 1 ?    0.4 :   1.0;
+			j.result = -1;
+
+			m_decoding.insert(res.out_path);
 			{
-				if (info.channels == 3)                                                        // apply to color changes
-					for (int x = 0; x < info.height * (info.width+info.pad) * info.channels; x += info.channels)
-						{
-							double BRIGHTNESS = -20;
-							double SATURATION = 1.0;
-							if(mMapMode == 1) { BRIGHTNESS = -140.0; SATURATION = 0.4; }
-
-							int val = 0.3 * info.data[x] + 0.6 * info.data[x+1] + 0.1 * info.data[x+2];  // deliberately not HSV weighing - want red's brighter
-							for (int c = 0; c < info.channels; ++c)
-								info.data[x+c] = intlim((1.0-SATURATION) * val + SATURATION * info.data[x+c] + BRIGHTNESS, 0, 255);
-						}
-
-				GLuint tex_id;
-				glGenTextures(1, &tex_id);
-				if (LoadTextureFromImage(info, tex_id, tex_Linear, NULL, NULL, NULL, NULL))
-				{
-					m_cache[res.out_path] = tex_id;
-				}
-				else
-				{
-					printf("Failed texture load from image.\n");
-					m_cache[res.out_path] = 0;
-				}
+				lock_guard<mutex> lock(m_decode_lock);
+				m_decode_todo.push_back(j);
+			}
+			m_decode_cond.notify_one();
+			r = m_requests.erase(r);
+		}
+		else if (res.out_status == cache_status_error || res.out_status == cache_status_cooling)
+		{                                                   // remember the failure, or a cooling tile would hog a slot
+			int code = res.out_error_type;
+
+			printf("%s: %d\n%s\n", res.out_path.c_str(), code, res.out_error_human.c_str());
+
+			add_tile(gFileCache.url_to_cache_path(r->req), 0, 0);
+			r = m_requests.erase(r);
+		}
+		else
+		{
+			r->downloading = true;
+			++r;
+		}
+	}
+}
+
+void	WED_SlippyMap::upload_decoded_tiles()
+{
+	list<decode_job> done;
+	{
+		lock_guard<mutex> lock(m_decode_lock);
+		done.swap(m_decode_done);
+	}
+
+	for(list<decode_job>::iterator j = done.begin(); j != done.end(); ++j)
+	{
+		m_decoding.erase(j->path);
+		if(j->result == 0)
+		{
+			GLuint tex_id;
+			glGenTextures(1, &tex_id);
+			if (LoadTextureFromImage(j->info, tex_id, tex_Linear, NULL, NULL, NULL, NULL))
+			{
+				add_tile(j->path, tex_id, j->info.width * j->info.height * 4);
 			}
 			else
 			{
-				printf("Can not read image tile - bad PNG or JPG data.\n");
-				m_cache[res.out_path] = 0;
+				printf("Failed texture load from image.\n");
+				glDeleteTextures(1, &tex_id);
+				add_tile(j->path, 0, 0);
 			}
-
-			delete m_cache_request;
-			m_cache_request = NULL;
+			DestroyBitmap(&j->info);
 		}
-		else if (res.out_status == cache_status_error)
+		else
 		{
-			int code = res.out_error_type;
+			printf("Can not read image tile - bad PNG or JPG data.\n");
+			add_tile(j->path, 0, 0);
+		}
+	}
+}
 
-			printf("%s: %d\n%s\n", res.out_path.c_str(), code, res.out_error_human.c_str());
+void	WED_SlippyMap::add_tile(const string& path, int tex_id, int bytes)
+{
+	map<string,tile_texture>::iterator t = m_cache.find(path);
+	if(t != m_cache.end())
+	{
+		// Can happen if a tile was evicted while still being decoded - just take the new texture.
+		drop_tile(t);
+	}
+
+	tile_texture tt;
+	tt.tex_id = tex_id;
+	tt.bytes = bytes;
+	tt.last_used = m_frame;
+	tt.retry_at = tex_id ? 0 : time(NULL) + TILE_RETRY_SECS;
+	m_lru.push_front(path);
+	tt.lru = m_lru.begin();
+	m_cache[path] = tt;
+	m_cache_bytes += bytes;
+}
 
-			m_cache[res.out_path] = 0;
+void	WED_SlippyMap::touch_tile(map<string,tile_texture>::iterator t)
+{
+	t->second.last_used = m_frame;
+	m_lru.splice(m_lru.begin(), m_lru, t->second.lru);
+}
 
-			delete m_cache_request;
-			m_cache_request = NULL;
-		}
+void	WED_SlippyMap::drop_tile(map<string,tile_texture>::iterator t)
+{
+	if(t->second.tex_id)
+	{
+		GLuint tex_id = t->second.tex_id;
+		glDeleteTextures(1, &tex_id);
+	}
+	m_cache_bytes -= t->second.bytes;
+	m_lru.erase(t->second.lru);
+	m_cache.erase(t);
+}
+
+void	WED_SlippyMap::purge_texture_cache()
+{
+	// Failed tiles cost no memory, so the budget never pushes them out - drop the expired ones that scrolled off screen.
+	time_t now = time(NULL);
+	for(map<string,tile_texture>::iterator t = m_cache.begin(); t != m_cache.end(); )
+	{
+		map<string,tile_texture>::iterator k(t++);
+		if(k->second.retry_at != 0 && k->second.retry_at <= now && k->second.last_used != m_frame)
+			drop_tile(k);
+	}
+
+	while(m_cache_bytes > TEX_CACHE_BUDGET && !m_lru.empty())
+	{
+		map<string,tile_texture>::iterator t = m_cache.find(m_lru.back());
+		DebugAssert(t != m_cache.end());
+		if(t->second.last_used == m_frame)       // everything left is on screen right now
+			break;
+		drop_tile(t);
 	}
 }
 
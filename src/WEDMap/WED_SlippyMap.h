@@ -25,10 +25,35 @@
 #ifndef WED_SlippyMap_h
 #define WED_SlippyMap_h
 
-class	WED_file_cache_request;
-
 #include "GUI_Timer.h"
 #include "WED_MapLayer.h"
+#include "WED_FileCache.h"
+#include "BitmapUtils.h"
+
+#include <list>
+#include <time.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+	WED_SlippyMap - TILE LOADING
+
+	Tiles come in through the file cache, which runs the downloads in the background.  We keep up to MAX_TILE_REQUESTS
+	of those in flight at once, and refill the free slots every frame from the tiles that are on screen but not
+	loaded yet, closest to the center of the view first.  Requests that are already downloading are only polled
+	again once the file cache's completion serial says some download has finished.
+
+	Once a tile is on disk, the PNG/JPEG decode and the color grading run on a worker thread.  Only the texture
+	upload happens on the UI thread, since that is where the GL context lives.
+
+	Textures are kept in an LRU cache with a memory budget.  Tiles drawn in the current frame are never evicted,
+	so a huge screen may go over the budget for a while, but panning around no longer grows GPU memory without
+	bound.
+
+	Tiles that fail to download or decode go into the cache with no texture, so they don't get asked for every frame.
+	They expire after TILE_RETRY_SECS and are then fetched again.
+*/
 
 enum yCoord_t { yNone, yNormal, yYahoo, yOSGeo };
 
@@ -46,13 +71,57 @@ public:
 
 private:
 
-			void	finish_loading_tile();
+	struct	tile_texture {
+		int					tex_id;		// 0 if the tile could not be loaded
+		int					bytes;		// GPU memory estimate
+		int					last_used;	// frame counter when we last drew it
+		time_t				retry_at;	// for a tile that could not be loaded: when to drop it and ask again, else 0
+		list<string>::iterator	lru;
+	};
+
+	struct	tile_request {
+		WED_file_cache_request	req;
+		bool					downloading;	// polled at least once and the file cache is fetching it
+	};
+
+	struct	decode_job {
+		string				path;
+		float				brightness;
+		float				saturation;
+		ImageInfo			info;
+		int					result;
+	};
+
+			void	finish_loading_tiles();
+			void	upload_decoded_tiles();
+			void	purge_texture_cache();
+			void	touch_tile(map<string,tile_texture>::iterator t);
+			void	drop_tile(map<string,tile_texture>::iterator t);
+			void	add_tile(const string& path, int tex_id, int bytes);
 			int 	get_zl_for_map(double in_ppm, double lattitude);
 
-	WED_file_cache_request* m_cache_request;
+			void	decoder_thread();
+
+	// Download slots - every one of these is a request that the file cache is working on.
+	list<tile_request>			m_requests;
+	int							m_request_serial;
+
+	//The texture cache, where they key is the tile texture path on disk; m_lru is most recently used first.
+	map<string,tile_texture>	m_cache;
+	list<string>				m_lru;
+	int							m_cache_bytes;
+	int							m_frame;
+
+	// Tiles that are downloaded but being decoded - they don't need a download slot any more.
+	set<string>					m_decoding;
 
-	//The texture cache, where they key is the tile texture path on disk and the value is the texture id
-	map<string,int>	m_cache;
+	// The decode worker.  Both queues are protected by m_decode_lock.
+	thread						m_decoder;
+	mutex						m_decode_lock;
+	condition_variable			m_decode_cond;
+	list<decode_job>			m_decode_todo;
+	list<decode_job>			m_decode_done;
+	bool						m_decode_quit;
 
 			int		mMapMode;
 			string	url_printf_fmt;
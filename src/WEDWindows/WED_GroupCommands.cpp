@@ -4411,6 +4411,7 @@ void WED_UpgradeRampStarts(IResolver * resolver)
 	WED_Thing * root = WED_GetWorld(resolver);
 	WED_ResourceMgr * rmgr = WED_GetResourceMgr(resolver);
 	ISelection * sel = WED_GetSelect(resolver);
+	rmgr->Preload(root, true);		// this looks at every object in the world, so load them all up front, in parallel
 	root->StartCommand("Upgrade Ramp Positions");
 	int did_work = wed_upgrade_airports_recursive(root, rmgr, sel);
 	if(did_work)
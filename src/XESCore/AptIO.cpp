@@ -32,6 +32,9 @@
 #include "AssertUtils.h"
 #include "CompGeomUtils.h"
 #include "STLUtils.h"
+#include "FileUtils.h"
+#include <thread>
+#include <atomic>
 
 #include "WED_Version.h"
 // for now
@@ -39,6 +42,9 @@
 #define ATC_VERS2 1050
 #define ATC_VERS3 1100
 
+#define APT_MIN_PARALLEL 64				// files with fewer airports than this aren't worth starting threads for
+#define APT_INDEX_VERSION 1
+
 
 #if OPENGL_MAP
 #include "Airports.h"
@@ -233,22 +239,18 @@ string	ReadAptFile(const char * inFileName, AptVector& outApts)
 	return err;
 }
 
-string	ReadAptFileMem(const char * inBegin, const char * inEnd, AptVector& outApts)
+// Reads the two header lines and leaves the scanner on the first record.
+static string	ReadAptHeader(MFTextScanner * s, int& vers, int& ln)
 {
-	outApts.clear();
-
-	MFTextScanner * s = TextScanner_OpenMem(inBegin, inEnd);
 	string ok;
 
-	int ln = 0;
-
 	// Versioning:
 	// 703 (base)
 	// 715 - addded vis flag to tower
 	// 810 - added vasi slope to towers
 	// 850 - added next-gen stuff
 
-		int vers = 0;
+	vers = 0;
 
 	if (TextScanner_IsDone(s))
 		ok = string("File is empty.");
@@ -274,6 +276,16 @@ string	ReadAptFileMem(const char * inBegin, const char * inEnd, AptVector& outAp
 		++ln;
 	}
 
+	return ok;
+}
+
+// Parses a run of records - everything after the header, or any part of it that starts with an airport record.
+// ln is the line number of the first line going in and of the last line parsed coming out.
+static string	ReadAptRecords(const char * inBegin, const char * inEnd, int vers, int& ln, AptVector& outApts, bool * outDone)
+{
+	MFTextScanner * s = TextScanner_OpenMem(inBegin, inEnd);
+	string ok;
+
 	set<string>		centers;
 	string codez;
 	string			lat_str, lon_str, rot_str, len_str, wid_str;
@@ -1083,13 +1095,6 @@ string	ReadAptFileMem(const char * inBegin, const char * inEnd, AptVector& outAp
 	}
 	TextScanner_Close(s);
 
-	if (!ok.empty())
-	{
-		char buf[50];
-		sprintf(buf," (Line %d)",ln);
-		ok += buf;
-	}
-
 	for (AptVector::iterator a = outApts.begin(); a != outApts.end(); ++a)
 	{
 		a->bounds = Bbox2();
@@ -1141,6 +1146,325 @@ string	ReadAptFileMem(const char * inBegin, const char * inEnd, AptVector& outAp
 			GenerateOGL(&*a);
 		#endif
 	}
+	if(outDone) *outDone = forceDone;
+	return ok;
+}
+
+static string	apt_line_error(const string& err, int ln)
+{
+	char buf[50];
+	sprintf(buf," (Line %d)",ln);
+	return err + buf;
+}
+
+// The record code of a line, the same way the parser sees it - atoi of the first token - or -1 for a blank line.
+static int	apt_line_code(const char * p, const char * e)
+{
+	while(p < e && (*p == ' ' || *p == '\t')) ++p;
+	if(p == e) return -1;
+	bool neg = false;
+	if(*p == '-' || *p == '+') neg = (*p++ == '-');
+	int code = 0;
+	while(p < e && *p >= '0' && *p <= '9')
+		code = code * 10 + (*p++ - '0');
+	return neg ? -code : code;
+}
+
+// Where things are in an apt.dat: the header, the start of every airport and the end of the records.
+struct	apt_file_layout_t {
+	int						vers;
+	const char *			body;			// first record after the header
+	const char *			body_end;		// the 99 record, or the end of the file
+	int						body_line;
+	vector<const char *>	apt_begin;		// every 1, 16 and 17 record
+	vector<int>				apt_line;
+};
+
+static string	ScanAptLayout(const char * inBegin, const char * inEnd, apt_file_layout_t& out)
+{
+	MFTextScanner * s = TextScanner_OpenMem(inBegin, inEnd);
+	int ln = 0;
+	string ok = ReadAptHeader(s, out.vers, ln);
+	out.body = out.body_end = TextScanner_GetBegin(s);
+	out.body_line = ln;
+	out.apt_begin.clear();
+	out.apt_line.clear();
+
+	if(ok.empty())
+	{
+		while(!TextScanner_IsDone(s))
+		{
+			int code = apt_line_code(TextScanner_GetBegin(s), TextScanner_GetEnd(s));
+			if(code == apt_done)
+				break;
+			if(code == apt_airport || code == apt_seaport || code == apt_heliport)
+			{
+				out.apt_begin.push_back(TextScanner_GetBegin(s));
+				out.apt_line.push_back(ln);
+			}
+			TextScanner_Next(s);
+			++ln;
+		}
+		out.body_end = TextScanner_IsDone(s) ? inEnd : TextScanner_GetBegin(s);
+	}
+	else
+		ok = apt_line_error(ok, ln);
+	TextScanner_Close(s);
+	return ok;
+}
+
+// Parse an apt.dat whose layout we know, in chunks of whole airports, on all cores.  The result (including which error
+// is reported) is the same as parsing it in one go: chunks are joined in file order, and we stop at the first error.
+static string	ReadAptLayout(const apt_file_layout_t& layout, AptVector& outApts)
+{
+	int num_apts = layout.apt_begin.size();
+	int num_threads = max(1, (int) thread::hardware_concurrency());
+	int num_chunks = (num_apts < APT_MIN_PARALLEL) ? 1 : min(num_apts, num_threads * 4);		// a few per thread, as airports vary a lot in size
+
+	struct chunk_t {
+		const char *	begin;
+		const char *	end;
+		int				ln;
+		AptVector		apts;
+		string			err;
+	};
+	vector<chunk_t>	chunks(num_chunks);
+
+	// Cut into chunks of about equal bytes.  The first one also takes anything between the header and the first airport.
+	size_t body_size = layout.body_end - layout.body;
+	int a = 0;
+	for(int c = 0; c < num_chunks; ++c)
+	{
+		chunks[c].begin = c ? layout.apt_begin[a] : layout.body;
+		chunks[c].ln = c ? layout.apt_line[a] : layout.body_line;
+		const char * target = layout.body + body_size * (c + 1) / num_chunks;
+		if(c == num_chunks - 1)
+			a = num_apts;
+		else
+		{
+			a = max(a + 1, (int) (lower_bound(layout.apt_begin.begin(), layout.apt_begin.end(), target) - layout.apt_begin.begin()));
+			a = min(a, num_apts - (num_chunks - 1 - c));				// leave at least one airport for each chunk to come
+		}
+		chunks[c].end = a < num_apts ? layout.apt_begin[a] : layout.body_end;
+	}
+
+	atomic<int>	next(0);
+	auto worker = [&]() {
+		int c;
+		while((c = next++) < num_chunks)
+			chunks[c].err = ReadAptRecords(chunks[c].begin, chunks[c].end, layout.vers, chunks[c].ln, chunks[c].apts, NULL);
+	};
+	vector<thread>	threads;
+	for(int t = 1; t < min(num_threads, num_chunks); ++t)
+		threads.push_back(thread(worker));
+	worker();
+	for(auto& t : threads)
+		t.join();
+
+	outApts.clear();
+	outApts.reserve(num_apts);
+	for(auto& c : chunks)
+	{
+		outApts.insert(outApts.end(), c.apts.begin(), c.apts.end());
+		if(!c.err.empty())
+			return apt_line_error(c.err, c.ln);
+	}
+	return string();
+}
+
+string	ReadAptFileMem(const char * inBegin, const char * inEnd, AptVector& outApts)
+{
+	outApts.clear();
+
+	apt_file_layout_t	layout;
+	string ok = ScanAptLayout(inBegin, inEnd, layout);
+	if(!ok.empty())
+		return ok;
+
+	return ReadAptLayout(layout, outApts);
+}
+
+/************************************************************************************************************************************************************************
+ * APT.DAT FILE INDEX
+ ************************************************************************************************************************************************************************/
+
+int		AptFileIndex_t::find(const string& icao) const
+{
+	unordered_map<string,int>::const_iterator i = by_icao.find(icao);
+	return i == by_icao.end() ? -1 : i->second;
+}
+
+void	AptFileIndex_t::find_in_bounds(const Bbox2& bounds, vector<int>& out) const
+{
+	out.clear();
+	for(int n = 0; n < airports.size(); ++n)
+		if(bounds.overlap(airports[n].bounds))
+			out.push_back(n);
+}
+
+static bool	apt_file_stamp(const char * inFileName, long long& size, long long& mtime)
+{
+	struct stat ss;
+	if(FILE_get_file_meta_data(inFileName, ss) != 0)
+		return false;
+	size = ss.st_size;
+	mtime = ss.st_mtime;
+	return true;
+}
+
+string	BuildAptFileIndex(const char * inFileName, AptFileIndex_t& outIndex)
+{
+	outIndex.airports.clear();
+	outIndex.by_icao.clear();
+	if(!apt_file_stamp(inFileName, outIndex.file_size, outIndex.file_mtime))
+		return string("could not stat file");
+
+	MFMemFile * f = MemFile_Open(inFileName);
+	if (f == NULL) return string("memfile_open failed");
+
+	const char * fbegin = MemFile_GetBegin(f);
+	apt_file_layout_t	layout;
+	AptVector			apts;
+	string ok = ScanAptLayout(fbegin, MemFile_GetEnd(f), layout);
+	if(ok.empty())
+		ok = ReadAptLayout(layout, apts);
+	if(ok.empty() && apts.size() != layout.apt_begin.size())
+		ok = "Airport records could not be located";
+
+	if(ok.empty())
+	{
+		outIndex.version = layout.vers;
+		outIndex.airports.resize(apts.size());
+		for(int n = 0; n < apts.size(); ++n)
+		{
+			AptFileIndexEntry_t& e = outIndex.airports[n];
+			e.icao = apts[n].icao;
+			e.bounds = apts[n].bounds;
+			e.offset = layout.apt_begin[n] - fbegin;
+			e.length = (n+1 < apts.size() ? layout.apt_begin[n+1] : layout.body_end) - layout.apt_begin[n];
+			e.line = layout.apt_line[n];
+			outIndex.by_icao.insert(unordered_map<string,int>::value_type(e.icao, n));		// first one wins, same as a linear search
+		}
+	}
+	MemFile_Close(f);
+	return ok;
+}
+
+static string	apt_index_path(const char * inFileName)
+{
+	return string(inFileName) + ".idx";
+}
+
+bool	ReadAptFileIndex(const char * inFileName, AptFileIndex_t& outIndex)
+{
+	outIndex.airports.clear();
+	outIndex.by_icao.clear();
+
+	long long size, mtime;
+	if(!apt_file_stamp(inFileName, size, mtime))
+		return false;
+
+	MFMemFile * f = MemFile_Open(apt_index_path(inFileName).c_str());
+	if(f == NULL)
+		return false;
+
+	MFTextScanner * s = TextScanner_Open(f);
+	bool ok = false;
+	if(!TextScanner_IsDone(s))
+	{
+		int idx_vers;
+		string line(TextScanner_GetBegin(s), TextScanner_GetEnd(s));
+		ok = sscanf(line.c_str(), "APT_INDEX %d %d %lld %lld", &idx_vers, &outIndex.version, &outIndex.file_size, &outIndex.file_mtime) == 4 &&
+			idx_vers == APT_INDEX_VERSION && outIndex.file_size == size && outIndex.file_mtime == mtime;
+		TextScanner_Next(s);
+	}
+
+	while(ok && !TextScanner_IsDone(s))
+	{
+		AptFileIndexEntry_t e;
+		double x1, y1, x2, y2;
+		long long offset, length;
+		string line(TextScanner_GetBegin(s), TextScanner_GetEnd(s));
+		char icao[64];
+		if(sscanf(line.c_str(), "%63s %lld %lld %d %lf %lf %lf %lf", icao, &offset, &length, &e.line, &x1, &y1, &x2, &y2) != 8 ||
+			offset < 0 || length < 0 || offset + length > size)
+		{
+			ok = false;
+			break;
+		}
+		e.icao = icao;
+		e.offset = offset;
+		e.length = length;
+		e.bounds = Bbox2(x1, y1, x2, y2);
+		outIndex.by_icao.insert(unordered_map<string,int>::value_type(e.icao, outIndex.airports.size()));
+		outIndex.airports.push_back(e);
+		TextScanner_Next(s);
+	}
+	TextScanner_Close(s);
+	MemFile_Close(f);
+
+	if(!ok)
+	{
+		outIndex.airports.clear();
+		outIndex.by_icao.clear();
+	}
+	return ok;
+}
+
+bool	WriteAptFileIndex(const char * inFileName, const AptFileIndex_t& inIndex)
+{
+	FILE * fi = fopen(apt_index_path(inFileName).c_str(), "w");
+	if(fi == NULL)
+		return false;
+
+	fprintf(fi, "APT_INDEX %d %d %lld %lld\n", APT_INDEX_VERSION, inIndex.version, inIndex.file_size, inIndex.file_mtime);
+	for(vector<AptFileIndexEntry_t>::const_iterator e = inIndex.airports.begin(); e != inIndex.airports.end(); ++e)
+		fprintf(fi, "%s %lld %lld %d %.9lf %.9lf %.9lf %.9lf\n", e->icao.empty() ? "-" : e->icao.c_str(),
+			(long long) e->offset, (long long) e->length, e->line,
+			e->bounds.xmin(), e->bounds.ymin(), e->bounds.xmax(), e->bounds.ymax());
+	bool ok = ferror(fi) == 0;
+	fclose(fi);
+	return ok;
+}
+
+string	GetAptFileIndex(const char * inFileName, AptFileIndex_t& outIndex)
+{
+	if(ReadAptFileIndex(inFileName, outIndex))
+		return string();
+	string err = BuildAptFileIndex(inFileName, outIndex);
+	if(err.empty())
+		WriteAptFileIndex(inFileName, outIndex);		// if we can't save it (read-only install?) we just build it again next time
+	return err;
+}
+
+string	ReadAptFileIndexed(const char * inFileName, const AptFileIndex_t& inIndex, const vector<int>& inWhich, AptVector& outApts)
+{
+	outApts.clear();
+	MFMemFile * f = MemFile_Open(inFileName);
+	if (f == NULL) return string("memfile_open failed");
+
+	const char * fbegin = MemFile_GetBegin(f);
+	size_t fsize = MemFile_GetEnd(f) - fbegin;
+	string ok;
+	for(vector<int>::const_iterator w = inWhich.begin(); w != inWhich.end(); ++w)
+	{
+		const AptFileIndexEntry_t& e = inIndex.airports[*w];
+		if(e.offset + e.length > fsize)
+		{
+			ok = "apt.dat index is out of date";
+			break;
+		}
+		AptVector one;
+		int ln = e.line;
+		ok = ReadAptRecords(fbegin + e.offset, fbegin + e.offset + e.length, inIndex.version, ln, one, NULL);
+		outApts.insert(outApts.end(), one.begin(), one.end());
+		if(!ok.empty())
+		{
+			ok = apt_line_error(ok, ln);
+			break;
+		}
+	}
+	MemFile_Close(f);
 	return ok;
 }
 
@@ -40,6 +40,42 @@ bool	WriteAptFile(const char * inFileName, const AptVector& outApts, int version
 bool	WriteAptFileOpen(FILE * inFile, const AptVector& outApts, int version);
 bool	WriteAptFileProcs(int (* print_func)(void *, const char *, ...), void * ref, const AptVector& outApts, int version);
 
+/*
+	APT.DAT FILE INDEX
+
+	The global apt.dat is hundreds of megabytes, and a lot of the time we only want a few airports out of it.  The index
+	remembers where in the file each airport's records are, with its ICAO and bounds, so that those can be parsed alone.
+	It is saved next to the apt.dat as <apt.dat>.idx and is only trusted while the apt.dat's size and mtime match.
+
+	ReadAptFile itself cuts the file at airport records and parses the pieces on all cores - the result is the same as a
+	serial parse, errors included.
+*/
+
+struct	AptFileIndexEntry_t {
+	string		icao;
+	Bbox2		bounds;
+	size_t		offset;			// file offset of the airport's 1/16/17 record
+	size_t		length;			// bytes up to the next airport (or the end of the records)
+	int			line;			// for error messages
+};
+
+struct	AptFileIndex_t {
+	int							version;		// apt.dat format version from the file's header
+	long long					file_size;		// the apt.dat's size and mtime when we indexed it
+	long long					file_mtime;
+	vector<AptFileIndexEntry_t>	airports;		// in file order
+	unordered_map<string,int>	by_icao;		// icao -> index into airports
+
+	int		find(const string& icao) const;									// -1 if we don't have it
+	void	find_in_bounds(const Bbox2& bounds, vector<int>& out) const;
+};
+
+string	BuildAptFileIndex(const char * inFileName, AptFileIndex_t& outIndex);
+bool	ReadAptFileIndex(const char * inFileName, AptFileIndex_t& outIndex);	// false if there is no index or the apt.dat changed
+bool	WriteAptFileIndex(const char * inFileName, const AptFileIndex_t& inIndex);
+string	GetAptFileIndex(const char * inFileName, AptFileIndex_t& outIndex);	// read the saved index, or build and save it
+string	ReadAptFileIndexed(const char * inFileName, const AptFileIndex_t& inIndex, const vector<int>& inWhich, AptVector& outApts);
+
 // Convert 810 to 850 layout
 void	ConvertForward(AptInfo_t& io_apt);
 
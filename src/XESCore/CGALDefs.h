@@ -105,6 +105,25 @@ typedef CGAL::Polygon_2<FastKernel>						Polygon_2;					// Ben says: this only w
 typedef CGAL::Polygon_with_holes_2<FastKernel>			Polygon_with_holes_2;		// true, we could use these definitons from our GPS segment traits.  This allows us to have polygons
 																					// Without GPS polygons!
 
+// A copy of a number that shares nothing with the original, so that it can go to another thread.  Lazy exact numbers share their
+// representation between copies and update it when they are evaluated, which is not thread safe.
+inline NT	isolate(const NT& c)
+{
+	const NT::ET& e = c.exact();
+#if USE_GMP
+	NT::ET r;
+	mpq_set(r.mpq(), e.mpq());
+	return NT(r);
+#else
+	return NT(NT::ET(e));		// Quotient<MP_Float> is a plain value - copying it is a deep copy.
+#endif
+}
+
+inline Point_2	isolate(const Point_2& p)
+{
+	return Point_2(isolate(p.x()), isolate(p.y()));
+}
+
 #if CGAL_VERSION_NR < 1040521000
 
 // CGAL 4.5.2 has this natively.  3.9 does not.  If we ever figure out exactly when it was added, we can tune it;
@@ -31,6 +31,8 @@
 #include "DEMTables.h"
 #include "BitmapUtils.h"
 #include "MathUtils.h"
+#include <thread>
+#include <atomic>
 
 #if IBM
 #define AVOID_WIN32_FILEIO
@@ -731,11 +733,13 @@ static	void	IgnoreTiffErrs(const char *, const char* fmt, va_list args)
 }
 
 struct	StTiffMemFile {
-	StTiffMemFile(const char * fname) { file = MemFile_Open(fname); offset = 0; }
-	~StTiffMemFile() { if (file) MemFile_Close(file); }
+	StTiffMemFile(const char * fname) { file = MemFile_Open(fname); offset = 0; owns = true; }
+	StTiffMemFile(MFMemFile * shared) { file = shared; offset = 0; owns = false; }		// another read position in an open file
+	~StTiffMemFile() { if (file && owns) MemFile_Close(file); }
 
 	MFMemFile *		file;
 	int				offset;
+	bool			owns;
 };
 
 static tsize_t	MemTIFFReadWriteProc(thandle_t handle, tdata_t data, tsize_t len)
@@ -790,19 +794,6 @@ static void 	MemTIFFUnmapFileProc(thandle_t, tdata_t, toff_t)
 {
 }
 
-template<typename T>
-void copy_scanline(
-				const T * v,
-				int y,
-				DEMGeo& dem)
-{
-	for (int x = 0; x < dem.mWidth; ++x, ++v)
-	{
-		float e = *v;
-		dem(x,dem.mHeight-y-1) = e;
-	}
-}
-
 template<typename T>
 void copy_from_scanline(
 				T * v,
@@ -816,26 +807,63 @@ void copy_from_scanline(
 	}
 }
 
+// Copies the part of one decoded tile or strip that falls inside the window into the DEM.  bx,by is the block's
+// top-left pixel in the image, bw,bh its size (already clipped to the image), stride its row length in pixels and
+// spp the samples per pixel - we take the first.  The window is image columns x0..x1, rows r0..r1.
 template<typename T>
-void copy_tile(
+void copy_block(
 				const T * v,
-				int x,
-				int y,
-				int dx,			// tile size
-				int dy,
+				int bx, int by,
+				int bw, int bh,
+				int stride, int spp,
+				int x0, int r0, int x1, int r1,
 				DEMGeo& dem)
 {
-	for (int cy = 0; cy < dy; ++cy)
-	for (int cx = 0; cx < dx; ++cx)
+	int cx0 = max(bx, x0), cx1 = min(bx + bw - 1, x1);
+	int cy0 = max(by, r0), cy1 = min(by + bh - 1, r1);
+	for (int r = cy0; r <= cy1; ++r)
 	{
-		int dem_x = x + cx;
-		int dem_y = dem.mHeight - (y + cy) - 1;
-		float e = *v;
-		dem(dem_x,dem_y) = e;
-		++v;
+		const T * row = v + ((r - by) * stride + (cx0 - bx)) * spp;
+		float * dst = &dem(cx0 - x0, r1 - r);
+		for (int c = cx0; c <= cx1; ++c, row += spp, ++dst)
+			*dst = *row;
 	}
 }
 
+static bool copy_block_any(
+				int format, int depth,
+				const void * v,
+				int bx, int by,
+				int bw, int bh,
+				int stride, int spp,
+				int x0, int r0, int x1, int r1,
+				DEMGeo& dem)
+{
+	switch(format) {
+	case SAMPLEFORMAT_UINT:
+		switch(depth) {
+		case 8:		copy_block((const unsigned char *) v,	bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		case 16:	copy_block((const unsigned short *) v,	bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		case 32:	copy_block((const unsigned int *) v,	bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		}
+		break;
+	case SAMPLEFORMAT_INT:
+		switch(depth) {
+		case 8:		copy_block((const char *) v,			bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		case 16:	copy_block((const short *) v,			bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		case 32:	copy_block((const int *) v,				bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		}
+		break;
+	case SAMPLEFORMAT_IEEEFP:
+		switch(depth) {
+		case 32:	copy_block((const float *) v,			bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		case 64:	copy_block((const double *) v,			bx,by,bw,bh,stride,spp,x0,r0,x1,r1,dem); return true;
+		}
+		break;
+	}
+	return false;
+}
+
 /*
 	GeoTiff notes -
 	First of all, Geotiff - unlike our DEMs, the first scanline is the "top" of the image, meaning north-most scanline.
@@ -860,9 +888,19 @@ void copy_tile(
 	In other words, the CGIAR SRTM files have essentially been shifted to the northeast by 1.5 arc-seconds.
 
 */
-bool	ExtractGeoTiff(DEMGeo& inMap, const char * inFileName, int post_style, int no_geo_needed)
+/*
+	Window reads - the image is decoded one TIFF block (tile or strip) at a time, and only blocks that overlap the
+	window are decoded at all.  Blocks are independent, so each thread opens its own TIFF handle on the shared memory
+	mapped file and takes blocks off a counter; every block writes its own pixels of the DEM.
+
+	Overviews (reduced-resolution IFDs, as written by gdaladdo) cover the same area as the full image with fewer
+	pixels, so we take the geo-coding from the full image and just space the overview's pixels out further.
+*/
+
+static bool	ExtractGeoTiffImpl(DEMGeo& inMap, const char * inFileName, int post_style, int no_geo_needed,
+							const double * window, int reduce)
 {
-	int result = -1;
+	bool ok = false;
 	double	corners[8];
 	TIFF * tif;
 	TIFFErrorHandler	warnH = TIFFSetWarningHandler(IgnoreTiffWarnings);
@@ -877,209 +915,187 @@ bool	ExtractGeoTiff(DEMGeo& inMap, const char * inFileName, int post_style, int
 	    MemTIFFSizeProc,
 	    MemTIFFMapFileProc, MemTIFFUnmapFileProc);
 	printf("Opened TIF file.\n");
-//    TIFF* tif = TIFFOpen(inFileName, "r");
 
     if (tif == NULL) goto bail;
 
+	{
 	if (!FetchTIFFCornersWithTIFF(tif, corners, post_style))
 	{
 		if(no_geo_needed)
 		{
 			printf("TIFF has no corners - using default.\n");
-			inMap.mWest = -180;
-			inMap.mSouth = -90;
-			inMap.mEast = 180;
-			inMap.mNorth = 90;
-			inMap.mPost = 1;
+			corners[0] = corners[4] = -180;
+			corners[1] = corners[3] = -90;
+			corners[2] = corners[6] = 180;
+			corners[5] = corners[7] = 90;
 		}
 		else
 		{
 			printf("Could not read GeoTiff projection data.\n");
-			return false;
+			TIFFClose(tif);
+			goto bail;
 		}
 	}
 
-	inMap.mWest = corners[0];
-	inMap.mSouth = corners[1];
-	inMap.mEast = corners[6];
-	inMap.mNorth = corners[7];
-	inMap.mPost = (post_style == dem_want_Post);
-
 	printf("Corners: %.12lf,%.12lf   %.12lf,%.12lf   %.12lf,%.12lf   %.12lf,%.12lf\n",
 		corners[0], corners[1], corners[2], corners[3], corners[4], corners[5], corners[6], corners[7]);
 
 	uint32 w, h;
-	uint16 cc;
+	uint16 cc = 1;
 	uint16 d;
-	uint16 format;
-	
-	format = SAMPLEFORMAT_UINT;	// sample format is NOT mandatory - unsigned int is the default if not present!
-
+	uint16 format = SAMPLEFORMAT_UINT;	// sample format is NOT mandatory - unsigned int is the default if not present!
+	int post = (post_style == dem_want_Post);
 
 	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
 	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
-	TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &cc);
-	TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &d);
-	TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT, &format);
-	printf("Image is: %dx%d, samples: %d, depth: %d, format: %d\n", w, h, cc, d, format);
 
-	inMap.resize(w,h);
-	
-	if(TIFFIsTiled(tif))
+	// Coarse sampling: the smallest overview no more than 'reduce' times coarser than the full image.
+	int		dir = 0;
+	if (reduce > 1)
 	{
-		uint32	tw, th;
-		TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
-		TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
-		tdata_t buf = _TIFFmalloc(TIFFTileSize(tif));
-		for (int y = 0; y < h; y += th)
-		for (int x = 0; x < w; x += tw)
+		double best = 1.0;
+		while (TIFFReadDirectory(tif))
 		{
-			result = TIFFReadTile(tif, buf, x, y, 0, 0);
-			if (result == -1) { printf("Tiff error in read.\n"); break; }
-
-			int ux = min(tw,w-x);
-			int uy = min(th,h-y);
-
-			switch(format) {
-			case SAMPLEFORMAT_UINT:
-				switch(d) {
-				case 8:
-					copy_tile<unsigned char>((const unsigned char *) buf, x,y,ux,uy, inMap);
-					break;
-				case 16:
-					copy_tile<unsigned short>((const unsigned short *) buf, x,y,ux,uy, inMap);
-					break;
-				case 32:
-					copy_tile<unsigned int>((const unsigned int *) buf, x,y,ux,uy, inMap);
-					break;
-				default:
-					printf("TIFF error: unsupported unsigned int sample depth: %d\n", d);
-					goto bail;
-				}
-				break;
-			case SAMPLEFORMAT_INT:
-				switch(d) {
-				case 8:
-					copy_tile<char>((const char *) buf, x,y,ux,uy, inMap);
-					break;
-				case 16:
-					copy_tile<short>((const short *) buf, x,y,ux,uy, inMap);
-					break;
-				case 32:
-					copy_tile<int>((const int *) buf, x,y,ux,uy, inMap);
-					break;
-				default:
-					printf("TIFF error: unsupported signed int sample depth: %d\n", d);
-					goto bail;
-				}
-				break;
-			case SAMPLEFORMAT_IEEEFP:
-				switch(d) {
-				case 32:
-					copy_tile<float>((const float *) buf, x,y,ux,uy, inMap);
-					break;
-				case 64:
-					copy_tile<double>((const double *) buf, x,y,ux,uy, inMap);
-					break;
-				default:
-					printf("TIFF error: unsupported floating point sample depth: %d\n", d);
-					goto bail;
+			uint32 sub = 0, ow = 0;
+			TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &sub);
+			TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &ow);
+			if ((sub & FILETYPE_REDUCEDIMAGE) && ow > 0)
+			{
+				double f = (double) w / (double) ow;
+				if (f > best && f <= (double) reduce + 0.01)
+				{
+					best = f;
+					dir = TIFFCurrentDirectory(tif);
 				}
-				break;
-			default:
-				printf("TIFF error: unsupported pixel format %d\n", format);
-				break;			
 			}
 		}
-
-		_TIFFfree(buf);	
-
-		TIFFClose(tif);
-
-		TIFFSetWarningHandler(warnH);
-		TIFFSetErrorHandler(errH);
-		return result != -1;
+		if (!TIFFSetDirectory(tif, dir))
+		{
+			TIFFClose(tif);
+			goto bail;
+		}
+		if (dir)
+			printf("Using overview %d, %.1fx coarser.\n", dir, best);
 	}
-	else
-	{
-		tsize_t line_size = TIFFScanlineSize(tif);
-		tdata_t aline = _TIFFmalloc(line_size);
-
-		int cs = TIFFCurrentStrip(tif);
-		int nos = TIFFNumberOfStrips(tif);
-		int cr = TIFFCurrentRow  (tif);
 
-		for (int y = 0; y < h; ++y)
+	uint32 iw, ih;
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &iw);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &ih);
+	TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &cc);
+	TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &d);
+	TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT, &format);
+	printf("Image is: %dx%d, samples: %d, depth: %d, format: %d\n", iw, ih, cc, d, format);
+
+	// Pick the image columns x0..x1 and rows r0..r1 (rows count down from the north edge) that cover the window.
+	double	west = corners[0], south = corners[1], east = corners[6], north = corners[7];
+	double	xres = (east - west) / (double) (iw - post);
+	double	yres = (north - south) / (double) (ih - post);
+	int		x0 = 0, x1 = iw - 1, r0 = 0, r1 = ih - 1;
+	if (window)
+	{
+		x0 = max(x0, (int) floor((window[0] - west) / xres + 1e-6));
+		x1 = min(x1, (int) ceil ((window[2] - west) / xres - 1e-6) - (1 - post));
+		r0 = max(r0, (int) floor((north - window[3]) / yres + 1e-6));
+		r1 = min(r1, (int) ceil ((north - window[1]) / yres - 1e-6) - (1 - post));
+		if (x0 > x1 || r0 > r1)
 		{
-			result = TIFFReadScanline(tif, aline, y, 0);
-			if (result == -1) { printf("Tiff error in read.\n"); break; }
+			printf("Window does not overlap the image.\n");
+			TIFFClose(tif);
+			goto bail;
+		}
+	}
 
-			switch(format) {
-			case SAMPLEFORMAT_UINT:
-				switch(d) {
-				case 8:
-					copy_scanline<unsigned char>((const unsigned char *) aline, y, inMap);
-					break;
-				case 16:
-					copy_scanline<unsigned short>((const unsigned short *) aline, y, inMap);
-					break;
-				case 32:
-					copy_scanline<unsigned int>((const unsigned int *) aline, y, inMap);
-					break;
-				default:
-					printf("TIFF error: unsupported unsigned int sample depth: %d\n", d);
-					goto bail;
-				}
-				break;
-			case SAMPLEFORMAT_INT:
-				switch(d) {
-				case 8:
-					copy_scanline<char>((const char *) aline, y, inMap);
-					break;
-				case 16:
-					copy_scanline<short>((const short *) aline, y, inMap);
-					break;
-				case 32:
-					copy_scanline<int>((const int *) aline, y, inMap);
-					break;
-				default:
-					printf("TIFF error: unsupported signed int sample depth: %d\n", d);
-					goto bail;
-				}
-				break;
-			case SAMPLEFORMAT_IEEEFP:
-				switch(d) {
-				case 32:
-					copy_scanline<float>((const float *) aline, y, inMap);
-					break;
-				case 64:
-					copy_scanline<double>((const double *) aline, y, inMap);
-					break;
-				default:
-					printf("TIFF error: unsupported floating point sample depth: %d\n", d);
-					goto bail;
-				}
-				break;
-			default:
-				printf("TIFF error: unsupported pixel format %d\n", format);
-				break;			
+	inMap.mWest = west + x0 * xres;
+	inMap.mEast = west + (x1 + 1 - post) * xres;
+	inMap.mNorth = north - r0 * yres;
+	inMap.mSouth = north - (r1 + 1 - post) * yres;
+	inMap.mPost = post;
+	inMap.resize(x1 - x0 + 1, r1 - r0 + 1);
+
+	// The blocks that overlap the window, as top-left pixels.
+	bool	tiled = TIFFIsTiled(tif);
+	uint32	bw = iw, bh;
+	if (tiled)
+	{
+		TIFFGetField(tif, TIFFTAG_TILEWIDTH, &bw);
+		TIFFGetField(tif, TIFFTAG_TILELENGTH, &bh);
+	}
+	else if (!TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &bh) || bh > ih)
+		bh = ih;
+	vector<pair<int,int> >	blocks;
+	for (int y = (r0 / bh) * bh; y <= r1; y += bh)
+	for (int x = (x0 / bw) * bw; x <= x1; x += bw)
+		blocks.push_back(pair<int,int>(x, y));
+
+	uint16 planar = PLANARCONFIG_CONTIG;
+	TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &planar);
+	int		spp = (planar == PLANARCONFIG_CONTIG) ? cc : 1;		// separate planes: plane 0 is the first sample
+	tsize_t	block_size = tiled ? TIFFTileSize(tif) : TIFFStripSize(tif);
+	TIFFClose(tif);
+
+	atomic<int>		next(0);
+	atomic<bool>	failed(false);
+
+	auto worker = [&]() {
+		StTiffMemFile	mine(tiffMem.file);
+		TIFF * t = XTIFFClientOpen(inFileName, "r", &mine,
+			MemTIFFReadWriteProc, MemTIFFReadWriteProc,
+			MemTIFFSeekProc, MemTIFFCloseProc,
+			MemTIFFSizeProc,
+			MemTIFFMapFileProc, MemTIFFUnmapFileProc);
+		if (t == NULL || !TIFFSetDirectory(t, dir))
+		{
+			failed = true;
+			if (t) TIFFClose(t);
+			return;
+		}
+		tdata_t buf = _TIFFmalloc(block_size);
+		int n;
+		while (!failed && (n = next++) < blocks.size())
+		{
+			int x = blocks[n].first, y = blocks[n].second;
+			tsize_t got = tiled ? TIFFReadTile(t, buf, x, y, 0, 0)
+								: TIFFReadEncodedStrip(t, TIFFComputeStrip(t, y, 0), buf, block_size);
+			if (got == -1) { printf("Tiff error in read.\n"); failed = true; break; }
+
+			int uw = tiled ? min<int>(bw, iw - x) : iw;
+			int uh = min<int>(bh, ih - y);
+			if (!copy_block_any(format, d, buf, x, y, uw, uh, bw, spp, x0, r0, x1, r1, inMap))
+			{
+				printf("TIFF error: unsupported pixel format %d, depth %d\n", format, d);
+				failed = true;
 			}
-
 		}
-		_TIFFfree(aline);
-
-
-		TIFFClose(tif);
-
-		TIFFSetWarningHandler(warnH);
-		TIFFSetErrorHandler(errH);
-		return result != -1;
+		_TIFFfree(buf);
+		TIFFClose(t);
+	};
+
+	int num_threads = min((int) blocks.size(), max(1, (int) thread::hardware_concurrency()));
+	vector<thread> threads;
+	for (int i = 1; i < num_threads; ++i)
+		threads.push_back(thread(worker));
+	worker();
+	for (auto& t : threads)
+		t.join();
+
+	ok = !failed;
 	}
 bail:
 	TIFFSetWarningHandler(warnH);
 	TIFFSetErrorHandler(errH);
-	return false;
+	return ok;
+}
 
+bool	ExtractGeoTiff(DEMGeo& inMap, const char * inFileName, int post_style, int no_geo_needed)
+{
+	return ExtractGeoTiffImpl(inMap, inFileName, post_style, no_geo_needed, NULL, 1);
+}
+
+bool	ExtractGeoTiffWindow(DEMGeo& inMap, const char * inFileName, int post_style,
+						double west, double south, double east, double north, int reduce)
+{
+	double window[4] = { west, south, east, north };
+	return ExtractGeoTiffImpl(inMap, inFileName, post_style, 0, window, reduce);
 }
 
 
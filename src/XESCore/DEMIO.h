@@ -84,6 +84,11 @@ bool	ExtractUSGSNaturalFile(DEMGeo& inMap, const char * inFileName);
 
 // GeoTiff - must be geographic projected for us to use.  Origin is NW corner.
 bool	ExtractGeoTiff(DEMGeo& inMap, const char * inFileName, int post_style, int no_geo_needed);
+// Reads just the part of a GeoTiff inside west,south,east,north (grown out to whole pixels) - only the tiles or strips
+// that overlap it are decoded, on all cores.  reduce > 1 asks for coarse sampling: if the file has overviews, the
+// coarsest one that is at most 'reduce' times coarser than the full image is read instead.
+bool	ExtractGeoTiffWindow(DEMGeo& inMap, const char * inFileName, int post_style,
+						double west, double south, double east, double north, int reduce = 1);
 bool	WriteGeoTiff(DEMGeo& inMap, const char * inFileName);
 
 // DTED - contains its own geo info
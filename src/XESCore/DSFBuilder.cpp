@@ -37,6 +37,8 @@
 #include "MathUtils.h"
 #include "PerfUtils.h"
 #include "GISTool_Globals.h"
+#include <thread>
+#include <atomic>
 
 /*
 	TODO:
@@ -94,6 +96,10 @@ DSFBuildPrefs_t	gDSFBuildPrefs = { 1 };
 // Set to 1 to visualize beters on screen.
 #define		SHOW_BEZIERS 0
 
+// Set to 1 to compute vertex attributes and build terrain patches on all cores.  Off until a DSF built this way has been compared
+// byte for byte against the one-thread build.
+#define		PARALLEL_PATCHES 0
+
 // These macros set the height and normal in the mesh to the new-style modes.
 #define USE_DEM_H(x,w,m,v)	((CategorizeVertex(m,v,terrain_Water) <= 0) ? (x) : -32768.0)
 #define USE_DEM_N(x)		0.0f
@@ -494,12 +500,9 @@ static void ProjectTex(double lon, double lat, double& s, double& t, const tex_p
 
 
 
-static double GetWaterBlend(CDT::Vertex_handle v_han, const DEMGeo& dem_land, const DEMGeo& dem_water)
+// lon and lat are the vertex's location, clamped to dem_land's bounds.
+static double GetWaterBlend(CDT::Vertex_handle v_han, double lon, double lat, const DEMGeo& dem_land, const DEMGeo& dem_water)
 {
-	double lon, lat;
-	lon = doblim(CGAL::to_double(v_han->point().x()),dem_land.mWest ,dem_land.mEast );
-	lat = doblim(CGAL::to_double(v_han->point().y()),dem_land.mSouth,dem_land.mNorth);
-
 	float land_ele  = dem_land.value_linear(lon, lat);
 	float water_ele = dem_water.value_linear(lon, lat);
 
@@ -516,14 +519,15 @@ static double GetWaterBlend(CDT::Vertex_handle v_han, const DEMGeo& dem_land, co
 
 // Tightness - given a vertex on a face and a certain terrain border we're putting down on that face,
 // what "tightness" shouldd the transition have - that's basically the T coord of the dither control mask.
-static double GetTightnessBlend(CDT& inMesh, CDT::Face_handle f_han, CDT::Vertex_handle v_han, int terrain)
+// The caller passes the terrain's projection angle so that this can run on the emitter threads without
+// touching the terrain table.
+static double GetTightnessBlend(CDT& inMesh, CDT::Face_handle f_han, CDT::Vertex_handle v_han, int terrain, int proj)
 {
 	// First check for projetion problems.  Take a vector of the angle this iterrain will proj at and
 	// the tri normal.  If they are 'shear' by more than 45 degrees, the projection is going to look like
 	// ass.  In that case automatically tighten up the border via a cos^2 power curve, for the tightest
 	// border at totally shear angle.
 	Vector3	tproj(0,0,1);
-	int proj = gNaturalTerrainInfo[terrain].proj_angle;
 	if (proj == proj_EastWest)	tproj = Vector3(1,0,0);
 	if (proj == proj_NorthSouth)	tproj = Vector3(0,1,0);
 
@@ -898,6 +902,262 @@ void 	CHECK_TRI(CDT::Vertex_handle a, CDT::Vertex_handle b, CDT::Vertex_handle c
 	}
 }
 
+/************************************************************************************************************************************************
+ * TERRAIN PATCH EMISSION
+ ************************************************************************************************************************************************
+
+	THEORY OF OPERATION
+
+	The DSF's terrain patches must come out in a fixed order: for each land use (in layer order), its base patches in patch order, then its
+	border patches in patch order.  Building a patch is the expensive part - CDT handle chasing, categorizing vertices, water blends and border
+	tightness - while writing it is cheap.  So the two are split.
+
+	The face pass that assigns triangles to patches also drops each triangle into a bucket per (patch, land use) for every base layer it draws
+	in, and per (patch, border land use) for every border it carries, so nothing later filters a patch's triangles by land use again.  The
+	buckets keep the face-pass order, which is the order the old filtered walks visited them in.  Every vertex used by a bucket gets its
+	per-vertex attributes (clamped lon/lat, DEM height, wet/dry and, for water, the wave blend) computed once.  The lon/lat come from the
+	mesh's lazy exact points, which are not safe to read from several threads, so they are converted on the main thread; the rest is done
+	in parallel from those doubles and the vertex and face info.
+
+	Then, one land use at a time, all of its patches are built on all cores into recorded command streams (primitive type, vertex count,
+	coordinates), and the streams are replayed into the DSF writer in the original order - so the file is byte-for-byte what the serial
+	emitter wrote.  Only the current land use's streams are held at once.
+
+	The real tri-fan builder (STUB_FANS 0) flags faces and reads the flags of neighbors in other patches, so in that configuration the patches
+	are built on one thread.  Everything runs on one thread unless PARALLEL_PATCHES is on - the parallel build has not been diffed against
+	the serial DSF yet.
+
+ ************************************************************************************************************************************************/
+
+struct	dsf_vertex_attr {
+	double		lon, lat;		// clamped to the DSF bounds
+	double		height;			// USE_DEM_H
+	double		wet;			// 0 if the vertex touches any land, 1 if it is all water
+	double		wave;			// GetWaterBlend - only computed for vertices in water patches
+};
+
+struct	dsf_vertex_cache {
+	hash_map<const CDT::Vertex *, int>	index;
+	vector<CDT::Vertex_handle>			verts;
+	vector<char>						need_wave;
+	vector<dsf_vertex_attr>				attr;
+
+	void	add(CDT::Vertex_handle v, bool water)
+	{
+		pair<hash_map<const CDT::Vertex *, int>::iterator, bool> i = index.insert(hash_map<const CDT::Vertex *, int>::value_type(&*v, (int) verts.size()));
+		if(i.second)
+		{
+			verts.push_back(v);
+			need_wave.push_back(water);
+		}
+		else if(water)
+			need_wave[i.first->second] = 1;
+	}
+
+	const dsf_vertex_attr&	get(CDT::Vertex_handle v) const
+	{
+		hash_map<const CDT::Vertex *, int>::const_iterator i = index.find(&*v);
+		DebugAssert(i != index.end());
+		return attr[i->second];
+	}
+
+	void	compute(CDT& mesh, const DEMGeo& elev, const DEMGeo& bath)
+	{
+		attr.resize(verts.size());
+		atomic<int>	next(0);
+		int			total = verts.size();
+
+		// to_double may evaluate a lazy number exactly, which writes to it - so the coordinates are read here, on this thread only.
+		for(int n = 0; n < total; ++n)
+		{
+			attr[n].lon = doblim(CGAL::to_double(verts[n]->point().x()),elev.mWest ,elev.mEast );
+			attr[n].lat = doblim(CGAL::to_double(verts[n]->point().y()),elev.mSouth,elev.mNorth);
+		}
+
+		// Each vertex is done by one thread - GetWaterBlend writes the vertex's wave height as it goes.
+		auto worker = [&]() {
+			int n;
+			while((n = next++) < total)
+			{
+				CDT::Vertex_handle v = verts[n];
+				dsf_vertex_attr& a = attr[n];
+				int cat = CategorizeVertex(mesh, v, terrain_Water);
+				a.height = (cat <= 0) ? v->info().height : -32768.0;
+				a.wet = (cat >= 0) ? 0.0 : 1.0;
+				a.wave = need_wave[n] ? GetWaterBlend(v, a.lon, a.lat, elev, bath) : 0.0;
+			}
+		};
+
+#if PARALLEL_PATCHES
+		int num_threads = min(total, max(1, (int) thread::hardware_concurrency()));
+#else
+		int num_threads = min(total, 1);
+#endif
+		vector<thread> threads;
+		for(int t = 1; t < num_threads; ++t)
+			threads.push_back(thread(worker));
+		worker();
+		for(auto& t : threads)
+			t.join();
+	}
+};
+
+struct	dsf_terrain_bucket {
+	vector<CDT::Face_handle>	tris;
+	vector<float>				blend;			// Border buckets only: the border blend of each tri's 3 vertices
+};
+
+typedef map<int, dsf_terrain_bucket>	dsf_bucket_map;		// Land use -> its bucket in one patch
+
+// Everything about the land use being emitted that the patch builders need, looked up once on the main thread.
+struct	dsf_terrain_layer {
+	int					lu;
+	bool				is_water;
+	tex_proj_info *		pinfo;
+	int					proj;			// Projection angle, for border tightness
+};
+
+struct	dsf_patch_job {
+	const dsf_terrain_bucket *	bucket;
+	bool						border;
+	vector<int>					prims;			// Pairs of primitive type, vertex count
+	vector<double>				coords;			// All vertices of all primitives, packed at the patch's coord depth
+	int							tris;
+	int							fans;
+};
+
+static void	build_base_patch(CDT& mesh, const dsf_vertex_cache& cache, const dsf_terrain_layer& layer, dsf_patch_job& job)
+{
+	TriFanBuilder	fan_builder(&mesh);
+	for(vector<CDT::Face_handle>::const_iterator f = job.bucket->tris.begin(); f != job.bucket->tris.end(); ++f)
+		fan_builder.AddTriToFanPool(*f);
+	fan_builder.CalcFans();
+
+	list<CDT::Vertex_handle>			primv;
+	list<CDT::Vertex_handle>::iterator	vert;
+	int									primt;
+	while(1)
+	{
+		primt = fan_builder.GetNextPrimitive(primv);
+		if(primv.empty()) break;
+		if(primt != dsf_Tri)
+		{
+			++job.fans;
+			job.tris += (primv.size() - 2);
+		} else
+			job.tris += (primv.size() / 3);
+
+		job.prims.push_back(primt);
+		job.prims.push_back(primv.size());
+		for(vert = primv.begin(); vert != primv.end(); ++vert)
+		{
+			const dsf_vertex_attr& a = cache.get(*vert);
+			job.coords.push_back(a.lon);
+			job.coords.push_back(a.lat);
+			job.coords.push_back(a.height);
+			job.coords.push_back(USE_DEM_N( (*vert)->info().normal[0]));
+			job.coords.push_back(USE_DEM_N(-(*vert)->info().normal[1]));
+			if (layer.is_water)
+			{
+				DebugAssert(a.wave >= 0.0);
+				DebugAssert(a.wave <= 1.0);
+				job.coords.push_back(a.wave);
+				job.coords.push_back(a.wet);
+			}
+			else if (layer.pinfo)
+			{
+				double s, t;
+				ProjectTex(a.lon, a.lat, s, t, layer.pinfo);
+				DebugAssert(s >= 0.0 && s <= 1.0);
+				DebugAssert(t >= 0.0 && t <= 1.0);
+				job.coords.push_back(s);
+				job.coords.push_back(t);
+			}
+		}
+	}
+}
+
+static void	build_border_patch(CDT& mesh, const dsf_vertex_cache& cache, const dsf_terrain_layer& layer, dsf_patch_job& job)
+{
+	int tris_this_patch = 0;
+	for(int tri = 0; tri < job.bucket->tris.size(); ++tri)
+	{
+		CDT::Face_handle f = job.bucket->tris[tri];
+		const float * bblend = &job.bucket->blend[tri * 3];
+
+		// Ben says: normally we would like to draw one DSF overdrawn tri for each border tri.  But there is an exception case:
+		// if ALL of our border blends are 100% but our border is NOT a variant (e.g. this is a meaningful border change) then
+		// we really need to make 3 border tris that all fade out...this allows the CENTER of our tri to show the base terrain
+		// while the borders show the neighboring tris.  (Without this, a single tri of cliff will be COMPLETELY covered by
+		// the non-cliff terrain surrouding on 3 sides.)  In this case we make THREE passes and force one vertex to 0% blend for
+		// each pass.
+		int ts = -1, te = 0;
+		if (bblend[0] == bblend[1] &&
+			bblend[1] == bblend[2] &&
+			bblend[0] == 1.0)
+		{
+			ts = 0; te = 3;
+		}
+
+		for (int border_pass = ts; border_pass < te; ++border_pass)
+		{
+			if (tris_this_patch >= MAX_TRIS_PER_PATCH)
+			{
+				job.prims.push_back(dsf_Tri);
+				job.prims.push_back(tris_this_patch * 3);
+				tris_this_patch = 0;
+			}
+
+			for (int vi = 2; vi >= 0 ; --vi)
+			{
+				const dsf_vertex_attr& a = cache.get(f->vertex(vi));
+				double tightness = GetTightnessBlend(mesh, f, f->vertex(vi), layer.lu, layer.proj);
+				DebugAssert(bblend[vi] >= 0.0 && bblend[vi] <= 1.0);
+				DebugAssert(tightness >= 0.0 && tightness <= 1.0);
+				job.coords.push_back(a.lon);
+				job.coords.push_back(a.lat);
+				job.coords.push_back(a.height);
+				job.coords.push_back(USE_DEM_N( f->vertex(vi)->info().normal[0]));
+				job.coords.push_back(USE_DEM_N(-f->vertex(vi)->info().normal[1]));
+				job.coords.push_back(vi == border_pass ? 0.0 : bblend[vi]);
+				job.coords.push_back(tightness);
+			}
+			++job.tris;
+			++tris_this_patch;
+		}
+	}
+	job.prims.push_back(dsf_Tri);
+	job.prims.push_back(tris_this_patch * 3);
+}
+
+// Builds the streams for all of one land use's patches.
+static void	build_patches(CDT& mesh, const dsf_vertex_cache& cache, const dsf_terrain_layer& layer, vector<dsf_patch_job>& jobs)
+{
+	atomic<int>	next(0);
+	int			total = jobs.size();
+
+	auto worker = [&]() {
+		int n;
+		while((n = next++) < total)
+		{
+			if(jobs[n].border)	build_border_patch(mesh, cache, layer, jobs[n]);
+			else				build_base_patch(mesh, cache, layer, jobs[n]);
+		}
+	};
+
+#if STUB_FANS && PARALLEL_PATCHES
+	int num_threads = min(total, max(1, (int) thread::hardware_concurrency()));
+#else
+	int num_threads = min(total, 1);
+#endif
+	vector<thread> threads;
+	for(int t = 1; t < num_threads; ++t)
+		threads.push_back(thread(worker));
+	worker();
+	for(auto& t : threads)
+		t.join();
+}
+
 struct	ObjPrio {
 
 	bool operator()(const int& lhs, const int& rhs) const
@@ -942,10 +1202,10 @@ void	BuildDSF(
 {
 
 
-vector<CDT::Face_handle>	sHiResTris[PATCH_DIM_HI * PATCH_DIM_HI];
 vector<CDT::Face_handle>	sLoResTris[PATCH_DIM_LO * PATCH_DIM_LO];
-set<int>					sHiResLU[PATCH_DIM_HI * PATCH_DIM_HI];
-set<int>					sHiResBO[PATCH_DIM_HI * PATCH_DIM_HI];
+dsf_bucket_map				sHiResBase[PATCH_DIM_HI * PATCH_DIM_HI];
+dsf_bucket_map				sHiResBorder[PATCH_DIM_HI * PATCH_DIM_HI];
+dsf_vertex_cache			sHiResVerts;
 set<int>					sLoResLU[PATCH_DIM_LO * PATCH_DIM_LO];
 
 
@@ -1141,39 +1401,66 @@ set<int>					sLoResLU[PATCH_DIM_LO * PATCH_DIM_LO];
 				CGAL::to_double(fi->vertex(1)->point().x()),CGAL::to_double(fi->vertex(1)->point().y()),
 				CGAL::to_double(fi->vertex(2)->point().x()),CGAL::to_double(fi->vertex(2)->point().y()));
 
-		// Accumulate the various texes into the various layers.  This means marking what land uses we have per each patch
-		// and also any borders we need.
-		sHiResTris[(int) x + (int) y * PATCH_DIM_HI].push_back(fi);
+		// Accumulate the various texes into the various layers.  This means bucketing the tri into each land use it draws in
+		// and each border it carries, per patch.
+		int patch = (int) x + (int) y * PATCH_DIM_HI;
+		int base_lu[2] = { fi->info().terrain, -1 };
 		DebugAssert(fi->info().terrain != -1);
 		landuses.insert(map<int, int, SortByLULayer>::value_type(fi->info().terrain,0));
 		// special case: maybe the hard variant is never used?  In that case, make sure to accum it here or we'll never export that land use.
 		if(IsAliased(fi->info().terrain))
 			landuses.insert(map<int, int, SortByLULayer>::value_type(IsAliased(fi->info().terrain),0));
-		sHiResLU[(int) x + (int) y * PATCH_DIM_HI].insert(fi->info().terrain);
-
 
 		if(IsCustomOverWaterHard(fi->info().terrain))
 		{
 			// Over water, but maintain hard physics.  So we need to put ourselves in the visual layer, and make sure there is water for aliasing.
 			landuses.insert(map<int, int, SortByLULayer>::value_type(terrain_Water,0));
 			landuses.insert(map<int, int, SortByLULayer>::value_type(terrain_VisualWater,0));
-			sHiResLU[(int) x + (int) y * PATCH_DIM_HI].insert(terrain_VisualWater);
+			base_lu[1] = terrain_VisualWater;
 		}
 		if(IsCustomOverWaterSoft(fi->info().terrain))
 		{
 			// Over water soft - put us in the water layer.
 			landuses.insert(map<int, int, SortByLULayer>::value_type(terrain_Water,0));
-			sHiResLU[(int) x + (int) y * PATCH_DIM_HI].insert(terrain_Water);
+			base_lu[1] = terrain_Water;
+		}
+
+		for (int b = 0; b < 2; ++b)
+		if (base_lu[b] != -1)
+		{
+			bool is_wet = base_lu[b] == terrain_VisualWater || base_lu[b] == terrain_Water;
+			CHECK_TRI(fi->vertex(0),fi->vertex(1),fi->vertex(2));
+			sHiResBase[patch][base_lu[b]].tris.push_back(fi);
+			for (int vi = 0; vi < 3; ++vi)
+				sHiResVerts.add(fi->vertex(vi), is_wet);
 		}
 
 		for (border_lu = fi->info().terrain_border.begin(); border_lu != fi->info().terrain_border.end(); ++border_lu)
 		{
-			sHiResBO[(int) x + (int) y * PATCH_DIM_HI].insert(*border_lu);
 			landuses.insert(map<int, int, SortByLULayer>::value_type(*border_lu,0));
 			DebugAssert(*border_lu != -1);
+#if !NO_BORDERS
+			if (*border_lu >= terrain_Natural)
+			{
+				// Border blends are read here, on one thread - a vertex with no blend for this border gets a 0 entry, as it always did.
+				dsf_terrain_bucket& bucket(sHiResBorder[patch][*border_lu]);
+				bucket.tris.push_back(fi);
+				for (int vi = 0; vi < 3; ++vi)
+				{
+					bucket.blend.push_back(fi->vertex(vi)->info().border_blend[*border_lu]);
+					sHiResVerts.add(fi->vertex(vi), false);
+				}
+			}
+#endif
 		}
 	}
 
+	if(writer1)
+	{
+		TIMER(vertex_attributes)
+		sHiResVerts.compute(inHiresMesh, inElevation, inBathymetry);
+	}
+
 	if (inProgress && inProgress(0, 5, "Compiling Mesh", 0.5)) return;
 
 #if !NO_ORTHO
@@ -1303,180 +1590,77 @@ set<int>					sLoResLU[PATCH_DIM_LO * PATCH_DIM_LO];
 #endif
 
 		/***************************************************************************************************************************************
-		 * WRITE OUT HI RES BASE PATCHES
+		 * WRITE OUT HI RES BASE AND BORDER PATCHES
 		 ***************************************************************************************************************************************/
-		for (cur_id = 0; cur_id < (PATCH_DIM_HI*PATCH_DIM_HI); ++cur_id)
-		if (sHiResLU[cur_id].count(lu_ranked->first))
-		{
-			TriFanBuilder	fan_builder(&inHiresMesh);
-			for (tri = 0; tri < sHiResTris[cur_id].size(); ++tri)
-			{
-				f = sHiResTris[cur_id][tri];
-				if (f->info().terrain == lu_ranked->first ||
-					(IsCustomOverWaterHard(f->info().terrain) && lu_ranked->first == terrain_VisualWater) ||		// Take hard cus tris when doing vis water
-					(IsCustomOverWaterSoft(f->info().terrain) && lu_ranked->first == terrain_Water))				// Take soft cus tris when doing real water
-				{
-					CHECK_TRI(f->vertex(0),f->vertex(1),f->vertex(2));
-					fan_builder.AddTriToFanPool(f);
-
-					++debug_add_tri_fan;
-				}
-			}
-			fan_builder.CalcFans();
+		dsf_terrain_layer	layer;
+		vector<dsf_patch_job> jobs;
+		dsf_bucket_map::iterator bucket;
 
-			tex_proj_info * pinfo = (gTexProj.count(lu_ranked->first)) ? &gTexProj[lu_ranked->first] : NULL;
+		layer.lu = lu_ranked->first;
+		layer.is_water = is_water;
+		layer.pinfo = (gTexProj.count(lu_ranked->first)) ? &gTexProj[lu_ranked->first] : NULL;
+		layer.proj = 0;
 
-			int flags = 0;
-			if(is_overlay)  flags |= dsf_Flag_Overlay;
-			if(lu_ranked->first != terrain_VisualWater &&			// Every patch is physical EXCEPT: visual water, obviously just for looks!
-				!IsCustomOverWaterSoft(lu_ranked->first))			// custom over soft water - we get physics from who is underneath
-				flags |= dsf_Flag_Physical;
+		for (cur_id = 0; cur_id < (PATCH_DIM_HI*PATCH_DIM_HI); ++cur_id)
+		if ((bucket = sHiResBase[cur_id].find(lu_ranked->first)) != sHiResBase[cur_id].end())
+		{
+			jobs.push_back(dsf_patch_job());
+			jobs.back().bucket = &bucket->second;
+			jobs.back().border = false;
+			jobs.back().tris = jobs.back().fans = 0;
+			debug_add_tri_fan += bucket->second.tris.size();
+		}
 
-			cbs.BeginPatch_f(lu_ranked->second, TERRAIN_NEAR_LOD, TERRAIN_FAR_LOD, flags, is_water ? 7 : (pinfo ? 7 : 5), writer1);
-			list<CDT::Vertex_handle>				primv;
-			list<CDT::Vertex_handle>::iterator		vert;
-			int										primt;
-			while(1)
+#if !NO_BORDERS
+		if (lu_ranked->first >= terrain_Natural)
+		{
+			for (cur_id = 0; cur_id < (PATCH_DIM_HI*PATCH_DIM_HI); ++cur_id)
+			if ((bucket = sHiResBorder[cur_id].find(lu_ranked->first)) != sHiResBorder[cur_id].end())
 			{
-                primt = fan_builder.GetNextPrimitive(primv);
-                if(primv.empty()) break;
-                if(primt != dsf_Tri)
-                 {
-                    ++total_tri_fans;
-                    total_tris += (primv.size() - 2);
-                } else {
-                    total_tris += (primv.size() / 3);
-                    tris_this_patch += (primv.size() / 3);
-                }
-                cbs.BeginPrimitive_f(primt, writer1);
-                for(vert = primv.begin(); vert != primv.end(); ++vert)
-                {
-					// Ben says: the use of doblim warrants some explanation: CGAL provides EXACT arithmetic, but it does not give exact
-					// conversion back to float EVEN when that is possible!!  So the edge of our tile is guaranteed to be exactly on the DSF
-					// border but is not guaranteed to be within the DSF border once rounded.
-					// Because of this, we have to clamp our output to the double-precision bounds after conversion, since DSFLib is sensitive
-					// to out-of-boundary conditions!
-					DebugAssert((*vert)->point().x() >= inElevation.mWest  && (*vert)->point().x() <= inElevation.mEast );
-					DebugAssert((*vert)->point().y() >= inElevation.mSouth && (*vert)->point().y() <= inElevation.mNorth);
-					coords8[0] = doblim(CGAL::to_double((*vert)->point().x()),inElevation.mWest ,inElevation.mEast );
-					coords8[1] = doblim(CGAL::to_double((*vert)->point().y()),inElevation.mSouth,inElevation.mNorth);
-					DebugAssert(coords8[0] >= inElevation.mWest  && coords8[0] <= inElevation.mEast );
-					DebugAssert(coords8[1] >= inElevation.mSouth && coords8[1] <= inElevation.mNorth);
-					coords8[2] =USE_DEM_H( (*vert)->info().height, is_water,inHiresMesh,(*vert));
-					coords8[3] =USE_DEM_N( (*vert)->info().normal[0]);
-					coords8[4] =USE_DEM_N(-(*vert)->info().normal[1]);
-					if (is_water)
-					{
-						coords8[5] = GetWaterBlend((*vert), inElevation, inBathymetry);
-						coords8[6] = CategorizeVertex(inHiresMesh,*vert,terrain_Water) >= 0 ? 0.0 : 1.0;
-						DebugAssert(coords8[5] >= 0.0);
-						DebugAssert(coords8[5] <= 1.0);
-					}
-					else if (pinfo)	{
-						ProjectTex(coords8[0],coords8[1],coords8[5],coords8[6],pinfo);
-						DebugAssert(coords8[5] >= 0.0);
-						DebugAssert(coords8[5] <= 1.0);
-						DebugAssert(coords8[6] >= 0.0);
-						DebugAssert(coords8[6] <= 1.0);
-					}
-					DebugAssert(coords8[3] >= -1.0);
-					DebugAssert(coords8[3] <=  1.0);
-					DebugAssert(coords8[4] >= -1.0);
-					DebugAssert(coords8[4] <=  1.0);
-					cbs.AddPatchVertex_f(coords8, writer1);
-				}
-				cbs.EndPrimitive_f(writer1);
+				jobs.push_back(dsf_patch_job());
+				jobs.back().bucket = &bucket->second;
+				jobs.back().border = true;
+				jobs.back().tris = jobs.back().fans = 0;
+				layer.proj = gNaturalTerrainInfo[lu_ranked->first].proj_angle;
 			}
-			cbs.EndPatch_f(writer1);
-			++total_patches;
 		}
+#endif
 
-		/***************************************************************************************************************************************
-		 * WRITE OUT HI RES BORDER PATCHES
-		 ***************************************************************************************************************************************/
+		build_patches(inHiresMesh, sHiResVerts, layer, jobs);
 
-#if !NO_BORDERS
-		for (cur_id = 0; cur_id < (PATCH_DIM_HI*PATCH_DIM_HI); ++cur_id)		// For each triangle in this patch
-		if (lu_ranked->first >= terrain_Natural)
-		if (sHiResBO[cur_id].count(lu_ranked->first))							// Quick check: do we have ANY border tris in this layer in this patch?
+		int flags = 0;
+		if(is_overlay)  flags |= dsf_Flag_Overlay;
+		if(lu_ranked->first != terrain_VisualWater &&			// Every patch is physical EXCEPT: visual water, obviously just for looks!
+			!IsCustomOverWaterSoft(lu_ranked->first))			// custom over soft water - we get physics from who is underneath
+			flags |= dsf_Flag_Physical;
+		int depth = is_water ? 7 : (layer.pinfo ? 7 : 5);
+
+		for (vector<dsf_patch_job>::iterator j = jobs.begin(); j != jobs.end(); ++j)
 		{
-			cbs.BeginPatch_f(lu_ranked->second, TERRAIN_NEAR_BORDER_LOD, TERRAIN_FAR_BORDER_LOD, dsf_Flag_Overlay, /*is_composite ? 8 :*/ 7, writer1);
-			cbs.BeginPrimitive_f(dsf_Tri, writer1);
-			tris_this_patch = 0;
-			for (tri = 0; tri < sHiResTris[cur_id].size(); ++tri)				// For each tri
+			int patch_depth = j->border ? 7 : depth;
+			if (j->border)	cbs.BeginPatch_f(lu_ranked->second, TERRAIN_NEAR_BORDER_LOD, TERRAIN_FAR_BORDER_LOD, dsf_Flag_Overlay, /*is_composite ? 8 :*/ 7, writer1);
+			else			cbs.BeginPatch_f(lu_ranked->second, TERRAIN_NEAR_LOD, TERRAIN_FAR_LOD, flags, depth, writer1);
+
+			int c = 0;
+			for (int p = 0; p < j->prims.size(); p += 2)
 			{
-				f = sHiResTris[cur_id][tri];
-				if (f->info().terrain_border.count(lu_ranked->first))			// If it has this border...
+				cbs.BeginPrimitive_f(j->prims[p], writer1);
+				for (int n = 0; n < j->prims[p+1]; ++n, c += patch_depth)
 				{
-					float	bblend[3];
-					int vi;
-					for (vi = 0; vi < 3; ++vi)
-						bblend[vi] = f->vertex(vi)->info().border_blend[lu_ranked->first];
-
-					// Ben says: normally we would like to draw one DSF overdrawn tri for each border tri.  But there is an exception case:
-					// if ALL of our border blends are 100% but our border is NOT a variant (e.g. this is a meaningful border change) then
-					// we really need to make 3 border tris that all fade out...this allows the CENTER of our tri to show the base terrain
-					// while the borders show the neighboring tris.  (Without this, a single tri of cliff will be COMPLETELY covered by
-					// the non-cliff terrain surrouding on 3 sides.)  In this case we make THREE passes and force one vertex to 0% blend for
-					// each pass.
-					int ts = -1, te = 0;
-//					if (!AreVariants(lu_ranked->first, f->info().terrain))
-					if (bblend[0] == bblend[1] &&
-						bblend[1] == bblend[2] &&
-						bblend[0] == 1.0)
-					{
-						ts = 0; te = 3;
-					}
-
-					for (int border_pass = ts; border_pass < te; ++border_pass)
-					{
-
-						if (tris_this_patch >= MAX_TRIS_PER_PATCH)
-						{
-							cbs.EndPrimitive_f(writer1);
-							cbs.BeginPrimitive_f(dsf_Tri, writer1);
-							tris_this_patch = 0;
-						}
-
-						for (vi = 2; vi >= 0 ; --vi)
-						{
-							DebugAssert(f->vertex(vi)->point().x() >= inElevation.mWest  && f->vertex(vi)->point().x() <= inElevation.mEast );
-							DebugAssert(f->vertex(vi)->point().y() >= inElevation.mSouth && f->vertex(vi)->point().y() <= inElevation.mNorth);
-							coords8[0] = doblim(CGAL::to_double(f->vertex(vi)->point().x()),inElevation.mWest ,inElevation.mEast );
-							coords8[1] = doblim(CGAL::to_double(f->vertex(vi)->point().y()),inElevation.mSouth,inElevation.mNorth);
-							DebugAssert(coords8[0] >= inElevation.mWest  && coords8[0] <= inElevation.mEast );
-							DebugAssert(coords8[1] >= inElevation.mSouth && coords8[1] <= inElevation.mNorth);
-
-							coords8[2] =USE_DEM_H( f->vertex(vi)->info().height , is_water, inHiresMesh,f->vertex(vi));
-							coords8[3] =USE_DEM_N( f->vertex(vi)->info().normal[0]);
-							coords8[4] =USE_DEM_N(-f->vertex(vi)->info().normal[1]);
-//							coords8[5] = f->vertex(vi)->info().border_blend[lu_ranked->first];
-							coords8[5] = vi == border_pass ? 0.0 : bblend[vi];
-							coords8[6] = GetTightnessBlend(inHiresMesh, f, f->vertex(vi), lu_ranked->first);
-							DebugAssert(coords8[5] >= 0.0);
-							DebugAssert(coords8[5] <= 1.0);
-							DebugAssert(coords8[6] >= 0.0);
-							DebugAssert(coords8[6] <= 1.0);
-							DebugAssert(!is_water);
-	//						if (is_composite)
-	//							coords8[7] = is_water ? GetWaterBlend(f->vertex(vi), waterType) : f->vertex(vi)->info().vege_density;
-							DebugAssert(coords8[3] >= -1.0);
-							DebugAssert(coords8[3] <=  1.0);
-							DebugAssert(coords8[4] >= -1.0);
-							DebugAssert(coords8[4] <=  1.0);
-							cbs.AddPatchVertex_f(coords8, writer1);
-						}
-						++total_tris;
-						++border_tris;
-						++tris_this_patch;
-					}
+					for (int d = 0; d < patch_depth; ++d)
+						coords8[d] = j->coords[c + d];
+					cbs.AddPatchVertex_f(coords8, writer1);
 				}
+				cbs.EndPrimitive_f(writer1);
 			}
-			cbs.EndPrimitive_f(writer1);
 			cbs.EndPatch_f(writer1);
+
+			total_tris += j->tris;
+			total_tri_fans += j->fans;
+			if (j->border)
+				border_tris += j->tris;
 			++total_patches;
 		}
-#endif
 	}
 
 	if(writer1)
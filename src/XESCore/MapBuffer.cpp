@@ -25,6 +25,10 @@
 #include "XESConstants.h"
 
 #include <CGAL/Arr_batched_point_location.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
 #if DEV
 	#include "GISTool_Globals.h"
 #endif
@@ -38,6 +42,17 @@
 // Set to put colored points on vertices
 #define SHOW_VERTEX_CHOICE 0
 
+// Set to 1 to also buffer every fast-path ring the exact way and throw if the two disagree.
+#define VALIDATE_FAST_RING 0
+
+// Set to 1 to buffer the polygons of a set on all cores.  Off: each worker builds whole arrangements, and CGAL 4.5.2 keeps some
+// lazy-kernel state in statics, so this has to be run against the serial result on real tiles before it can be trusted.
+#define PARALLEL_BUFFER_SET 0
+
+// Two edges of a naive ring this far apart (in degrees, in doubles) cannot touch in exact arithmetic.  This is far above the rounding
+// error of a lat/lon in doubles and far below any distance we buffer by.
+#define FAST_RING_EPSILON 1.0e-9
+
 // This is a hack - by converting our buffer pts to double, we shorten their mantissas, which cuts down the computing 
 // we must do on the planar map build-up by, well, a lot!
 //#define PROCESS(x) (ben2cgal<Point_2>(cgal2ben((x))))
@@ -460,6 +475,180 @@ void	SimplifyPointSequence(Polygon_2& input_seq)
 	}	
 }
 
+/***************************************************************************************************************************************
+ * FAST RING RESOLUTION
+ ***************************************************************************************************************************************/
+/*
+	Most of the cost of buffering is inserting the naive ring into an arrangement - every crossing is an exact intersection and a new
+	vertex.  But for most polygons the only crossings are the little CW loops we make at left turns: the offset edges before and after
+	the turn cross near the corner, and the loop past the crossing (out to the end of the first edge, back to the original vertex, out to
+	the start of the next edge) is negative space outside the buffer.  If those are the ONLY crossings, the buffered area is exactly the
+	ring with each loop cut off at its crossing, and that ring is simple, so it can go into the arrangement without any intersection work.
+
+	So we look for crossings in doubles first: two edges that are more than FAST_RING_EPSILON apart in doubles cannot touch.  Anything
+	closer than that - a loop crossing, a near miss, an eroded edge - might be a degeneracy, and unless it is a loop crossing we give up
+	and let the exact arrangement sort it out.  The loop crossings themselves are found with exact predicates and constructions on the
+	same segments the arrangement would have intersected, so the fast ring is the exact answer, not an approximation of it.
+
+	Why is cutting a loop off correct?  The ring is the cut ring plus the loop X-A-V-B-X, so the depth of any point is its depth in the
+	cut ring minus one if it is inside the (CW) loop.  The loop's edges clear every other edge, so the loop is entirely inside or entirely
+	outside the cut ring - and if the cut ring turns left at X, the loop starts out in the sector opposite the ring's interior.
+*/
+
+// Squared distance between two segments in doubles, or 0 if they clearly cross.
+static double	approx_clearance_sqr(const Segment2& a, const Segment2& b)
+{
+	Vector2	va(a.p1,a.p2), vb(b.p1,b.p2);
+	double	a1 = vb.signed_area(Vector2(b.p1,a.p1)), a2 = vb.signed_area(Vector2(b.p1,a.p2));
+	double	b1 = va.signed_area(Vector2(a.p1,b.p1)), b2 = va.signed_area(Vector2(a.p1,b.p2));
+	if(((a1 < 0.0 && a2 > 0.0) || (a1 > 0.0 && a2 < 0.0)) &&
+	   ((b1 < 0.0 && b2 > 0.0) || (b1 > 0.0 && b2 < 0.0)))
+		return 0.0;
+	return min(min(a.squared_distance(b.p1), a.squared_distance(b.p2)),
+			   min(b.squared_distance(a.p1), b.squared_distance(a.p2)));
+}
+
+// Given the tagged naive ring, build the curves of the same ring with its left-turn loops cut off, tagged with the side they came from.
+// Returns false if the ring has any other possible crossing - then the ring must be resolved the exact way.
+static bool	BuildSimpleRing(const TaggedPolygon_t& ring, vector<X_monotone_curve_2>& out_curves)
+{
+	int n = ring.size();
+	if(n < 8)
+		return false;
+	double	eps2 = FAST_RING_EPSILON * FAST_RING_EPSILON;
+
+	vector<Segment2>	approx(n);
+	vector<Bbox2>		bounds(n);
+	for(int i = 0; i < n; ++i)
+	{
+		approx[i] = Segment2(cgal2ben(ring[i].source()), cgal2ben(ring[i].target()));
+		bounds[i] = Bbox2(approx[i]);
+		if(approx[i].squared_length() <= eps2)
+			return false;
+	}
+
+	// Adjacent edges may only touch at their shared vertex - an edge that folds back along the last one is a degeneracy.
+	for(int i = 0; i < n; ++i)
+	{
+		const Segment2& a(approx[i]);
+		const Segment2& b(approx[(i+1) % n]);
+		if(b.squared_distance(a.p1) <= eps2 || a.squared_distance(b.p2) <= eps2)
+			return false;
+	}
+
+	// Sweep the edges by their left ends to find every pair of non-adjacent edges that comes within the margin.  The only pair we can
+	// take is edges i and i+3 - the edges into and out of a left-turn loop.
+	vector<int>	order(n);
+	for(int i = 0; i < n; ++i)
+		order[i] = i;
+	sort(order.begin(), order.end(), [&](int a, int b) { return bounds[a].xmin() < bounds[b].xmin(); });
+
+	vector<char>	loop_at(n, 0);
+	for(int oi = 0; oi < n; ++oi)
+	{
+		int i = order[oi];
+		for(int oj = oi + 1; oj < n && bounds[order[oj]].xmin() <= bounds[i].xmax() + FAST_RING_EPSILON; ++oj)
+		{
+			int j = order[oj];
+			int d = (j - i + n) % n;
+			if(d == 1 || d == n - 1)
+				continue;
+			if(bounds[j].ymin() > bounds[i].ymax() + FAST_RING_EPSILON || bounds[i].ymin() > bounds[j].ymax() + FAST_RING_EPSILON)
+				continue;
+			if(approx_clearance_sqr(approx[i], approx[j]) > eps2)
+				continue;
+			if(d == 3)			loop_at[i] = 1;
+			else if(d == n - 3)	loop_at[j] = 1;
+			else				return false;
+		}
+	}
+
+	// Cut each loop at its crossing X.  Loops may share their crossing edges but not overlap.
+	vector<Point_2>	cut_start(n), cut_end(n);
+	vector<char>	has_start(n, 0), has_end(n, 0), dropped(n, 0);
+	for(int i = 0; i < n; ++i)
+	if(loop_at[i])
+	{
+		int a = (i + 1) % n, v = (i + 2) % n, b = (i + 3) % n;
+		if(loop_at[a] || loop_at[v])
+			return false;
+		Segment_2	s_in(ring[i].source(), ring[i].target());
+		Segment_2	s_out(ring[b].source(), ring[b].target());
+		Point_2		x;
+		CGAL::Object r = CGAL::intersection(s_in, s_out);
+		if(!CGAL::assign(x, r))
+			return false;
+		if(!CGAL::left_turn(s_in.source(), x, s_out.target()))
+			return false;
+		Polygon_2	loop;
+		loop.push_back(x);
+		loop.push_back(ring[a].source());
+		loop.push_back(ring[v].source());
+		loop.push_back(ring[b].source());
+		if(loop.orientation() != CGAL::CLOCKWISE)
+			return false;
+		cut_end[i] = x;		has_end[i] = 1;
+		cut_start[b] = x;	has_start[b] = 1;
+		dropped[a] = dropped[v] = 1;
+	}
+
+	out_curves.clear();
+	for(int i = 0; i < n; ++i)
+	if(!dropped[i])
+	{
+		Point_2	p1(has_start[i] ? cut_start[i] : ring[i].source());
+		Point_2	p2(has_end[i] ? cut_end[i] : ring[i].target());
+		if(has_start[i] || has_end[i])
+		{
+			// Two crossings on one edge must stay in order along it, with room between them.
+			Segment2	cut(cgal2ben(p1), cgal2ben(p2));
+			if(cut.squared_length() <= eps2 || Vector2(cut.p1,cut.p2).dot(Vector2(approx[i].p1,approx[i].p2)) <= 0.0)
+				return false;
+		}
+		out_curves.push_back(X_monotone_curve_2(Segment_2(p1, p2), i));
+	}
+	return true;
+}
+
+// Given the naive ring in an arrangement, find the depth of every face from the direction of the ring's curves on each edge.  Faces
+// with depth > 0 are "inside" - that is the buffered area.
+static void	FindRingDepth(Pmwx& arr, const TaggedPolygon_t& inset_crv)
+{
+	// We are going to mark the "transition" field of each edge with 1 for each
+	// edge in the same direction of the original polygon that is on this edge.
+	// This way we can count how many times we are crossing the boundary.  (In some
+	// cases we will get many edges overlapping!)
+	for(Pmwx::Edge_iterator he = arr.edges_begin(); he != arr.edges_end(); ++he)
+	{
+		he->data().mTransition=0;
+		he->twin()->data().mTransition=0;
+		for(EdgeKey_iterator k = he->curve().data().begin(); k != he->curve().data().end(); ++k)
+		{
+			Vector_2	curve_dir(inset_crv[*k].source(),inset_crv[*k].target());
+			Point_2		p(he->target()->point() + curve_dir);
+
+			// If the original curve and half-edge go in the same direction, that half-edge gets the "count".
+			// We cannot use the derived curve because each half-edge holds only one curve - instead we look up
+			// our "key" in the source curve, because each half-edge can have many curves.
+			// We COULD special-case the 1-key case, but Shark indicates that this isn't that expensive relative to
+			// curve insertion!
+			if(CGAL::angle(he->source()->point(),he->target()->point(),p) == CGAL::OBTUSE)		he->data().mTransition++;
+			else																				he->twin()->data().mTransition++;
+		}
+	}
+
+	// Visit all faces starting at unbounded and propagate depth.
+	set<Pmwx::Face_handle>	all_faces;
+	for(Pmwx::Face_iterator f = arr.faces_begin(); f != arr.faces_end(); ++f)
+		all_faces.insert(f);
+
+	visit_face(arr.unbounded_face(), all_faces, 0);
+	DebugAssert(all_faces.empty());
+
+	for(Pmwx::Face_iterator f = arr.faces_begin(); f != arr.faces_end(); ++f)
+		f->set_contained(f->data().mTerrainType > 0);
+}
+
 /***************************************************************************************************************************************
  * POLYGON BUFFERING
  ***************************************************************************************************************************************/
@@ -505,52 +694,38 @@ void	BufferPolygon(
 	TagPolygon(inset_seq,inset_crv);
 
 	// Step 2.
-	// Insert the non-simple naive ring into an arrangement.
+	// Insert the ring into an arrangement - with its loops cut off if that leaves it simple, otherwise the whole non-simple naive ring.
 	Pmwx	arr;
-	CGAL::insert(arr,inset_crv.begin(), inset_crv.end());
+	vector<X_monotone_curve_2>	simple_crv;
+	bool	is_fast = BuildSimpleRing(inset_crv, simple_crv);
+	if(is_fast)
+		CGAL::insert_non_intersecting_curves(arr, simple_crv.begin(), simple_crv.end());
+	else
+		CGAL::insert(arr,inset_crv.begin(), inset_crv.end());
 
 	#if DEV && DEBUG_BUFFER_POLY
 	try {
 	#endif
 
-	// We are going to mark the "transition" field of each edge with 1 for each
-	// edge in the same direction of the original polygon that is on this edge.
-	// This way we can count how many times we are crossing the boundary.  (In some
-	// cases we will get many edges overlapping!)
-	for(Pmwx::Edge_iterator he = arr.edges_begin(); he != arr.edges_end(); ++he)
-	{
-		he->data().mTransition=0;
-		he->twin()->data().mTransition=0;
-		for(EdgeKey_iterator k = he->curve().data().begin(); k != he->curve().data().end(); ++k)
-		{
-			Vector_2	curve_dir(inset_crv[*k].source(),inset_crv[*k].target());
-			Point_2		p(he->target()->point() + curve_dir);
-
-			// If the original curve and half-edge go in the same direction, that half-edge gets the "count".
-			// We cannot use the derived curve because each half-edge holds only one curve - instead we look up
-			// our "key" in the source curve, because each half-edge can have many curves.
-			// We COULD special-case the 1-key case, but Shark indicates that this isn't that expensive relative to
-			// curve insertion!
-			if(CGAL::angle(he->source()->point(),he->target()->point(),p) == CGAL::OBTUSE)		he->data().mTransition++;
-			else																				he->twin()->data().mTransition++;
-		}
-	}
-
 	// Step 3.
-	// Visit all faces starting at unbounded and propagate depth.
-	set<Pmwx::Face_handle>	all_faces;
-	for(Pmwx::Face_iterator f = arr.faces_begin(); f != arr.faces_end(); ++f)
-		all_faces.insert(f);
-
-	visit_face(arr.unbounded_face(), all_faces, 0);
-	DebugAssert(all_faces.empty());
-
-	// Faces with depth > 0 are "inside"...this is the buffered area.
-	for(Pmwx::Face_iterator f = arr.faces_begin(); f != arr.faces_end(); ++f)
-		f->set_contained(f->data().mTerrainType > 0);
+	// Propagate depth from the unbounded face; faces with depth > 0 are the buffered area.
+	FindRingDepth(arr, inset_crv);
 
 	out_new_polygon = arr;
 
+	#if VALIDATE_FAST_RING
+	if(is_fast)
+	{
+		Pmwx	exact;
+		CGAL::insert(exact,inset_crv.begin(), inset_crv.end());
+		FindRingDepth(exact, inset_crv);
+		Polygon_set_2	diff(exact);
+		diff.symmetric_difference(out_new_polygon);
+		if(!diff.is_empty())
+			throw "Fast buffer ring does not match the exact buffer.";
+	}
+	#endif
+
 	#if DEV && DEBUG_BUFFER_POLY
 	} catch(...) {
 		for(Pmwx::Edge_iterator e = arr.edges_begin(); e != arr.edges_end(); ++e)
@@ -648,6 +823,92 @@ void	ValidateBuffer(
 
 	}
 }
+
+#if PARALLEL_BUFFER_SET
+
+// A copy of a polygon that shares no numbers with the original, so it can be buffered on another thread.
+static Polygon_with_holes_2	isolate(const Polygon_with_holes_2& pwh)
+{
+	Polygon_2	outer;
+	for(Polygon_2::Vertex_const_iterator v = pwh.outer_boundary().vertices_begin(); v != pwh.outer_boundary().vertices_end(); ++v)
+		outer.push_back(isolate(*v));
+	Polygon_with_holes_2	ret(outer);
+	for(Polygon_with_holes_2::Hole_const_iterator h = pwh.holes_begin(); h != pwh.holes_end(); ++h)
+	{
+		Polygon_2	hole;
+		for(Polygon_2::Vertex_const_iterator v = h->vertices_begin(); v != h->vertices_end(); ++v)
+			hole.push_back(isolate(*v));
+		ret.add_hole(hole);
+	}
+	return ret;
+}
+
+// Each polygon of the set is buffered on its own, so we buffer them on all cores and join the results on the main thread.  The workers
+// get copies of the polygons that share no exact numbers with the caller's set; the buffered pieces they make are only touched by the
+// main thread once the workers are done.
+void	BufferPolygonSet(
+				const Polygon_set_2&		in_polygon,
+				double						in_inset,
+				Polygon_set_2&				out_new_polygon)
+{
+	list<Polygon_with_holes_2>	plist_in, plist_out;
+	in_polygon.polygons_with_holes(back_inserter(plist_in));
+
+	vector<Polygon_with_holes_2>			jobs;
+	jobs.reserve(plist_in.size());
+	for(list<Polygon_with_holes_2>::iterator i = plist_in.begin(); i != plist_in.end(); ++i)
+		jobs.push_back(isolate(*i));
+	plist_in.clear();
+
+	int count = jobs.size();
+	vector<list<Polygon_with_holes_2> >	results(count);
+	atomic<int>		next(0);
+	mutex			err_lock;
+	exception_ptr	err;
+	int				err_n = count;
+
+	auto worker = [&]() {
+		int n;
+		while((n = next++) < count)
+		{
+			try {
+				Polygon_set_2 buffered;
+				BufferPolygonWithHoles(jobs[n], NULL, in_inset, buffered);
+				buffered.polygons_with_holes(back_inserter(results[n]));
+			} catch(...) {
+				lock_guard<mutex> lock(err_lock);
+				if(n < err_n)
+				{
+					err_n = n;
+					err = current_exception();
+				}
+			}
+		}
+	};
+
+#if (DEV && DEBUG_BUFFER_POLY) || SHOW_RAW_RING || SHOW_VERTEX_CHOICE
+	int num_threads = 1;		// The debug drawing is not thread safe.
+#else
+	int num_threads = min(count, max(1, (int) thread::hardware_concurrency()));
+#endif
+	vector<thread> threads;
+	for(int t = 1; t < num_threads; ++t)
+		threads.push_back(thread(worker));
+	worker();
+	for(auto& t : threads)
+		t.join();
+	if(err)
+		rethrow_exception(err);
+
+	for(int n = 0; n < count; ++n)
+		plist_out.splice(plist_out.end(), results[n]);
+
+	out_new_polygon.clear();
+	out_new_polygon.join(plist_out.begin(),plist_out.end());
+}
+
+#else
+
 void	BufferPolygonSet(
 				const Polygon_set_2&		in_polygon,
 				double						in_inset,
@@ -665,3 +926,5 @@ void	BufferPolygonSet(
 	plist_in.clear();
 	out_new_polygon.join(plist_out.begin(),plist_out.end());
 }
+
+#endif /* PARALLEL_BUFFER_SET */
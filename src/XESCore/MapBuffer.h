@@ -63,6 +63,7 @@ void	BufferPolygonWithHoles(
 				double						in_inset,
 				Polygon_set_2&				out_new_polygon);
 
+// Buffers every polygon of the set (on all cores if PARALLEL_BUFFER_SET is on in MapBuffer.cpp) and joins the results.
 void	BufferPolygonSet(
 				const Polygon_set_2&		in_polygon,
 				double						in_inset,
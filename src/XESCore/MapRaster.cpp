@@ -88,39 +88,59 @@ void	MapFromDEM(
 	// for DEMs always return pixel centers, doing the offset for you.  So one "equation" works for both
 	// cases.
 	
-	/* Vertical dividers */		
+	// Pushing one curve per pixel side hands the sweep millions of unit curves for a 1200x1200 land use raster, so
+	// boundaries are merged into runs: a run of pixel sides along one grid line continues as long as the key (the value
+	// of the face to its left) stays the same and no boundary on the other axis touches the corner between them - a
+	// touching boundary would end in the run's interior, and the curves must not intersect there.
+	// Runs are only merged when splits is 1.  Splits cuts every pixel side into that many pieces, and callers (e.g. the
+	// forest stands) rely on those extra vertices, and the corner cutter needs every pixel side when rounding.
+	bool merge_runs = splits == 1 && !want_rounding;
+	
+	// Is there a vertical boundary on grid line X (the left side of column X) in row y, and what is left of it?
+	auto has_v = [&](int X, int y) -> bool {
+		if(y < y1 || y >= y2)	return false;
+		if(X == x1)				return in_dem.get(x1,y) != null_post;
+		if(X == x2)				return in_dem.get(x2-1,y) != null_post;
+		return (cut_lines_x && (X % cut_lines_x == 0)) || in_dem.get(X-1,y) != in_dem.get(X,y);
+	};
+	auto key_v = [&](int X, int y) -> float {
+		return X == x1 ? null_post : in_dem.get(X-1,y);
+	};
+	// Is there a horizontal boundary on grid line Y (the bottom of row Y) in column x, and what is below it?
+	auto has_h = [&](int x, int Y) -> bool {
+		if(x < x1 || x >= x2)	return false;
+		if(Y == y1)				return in_dem.get(x,y1) != null_post;
+		if(Y == y2)				return in_dem.get(x,y2-1) != null_post;
+		return (cut_lines_y && (Y % cut_lines_y == 0)) || in_dem.get(x,Y-1) != in_dem.get(x,Y);
+	};
+	auto key_h = [&](int x, int Y) -> float {
+		return Y == y1 ? null_post : in_dem.get(x,Y-1);
+	};
+	
+	/* Vertical dividers */
+	for(x = x1; x <= x2; ++x)
 	for(y = y1; y < y2; ++y)
+	if(has_v(x,y))
 	{
-		double y_bot = in_dem.y_to_lat_double(y-0.5);
-		double y_top = in_dem.y_to_lat_double(y+0.5);
-		
-		if(in_dem.get(x1,y) != null_post)
-			push_vertical(in_dem.x_to_lon_double(x1-0.5), y_bot, y_top, curves, null_post, translator, splits);
-
-		for(x = x1+1; x < x2; ++x)
-		if((cut_lines_x && (x % cut_lines_x == 0)) || in_dem.get(x-1,y) != in_dem.get(x,y))
-			push_vertical(in_dem.x_to_lon_double(x-0.5), y_bot, y_top, curves, in_dem.get(x-1,y), translator, splits);
-
-		if(in_dem.get(x2-1,y) != null_post)
-			push_vertical(in_dem.x_to_lon_double(x2-0.5), y_bot, y_top, curves, in_dem.get(x2-1,y), translator, splits);
-		
+		float key = key_v(x,y);
+		int y_start = y;
+		if(merge_runs)
+		while(has_v(x,y+1) && key_v(x,y+1) == key && !has_h(x-1,y+1) && !has_h(x,y+1))
+			++y;
+		push_vertical(in_dem.x_to_lon_double(x-0.5), in_dem.y_to_lat_double(y_start-0.5), in_dem.y_to_lat_double(y+0.5), curves, key, translator, splits);
 	}
 
 	/* Horizontal dividers */
+	for(y = y1; y <= y2; ++y)
 	for(x = x1; x < x2; ++x)
+	if(has_h(x,y))
 	{
-		double x_lft = in_dem.x_to_lon_double(x-0.5);
-		double x_rgt = in_dem.x_to_lon_double(x+0.5);
-		
-		if(in_dem.get(x,y1) != null_post)
-			push_horizontal(in_dem.y_to_lat_double(y1-0.5), x_rgt, x_lft, curves, null_post, translator, splits);
-
-		for(y = y1+1; y < y2; ++y)
-		if((cut_lines_y && (y % cut_lines_y == 0)) || in_dem.get(x,y-1) != in_dem.get(x,y))
-			push_horizontal(in_dem.y_to_lat_double(y-0.5), x_rgt, x_lft, curves, in_dem.get(x,y-1), translator, splits);
-
-		if(in_dem.get(x,y2-1) != null_post)
-			push_horizontal(in_dem.y_to_lat_double(y2-0.5), x_rgt, x_lft, curves, in_dem.get(x,y2-1), translator, splits);			
+		float key = key_h(x,y);
+		int x_start = x;
+		if(merge_runs)
+		while(has_h(x+1,y) && key_h(x+1,y) == key && !has_v(x+1,y-1) && !has_v(x+1,y))
+			++x;
+		push_horizontal(in_dem.y_to_lat_double(y-0.5), in_dem.x_to_lon_double(x+0.5), in_dem.x_to_lon_double(x_start-0.5), curves, key, translator, splits);
 	}
 	
 	CGAL::insert_non_intersecting_curves(out_map, curves.begin(), curves.end());
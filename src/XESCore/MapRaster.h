@@ -35,6 +35,7 @@ struct CoordTranslator2;
 // Note: x1/y1 is the address of the lower left SAMPLE to use, and x2/y2 is the first sample NOT to use - that is, this is [) style range,
 // no matter WHAT the DEM format - we are referring to samples, not lat/lon coords.
 // So passing 0,0,mWidth,mHeight converts the entire DEM.
+// Unless want_rounding is set, straight runs of pixel sides are inserted as one curve, so 'splits' cuts each run, not each pixel side.
 void	MapFromDEM(
 				const DEMGeo&		in_dem,
 				int					x1,
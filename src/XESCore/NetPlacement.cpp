@@ -386,6 +386,50 @@ inline bool within_box(const Point2& p1, const Point2& p2, double d)
 
 typedef multiset<Net_JunctionInfo_t *, sort_by_y>	y_sorted_set;
 
+/************************************************************************************************************************
+ * JUNCTION GRID
+ ************************************************************************************************************************
+ 
+ Finding the junctions within "dist" of each other used to be a sweep over the junctions sorted by latitude - but a 
+ band of latitude runs the whole width of the tile, so in a dense city every junction was tested against every other
+ junction in its row of streets.  Instead we bucket the junctions into grid cells twice "dist" on a side; any pair
+ within the box lies in the same or adjacent cells (with room to spare for rounding), so each junction only tests the
+ 9 cells around it.
+
+ The pairs come out exactly as the sweep made them: each pair is (earlier, later) in latitude order, and the pairs
+ for one junction are listed in that same order, so the merges (and thus the resulting network) do not change.
+
+*/
+struct junction_grid {
+
+	junction_grid(const vector<Net_JunctionInfo_t *>& juncs, double cell_size) : cell(cell_size)
+	{
+		for(int n = 0; n < juncs.size(); ++n)
+			cells[key(cell_x(juncs[n]->location.x()), cell_y(juncs[n]->location.y()))].push_back(n);
+	}
+
+	int	cell_x(double x) const { return (int) floor(x / cell); }
+	int	cell_y(double y) const { return (int) floor(y / cell); }
+	
+	static long long key(int x, int y) { return ((long long) x << 32) | (unsigned int) y; }
+
+	// Indices of all junctions in the 3x3 cells around p, in no particular order.
+	void	near(const Point2& p, vector<int>& out) const
+	{
+		int x = cell_x(p.x()), y = cell_y(p.y());
+		for(int dy = -1; dy <= 1; ++dy)
+		for(int dx = -1; dx <= 1; ++dx)
+		{
+			hash_map<long long, vector<int> >::const_iterator c = cells.find(key(x+dx,y+dy));
+			if(c != cells.end())
+				out.insert(out.end(), c->second.begin(), c->second.end());
+		}
+	}
+
+	double								cell;
+	hash_map<long long, vector<int> >	cells;
+};
+
 void	MergeNearJunctions(Net_JunctionInfoSet& juncs, Net_ChainInfoSet& chains, double dist)
 {
 //		ValidateNetworkTopology(juncs,chains);
@@ -396,24 +440,29 @@ void	MergeNearJunctions(Net_JunctionInfoSet& juncs, Net_ChainInfoSet& chains, do
 	{
 
 		bool did_work = false;
-		y_sorted_set	sorted_juncs;
 		
-		copy(juncs.begin(),juncs.end(),set_inserter(sorted_juncs));
-
+		// Same order as a y_sorted_set: by latitude, ties in set order.
+		vector<Net_JunctionInfo_t *>	sorted_juncs(juncs.begin(),juncs.end());
+		stable_sort(sorted_juncs.begin(),sorted_juncs.end(),sort_by_y());
+		
+		junction_grid	grid(sorted_juncs, dist > 0.0 ? 2.0 * dist : 1.0);
+		
 		vector<JuncPair> kill;
-		for(y_sorted_set::iterator i = sorted_juncs.begin(); i != sorted_juncs.end(); ++i)
+		vector<int>		nearby;
+		for(int i = 0; i < sorted_juncs.size(); ++i)
 		{
-			y_sorted_set::iterator j(i);
-			++j;
-			while(j != sorted_juncs.end() && (((*j)->location.y() - (*i)->location.y()) < (2.0*dist)))
+			nearby.clear();
+			grid.near(sorted_juncs[i]->location, nearby);
+			sort(nearby.begin(),nearby.end());
+			for(vector<int>::iterator j = upper_bound(nearby.begin(),nearby.end(),i); j != nearby.end(); ++j)
 			{
-//				printf("Measuring: 0x%08x, 0x%08x\n", (*i), (*j));
+//				printf("Measuring: 0x%08x, 0x%08x\n", sorted_juncs[i], sorted_juncs[*j]);
 			
-				if(within_box((*i)->location,(*j)->location,dist))
+				if((sorted_juncs[*j]->location.y() - sorted_juncs[i]->location.y()) < (2.0*dist))
+				if(within_box(sorted_juncs[i]->location,sorted_juncs[*j]->location,dist))
 				{
-					kill.push_back(JuncPair(*i,*j));
+					kill.push_back(JuncPair(sorted_juncs[i],sorted_juncs[*j]));
 				}
-				++j;
 			}
 		}
 		sort(kill.begin(),kill.end(), sort_by_sqr_dist());
@@ -44,6 +44,16 @@
 #include "BlockFill.h"
 #include "BlockAlgs.h"
 #include "MathUtils.h"
+#include <float.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+
+// Zone the faces on all cores.  Off by default: zoning reads the face and edge coordinates, which are lazy exact numbers,
+// and CGAL 4.5.2's lazy numbers are not safe to read from two threads at once (to_double can compute and cache the exact
+// value, and the handle reference counts are not atomic).
+#define PARALLEL_ZONING 0
 
 // NOTE: all that this does is propegate parks, forestparks, cemetaries and golf courses to the feature type if
 // it isn't assigned.
@@ -302,6 +312,8 @@ static bool ReadLandFillRule(const vector<string>& tokens, void * ref)
 	return true;
 }
 
+static void	IndexZoningRules(void);
+
 void LoadZoningRules(rf_region inRegion)
 {
 	gLandClassInfo.clear();
@@ -324,6 +336,7 @@ void LoadZoningRules(rf_region inRegion)
 	RegisterLineHandler("FACADE_SPELLING", ReadFacadeRule, NULL);
 
 	LoadConfigFile(inRegion == rf_eu ? "zoning_eu.txt" : "zoning_us.txt");
+	IndexZoningRules();
 
 	for(FacadeSpellingTable::iterator sp = gFacadeSpellings.begin(); sp != gFacadeSpellings.end(); ++sp)
 	{
@@ -380,6 +393,141 @@ inline void remove_these(set<int>& stuff, const set<int>& nuke_these)
 		stuff.erase(*i);
 }
 
+/************************************************************************************************
+ * ZONING RULE INDEX
+ ************************************************************************************************
+
+	THEORY OF OPERATION
+
+	PickZoningRule wants the FIRST rule in the table that matches a block, and a rule table has a few hundred rules.  But most rules
+	are ruled out by three cheap tests: the terrain they require, the water/train/road edge levels they require, and the block size
+	range they accept.  So when the rules are loaded we compile the table into lists of candidate rules, keyed by:
+
+	1. The block's terrain.  Every terrain that some rule names gets its own lists (its rules plus the wildcard rules); any other
+	   terrain can only match the wildcard rules, which are filed under NO_VALUE.
+	2. The block's water, train and road levels (each 0-2), 27 combinations.
+	3. Which elementary interval of the list's size breakpoints the block's area falls in.  The breakpoints are all of the
+	   size_min/size_max values of the rules in the list.  An area is either exactly on a breakpoint or strictly between two
+	   (or outside all of them), and every rule accepts either all of the areas in such an interval or none of them.
+
+	Each list is in table order and PickZoningRule still runs every test on each candidate, so it picks the same rule the linear
+	scan did.  Levels outside 0-2 fall back to the linear scan.
+*/
+
+#define ZONING_LEVELS 3			// has_water, has_train and has_road are each 0 (none), 1 (some) or 2 (all)
+
+struct zoning_size_index {
+	vector<float>			breaks;		// Sorted unique size breakpoints
+	vector<vector<int> >	cells;		// Candidates below breaks[0], at breaks[0], between breaks[0] and breaks[1], at breaks[1]...
+
+	const vector<int>&	lookup(float area) const
+	{
+		int i = lower_bound(breaks.begin(), breaks.end(), area) - breaks.begin();
+		return cells[(i < breaks.size() && breaks[i] == area) ? i * 2 + 1 : i * 2];
+	}
+};
+
+struct zoning_terrain_index {
+	zoning_size_index	levels[ZONING_LEVELS * ZONING_LEVELS * ZONING_LEVELS];		// Indexed by water, train, road level
+};
+
+static hash_map<int, zoning_terrain_index>	sZoningIndex;
+
+static void	index_rule_sizes(const vector<int>& rules, zoning_size_index& idx)
+{
+	set<float>	breaks;
+	for(vector<int>::const_iterator r = rules.begin(); r != rules.end(); ++r)
+	if(gZoningRules[*r].size_min != 0 || gZoningRules[*r].size_max != 0)
+	{
+		breaks.insert(gZoningRules[*r].size_min);
+		breaks.insert(gZoningRules[*r].size_max);
+	}
+	idx.breaks.assign(breaks.begin(), breaks.end());
+
+	int nb = idx.breaks.size();
+	idx.cells.resize(nb * 2 + 1);
+	for(int c = 0; c < idx.cells.size(); ++c)
+	{
+		// Any area in the cell will do to decide who accepts the cell - take one.
+		double area;
+		if(c % 2)				area = idx.breaks[c / 2];
+		else if(c == 0)			area = -DBL_MAX;
+		else if(c == nb * 2)	area = DBL_MAX;
+		else					area = ((double) idx.breaks[c / 2 - 1] + (double) idx.breaks[c / 2]) * 0.5;
+
+		for(vector<int>::const_iterator r = rules.begin(); r != rules.end(); ++r)
+		if(check_rule<double>(gZoningRules[*r].size_min, gZoningRules[*r].size_max, area))
+			idx.cells[c].push_back(*r);
+	}
+}
+
+static void	IndexZoningRules(void)
+{
+	sZoningIndex.clear();
+
+	set<int>	terrains;
+	terrains.insert(NO_VALUE);
+	for(ZoningRuleTable::const_iterator r = gZoningRules.begin(); r != gZoningRules.end(); ++r)
+		terrains.insert(r->terrain);
+
+	for(set<int>::iterator t = terrains.begin(); t != terrains.end(); ++t)
+	{
+		zoning_terrain_index& tidx(sZoningIndex[*t]);
+		for(int w = 0; w < ZONING_LEVELS; ++w)
+		for(int tr = 0; tr < ZONING_LEVELS; ++tr)
+		for(int rd = 0; rd < ZONING_LEVELS; ++rd)
+		{
+			vector<int>	rules;
+			for(int r = 0; r < gZoningRules.size(); ++r)
+			if(gZoningRules[r].terrain == NO_VALUE || gZoningRules[r].terrain == *t)
+			if(w >= gZoningRules[r].req_water && tr >= gZoningRules[r].req_train && rd >= gZoningRules[r].req_road)
+				rules.push_back(r);
+			index_rule_sizes(rules, tidx.levels[(w * ZONING_LEVELS + tr) * ZONING_LEVELS + rd]);
+		}
+	}
+}
+
+// The rules that could match a block, in table order, or NULL if the block can't be looked up and the whole table must be scanned.
+static const vector<int> *	FindZoningCandidates(int terrain, float area, int has_water, int has_train, int has_road)
+{
+	if(has_water < 0 || has_water >= ZONING_LEVELS ||
+	   has_train < 0 || has_train >= ZONING_LEVELS ||
+	   has_road  < 0 || has_road  >= ZONING_LEVELS)
+		return NULL;
+
+	hash_map<int, zoning_terrain_index>::const_iterator t = sZoningIndex.find(terrain);
+	if(t == sZoningIndex.end())
+		t = sZoningIndex.find(NO_VALUE);
+	if(t == sZoningIndex.end())
+		return NULL;
+
+	return &t->second.levels[(has_water * ZONING_LEVELS + has_train) * ZONING_LEVELS + has_road].lookup(area);
+}
+
+// How hard PickZoningRule had to work over a zoning pass.
+struct zoning_stats_t {
+	int			faces;
+	int			zoned;
+	long long	rules_tested;
+	int			rules_worst;
+
+	zoning_stats_t() : faces(0), zoned(0), rules_tested(0), rules_worst(0) { }
+
+	void	add(const zoning_stats_t& rhs)
+	{
+		faces += rhs.faces;
+		zoned += rhs.zoned;
+		rules_tested += rhs.rules_tested;
+		rules_worst = max(rules_worst, rhs.rules_worst);
+	}
+
+	void	dump(void) const
+	{
+		printf("Zoning: %d of %d blocks zoned, %.1f of %d rules tested per block (worst %d).\n",
+			zoned, faces, faces ? (double) rules_tested / (double) faces : 0.0, (int) gZoningRules.size(), rules_worst);
+	}
+};
+
 static int		PickZoningRule(
 						int			terrain,
 						float		area,
@@ -406,10 +554,16 @@ static int		PickZoningRule(
 						float		long_side,			// Length  in meters of the longest side.
 						float		major_length,		// Length along the "long" axis of the block
 						float		minor_length,		// Length along the "short" axis of the block.
-						set<int>&	features)
+						set<int>&	features,
+						zoning_stats_t *	stats)
 {
-	for(ZoningRuleTable::const_iterator r = gZoningRules.begin(); r != gZoningRules.end(); ++r)
+	const vector<int> * candidates = FindZoningCandidates(terrain, area, has_water, has_train, has_road);
+	int count = candidates ? candidates->size() : gZoningRules.size();
+	int zoning = NO_VALUE;
+	int n;
+	for(n = 0; n < count; ++n)
 	{
+		const ZoningRule_t * r = &gZoningRules[candidates ? (*candidates)[n] : n];
 		if(r->terrain == NO_VALUE || r->terrain == terrain)
 		if(0 == r->sides_max || (r->sides_min <= num_sides && num_sides <= r->sides_max))
 		if(check_rule(r->size_min, r->size_max, area))
@@ -434,10 +588,21 @@ static int		PickZoningRule(
 		if(r->crud_ok || is_subset(features, r->consume_features))
 		{
 			remove_these(features, r->consume_features);
-			return r->zoning;
+			zoning = r->zoning;
+			break;
 		}
 	}
-	return NO_VALUE;
+
+	if(stats)
+	{
+		++stats->faces;
+		if(zoning != NO_VALUE)
+			++stats->zoned;
+		int tested = min(n + 1, count);
+		stats->rules_tested += tested;
+		stats->rules_worst = max(stats->rules_worst, tested);
+	}
+	return zoning;
 }
 
 
@@ -587,49 +752,37 @@ void kill_antennas(Pmwx& io_map, Pmwx::Face_handle f, float max_len)
 	} while (++circ != stop);
 }
 
-static void ZoneOneFace(
-				Pmwx& 				ioMap,
-				const DEMGeo&		inElev,
+// Everything zoning works out for one face.  It is computed on a worker thread and held here until the face is committed
+// back to the map, in face order - nothing a worker does is visible to the other workers.
+struct zone_face_t {
+	Pmwx::Face_handle	face;
+
+	float				count;				// Land use raster sample
+	float				total_forest;
+	float				total_urban;
+	float				total_park;
+	map<int, int>		histo;
+
+	GISParamMap			params;				// The face's params as zoning leaves them
+	int					zone;				// NO_VALUE if no rule matched
+	bool				decided;			// Got as far as the zoning decision - the feature temps get reset
+	zoning_stats_t		stats;
+
+	zone_face_t() : count(0), total_forest(0), total_urban(0), total_park(0), zone(NO_VALUE), decided(false) { }
+
+	// Urban faces have their road antennas cut before zoning looks at their edges.
+	bool	wants_antennas_killed(void) const { return count && (total_urban / count) > 0.5 && face->number_of_holes() == 0; }
+	float	antenna_length(void) const { return ((total_urban / count) > 0.75) ? 35.0 : 20.0; }
+};
+
+static void SampleFaceLandUse(
 				const DEMGeo& 		inLanduse,
 				const DEMGeo&		inForest,
 				const DEMGeo&		inPark,
-				const DEMGeo& 		inSlope,
-				const AptVector&	inApts,
 				const DEMGeo&		urban_density_from_lu,
-				Pmwx::Face_handle	face)
+				zone_face_t&		z)
 {
-	//--------------------------------------------------------------------------------------------------------------------------------
-	// BASIC BLOCK INFO - AREA, RASTER FEATURES
-	//--------------------------------------------------------------------------------------------------------------------------------
-
-	double mfam = GetMapFaceAreaMeters(face);
-	double	max_height = 0.0;
-	set<int>	my_pt_features;
-
-	if (mfam < MAX_OBJ_SPREAD)
-	for (GISPointFeatureVector::iterator feat = face->data().mPointFeatures.begin(); feat != face->data().mPointFeatures.end(); ++feat)
-	{
-		my_pt_features.insert(feat->mFeatType);
-		if (feat->mFeatType == feat_Building)
-		{
-			if (feat->mParams.count(pf_Height))
-			{
-				max_height = max(max_height, feat->mParams[pf_Height]);
-			}
-		} else {
-			printf("Has other feature: %s\n", FetchTokenString(feat->mFeatType));
-		}
-	}
-
-	int has_water = 0;
-	int has_non_water = 0;
-	int has_train = 0;
-	int has_prim = 0;
-	int	has_non_train = 0;
-	int has_local = 0;
-	int has_non_local = 0;
-	Bbox2 face_extent;
-
+	Pmwx::Face_handle face = z.face;
 	PolyRasterizer<double>	r;
 	int x, y, x1, x2;
 	y = SetupRasterizerForDEM(face, inLanduse, r);
@@ -654,9 +807,10 @@ static void ZoneOneFace(
 
 				total_urban += d;
 
-				if(gLandClassInfo.count(e))
+				LandClassInfoTable::const_iterator lc = gLandClassInfo.find(e);
+				if(lc != gLandClassInfo.end())
 				{
-					LandClassInfo_t& i(gLandClassInfo[e]);
+					const LandClassInfo_t& i(lc->second);
 					histo[i.category]++;
 					total_forest += i.veg_density;
 
@@ -691,9 +845,10 @@ static void ZoneOneFace(
 		count++;
 
 		total_urban += d;
-		if(gLandClassInfo.count(e))
+		LandClassInfoTable::const_iterator lc = gLandClassInfo.find(e);
+		if(lc != gLandClassInfo.end())
 		{
-			LandClassInfo_t& i(gLandClassInfo[e]);
+			const LandClassInfo_t& i(lc->second);
 			histo[i.category]++;
 			total_forest += i.veg_density;
 			if(p != NO_VALUE)
@@ -708,32 +863,83 @@ static void ZoneOneFace(
 
 	}
 
-	if(count)
-	if((total_urban / count) > 0.5)
-	if(face->number_of_holes() == 0)
-		kill_antennas(ioMap,face,  ((total_urban / count) > 0.75) ? 35.0 : 20.0);
+	z.count = count;
+	z.total_forest = total_forest;
+	z.total_urban = total_urban;
+	z.total_park = total_park;
+	z.histo.swap(histo);
+}
+
+static void ZoneOneFace(
+				const DEMGeo&		inElev,
+				const DEMGeo& 		inLanduse,
+				const DEMGeo&		inForest,
+				const DEMGeo&		inPark,
+				const DEMGeo& 		inSlope,
+				const AptVector&	inApts,
+				zone_face_t&		z)
+{
+	Pmwx::Face_handle face = z.face;
+	GISParamMap& params(z.params);
+	params = face->data().mParams;
+
+	//--------------------------------------------------------------------------------------------------------------------------------
+	// BASIC BLOCK INFO - AREA, RASTER FEATURES
+	//--------------------------------------------------------------------------------------------------------------------------------
+
+	double mfam = GetMapFaceAreaMeters(face);
+	double	max_height = 0.0;
+	set<int>	my_pt_features;
+
+	if (mfam < MAX_OBJ_SPREAD)
+	for (GISPointFeatureVector::iterator feat = face->data().mPointFeatures.begin(); feat != face->data().mPointFeatures.end(); ++feat)
+	{
+		my_pt_features.insert(feat->mFeatType);
+		if (feat->mFeatType == feat_Building)
+		{
+			if (feat->mParams.count(pf_Height))
+			{
+				max_height = max(max_height, feat->mParams[pf_Height]);
+			}
+		} else {
+			printf("Has other feature: %s\n", FetchTokenString(feat->mFeatType));
+		}
+	}
+
+	int has_water = 0;
+	int has_non_water = 0;
+	int has_train = 0;
+	int has_prim = 0;
+	int	has_non_train = 0;
+	int has_local = 0;
+	int has_non_local = 0;
+	Bbox2 face_extent;
+
+	int x, y, x1, x2;
+	float count = z.count, total_forest = z.total_forest, total_urban = z.total_urban, total_park = z.total_park;
+	const map<int, int>& histo(z.histo);
 
 	multimap<int, int, greater<int> > histo2;
-	for(map<int,int>::iterator i = histo.begin(); i != histo.end(); ++i)
+	for(map<int,int>::const_iterator i = histo.begin(); i != histo.end(); ++i)
 		histo2.insert(multimap<int,int, greater<int> >::value_type(i->second,i->first));
 
 	multimap<int, int, greater<int> >::iterator i = histo2.begin();
 	if(histo2.size() > 0)
 	{
-		face->data().mParams[af_Cat1] = i->second;
-		face->data().mParams[af_Cat1Rat] = (float) i->first / (float) count;
+		params[af_Cat1] = i->second;
+		params[af_Cat1Rat] = (float) i->first / (float) count;
 		++i;
 
 		if(histo2.size() > 1)
 		{
-			face->data().mParams[af_Cat2] = i->second;
-			face->data().mParams[af_Cat2Rat] = (float) i->first / (float) count;
+			params[af_Cat2] = i->second;
+			params[af_Cat2Rat] = (float) i->first / (float) count;
 			++i;
 
 			if(histo2.size() > 2)
 			{
-				face->data().mParams[af_Cat3] = i->second;
-				face->data().mParams[af_Cat3Rat] = (float) i->first / (float) count;
+				params[af_Cat3] = i->second;
+				params[af_Cat3Rat] = (float) i->first / (float) count;
 				++i;
 			}
 		}
@@ -994,7 +1200,7 @@ static void ZoneOneFace(
 		}
 	}
 
-	face->data().mParams[af_AGSides] = num_sides;
+	params[af_AGSides] = num_sides;
 
 	//--------------------------------------------------------------------------------------------------------------------------------
 	// LET US MAKE A FREAKING DECISION!!!
@@ -1009,10 +1215,10 @@ static void ZoneOneFace(
 					max_height,
 					min_angle,
 					max_angle,
-					face->data().mParams[af_Cat1],
-					face->data().mParams[af_Cat1Rat],
-					face->data().mParams[af_Cat2],
-					face->data().mParams[af_Cat1Rat] + face->data().mParams[af_Cat2Rat],	// Really?  Yes.  This is the "high water mark" of BOTH cat 1 + cat 2.  That way
+					params[af_Cat1],
+					params[af_Cat1Rat],
+					params[af_Cat2],
+					params[af_Cat1Rat] + params[af_Cat2Rat],	// Really?  Yes.  This is the "high water mark" of BOTH cat 1 + cat 2.  That way
 					has_water,																// We can say "80% industrial, 90% urban, and we cover 80I+10U and 90I+0U.  In other
 					has_train,																// words when we can accept a mix, this lets the DOMINANT type crowd out the secondary.
 					has_local,
@@ -1027,56 +1233,99 @@ static void ZoneOneFace(
 					long_axis_length,
 					short_axis_length,
 
-					my_pt_features);
+					my_pt_features,
+					&z.stats);
 
+	// The terrain the zoning wants is applied when the face is committed.
+	z.zone = zone;
+	z.decided = true;
 	if(zone != NO_VALUE)
-	{
-		face->data().SetZoning(zone);
-		int wanted_terrain = gZoningInfo[zone].terrain_type;
-		if(wanted_terrain != NO_VALUE)
-			face->data().mTerrainType = wanted_terrain;
-	}
-	face->data().mParams[af_HeightObjs] = max_height;
-
-	face->data().mParams[af_UrbanAverage] = total_urban / (float) count;
-	face->data().mParams[af_ForestAverage] = total_forest / (float) count;
-	face->data().mParams[af_ParkAverage] = total_park / (float) count;
-	face->data().mParams[af_SlopeMax] = max_slope;
-	face->data().mParams[af_AreaMeters] = mfam;
+		params[af_Zoning] = zone;
+	params[af_HeightObjs] = max_height;
 
+	params[af_UrbanAverage] = total_urban / (float) count;
+	params[af_ForestAverage] = total_forest / (float) count;
+	params[af_ParkAverage] = total_park / (float) count;
+	params[af_SlopeMax] = max_slope;
+	params[af_AreaMeters] = mfam;
 
-	face->data().mParams[af_ShortestSide]		= short_side;
-	face->data().mParams[af_LongestSide]		= long_side;
-	face->data().mParams[af_ShortAxisLength]	= short_axis_length;
-	face->data().mParams[af_LongAxisLength]		= long_axis_length;
-	face->data().mParams[af_BlockErr]			= max_err;
 
-	face->data().mParams[af_MinAngle]			= min_angle;
-	face->data().mParams[af_MaxAngle]			= max_angle;
+	params[af_ShortestSide]		= short_side;
+	params[af_LongestSide]		= long_side;
+	params[af_ShortAxisLength]	= short_axis_length;
+	params[af_LongAxisLength]		= long_axis_length;
+	params[af_BlockErr]			= max_err;
 
-	face->data().mParams[af_WaterEdge]	=	has_water;
-	face->data().mParams[af_RoadEdge]	=	has_local;
-	face->data().mParams[af_RailEdge]	=	has_train;
-	face->data().mParams[af_PrimaryEdge]=	has_prim;
+	params[af_MinAngle]			= min_angle;
+	params[af_MaxAngle]			= max_angle;
 
-	face->data().mParams[af_LocalPercent] = len_local / len_total;
-	face->data().mParams[af_RailPercent] = len_train / len_total;
+	params[af_WaterEdge]	=	has_water;
+	params[af_RoadEdge]	=	has_local;
+	params[af_RailEdge]	=	has_train;
+	params[af_PrimaryEdge]=	has_prim;
 
-	// FEATURE ASSIGNMENT - first go and assign any features we might have.
-	face->data().mTemp1 = NO_VALUE;
-	face->data().mTemp2 = 0;
+	params[af_LocalPercent] = len_local / len_total;
+	params[af_RailPercent] = len_train / len_total;
 
 
 	if(((len_local / len_total) < 0.1 && mfam < 10000.0) ||
 		(short_axis_length > 0.0 && short_axis_length < 20.0) ||
 		mfam < 900.0)
 	{
-		face->data().mParams[af_Median] = 2;
+		params[af_Median] = 2;
 	}
 
 }
 
 
+// Runs func(n) for every n in [0, count) - on all cores if PARALLEL_ZONING is on, otherwise on the calling thread -
+// reporting progress from the calling thread.  If calls throw, the exception from the lowest n is rethrown once every
+// thread is done.
+template <typename F>
+static void	for_each_face_parallel(int count, ProgressFunc inProg, int stage, int stage_count, const char * msg, const F& func)
+{
+	atomic<int>		next(0);
+	mutex			err_lock;
+	exception_ptr	err;
+	int				err_n = count;
+	int				check = max(1, count / 100);
+
+	auto worker = [&](bool main_thread) {
+		int n;
+		while((n = next++) < count)
+		{
+			if(main_thread)
+			{
+				PROGRESS_CHECK(inProg, stage, stage_count, msg, n, count, check)
+			}
+			try {
+				func(n);
+			} catch(...) {
+				lock_guard<mutex> lock(err_lock);
+				if(n < err_n)
+				{
+					err_n = n;
+					err = current_exception();
+				}
+			}
+		}
+	};
+
+#if PARALLEL_ZONING
+	int num_threads = min(count, max(1, (int) thread::hardware_concurrency()));
+#else
+	int num_threads = 1;
+#endif
+	vector<thread> threads;
+	for(int t = 1; t < num_threads; ++t)
+		threads.push_back(thread(worker, false));
+	worker(true);
+	for(auto& t : threads)
+		t.join();
+	if(err)
+		rethrow_exception(err);
+}
+
 void	ZoneManMadeAreas(
 				Pmwx& 				ioMap,
 				const DEMGeo&		inElev,
@@ -1116,24 +1365,52 @@ void	ZoneManMadeAreas(
 	/*****************************************************************************
 	 * PASS 1 - ZONING ASSIGNMENT VIA LAD USE DATA + FEATURES
 	 *****************************************************************************/
+	// Zoning a face only reads the map, so the faces are zoned into private results (on all cores if PARALLEL_ZONING is on);
+	// the results are then written back in face order.  Cutting road antennas does edit the map, so that happens between the land use sample and the rest
+	// of the zoning, one face at a time.  It only removes edges that have the face on both sides, so no other face's zoning
+	// can see it.
+	vector<zone_face_t>	zone_faces;
 	for (face = ioMap.faces_begin(); face != ioMap.faces_end(); ++face, ++ctr)
 	if (!face->is_unbounded())
 	if(!face->data().IsWater())
 	if(inDebug == Pmwx::Face_handle() || face == inDebug)
 	{
-		PROGRESS_CHECK(inProg, 0, 3, "Zoning terrain...", ctr, total, check)
-		ZoneOneFace(
-					ioMap,
-					inElev,
-					inLanduse,
-					inForest,
-					inPark,
-					inSlope,
-					inApts,
-					urban_density_from_lu,
-		
-			face);
+		zone_faces.push_back(zone_face_t());
+		zone_faces.back().face = face;
+	}
+
+	for_each_face_parallel(zone_faces.size(), NULL, 0, 3, "Zoning terrain...", [&](int n) {
+		SampleFaceLandUse(inLanduse, inForest, inPark, urban_density_from_lu, zone_faces[n]);
+	});
+
+	for(vector<zone_face_t>::iterator z = zone_faces.begin(); z != zone_faces.end(); ++z)
+	if(z->wants_antennas_killed())
+		kill_antennas(ioMap, z->face, z->antenna_length());
+
+	for_each_face_parallel(zone_faces.size(), inProg, 0, 3, "Zoning terrain...", [&](int n) {
+		ZoneOneFace(inElev, inLanduse, inForest, inPark, inSlope, inApts, zone_faces[n]);
+	});
+
+	zoning_stats_t	stats;
+	for(vector<zone_face_t>::iterator z = zone_faces.begin(); z != zone_faces.end(); ++z)
+	{
+		GIS_face_data& fd(z->face->data());
+		fd.mParams.swap(z->params);
+		if(z->zone != NO_VALUE)
+		{
+			int wanted_terrain = gZoningInfo[z->zone].terrain_type;
+			if(wanted_terrain != NO_VALUE)
+				fd.mTerrainType = wanted_terrain;
+		}
+		// FEATURE ASSIGNMENT - first go and assign any features we might have.
+		if(z->decided)
+		{
+			fd.mTemp1 = NO_VALUE;
+			fd.mTemp2 = 0;
+		}
+		stats.add(z->stats);
 	}
+	stats.dump();
 
 #define HEIGHT_SPREAD_FACTOR 0.5
 #define MIN_HEIGHT_TO_SPREAD 16.0
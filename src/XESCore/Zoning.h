@@ -246,7 +246,9 @@ void	LoadZoningRules(rf_region inRegion);
  * Given a map and various raster parameters, go through the map and
  * assign terrain types to all polygons as appropriate.  This includes
  * terrain type based on area features or terrain types based on
- * urban zoning.
+ * urban zoning.  The faces are zoned into private results (on all
+ * cores if PARALLEL_ZONING is on in Zoning.cpp) and written back to
+ * the map in face order.
  *
  */
 void	ZoneManMadeAreas(
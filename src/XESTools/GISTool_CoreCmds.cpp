@@ -39,6 +39,11 @@
 #include "MemFileUtils.h"
 #include "GISUtils.h"
 #include "XESInit.h"
+#include "BatchUtils.h"
+#if !IBM
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #if OPENGL_MAP
 #include "RF_Notify.h"
@@ -3045,8 +3050,117 @@ static int DoInitWithRegion(const vector<const char *>& args)
 	return 0;
 }
 
+#define DoBatch_HELP \
+"USAGE: batch <tile list> <pipeline> <log dir> [<max jobs>] [<GB per job>]\n"\
+"Runs a GISTool pipeline on many tiles, several at once.  The tile list has one tile\n"\
+"per line, like +42-072.  The pipeline is a file of GISTool commands, like stdin\n"\
+"input, where $TILE, $WEST, $SOUTH, $EAST and $NORTH are replaced by each tile's\n"\
+"name and bounds.  Do not use -region in the pipeline - the batch loads the config\n"\
+"for each region once, and every tile runs in a process forked from that.\n"\
+"Each tile logs to <log dir>/<tile>.log.  Finished tiles are listed in\n"\
+"<log dir>/batch_done.txt and skipped if the batch is run again.  Max jobs defaults\n"\
+"to the CPU count; with GB per job, a tile only starts if that much memory is free.\n"
+
+static int RunBatchTile(const string& tile, void * ref)
+{
+	const vector<string>& pipeline(*(const vector<string> *) ref);
+	BatchParseTile(tile, gMapWest, gMapSouth);
+	gMapEast = gMapWest + 1;
+	gMapNorth = gMapSouth + 1;
+
+	vector<string>			expanded;
+	vector<const char *>	args;
+	for(vector<string>::const_iterator t = pipeline.begin(); t != pipeline.end(); ++t)
+		expanded.push_back(BatchExpandTile(*t, tile));
+	for(vector<string>::iterator t = expanded.begin(); t != expanded.end(); ++t)
+		args.push_back(t->c_str());
+	return GISTool_ParseCommands(args);
+}
+
+static int DoBatch(const vector<const char *>& args)
+{
+	BatchSpec_t		spec;
+	vector<string>	pipeline;
+
+	if(!BatchReadTileList(args[0], spec.tiles))
+	{
+		fprintf(stderr,"Could not read tile list %s\n", args[0]);
+		return 1;
+	}
+	for(vector<string>::iterator t = spec.tiles.begin(); t != spec.tiles.end(); ++t)
+	{
+		int w, s;
+		if(!BatchParseTile(*t, w, s))
+		{
+			fprintf(stderr,"Bad tile name %s in %s\n", t->c_str(), args[0]);
+			return 1;
+		}
+	}
+
+	FILE * fi = fopen(args[1], "r");
+	if(!fi)
+	{
+		fprintf(stderr,"Could not read pipeline %s\n", args[1]);
+		return 1;
+	}
+	char buf[1024];
+	while(fgets(buf, sizeof(buf), fi))
+	{
+		char * c = strchr(buf, '#');
+		if(c) *c = 0;
+		for(char * tok = strtok(buf, "\r\n \t"); tok; tok = strtok(NULL, "\r\n \t"))
+			pipeline.push_back(tok);
+	}
+	fclose(fi);
+
+	spec.log_dir = args[2];
+	if(args.size() > 3)	spec.max_jobs = atoi(args[3]);
+	if(args.size() > 4)	spec.mem_per_job = atof(args[4]) * 1024.0 * 1024.0 * 1024.0;
+
+	// The config tables depend on the region and can only be loaded once per process - so each region gets a
+	// process of its own that loads them and then forks that region's tiles.
+	vector<string>	all(spec.tiles);
+	int				failed = 0;
+	BatchResetFailed(spec.log_dir);
+	for(int eu = 0; eu < 2; ++eu)
+	{
+		spec.tiles.clear();
+		for(vector<string>::iterator t = all.begin(); t != all.end(); ++t)
+		if(is_eu(t->c_str()) == (eu != 0))
+			spec.tiles.push_back(*t);
+		if(spec.tiles.empty())
+			continue;
+#if IBM
+		// No fork - all we can do is load one region's config and run its tiles right here.
+		if(spec.tiles.size() != all.size())
+		{
+			fprintf(stderr,"Batch: cannot mix US and EU tiles on this platform.\n");
+			return 1;
+		}
+		gRegion = eu ? rf_eu : rf_usa;
+		XESInit(gRegion, true);
+		failed += BatchRunTiles(spec, RunBatchTile, &pipeline);
+#else
+		fflush(stdout);
+		fflush(stderr);
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			gRegion = eu ? rf_eu : rf_usa;
+			XESInit(gRegion, true);
+			_exit(BatchRunTiles(spec, RunBatchTile, &pipeline) ? 1 : 0);
+		}
+		int status = 0;
+		if(pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			++failed;
+#endif
+	}
+	return failed ? 1 : 0;
+}
+
 static	GISTool_RegCmd_t		sCoreCmds[] = {
 { "-region",		1, 1, DoInitWithRegion,	"Init RF to a particular set of region presets.", "" },
+{ "-batch",			3, 5, DoBatch,			"Run a pipeline on many tiles in parallel.", DoBatch_HELP },
 { "-crop", 			0, 1, DoCrop, 			"Crop the map and DEMs to the current extent.", "" },
 { "-cropgrid",		0, 0, DoCropGrid, 		"Crop the map along 1x1 degree grid lines.", "" },
 { "-bbox", 			0, 0, DoBbox, 			"Show bounds of all maps.", "" },
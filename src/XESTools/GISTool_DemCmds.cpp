@@ -55,6 +55,7 @@
 " a GeoTiff only - allow DEM to be area data if file contains area data.\n"\
 " a bil/hgt only - force area-style DEM.  Otherwise area/point comes from the particular .hdr file.\n"\
 " l force DEM location to current bounding box.\n"\
+" w GeoTiff only - read just the part of the file inside the current extent.\n"\
 "Format can be one of: \n"\
 "tiff\n"\
 "hgt\n"\
@@ -102,7 +103,10 @@ static int DoRasterImport(const vector<const char *>& args)
 	}
 	else if(strcmp(args[1],"tiff") == 0)
 	{
-		if(!ExtractGeoTiff(*dem, args[2], mode, strstr(args[0],"l") != NULL))
+		bool ok = strstr(args[0],"w") ?
+			ExtractGeoTiffWindow(*dem, args[2], mode, gMapWest, gMapSouth, gMapEast, gMapNorth) :
+			ExtractGeoTiff(*dem, args[2], mode, strstr(args[0],"l") != NULL);
+		if(!ok)
 		{
 			if(strstr(args[0],"i")) return 0;
 			fprintf(stderr,"Unable to read GeoTiff file %s\n", args[2]);
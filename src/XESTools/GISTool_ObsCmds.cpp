@@ -132,6 +132,34 @@ static int DoAptImport(const vector<const char *>& args)
 	return 0;
 }
 
+// Pick a few airports out of a (big) apt.dat using its index, which is built on first use.
+static int DoAptImportICAO(const vector<const char *>& args)
+{
+	gApts.clear();
+	gAptIndex.clear();
+
+	AptFileIndex_t	index;
+	string err = GetAptFileIndex(args[0], index);
+	if (!err.empty()) { fprintf(stderr,"Error indexing %s: %s\n", args[0], err.c_str()); return 1; }
+
+	vector<int>	which;
+	for(int n = 1; n < args.size(); ++n)
+	{
+		int i = index.find(args[n]);
+		if(i < 0)
+			fprintf(stderr,"Airport %s is not in %s.\n", args[n], args[0]);
+		else
+			which.push_back(i);
+	}
+
+	err = ReadAptFileIndexed(args[0], index, which, gApts);
+	if (!err.empty()) { fprintf(stderr,"Error importing %s: %s\n", args[0], err.c_str()); return 1; }
+	if(gVerbose)
+		printf("Loaded %zd of %zd airports.\n", gApts.size(), index.airports.size());
+
+	IndexAirports(gApts,gAptIndex);
+	return 0;
+}
 
 static int DoAptExport(const vector<const char *>& args)
 {
@@ -455,6 +483,7 @@ static	GISTool_RegCmd_t		sObsCmds[] = {
 			"asr    Import an FAA ASR file from the digital aero chart suplement (DAC) - pull out the asr data from asr.dat.\n"
 			"arsr   Import an FAA ARSR file from the digital aero chart suplement (DAC) - pull out the arsr data from asr.dat.\n" },
 { "-apt", 			1, -1, DoAptImport, 			"Import airport data.", "-apt <file>\nClear loaded airports and load from this file." },
+{ "-aptonly", 		2, -1, DoAptImportICAO, 		"Import some airports.", "-aptonly <file> <icao> [<icao> ...]\nClear loaded airports and load only the named airports from this file.  An index is saved next to the file to make this fast the next time." },
 { "-aptwrite", 		1, 1, DoAptExport, 			"Export airport data.", "-aptwrite <file>\nExports all loaded airports to one apt.dat file." },
 { "-aptindex", 		1, 2, DoAptBulkExport, 		"Export airport data.", "-aptindex <export_dir> <grid>/\nExport all loaded airports to a directory as individual tiled apt.dat files." },
 { "-apttest", 		0, 0, DoAptTest, 			"Test airport procesing code.", "-apttest\nThis command processes each loaded airport against an empty DSF to confirm that the polygon cutting logic works.  While this isn't a perfect proxy for the real render, it can identify airport boundaries that have sliver problems (since this is done before the airport is cut into the DSF." },
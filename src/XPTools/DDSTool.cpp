@@ -27,6 +27,9 @@
 #include "FileUtils.h"
 #include "MathUtils.h"
 
+#include <thread>
+#include <atomic>
+
 #if PHONE
 	#define WANT_PVR 1
 	#define WANT_ATI IBM
@@ -406,6 +409,149 @@ unsigned char fade_2_black_filter(unsigned char src[], int count, int channel, i
 }
 
 
+struct dxt_options {
+	int		dxt_type;		// 1, 3 or 5 - or 0 to pick DXT1 or DXT5 from the image's alpha
+	int		has_mips;
+	float	gamma;
+	bool	scale_up;
+	bool	scale_down;
+	bool	scale_half;
+};
+
+// Parses --png2dxt[1|3|5] [<mip mode>] <gamma> <scale> starting at argv[n], returns the index after them.
+static int parse_dxt_options(char * argv[], int n, dxt_options& opts)
+{
+	opts.dxt_type = argv[n][9] ? argv[n][9]-'0' : 0;
+	++n;
+
+	opts.has_mips = 0;
+	     if(strcmp(argv[n], "--std_mips") == 0)		{ opts.has_mips = 0; ++n; }
+	else if(strcmp(argv[n], "--pre_mips") == 0)		{ opts.has_mips = 1; ++n; }
+	else if(strcmp(argv[n], "--night_mips") == 0)	{ opts.has_mips = 2; ++n; }
+	else if(strcmp(argv[n], "--fade_mips") == 0)	{ opts.has_mips = 3; ++n; }
+	else if(strcmp(argv[n], "--ctl_mips") == 0)		{ opts.has_mips = 4; ++n; }
+
+	opts.gamma = (strcmp(argv[n], "--gamma_22") == 0) ? 2.2f : 1.8f;
+	++n;
+
+	opts.scale_up = strcmp(argv[n], "--scale_up") == 0;
+	opts.scale_down = strcmp(argv[n], "--scale_down") == 0;
+	opts.scale_half = strcmp(argv[n], "--scale_half") == 0;
+	++n;
+
+	return n;
+}
+
+static int png_to_dxt(const char * inf, const char * outf, const dxt_options& opts, DDS_encode_pool * pool)
+{
+	ImageInfo	info;
+	if (CreateBitmapFromPNG(inf, &info, false, opts.gamma)!=0)
+	{
+		printf("Unable to open png file %s\n", inf);
+		return 1;
+	}
+
+	if (!HandleScale(info, opts.scale_up, opts.scale_down, opts.scale_half, false))
+	{
+		// Image does NOT meet our power of 2 needs.
+		if(!opts.scale_up && !opts.scale_down && !opts.scale_half)
+		{
+			printf("The imager is not a power of 2.  It is: %ld by %ld\n", info.width, info.height);
+			DestroyBitmap(&info);
+			return 1;
+		}
+	}
+
+	if(info.channels == 1)
+	{
+		printf("Unable to write DDS file from alpha-only PNG %s\n", outf);
+	}
+	int dxt_type = opts.dxt_type;
+	if(dxt_type == 0)
+	{
+		if(info.channels == 3)  dxt_type=1;
+		else					dxt_type=5;
+	}
+
+	ConvertBitmapToAlpha(&info,false);
+	switch(opts.has_mips) {
+//	case 0:			MakeMipmapStack(&info);							break;
+	case 0:			MakeMipmapStackWithFilter(&info,srgb_filter);	break;
+	case 1:			MakeMipmapStackFromImage(&info);				break;
+	case 2:			MakeMipmapStackWithFilter(&info,night_filter);	break;
+	case 3:			MakeMipmapStackWithFilter(&info,fade_filter);	break;
+	case 4:			MakeMipmapStackWithFilter(&info,fade_2_black_filter);	break;
+	}
+
+	int err = WriteBitmapToDDS(info, dxt_type, outf, opts.gamma == GAMMA_SRGB, pool);
+	DestroyBitmap(&info);
+	if (err != 0)
+	{
+		printf("Unable to write DDS file %s\n", outf);
+		return 1;
+	}
+	return 0;
+}
+
+/*	BATCH MODE
+
+	DDSTool --batch <dxt mode> <mip mode> <gamma> <scale> <src dir> [<dst dir>]
+
+	Converts every .png under src dir to a .dds of the same relative path under dst dir (or next to
+	the .png), skipping any whose .dds is already newer than the .png.  Only a few files are decoded
+	and mip-mapped at once, but all of their DXT compression runs on one shared pool, one thread per core.
+*/
+
+#define BATCH_FILES_IN_FLIGHT 4
+
+static int batch_png_to_dxt(string src_dir, string dst_dir, const dxt_options& opts)
+{
+	while(src_dir.size() > 1 && (src_dir.back() == '/' || src_dir.back() == '\\'))	src_dir.erase(src_dir.size()-1);
+	while(dst_dir.size() > 1 && (dst_dir.back() == '/' || dst_dir.back() == '\\'))	dst_dir.erase(dst_dir.size()-1);
+
+	vector<string> files, dirs;
+	if(FILE_get_directory_recursive(src_dir, files, dirs) < 0)
+	{
+		printf("Unable to read directory %s\n", src_dir.c_str());
+		return 1;
+	}
+
+	vector<pair<string, string> >	todo;
+	int up_to_date = 0;
+	for(vector<string>::iterator f = files.begin(); f != files.end(); ++f)
+	if(FILE_get_file_extension(*f) == "png")
+	{
+		string rel = f->substr(src_dir.size());
+		string dst = (dst_dir.empty() ? src_dir : dst_dir) + rel.substr(0, rel.size() - 3) + "dds";
+		date_cmpr_result_t age = FILE_date_cmpr(f->c_str(), dst.c_str());
+		if(age == dcr_secondIsNew || age == dcr_same)
+			++up_to_date;
+		else
+			todo.push_back(make_pair(*f, dst));
+	}
+
+	DDS_encode_pool * pool = DDS_encode_pool_create(0);
+	atomic<int>	next(0), failed(0);
+	vector<thread> workers;
+	for(int i = 0; i < min((int) todo.size(), BATCH_FILES_IN_FLIGHT); ++i)
+		workers.push_back(thread([&]() {
+			int n;
+			while((n = next++) < (int) todo.size())
+			{
+				printf("%s\n", todo[n].first.c_str());
+				FILE_make_dir_exist(FILE_get_dir_name(todo[n].second).c_str());
+				if(png_to_dxt(todo[n].first.c_str(), todo[n].second.c_str(), opts, pool) != 0)
+					++failed;
+			}
+		}));
+	for(vector<thread>::iterator t = workers.begin(); t != workers.end(); ++t)
+		t->join();
+	DDS_encode_pool_destroy(pool);
+
+	printf("%d converted, %d up to date, %d failed.\n", (int) todo.size() - (int) failed, up_to_date, (int) failed);
+	return failed ? 1 : 0;
+}
+
 int main(int argc, char * argv[])
 {
 	char	my_dir[2048];
@@ -478,6 +624,7 @@ int main(int argc, char * argv[])
 	if (argc < 4) {
 		printf("Usage: %s <convert mode> <options> <input_file> <output_file>|-\n",argv[0]);
 		printf("Usage: %s --quilt <input_file> <width> <height> <patch size> <overlap> <trials> <output_files>\n",argv[0]);
+		printf("Usage: %s --batch --png2dxt[1|3|5] <options> <input_dir> [<output_dir>]\n",argv[0]);
 		printf("       %s --version\n",argv[0]);
 		exit(1);
 	}
@@ -659,65 +806,29 @@ int main(int argc, char * argv[])
 		return 0;
 	}
 #endif
-	else if(strcmp(argv[1],"--png2dxt")==0 ||
-	   strcmp(argv[1],"--png2dxt1")==0 ||
-	   strcmp(argv[1],"--png2dxt3")==0 ||
-	   strcmp(argv[1],"--png2dxt5")==0)
+	else if(strcmp(argv[1],"--batch")==0)
 	{
-		int arg_base = 2;
-		int has_mips = 0;
-
-		if(strcmp(argv[arg_base], "--std_mips") == 0)
-		{
-			has_mips = 0;
-			++arg_base;
-		}
-		else if(strcmp(argv[arg_base], "--pre_mips") == 0)
-		{
-			has_mips = 1;
-			++arg_base;
-		}
-		else if(strcmp(argv[arg_base], "--night_mips") == 0)
-		{
-			has_mips = 2;
-			++arg_base;
-		}
-		else if(strcmp(argv[arg_base], "--fade_mips") == 0)
-		{
-			has_mips = 3;
-			++arg_base;
-		}
-		else if(strcmp(argv[arg_base], "--ctl_mips") == 0)
-		{
-			has_mips = 4;
-			++arg_base;
-		}
-
-		float gamma = (strcmp(argv[arg_base], "--gamma_22") == 0) ? 2.2f : 1.8f;
-		arg_base +=1;
-
-
-		bool scale_up = strcmp(argv[arg_base], "--scale_up") == 0;
-		bool scale_down = strcmp(argv[arg_base], "--scale_down") == 0;
-		bool scale_half = strcmp(argv[arg_base], "--scale_half") == 0;
-		arg_base +=1;
-
-		ImageInfo	info;
-		if (CreateBitmapFromPNG(argv[arg_base], &info, false, gamma)!=0)
+		if(argc < 6 || strncmp(argv[2], "--png2dxt", 9) != 0)
 		{
-			printf("Unable to open png file %s\n", argv[arg_base]);
+			printf("Usage: %s --batch --png2dxt[1|3|5] <options> <input_dir> [<output_dir>]\n",argv[0]);
 			return 1;
 		}
-
-		if (!HandleScale(info, scale_up, scale_down, scale_half, false))
+		dxt_options opts;
+		int n = parse_dxt_options(argv, 2, opts);
+		if(n >= argc)
 		{
-			// Image does NOT meet our power of 2 needs.
-			if(!scale_up && !scale_down && !scale_half)
-			{
-				printf("The imager is not a power of 2.  It is: %ld by %ld\n", info.width, info.height);
-				return 1;
-			}
+			printf("No input directory given.\n");
+			return 1;
 		}
+		return batch_png_to_dxt(argv[n], n+1 < argc ? argv[n+1] : "", opts);
+	}
+	else if(strcmp(argv[1],"--png2dxt")==0 ||
+	   strcmp(argv[1],"--png2dxt1")==0 ||
+	   strcmp(argv[1],"--png2dxt3")==0 ||
+	   strcmp(argv[1],"--png2dxt5")==0)
+	{
+		dxt_options opts;
+		int arg_base = parse_dxt_options(argv, 1, opts);
 
 		char buf[1024];
 		const char * outf = argv[arg_base+1];
@@ -729,33 +840,10 @@ int main(int argc, char * argv[])
 			outf=buf;
 		}
 
-		if(info.channels == 1)
-		{
-			printf("Unable to write DDS file from alpha-only PNG %s\n", argv[arg_base+1]);
-		}
-		int dxt_type = argv[1][9]-'0';
-		if(argv[1][9]==0)
-		{
-			if(info.channels == 3)  dxt_type=1;
-			else					dxt_type=5;
-		}
-
-		ConvertBitmapToAlpha(&info,false);
-		switch(has_mips) {
-//		case 0:			MakeMipmapStack(&info);							break;
-		case 0:			MakeMipmapStackWithFilter(&info,srgb_filter);	break;
-		case 1:			MakeMipmapStackFromImage(&info);				break;
-		case 2:			MakeMipmapStackWithFilter(&info,night_filter);	break;
-		case 3:			MakeMipmapStackWithFilter(&info,fade_filter);	break;
-		case 4:			MakeMipmapStackWithFilter(&info,fade_2_black_filter);	break;
-		}
-
-		if (WriteBitmapToDDS(info, dxt_type, outf, gamma == GAMMA_SRGB)!=0)
-		{
-			printf("Unable to write DDS file %s\n", argv[arg_base+1]);
-			return 1;
-		}
-		return 0;
+		DDS_encode_pool * pool = DDS_encode_pool_create(0);
+		int err = png_to_dxt(argv[arg_base], outf, opts, pool);
+		DDS_encode_pool_destroy(pool);
+		return err;
 	}
 	else if(strcmp(argv[1],"--png2rgb")==0)
 	{